@@ -0,0 +1,86 @@
+#include "arena.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define ARENA_ALIGN 16
+
+size_t arena_size(size_t size)
+{
+	return (size + ARENA_ALIGN - 1) & ~(size_t) (ARENA_ALIGN - 1);
+}
+
+bool arena_reserve(arena_T *arena, size_t size)
+{
+	if (arena->size >= size)
+		return true;
+	
+	free(arena->base);
+	
+	arena->base = malloc(size);
+	arena->size = (arena->base == NULL ? 0 : size);
+	arena->used = 0;
+	
+	return arena->base != NULL;
+}
+
+void *arena_alloc(arena_T *arena, size_t size)
+{
+	size = arena_size(size);
+	
+	if (size > arena->size - arena->used)
+		return NULL;
+	
+	void *memory = arena->base + arena->used;
+	arena->used += size;
+	
+	memset(memory, 0, size);
+	return memory;
+}
+
+void arena_reset(arena_T *arena)
+{
+	arena->used = 0;
+}
+
+void arena_free(arena_T *arena)
+{
+	free(arena->base);
+	memset(arena, 0, sizeof(arena_T));
+}
+
+#ifdef ALLOC_DEBUG
+volatile unsigned long heap_allocations = 0;
+
+void *__real_malloc(size_t);
+void *__real_calloc(size_t, size_t);
+void *__real_realloc(void *, size_t);
+
+void *__wrap_malloc(size_t size)
+{
+	__sync_fetch_and_add(&heap_allocations, 1);
+	return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+	__sync_fetch_and_add(&heap_allocations, 1);
+	return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *memory, size_t size)
+{
+	__sync_fetch_and_add(&heap_allocations, 1);
+	return __real_realloc(memory, size);
+}
+
+void assert_no_allocations(unsigned long since, const char *where)
+{
+	if (heap_allocations != since)
+	{
+		fprintf(stderr, "%lu heap allocation(s) in %s\n", heap_allocations - since, where);
+		abort();
+	}
+}
+#endif
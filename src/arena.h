@@ -0,0 +1,50 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+/*
+ * Bump allocator for objects that live exactly as long as something else,
+ * e.g. a game. Everything is released at once by resetting the arena, and
+ * the memory is kept around for the next user.
+*/
+typedef struct
+{
+	unsigned char *base;
+	size_t size;
+	size_t used;
+} arena_T;
+
+/*
+ * Makes sure the arena holds at least `size` bytes, growing it if needed.
+ * Growing drops anything already allocated. Returns false if out of memory.
+*/
+bool arena_reserve(arena_T *, size_t size);
+
+/* returns zeroed, suitably aligned memory, or NULL if the arena is full */
+void *arena_alloc(arena_T *, size_t size);
+
+/* what `arena_alloc()` actually takes out of the arena for `size` bytes */
+size_t arena_size(size_t size);
+
+void arena_reset(arena_T *);
+void arena_free(arena_T *);
+
+/*
+ * Building with ALLOC_DEBUG wraps malloc() and friends with a counter (see
+ * the makefile), so stretches of code that must never touch the heap can
+ * be checked.
+*/
+#ifdef ALLOC_DEBUG
+extern volatile unsigned long heap_allocations;
+
+void assert_no_allocations(unsigned long since, const char *where);
+
+#define ALLOC_WATCH_BEGIN()   unsigned long alloc_watch_start = heap_allocations
+#define ALLOC_WATCH_END(where) assert_no_allocations(alloc_watch_start, where)
+#else
+#define ALLOC_WATCH_BEGIN()    ((void) 0)
+#define ALLOC_WATCH_END(where) ((void) 0)
+#endif
+#endif
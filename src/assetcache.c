@@ -0,0 +1,391 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "assetcache.h"
+#include "globals.h"
+#include "sdlhelperfuncs.h"
+#include "trace.h"
+
+#include <SDL/SDL_image.h>
+#include <SDL/SDL_ttf.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define CACHE_MAGIC   "SNKA"
+#define CACHE_VERSION 1
+
+#define NUM_FONTS  3
+#define NUM_IMAGES 3
+
+static const int font_sizes[NUM_FONTS] = { 20, 40, 60 };
+
+static const char *const image_files[NUM_IMAGES] =
+{
+	"images/error.png",
+	"images/game_bg.png",
+	"images/menu_bg.png"
+};
+
+typedef struct
+{
+	char name[32];
+	uint32_t w;
+	uint32_t h;
+	uint32_t pitch;
+	uint32_t offset;
+} cached_image_T;
+
+/*
+ * The header, followed by the glyph coverage and image pixels it points
+ * at. A cache only ever belongs to the machine that baked it, so it's
+ * written in the machine's own layout.
+*/
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t hash;
+	uint64_t size;
+	
+	cached_font_T font[NUM_FONTS];
+	cached_image_T image[NUM_IMAGES];
+} cache_header_T;
+
+static struct
+{
+	uint8_t *data;
+	size_t size;
+	const cache_header_T *header;
+} cache;
+
+static bool assets_hash(uint64_t *);
+static bool bake_glyph(TTF_Font *, char c, cached_glyph_T *, FILE *, uint32_t *offset);
+static bool bake_image(const char *filename, cached_image_T *, FILE *, uint32_t *offset);
+
+bool asset_cache_open(void)
+{
+	TRACE_SCOPE("asset_cache_open");
+	
+	int fd = open(ASSET_CACHE_FILE, O_RDONLY);
+	if (fd == -1)
+		return false;
+	
+	struct stat st;
+	if (fstat(fd, &st) == -1 || (size_t) st.st_size < sizeof(cache_header_T))
+	{
+		close(fd);
+		return false;
+	}
+	
+	/* private and writable, so a surface made from it can't fault the cache */
+	void *data = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	
+	if (data == MAP_FAILED)
+		return false;
+	
+	const cache_header_T *header = data;
+	uint64_t hash;
+	
+	bool valid = memcmp(header->magic, CACHE_MAGIC, 4) == 0 &&
+	             header->version == CACHE_VERSION &&
+	             header->size == (uint64_t) st.st_size &&
+	             assets_hash(&hash) && header->hash == hash;
+	
+	/* everything the header points at has to be inside the file */
+	for (int i = 0; i < NUM_FONTS && valid; i++)
+		for (int c = 0; c < NUM_GLYPHS && valid; c++)
+		{
+			const cached_glyph_T *glyph = &header->font[i].glyph[c];
+			valid = (uint64_t) glyph->offset + (uint64_t) glyph->w * glyph->h <= header->size;
+		}
+	
+	for (int i = 0; i < NUM_IMAGES && valid; i++)
+	{
+		const cached_image_T *image = &header->image[i];
+		valid = (uint64_t) image->offset + (uint64_t) image->pitch * image->h <= header->size;
+	}
+	
+	if (valid == false)
+	{
+		munmap(data, st.st_size);
+		return false;
+	}
+	
+	cache.data = data;
+	cache.size = st.st_size;
+	cache.header = header;
+	
+	return true;
+}
+
+void asset_cache_close(void)
+{
+	if (cache.data != NULL)
+		munmap(cache.data, cache.size);
+	
+	memset(&cache, 0, sizeof(cache));
+}
+
+const cached_font_T *asset_cache_font(int size)
+{
+	if (cache.header == NULL)
+		return NULL;
+	
+	for (int i = 0; i < NUM_FONTS; i++)
+		if (cache.header->font[i].size == size)
+			return &cache.header->font[i];
+	
+	return NULL;
+}
+
+const uint8_t *asset_cache_coverage(const cached_glyph_T *glyph)
+{
+	return cache.data + glyph->offset;
+}
+
+SDL_Surface *asset_cache_image(const char *filename)
+{
+	if (cache.header == NULL)
+		return NULL;
+	
+	const SDL_PixelFormat *format = SDL_GetVideoSurface()->format;
+	
+	for (int i = 0; i < NUM_IMAGES; i++)
+	{
+		const cached_image_T *image = &cache.header->image[i];
+		
+		if (strcmp(image->name, filename) == 0)
+			return SDL_CreateRGBSurfaceFrom(cache.data + image->offset, image->w, image->h,
+				format->BitsPerPixel, image->pitch,
+				format->Rmask, format->Gmask, format->Bmask, format->Amask);
+	}
+	
+	return NULL;
+}
+
+bool asset_cache_bake(void)
+{
+	TRACE_SCOPE("asset_cache_bake");
+	
+	cache_header_T header;
+	memset(&header, 0, sizeof(cache_header_T));
+	
+	memcpy(header.magic, CACHE_MAGIC, 4);
+	header.version = CACHE_VERSION;
+	
+	if (assets_hash(&header.hash) == false)
+		return false;
+	
+	/* written next to the real cache and renamed over it once complete */
+	const char *temp_path = ASSET_CACHE_FILE ".new";
+	
+	FILE *file = fopen(temp_path, "wb");
+	if (file == NULL)
+		return false;
+	
+	uint32_t offset = sizeof(cache_header_T);
+	bool ok = fwrite(&header, sizeof(cache_header_T), 1, file) == 1;
+	
+	for (int i = 0; i < NUM_FONTS && ok; i++)
+	{
+		cached_font_T *font = &header.font[i];
+		
+		/* rasterised at the size it's shown, which is sharper than scaling it */
+		TTF_Font *ttf = TTF_OpenFont(FONT_FILE, font_sizes[i] * screen_scale);
+		if (ttf == NULL)
+		{
+			ok = false;
+			break;
+		}
+		
+		font->size = font_sizes[i] * screen_scale;
+		font->height = TTF_FontHeight(ttf);
+		
+		for (int c = 0; c < NUM_GLYPHS && ok; c++)
+			ok = bake_glyph(ttf, FIRST_GLYPH + c, &font->glyph[c], file, &offset);
+		
+		TTF_CloseFont(ttf);
+	}
+	
+	for (int i = 0; i < NUM_IMAGES && ok; i++)
+		ok = bake_image(image_files[i], &header.image[i], file, &offset);
+	
+	header.size = offset;
+	
+	ok = ok && fseek(file, 0, SEEK_SET) == 0 &&
+	     fwrite(&header, sizeof(cache_header_T), 1, file) == 1;
+	
+	ok = (fclose(file) == 0) && ok;
+	
+	if (ok == false || rename(temp_path, ASSET_CACHE_FILE) != 0)
+	{
+		printf("Couldn't write the asset cache %s\n", ASSET_CACHE_FILE);
+		remove(temp_path);
+		return false;
+	}
+	
+	return true;
+}
+
+/* stores a glyph's coverage as it comes out of rendering it on its own */
+static bool bake_glyph(TTF_Font *ttf, char c, cached_glyph_T *glyph, FILE *file, uint32_t *offset)
+{
+	int minx, maxx, miny, maxy, advance;
+	
+	if (TTF_GlyphMetrics(ttf, (Uint16) c, &minx, &maxx, &miny, &maxy, &advance) == -1)
+		return false;
+	
+	glyph->xoffset = (minx < 0 ? minx : 0);
+	glyph->advance = advance;
+	glyph->offset = *offset;
+	
+	char text[2] = { c, '\0' };
+	SDL_Color white = { 255, 255, 255 };
+	
+	/* nothing to draw, e.g. a space */
+	SDL_Surface *surface = TTF_RenderText_Blended(ttf, text, white);
+	if (surface == NULL)
+		return true;
+	
+	glyph->w = surface->w;
+	glyph->h = surface->h;
+	
+	SDL_LockSurface(surface);
+	
+	const SDL_PixelFormat *format = surface->format;
+	uint8_t row[surface->w];
+	bool ok = true;
+	
+	for (int y = 0; y < surface->h && ok; y++)
+	{
+		const Uint32 *pixels = (const Uint32 *) ((const uint8_t *) surface->pixels + y * surface->pitch);
+		
+		for (int x = 0; x < surface->w; x++)
+			row[x] = (uint8_t) ((pixels[x] & format->Amask) >> format->Ashift);
+		
+		ok = fwrite(row, 1, surface->w, file) == (size_t) surface->w;
+	}
+	
+	SDL_UnlockSurface(surface);
+	SDL_FreeSurface(surface);
+	
+	*offset += glyph->w * glyph->h;
+	return ok;
+}
+
+/* stores an image converted to the display format and scaled, as `load_image()` would */
+static bool bake_image(const char *filename, cached_image_T *image, FILE *file, uint32_t *offset)
+{
+	SDL_Surface *loaded = IMG_Load(filename);
+	if (loaded == NULL)
+		return false;
+	
+	SDL_Surface *surface = SDL_DisplayFormat(loaded);
+	SDL_FreeSurface(loaded);
+	
+	if (surface != NULL && screen_scale > 1)
+	{
+		SDL_Surface *scaled = scale_surface(surface, screen_scale);
+		
+		SDL_FreeSurface(surface);
+		surface = scaled;
+	}
+	
+	if (surface == NULL)
+		return false;
+	
+	snprintf(image->name, sizeof(image->name), "%s", filename);
+	image->w = surface->w;
+	image->h = surface->h;
+	image->pitch = surface->pitch;
+	image->offset = *offset;
+	
+	SDL_LockSurface(surface);
+	bool ok = fwrite(surface->pixels, surface->pitch, surface->h, file) == (size_t) surface->h;
+	SDL_UnlockSurface(surface);
+	
+	*offset += image->pitch * image->h;
+	
+	SDL_FreeSurface(surface);
+	return ok;
+}
+
+static uint64_t fnv1a(uint64_t hash, const void *data, size_t len)
+{
+	const uint8_t *bytes = data;
+	
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ bytes[i]) * 1099511628211ULL;
+	
+	return hash;
+}
+
+static bool hash_file(uint64_t *hash, const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+	
+	uint8_t buffer[16384];
+	size_t len;
+	
+	while ((len = fread(buffer, 1, sizeof(buffer), file)) > 0)
+		*hash = fnv1a(*hash, buffer, len);
+	
+	fclose(file);
+	return true;
+}
+
+/* a hash of everything the cache is made from, and of the display format and scale */
+static bool assets_hash(uint64_t *hash)
+{
+	TRACE_SCOPE("assets_hash");
+	
+	*hash = 14695981039346656037ULL;
+	
+	const SDL_PixelFormat *format = SDL_GetVideoSurface()->format;
+	uint32_t display[5] = { format->BitsPerPixel, format->Rmask, format->Gmask, format->Bmask, format->Amask };
+	
+	*hash = fnv1a(*hash, display, sizeof(display));
+	*hash = fnv1a(*hash, &screen_scale, sizeof(screen_scale));
+	*hash = fnv1a(*hash, font_sizes, sizeof(font_sizes));
+	
+	if (hash_file(hash, FONT_FILE) == false)
+		return false;
+	
+	for (int i = 0; i < NUM_IMAGES; i++)
+		if (hash_file(hash, image_files[i]) == false)
+			return false;
+	
+	return true;
+}
+
+void startup_log(const char *stage)
+{
+	static struct timespec start;
+	static bool started = false;
+	static bool finished = false;
+	
+	if (finished)
+		return;
+	
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	
+	if (started == false)
+	{
+		start = now;
+		started = true;
+	}
+	
+	double elapsed = (now.tv_sec - start.tv_sec) * 1e3 + (now.tv_nsec - start.tv_nsec) / 1e6;
+	printf("startup: %-20s %8.2f ms\n", stage, elapsed);
+	
+	if (strcmp(stage, "first frame") == 0)
+		finished = true;
+}
@@ -0,0 +1,76 @@
+#ifndef ASSETCACHE_H
+#define ASSETCACHE_H
+
+#include <SDL/SDL.h>
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Everything startup would otherwise spend its time on, done ahead of time:
+ * the font rasterised at every size the game uses, and the background
+ * images decoded into the display's pixel format, both at the screen's
+ * scale. `asset_cache_bake()` writes it all to one file, which later
+ * launches map straight into memory.
+ *
+ * The cache is tagged with a hash of the font and images it was made from
+ * (and of the display format and scale), and is ignored once any of them
+ * changes.
+*/
+
+#define ASSET_CACHE_FILE "assets.cache"
+
+#define FONT_FILE "coolvetica.ttf"
+
+/* the printable ASCII characters */
+#define FIRST_GLYPH ' '
+#define NUM_GLYPHS  95
+
+typedef struct
+{
+	/*
+	 * The glyph's coverage, `w` by `h` bytes, as it's drawn when rendered
+	 * on its own. It goes `xoffset` pixels from the pen position, then the
+	 * pen moves on by `advance`.
+	*/
+	int32_t xoffset;
+	int32_t advance;
+	int32_t w;
+	int32_t h;
+	uint32_t offset; /* of the coverage in the cache */
+} cached_glyph_T;
+
+typedef struct
+{
+	int32_t size;
+	int32_t height;
+	cached_glyph_T glyph[NUM_GLYPHS];
+} cached_font_T;
+
+/*
+ * Maps the cache; returns false, leaving everything to be loaded the slow
+ * way, if there's no cache or it doesn't match the current assets. Needs
+ * the video mode set.
+*/
+bool asset_cache_open(void);
+void asset_cache_close(void);
+
+/* rasterises and decodes everything into a new cache file */
+bool asset_cache_bake(void);
+
+/* NULL if the cache is closed or doesn't have the font at that size */
+const cached_font_T *asset_cache_font(int size);
+const uint8_t *asset_cache_coverage(const cached_glyph_T *);
+
+/*
+ * A surface whose pixels live in the cache, or NULL if the image isn't
+ * cached. Freeing it doesn't touch the cache.
+*/
+SDL_Surface *asset_cache_image(const char *filename);
+
+/*
+ * Startup timing log: prints how long since the first call each stage was
+ * reached, up to and including the "first frame".
+*/
+void startup_log(const char *stage);
+#endif
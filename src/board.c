@@ -0,0 +1,1241 @@
+#include "board.h"
+#include "trace.h"
+#include "varint.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* random spawn attempts before falling back to a scan of the whole board */
+#define SPAWN_ATTEMPTS 64
+
+/* a rock joins up with at most all of its neighbours */
+#define UNIONS_PER_ROCK 8
+
+/* set in a union log entry if the union grew the rank of the new root */
+#define UNION_GREW 0x80000000u
+
+/* the board's timers, the last of them one per snake */
+#define TIMER_POWERUP_SPAWN  0
+#define TIMER_POWERUP_EXPIRY 1
+#define TIMER_REVERSAL(i)    (2 + (i))
+
+#define NUM_TIMERS(config) (2 + (uint32_t) (config)->num_snakes)
+
+static void place_head(board_T *, int snake, uint32_t cell, direction_T);
+static void kill_snake(board_T *, int snake, death_cause_T, uint32_t cell);
+static void remove_body(board_T *, int snake);
+static bool place_snake(board_T *, int snake, int x, int y);
+static void respawn_snake(board_T *, int snake);
+
+static void eat_powerup(board_T *, int snake);
+static void run_timers(board_T *);
+
+static bool spawn_cell(board_T *, uint32_t *cell, cell_kind_T);
+static bool keeps_free_cells_connected(const board_T *, uint32_t cell);
+static void place_rock(board_T *, uint32_t cell);
+static void add_rock(board_T *);
+static void add_food(board_T *, int food);
+static void add_power_up(board_T *);
+static void remove_rocks(board_T *, int keep);
+
+/* the kernels, see board_kernel.h */
+#define KERNEL(name) name##_43x32 /* the game's own board */
+#define KERNEL_COLS 43
+#define KERNEL_ROWS 32
+#include "board_kernel.h"
+
+#define KERNEL(name) name##_64x64
+#define KERNEL_COLS 64
+#define KERNEL_ROWS 64
+#include "board_kernel.h"
+
+#define KERNEL(name) name##_128x128
+#define KERNEL_COLS 128
+#define KERNEL_ROWS 128
+#include "board_kernel.h"
+
+#define KERNEL(name) name##_256x256
+#define KERNEL_COLS 256
+#define KERNEL_ROWS 256
+#include "board_kernel.h"
+
+#define KERNEL(name) name##_512x512
+#define KERNEL_COLS 512
+#define KERNEL_ROWS 512
+#include "board_kernel.h"
+
+#define KERNEL(name) name##_generic
+#define KERNEL_COLS ((uint32_t) board->config.cols)
+#define KERNEL_ROWS ((uint32_t) board->config.rows)
+#include "board_kernel.h"
+
+static const struct
+{
+	int cols;
+	int rows;
+	board_kernel_T kernel;
+	const char *name;
+} kernels[] =
+{
+	{ 43,  32,  move_snakes_43x32,   "43x32"   },
+	{ 64,  64,  move_snakes_64x64,   "64x64"   },
+	{ 128, 128, move_snakes_128x128, "128x128" },
+	{ 256, 256, move_snakes_256x256, "256x256" },
+	{ 512, 512, move_snakes_512x512, "512x512" }
+};
+
+#define NUM_KERNELS (sizeof(kernels) / sizeof(kernels[0]))
+
+void board_default_config(board_config_T *config, int cols, int rows)
+{
+	config->cols = cols;
+	config->rows = rows;
+	
+	config->num_snakes = 1;
+	config->num_humans = 1;
+	config->max_snake_length = 400;
+	
+	config->num_apples = 3;
+	config->max_rocks = 400;
+	
+	/* 120px on the original 15px grid */
+	config->spawn_clearance = 8;
+	
+	config->score_multiplier = 40;
+	
+	config->respawn_bots = false;
+}
+
+/*
+ * Snakes' runs are rings sized to the next power of two; a body never has
+ * more runs than moves, so the longest snake fits even if it turns at
+ * every one.
+*/
+static uint32_t run_capacity(const board_config_T *config)
+{
+	uint32_t capacity = 1;
+	while (capacity < (uint32_t) config->max_snake_length)
+		capacity <<= 1;
+	
+	return capacity;
+}
+
+/*
+ * Everything a board needs lives in one block: the snakes first (for
+ * alignment), then the arrays of cell indices, then the rock ranks.
+*/
+size_t board_memory_size(const board_config_T *config)
+{
+	size_t num_cells = (size_t) config->cols * config->rows;
+	
+	return (size_t) config->num_snakes * sizeof(snake_T) +
+	       sizeof(uint32_t) * (2 * num_cells +
+	                           (size_t) config->num_snakes * run_capacity(config) +
+	                           2 * (size_t) config->num_apples +
+	                           (2 + UNIONS_PER_ROCK) * (size_t) config->max_rocks +
+	                           (size_t) config->num_snakes) +
+	       wheel_memory_size(NUM_TIMERS(config)) +
+	       sizeof(uint8_t) * num_cells;
+}
+
+bool board_init(board_T *board, const board_config_T *config, uint32_t seed)
+{
+	return board_init_in(board, config, seed, NULL);
+}
+
+bool board_init_in(board_T *board, const board_config_T *config, uint32_t seed, arena_T *arena)
+{
+	memset(board, 0, sizeof(board_T));
+	board->config = *config;
+	
+	/* xorshift can't leave the zero state */
+	board->rng = (seed == 0 ? 0x9E3779B9 : seed);
+	
+	board->kernel = move_snakes_generic;
+	
+	for (size_t i = 0; i < NUM_KERNELS; i++)
+		if (kernels[i].cols == config->cols && kernels[i].rows == config->rows)
+			board->kernel = kernels[i].kernel;
+	
+	uint32_t capacity = run_capacity(config);
+	size_t num_cells = (size_t) config->cols * config->rows;
+	
+	size_t size = board_memory_size(config);
+	
+	if (arena == NULL)
+	{
+		board->memory = calloc(1, size);
+		board->owns_memory = true;
+	}
+	else
+		board->memory = arena_alloc(arena, size);
+	
+	if (board->memory == NULL)
+		return false;
+	
+	board->snake = board->memory;
+	
+	uint32_t *cells = (uint32_t *) (board->snake + config->num_snakes);
+	
+	board->grid      = cells; cells += num_cells;
+	board->run_pool  = cells; cells += (size_t) config->num_snakes * capacity;
+	board->apple     = cells; cells += config->num_apples;
+	board->rock      = cells; cells += config->max_rocks;
+	board->eaten     = (int *) cells; cells += config->num_apples;
+	board->dead      = (int *) cells; cells += config->num_snakes;
+	
+	board->rock_parent    = cells; cells += num_cells;
+	board->rock_log_start = cells; cells += config->max_rocks;
+	board->union_log      = cells; cells += (size_t) UNIONS_PER_ROCK * config->max_rocks;
+	
+	wheel_init(&board->timers, cells, NUM_TIMERS(config));
+	
+	board->rock_rank = (uint8_t *) cells + wheel_memory_size(NUM_TIMERS(config));
+	
+	for (int i = 0; i < config->num_snakes; i++)
+	{
+		snake_T *snake = &board->snake[i];
+		
+		snake->runs = board->run_pool + (size_t) i * capacity;
+		snake->mask = capacity - 1;
+		snake->human = (i < config->num_humans);
+	}
+	
+	/* the first snake always starts in the same place, the rest anywhere */
+	if (config->num_snakes > 0)
+		place_snake(board, 0, (config->cols > 13 ? 13 : config->cols - 1),
+		                      (config->rows > 13 ? 13 : config->rows - 1));
+	
+	for (int i = 1; i < config->num_snakes; i++)
+		respawn_snake(board, i);
+	
+	/* pick random apple starting positions */
+	int clearance = board->config.spawn_clearance;
+	board->config.spawn_clearance = 0;
+	
+	for (int i = 0; i < config->num_apples; i++)
+	{
+		board->apple[i] = NO_CELL;
+		add_food(board, i);
+	}
+	
+	board->config.spawn_clearance = clearance;
+	
+	/* set up the powerup */
+	board->powerup.active = false;
+	wheel_schedule(&board->timers, TIMER_POWERUP_SPAWN, board->tick + POWERUP_FREQUENCY);
+	
+	return true;
+}
+
+void board_free(board_T *board)
+{
+	if (board->owns_memory)
+		free(board->memory);
+	
+	memset(board, 0, sizeof(board_T));
+}
+
+void board_copy(board_T *dst, const board_T *src)
+{
+	board_T layout = *dst;
+	
+	memcpy(dst->memory, src->memory, board_memory_size(&src->config));
+	*dst = *src;
+	
+	/* keep pointing into our own block */
+	dst->memory      = layout.memory;
+	dst->owns_memory = layout.owns_memory;
+	dst->grid        = layout.grid;
+	dst->snake       = layout.snake;
+	dst->run_pool    = layout.run_pool;
+	dst->apple       = layout.apple;
+	dst->rock        = layout.rock;
+	dst->eaten       = layout.eaten;
+	dst->dead        = layout.dead;
+	
+	dst->rock_parent    = layout.rock_parent;
+	dst->rock_rank      = layout.rock_rank;
+	
+	dst->timers.slot  = layout.timers.slot;
+	dst->timers.timer = layout.timers.timer;
+	dst->rock_log_start = layout.rock_log_start;
+	dst->union_log      = layout.union_log;
+	
+	uint32_t capacity = run_capacity(&dst->config);
+	
+	for (int i = 0; i < dst->config.num_snakes; i++)
+		dst->snake[i].runs = dst->run_pool + (size_t) i * capacity;
+}
+
+/*
+ * Saved boards are a flat list of varints; the grid isn't stored as it can
+ * be rebuilt from the entities on it.
+*/
+size_t board_save_bound(const board_config_T *config)
+{
+	return VARINT_MAX_LEN * (16 + (size_t) config->max_rocks + config->num_apples +
+		(size_t) config->num_snakes * (16 + run_capacity(config)));
+}
+
+/* ticks until the timer is due, 0 if it isn't scheduled */
+static uint32_t timer_left(const board_T *board, uint32_t timer)
+{
+	if (wheel_scheduled(&board->timers, timer) == false)
+		return 0;
+	
+	return wheel_due(&board->timers, timer) - board->tick;
+}
+
+static uint64_t zigzag(int64_t value)
+{
+	return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t unzigzag(uint64_t value)
+{
+	return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+size_t board_save(const board_T *board, uint8_t *buf)
+{
+	uint8_t *p = buf;
+	
+	p += varint_put(p, board->tick);
+	p += varint_put(p, board->rng);
+	
+	p += varint_put(p, board->num_rocks);
+	for (int i = 0; i < board->num_rocks; i++)
+		p += varint_put(p, board->rock[i]);
+	
+	/* cells are stored plus one so that NO_CELL becomes 0 */
+	for (int i = 0; i < board->config.num_apples; i++)
+		p += varint_put(p, (uint32_t) (board->apple[i] + 1));
+	
+	const powerup_T *powerup = &board->powerup;
+	p += varint_put(p, (uint32_t) (powerup->cell + 1));
+	p += varint_put(p, powerup->active);
+	p += varint_put(p, powerup->type);
+	p += varint_put(p, timer_left(board, TIMER_POWERUP_SPAWN));
+	p += varint_put(p, timer_left(board, TIMER_POWERUP_EXPIRY));
+	
+	for (int i = 0; i < board->config.num_snakes; i++)
+	{
+		const snake_T *snake = &board->snake[i];
+		
+		p += varint_put(p, snake->alive);
+		p += varint_put(p, snake->length);
+		
+		/* the body as it's kept, its tail then its runs */
+		if (snake->length > 0)
+		{
+			p += varint_put(p, snake->tail);
+			p += varint_put(p, snake->num_runs);
+			
+			for (uint32_t j = 0; j < snake->num_runs; j++)
+				p += varint_put(p, snake_run(snake, j));
+		}
+		
+		p += varint_put(p, zigzag(snake->pending_snake_segments));
+		p += varint_put(p, snake->dir);
+		p += varint_put(p, snake->next_dir);
+		p += varint_put(p, snake->controls_reversed);
+		p += varint_put(p, timer_left(board, TIMER_REVERSAL(i)));
+		p += varint_put(p, zigzag(snake->score));
+		p += varint_put(p, snake->moved_tick);
+	}
+	
+	return p - buf;
+}
+
+typedef struct
+{
+	const uint8_t *p;
+	const uint8_t *end;
+	bool ok;
+} reader_T;
+
+static uint64_t read_varint(reader_T *r)
+{
+	uint64_t value = 0;
+	size_t len = (r->ok ? varint_get(r->p, r->end - r->p, &value) : 0);
+	
+	if (len == 0)
+	{
+		r->ok = false;
+		return 0;
+	}
+	
+	r->p += len;
+	return value;
+}
+
+/* reads a cell index, which must be on the board */
+static uint32_t read_cell(reader_T *r, const board_T *board)
+{
+	uint64_t cell = read_varint(r);
+	
+	if (cell >= (uint64_t) board->config.cols * board->config.rows)
+		r->ok = false;
+	
+	return (uint32_t) cell;
+}
+
+static uint32_t read_optional_cell(reader_T *r, const board_T *board)
+{
+	uint64_t cell = read_varint(r);
+	
+	if (cell > (uint64_t) board->config.cols * board->config.rows)
+		r->ok = false;
+	
+	return (uint32_t) cell - 1;
+}
+
+/* reads how long until the timer is due, and schedules it */
+static void read_timer(reader_T *r, board_T *board, uint32_t timer)
+{
+	uint64_t left = read_varint(r);
+	
+	if (left > UINT32_MAX)
+		r->ok = false;
+	
+	if (left > 0 && r->ok)
+		wheel_schedule(&board->timers, timer, board->tick + (uint32_t) left);
+}
+
+bool board_load(board_T *board, const uint8_t *buf, size_t size)
+{
+	reader_T r = { buf, buf + size, true };
+	const board_config_T *config = &board->config;
+	
+	memset(board->grid, 0, (size_t) config->cols * config->rows * sizeof(uint32_t));
+	
+	board->tick = read_varint(&r);
+	board->rng  = read_varint(&r);
+	
+	uint64_t num_rocks = read_varint(&r);
+	if (num_rocks > (uint64_t) config->max_rocks)
+		return false;
+	
+	/* placed again in the same order, to rebuild the groups of rocks */
+	board->num_rocks = 0;
+	board->union_log_len = 0;
+	
+	for (uint64_t i = 0; i < num_rocks && r.ok; i++)
+	{
+		uint32_t cell = read_cell(&r, board);
+		
+		if (r.ok && CELL_KIND(board->grid[cell]) == CELL_ROCK)
+			return false;
+		
+		if (r.ok)
+			place_rock(board, cell);
+	}
+	
+	for (int i = 0; i < config->num_apples && r.ok; i++)
+	{
+		board->apple[i] = read_optional_cell(&r, board);
+		if (board->apple[i] != NO_CELL)
+			board->grid[board->apple[i]] = MAKE_CELL(CELL_APPLE, i);
+	}
+	
+	powerup_T *powerup = &board->powerup;
+	powerup->cell   = read_optional_cell(&r, board);
+	powerup->active = read_varint(&r);
+	powerup->type   = read_varint(&r) % 3;
+	
+	wheel_init(&board->timers, board->timers.timer, NUM_TIMERS(config));
+	read_timer(&r, board, TIMER_POWERUP_SPAWN);
+	read_timer(&r, board, TIMER_POWERUP_EXPIRY);
+	
+	if (r.ok && powerup->active && powerup->cell != NO_CELL)
+		board->grid[powerup->cell] = MAKE_CELL(CELL_POWERUP, 0);
+	
+	board->humans_alive = 0;
+	
+	for (int i = 0; i < config->num_snakes && r.ok; i++)
+	{
+		snake_T *snake = &board->snake[i];
+		
+		snake->alive  = read_varint(&r);
+		snake->length = 0;
+		
+		uint64_t length = read_varint(&r);
+		if (length > (uint64_t) config->max_snake_length)
+			return false;
+		
+		if (length > 0)
+		{
+			uint32_t cell = read_cell(&r, board);
+			uint64_t num_runs = read_varint(&r);
+			
+			if (num_runs >= length)
+				return false;
+			
+			if (r.ok)
+				place_head(board, i, cell, DIR_RIGHT);
+			
+			/* retraced a move at a time, which also fills in the grid */
+			for (uint64_t j = 0; j < num_runs && r.ok; j++)
+			{
+				uint64_t run = read_varint(&r);
+				direction_T dir = RUN_DIR(run);
+				
+				if (RUN_LENGTH(run) == 0 || RUN_LENGTH(run) > length - snake->length)
+					return false;
+				
+				for (uint64_t k = 0; k < RUN_LENGTH(run); k++)
+				{
+					cell = board_step(board, cell, dir);
+					place_head(board, i, cell, dir);
+				}
+			}
+			
+			if (r.ok && snake->length != length)
+				return false;
+		}
+		
+		snake->pending_snake_segments = unzigzag(read_varint(&r));
+		snake->dir                    = read_varint(&r) & 3;
+		snake->next_dir               = read_varint(&r) & 3;
+		snake->controls_reversed      = read_varint(&r);
+		read_timer(&r, board, TIMER_REVERSAL(i));
+		snake->score                  = unzigzag(read_varint(&r));
+		snake->moved_tick             = read_varint(&r);
+		
+		snake->apple_tick   = 0;
+		snake->powerup_tick = 0;
+		snake->death_cause  = DEATH_NONE;
+		
+		if (snake->alive && snake->human)
+			board->humans_alive++;
+	}
+	
+	return r.ok;
+}
+
+const char *board_check(const board_T *board)
+{
+	const board_config_T *config = &board->config;
+	uint32_t num_cells = (uint32_t) config->cols * config->rows;
+	
+	/* everything on the grid is where it thinks it is */
+	size_t num_occupied = 0;
+	
+	for (uint32_t cell = 0; cell < num_cells; cell++)
+	{
+		uint32_t contents = board->grid[cell];
+		uint32_t i = CELL_INDEX(contents);
+		
+		if (contents == MAKE_CELL(CELL_EMPTY, 0))
+			continue;
+		
+		switch (CELL_KIND(contents))
+		{
+			case CELL_EMPTY:
+				return "empty cell with an index";
+			
+			case CELL_ROCK:
+				if (i >= (uint32_t) board->num_rocks || board->rock[i] != cell)
+					return "rock on the grid that isn't in the rock list";
+				break;
+			
+			case CELL_APPLE:
+				if (i >= (uint32_t) config->num_apples || board->apple[i] != cell)
+					return "apple on the grid that isn't in the apple list";
+				break;
+			
+			case CELL_POWERUP:
+				if (board->powerup.active == false || board->powerup.cell != cell)
+					return "powerup on the grid that isn't the active one";
+				break;
+			
+			case CELL_SNAKE:
+				if (i >= (uint32_t) config->num_snakes || board->snake[i].alive == false)
+					return "snake on the grid that isn't alive";
+				break;
+			
+			default:
+				return "unknown cell kind";
+		}
+		
+		num_occupied++;
+	}
+	
+	/* and everything is on the grid, each in a cell of its own */
+	size_t num_things = 0;
+	
+	if (board->num_rocks < 0 || board->num_rocks > config->max_rocks)
+		return "rock count out of range";
+	
+	for (int i = 0; i < board->num_rocks; i++)
+	{
+		if (board->rock[i] >= num_cells || board->grid[board->rock[i]] != MAKE_CELL(CELL_ROCK, i))
+			return "rock missing from the grid";
+		
+		num_things++;
+	}
+	
+	for (int i = 0; i < config->num_apples; i++)
+	{
+		if (board->apple[i] == NO_CELL)
+			continue;
+		
+		if (board->apple[i] >= num_cells || board->grid[board->apple[i]] != MAKE_CELL(CELL_APPLE, i))
+			return "apple missing from the grid";
+		
+		num_things++;
+	}
+	
+	const powerup_T *powerup = &board->powerup;
+	
+	if (powerup->active && powerup->cell != NO_CELL)
+	{
+		if (powerup->cell >= num_cells || board->grid[powerup->cell] != MAKE_CELL(CELL_POWERUP, 0))
+			return "powerup missing from the grid";
+		
+		num_things++;
+	}
+	
+	if (wheel_scheduled(&board->timers, TIMER_POWERUP_EXPIRY) != powerup->active ||
+	    wheel_scheduled(&board->timers, TIMER_POWERUP_SPAWN) == powerup->active)
+		return "powerup timers don't match the powerup";
+	
+	int humans_alive = 0;
+	
+	for (int i = 0; i < config->num_snakes; i++)
+	{
+		const snake_T *snake = &board->snake[i];
+		
+		if (snake->alive == false)
+		{
+			if (snake->length != 0)
+				return "dead snake left on the board";
+			
+			continue;
+		}
+		
+		if (snake->length == 0 || snake->length > (uint32_t) config->max_snake_length)
+			return "snake length out of range";
+		
+		if (snake->num_runs >= snake->length || snake->num_runs > snake->mask + 1)
+			return "snake run count out of range";
+		
+		if (snake->pending_snake_segments < 0)
+			return "negative pending snake segments";
+		
+		uint32_t cell = snake->tail;
+		uint32_t segments = 1;
+		
+		if (cell >= num_cells || board->grid[cell] != MAKE_CELL(CELL_SNAKE, i))
+			return "snake segment off the board or missing from the grid";
+		
+		for (uint32_t j = 0; j < snake->num_runs; j++)
+		{
+			uint32_t run = snake_run(snake, j);
+			
+			if (RUN_LENGTH(run) == 0 || (j > 0 && RUN_DIR(run) == RUN_DIR(snake_run(snake, j - 1))))
+				return "snake runs empty or not merged";
+			
+			if (RUN_LENGTH(run) > snake->length - segments)
+				return "snake runs longer than the snake";
+			
+			for (uint32_t k = 0; k < RUN_LENGTH(run); k++)
+			{
+				cell = board_step(board, cell, RUN_DIR(run));
+				segments++;
+				
+				if (board->grid[cell] != MAKE_CELL(CELL_SNAKE, i))
+					return "snake segment off the board or missing from the grid";
+			}
+		}
+		
+		if (segments != snake->length || cell != snake->head)
+			return "snake runs don't lead from its tail to its head";
+		
+		if (snake->controls_reversed != wheel_scheduled(&board->timers, TIMER_REVERSAL(i)))
+			return "reversed controls without a timer to end them";
+		
+		num_things += snake->length;
+		humans_alive += snake->human;
+	}
+	
+	if (num_occupied != num_things)
+		return "things overlap on the grid";
+	
+	if (humans_alive != board->humans_alive)
+		return "wrong count of humans alive";
+	
+	for (uint32_t i = 0; i < board->timers.num_timers; i++)
+		if (wheel_scheduled(&board->timers, i) && wheel_due(&board->timers, i) <= board->tick)
+			return "timer left over from the past";
+	
+	if (board->union_log_len > (uint32_t) board->num_rocks * UNIONS_PER_ROCK)
+		return "union log longer than the rocks could have made";
+	
+	return NULL;
+}
+
+void board_use_generic_kernel(board_T *board)
+{
+	board->kernel = move_snakes_generic;
+}
+
+const char *board_kernel_name(const board_T *board)
+{
+	for (size_t i = 0; i < NUM_KERNELS; i++)
+		if (board->kernel == kernels[i].kernel)
+			return kernels[i].name;
+	
+	return "generic";
+}
+
+uint32_t board_rand(board_T *board)
+{
+	uint32_t x = board->rng;
+	
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	
+	return board->rng = x;
+}
+
+void board_turn(board_T *board, int i, turn_T turn)
+{
+	snake_T *snake = &board->snake[i];
+	
+	if (turn == TURN_NONE)
+		return;
+	
+	/* reversed controls swap left and right */
+	bool left = ((turn == TURN_LEFT) != snake->controls_reversed);
+	
+	snake->next_dir = (snake->dir + (left ? 1 : 3)) & 3;
+}
+
+void board_tick(board_T *board)
+{
+	TRACE_SCOPE("board_tick");
+	
+	board->tick++;
+	board->num_eaten = 0;
+	board->num_dead = 0;
+	board->pending_rocks = 0;
+	
+	board->kernel(board);
+	
+	/* dead snakes stay solid until every head has moved */
+	for (int i = 0; i < board->num_dead; i++)
+		remove_body(board, board->dead[i]);
+	
+	for (int i = 0; i < board->num_eaten; i++)
+	{
+		add_food(board, board->eaten[i]);
+		add_rock(board);
+	}
+	
+	for (int i = 0; i < board->pending_rocks; i++)
+		add_rock(board);
+	
+	run_timers(board);
+	
+	if (board->config.respawn_bots)
+	{
+		for (int i = 0; i < board->num_dead; i++)
+			if (board->snake[board->dead[i]].human == false)
+				respawn_snake(board, board->dead[i]);
+	}
+}
+
+/* `dir` is the move there from the old head, if the snake has one */
+static void place_head(board_T *board, int i, uint32_t cell, direction_T dir)
+{
+	snake_T *snake = &board->snake[i];
+	uint32_t *last = &snake->runs[(snake->first_run + snake->num_runs - 1) & snake->mask];
+	
+	if (snake->length == 0)
+	{
+		snake->tail = cell;
+		snake->num_runs = 0;
+	}
+	else if (snake->num_runs > 0 && RUN_DIR(*last) == dir)
+		*last += MAKE_RUN(0, 1);
+	else
+	{
+		snake->runs[(snake->first_run + snake->num_runs) & snake->mask] = MAKE_RUN(dir, 1);
+		snake->num_runs++;
+	}
+	
+	snake->head = cell;
+	snake->length++;
+	snake->moved_tick = board->tick;
+	
+	board->grid[cell] = MAKE_CELL(CELL_SNAKE, i);
+}
+
+static void kill_snake(board_T *board, int i, death_cause_T cause, uint32_t cell)
+{
+	snake_T *snake = &board->snake[i];
+	
+	if (snake->alive == false)
+		return;
+	
+	snake->alive = false;
+	snake->death_cause = cause;
+	snake->death_cell = cell;
+	board->dead[board->num_dead++] = i;
+	
+	if (snake->human)
+		board->humans_alive--;
+}
+
+static void remove_body(board_T *board, int i)
+{
+	snake_T *snake = &board->snake[i];
+	uint32_t cell = snake->tail;
+	
+	if (snake->length > 0 && board->grid[cell] == MAKE_CELL(CELL_SNAKE, i))
+		board->grid[cell] = MAKE_CELL(CELL_EMPTY, 0);
+	
+	for (uint32_t j = 0; j < snake->num_runs; j++)
+	{
+		uint32_t run = snake_run(snake, j);
+		
+		for (uint32_t k = 0; k < RUN_LENGTH(run); k++)
+		{
+			cell = board_step(board, cell, RUN_DIR(run));
+			
+			if (board->grid[cell] == MAKE_CELL(CELL_SNAKE, i))
+				board->grid[cell] = MAKE_CELL(CELL_EMPTY, 0);
+		}
+	}
+	
+	snake->length = 0;
+	snake->num_runs = 0;
+}
+
+/* lays the snake out heading right with its head at x, y */
+static bool place_snake(board_T *board, int i, int x, int y)
+{
+	snake_T *snake = &board->snake[i];
+	int cols = board->config.cols;
+	
+	uint32_t cells[STARTING_SNAKE_LEN];
+	
+	for (int j = 0; j < STARTING_SNAKE_LEN; j++)
+	{
+		cells[j] = y * cols + ((x - j) % cols + cols) % cols;
+		
+		if (CELL_KIND(board->grid[cells[j]]) != CELL_EMPTY)
+			return false;
+	}
+	
+	snake->length = 0;
+	
+	for (int j = STARTING_SNAKE_LEN - 1; j >= 0; j--)
+		place_head(board, i, cells[j], DIR_RIGHT);
+	
+	snake->pending_snake_segments = 0;
+	snake->dir = DIR_RIGHT;
+	snake->next_dir = DIR_RIGHT;
+	snake->controls_reversed = false;
+	wheel_cancel(&board->timers, TIMER_REVERSAL(i));
+	
+	snake->alive = true;
+	snake->score = 0;
+	snake->death_cause = DEATH_NONE;
+	
+	if (snake->human)
+		board->humans_alive++;
+	
+	return true;
+}
+
+static void respawn_snake(board_T *board, int i)
+{
+	for (int attempt = 0; attempt < SPAWN_ATTEMPTS; attempt++)
+	{
+		int x = board_rand(board) % board->config.cols;
+		int y = board_rand(board) % board->config.rows;
+		
+		if (place_snake(board, i, x, y))
+			return;
+	}
+}
+
+static void eat_powerup(board_T *board, int i)
+{
+	snake_T *snake = &board->snake[i];
+	int multiplier = board->config.score_multiplier;
+	
+	snake->powerup_tick = board->tick;
+	
+	switch (board->powerup.type)
+	{
+		case POWERUP_BANANA:
+		{
+			snake->powerup_outcome = OUTCOME_BANANA;
+			snake->score += multiplier * 3;
+			snake->pending_snake_segments += SNAKE_LENGTH_INCREMENT;
+			board->pending_rocks++;
+			break;
+		}
+		
+		case POWERUP_GRAPE:
+		{
+			snake->powerup_outcome = OUTCOME_GRAPE;
+			snake->score += multiplier;
+			snake->pending_snake_segments += SNAKE_LENGTH_INCREMENT;
+			remove_rocks(board, board->num_rocks * 4 / 5);
+			break;
+		}
+		
+		case POWERUP_MYSTERY:
+		{
+			if (board_rand(board) % 2) /* pick a random outcome */
+			{
+				snake->powerup_outcome = OUTCOME_MYSTERY_BONUS;
+				snake->score += multiplier * 10;
+				snake->pending_snake_segments += SNAKE_LENGTH_INCREMENT;
+				board->pending_rocks++;
+			}
+			else /* reverse the controls */
+			{
+				snake->powerup_outcome = OUTCOME_MYSTERY_REVERSAL;
+				snake->score += multiplier;
+				snake->pending_snake_segments += SNAKE_LENGTH_INCREMENT;
+				board->pending_rocks++;
+				
+				/* until the tick the next powerup would turn up on, as it always lasted */
+				snake->controls_reversed = true;
+				wheel_schedule(&board->timers, TIMER_REVERSAL(i), board->tick + REVERSAL_DURATION - 1);
+			}
+			break;
+		}
+	}
+	
+	/* the head is about to take over the powerup's cell */
+	board->powerup.active = false;
+	
+	/* counted from the end of the tick it's eaten on, as the powerup's counters always were */
+	wheel_cancel(&board->timers, TIMER_POWERUP_EXPIRY);
+	wheel_schedule(&board->timers, TIMER_POWERUP_SPAWN, board->tick + POWERUP_FREQUENCY - 1);
+}
+
+static void spawn_powerup(board_T *board)
+{
+	powerup_T *powerup = &board->powerup;
+	
+	powerup->active = true;
+	powerup->type = board_rand(board) % 3;
+	
+	add_power_up(board);
+	
+	/* the tick it turns up on is the first of its POWERUP_DURATION */
+	wheel_schedule(&board->timers, TIMER_POWERUP_EXPIRY, board->tick + POWERUP_DURATION - 1);
+}
+
+static void expire_powerup(board_T *board)
+{
+	powerup_T *powerup = &board->powerup;
+	
+	if (powerup->cell != NO_CELL)
+		board->grid[powerup->cell] = MAKE_CELL(CELL_EMPTY, 0);
+	
+	powerup->active = false;
+	
+	wheel_schedule(&board->timers, TIMER_POWERUP_SPAWN, board->tick + POWERUP_FREQUENCY);
+}
+
+/* only the timers due this tick are looked at, however many are waiting */
+static void run_timers(board_T *board)
+{
+	uint32_t timer;
+	
+	while ((timer = wheel_expire(&board->timers, board->tick)) != NO_TIMER)
+	{
+		switch (timer)
+		{
+			case TIMER_POWERUP_SPAWN:  spawn_powerup(board);  break;
+			case TIMER_POWERUP_EXPIRY: expire_powerup(board); break;
+			
+			/* reversed controls wearing off */
+			default:
+				board->snake[timer - TIMER_REVERSAL(0)].controls_reversed = false;
+				break;
+		}
+	}
+}
+
+uint32_t board_step(const board_T *board, uint32_t cell, direction_T dir)
+{
+	int cols = board->config.cols;
+	int rows = board->config.rows;
+	int x = cell % cols;
+	int y = cell / cols;
+	
+	/* move to the opposite edge of the board when going off it */
+	switch (dir)
+	{
+		case DIR_RIGHT: x = (x + 1 == cols ? 0 : x + 1);        break;
+		case DIR_LEFT:  x = (x == 0        ? cols - 1 : x - 1); break;
+		case DIR_DOWN:  y = (y + 1 == rows ? 0 : y + 1);        break;
+		case DIR_UP:    y = (y == 0        ? rows - 1 : y - 1); break;
+	}
+	
+	return (uint32_t) y * cols + x;
+}
+
+/*
+ * The clearance window is a fixed size, so checking it through the grid
+ * costs the same however long (or however many) the snakes are.
+*/
+static bool far_enough_from_snakes(const board_T *board, int x, int y)
+{
+	int clearance = board->config.spawn_clearance;
+	
+	int x0 = (x - clearance < 0 ? 0 : x - clearance);
+	int y0 = (y - clearance < 0 ? 0 : y - clearance);
+	int x1 = (x + clearance >= board->config.cols ? board->config.cols - 1 : x + clearance);
+	int y1 = (y + clearance >= board->config.rows ? board->config.rows - 1 : y + clearance);
+	
+	for (int j = y0; j <= y1; j++)
+	{
+		const uint32_t *row = board->grid + (size_t) j * board->config.cols;
+		
+		for (int i = x0; i <= x1; i++)
+			if (CELL_KIND(row[i]) == CELL_SNAKE)
+				return false;
+	}
+	
+	return true;
+}
+
+/*
+ * Picks a random empty cell away from the snakes for something of `kind`.
+ * On a crowded board the clearance is given up after a while, and failing
+ * that the first empty cell after a random starting point is taken.
+ * Returns false if there's nowhere for it.
+ *
+ * Rocks never cut the board in two, so apples and powerups are reachable
+ * wherever they go; rocks themselves are only put where that stays true.
+*/
+static bool spawn_cell(board_T *board, uint32_t *cell, cell_kind_T kind)
+{
+	uint32_t num_cells = (uint32_t) board->config.cols * board->config.rows;
+	
+	for (int attempt = 0; attempt < 2 * SPAWN_ATTEMPTS; attempt++)
+	{
+		uint32_t candidate = board_rand(board) % num_cells;
+		
+		if (CELL_KIND(board->grid[candidate]) != CELL_EMPTY)
+			continue;
+		
+		if (attempt < SPAWN_ATTEMPTS &&
+		    far_enough_from_snakes(board, cell_x(board, candidate), cell_y(board, candidate)) == false)
+			continue;
+		
+		if (kind == CELL_ROCK && keeps_free_cells_connected(board, candidate) == false)
+			continue;
+		
+		*cell = candidate;
+		return true;
+	}
+	
+	uint32_t start = board_rand(board) % num_cells;
+	
+	for (uint32_t i = 0; i < num_cells; i++)
+	{
+		uint32_t candidate = (start + i) % num_cells;
+		
+		if (CELL_KIND(board->grid[candidate]) == CELL_EMPTY &&
+		    (kind != CELL_ROCK || keeps_free_cells_connected(board, candidate)))
+		{
+			*cell = candidate;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static uint32_t find_rock_group(const board_T *board, uint32_t cell)
+{
+	while (board->rock_parent[cell] != cell)
+		cell = board->rock_parent[cell];
+	
+	return cell;
+}
+
+/* union by rank, logged so `remove_rocks()` can undo it */
+static void join_rock_groups(board_T *board, uint32_t a, uint32_t b)
+{
+	a = find_rock_group(board, a);
+	b = find_rock_group(board, b);
+	
+	if (a == b)
+		return;
+	
+	if (board->rock_rank[a] < board->rock_rank[b])
+	{
+		uint32_t swap = a;
+		a = b;
+		b = swap;
+	}
+	
+	bool grew = (board->rock_rank[a] == board->rock_rank[b]);
+	if (grew)
+		board->rock_rank[a]++;
+	
+	board->rock_parent[b] = a;
+	board->union_log[board->union_log_len++] = b | (grew ? UNION_GREW : 0);
+}
+
+/* the 8 cells round `cell`, clockwise from the one above */
+static void neighbours(const board_T *board, uint32_t cell, uint32_t ring[8])
+{
+	ring[0] = board_step(board, cell,    DIR_UP);
+	ring[1] = board_step(board, ring[0], DIR_RIGHT);
+	ring[2] = board_step(board, cell,    DIR_RIGHT);
+	ring[3] = board_step(board, ring[2], DIR_DOWN);
+	ring[4] = board_step(board, cell,    DIR_DOWN);
+	ring[5] = board_step(board, ring[4], DIR_LEFT);
+	ring[6] = board_step(board, cell,    DIR_LEFT);
+	ring[7] = board_step(board, ring[6], DIR_UP);
+}
+
+/*
+ * Whether the cells that aren't rocks stay connected with a rock at `cell`.
+ *
+ * Going round its neighbours, the runs of non-rock cells that touch `cell`
+ * on a side are split up by runs of rock (a lone corner cell between two
+ * rocks doesn't split them, as those rocks touch). If there's only one
+ * run, whatever went through `cell` can go round it instead. Otherwise it
+ * only cuts anything off if two of the runs of rock are already joined up
+ * some other way, as the new rock then closes a loop with runs of free
+ * cells either side of it.
+ *
+ * A loop going all the way round the (wrapping) board doesn't actually cut
+ * it in two, but it's turned down all the same.
+*/
+static bool keeps_free_cells_connected(const board_T *board, uint32_t cell)
+{
+	uint32_t ring[8];
+	neighbours(board, cell, ring);
+	
+	int start = -1;
+	for (int i = 0; i < 8 && start == -1; i++)
+		if (CELL_KIND(board->grid[ring[i]]) == CELL_ROCK)
+			start = i;
+	
+	if (start == -1)
+		return true;
+	
+	uint32_t rock_runs[4];
+	int num_rock_runs = 0;
+	bool in_rock_run = false;
+	
+	for (int j = 0; j < 8; j++)
+	{
+		int i = (start + j) % 8;
+		
+		if (CELL_KIND(board->grid[ring[i]]) == CELL_ROCK)
+		{
+			if (in_rock_run == false)
+				rock_runs[num_rock_runs++] = find_rock_group(board, ring[i]);
+			
+			in_rock_run = true;
+		}
+		else if (i % 2 == 0) /* a side, not a corner */
+			in_rock_run = false;
+	}
+	
+	/* the last run carries on round into the first */
+	if (in_rock_run && num_rock_runs > 1)
+		num_rock_runs--;
+	
+	for (int i = 0; i < num_rock_runs; i++)
+		for (int j = i + 1; j < num_rock_runs; j++)
+			if (rock_runs[i] == rock_runs[j])
+				return false;
+	
+	return true;
+}
+
+static void place_rock(board_T *board, uint32_t cell)
+{
+	board->grid[cell] = MAKE_CELL(CELL_ROCK, board->num_rocks);
+	
+	board->rock_log_start[board->num_rocks] = board->union_log_len;
+	board->rock[board->num_rocks++] = cell;
+	
+	board->rock_parent[cell] = cell;
+	board->rock_rank[cell] = 0;
+	
+	uint32_t ring[8];
+	neighbours(board, cell, ring);
+	
+	for (int i = 0; i < 8; i++)
+		if (CELL_KIND(board->grid[ring[i]]) == CELL_ROCK)
+			join_rock_groups(board, cell, ring[i]);
+}
+
+static void add_rock(board_T *board)
+{
+	TRACE_SCOPE("add_rock");
+	
+	uint32_t cell;
+	
+	if (board->num_rocks == board->config.max_rocks || spawn_cell(board, &cell, CELL_ROCK) == false)
+		return;
+	
+	place_rock(board, cell);
+}
+
+static void add_food(board_T *board, int food)
+{
+	uint32_t cell;
+	
+	if (spawn_cell(board, &cell, CELL_APPLE) == false)
+		return;
+	
+	board->grid[cell] = MAKE_CELL(CELL_APPLE, food);
+	board->apple[food] = cell;
+}
+
+static void add_power_up(board_T *board)
+{
+	uint32_t cell;
+	
+	if (spawn_cell(board, &cell, CELL_POWERUP) == false)
+	{
+		board->powerup.cell = NO_CELL;
+		return;
+	}
+	
+	board->grid[cell] = MAKE_CELL(CELL_POWERUP, 0);
+	board->powerup.cell = cell;
+}
+
+/* removes the most recently placed rocks, keeping the first `keep` */
+static void remove_rocks(board_T *board, int keep)
+{
+	while (board->num_rocks > keep)
+	{
+		board->num_rocks--;
+		board->grid[board->rock[board->num_rocks]] = MAKE_CELL(CELL_EMPTY, 0);
+		
+		/* split the rock's groups back up */
+		while (board->union_log_len > board->rock_log_start[board->num_rocks])
+		{
+			uint32_t entry = board->union_log[--board->union_log_len];
+			uint32_t child = entry & ~UNION_GREW;
+			
+			if (entry & UNION_GREW)
+				board->rock_rank[board->rock_parent[child]]--;
+			
+			board->rock_parent[child] = child;
+		}
+	}
+}
@@ -0,0 +1,266 @@
+#ifndef BOARD_H
+#define BOARD_H
+
+#include "arena.h"
+#include "wheel.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Headless game rules. A board holds any number of snakes (human or bot)
+ * together with the apples, rocks and powerup they compete for. Everything
+ * on the board is tracked in a shared occupancy grid, so every collision
+ * test is a single lookup no matter how many snakes are playing.
+ *
+ * Nothing in here knows about SDL; positions are in cells, not pixels.
+ */
+
+/* pixel size of a board cell, and of the block drawn inside it */
+#define CELL_SIZE  15
+#define BLOCK_SIZE 10
+
+/* time in number of snake moves (aka. game ticks) */
+#define POWERUP_FREQUENCY 150
+#define POWERUP_DURATION  75
+#define REVERSAL_DURATION 150
+
+/* size to grow snake by when food consumed */
+#define SNAKE_LENGTH_INCREMENT 3
+
+#define STARTING_SNAKE_LEN 4
+
+typedef enum { DIR_RIGHT, DIR_UP, DIR_LEFT, DIR_DOWN } direction_T;
+typedef enum { TURN_NONE, TURN_LEFT, TURN_RIGHT } turn_T;
+
+typedef enum { POWERUP_BANANA, POWERUP_GRAPE, POWERUP_MYSTERY } powerup_type_T;
+
+/* what eating a powerup did, the mystery box having two outcomes */
+typedef enum { OUTCOME_BANANA, OUTCOME_GRAPE, OUTCOME_MYSTERY_BONUS, OUTCOME_MYSTERY_REVERSAL } powerup_outcome_T;
+
+typedef enum { DEATH_NONE, DEATH_SELF, DEATH_SNAKE, DEATH_HEAD_ON, DEATH_ROCK } death_cause_T;
+
+/* occupancy grid entries are `(index << 3) | kind` */
+typedef enum { CELL_EMPTY, CELL_ROCK, CELL_APPLE, CELL_POWERUP, CELL_SNAKE } cell_kind_T;
+
+#define CELL_KIND(c)       ((c) & 7)
+#define CELL_INDEX(c)      ((c) >> 3)
+#define MAKE_CELL(kind, i) (((uint32_t) (i) << 3) | (kind))
+
+#define NO_CELL UINT32_MAX
+
+/* `length` moves in one direction */
+#define RUN_DIR(r)            ((direction_T) ((r) & 3))
+#define RUN_LENGTH(r)         ((r) >> 2)
+#define MAKE_RUN(dir, length) (((uint32_t) (length) << 2) | (dir))
+
+typedef struct
+{
+	uint32_t cell;
+	
+	bool active;
+	
+	int type;
+} powerup_T;
+
+typedef struct
+{
+	/*
+	 * The body is kept as the moves from its tail to its head, run-length
+	 * encoded: a ring of MAKE_RUN()s, `runs[first_run]` leaving the tail.
+	 * Moving only touches the runs at either end, and the body takes a
+	 * run per turn rather than a cell per segment, however long it gets.
+	*/
+	uint32_t *runs;
+	uint32_t mask;
+	uint32_t first_run;
+	uint32_t num_runs;
+	
+	uint32_t head; /* cells, the same cell while the snake is one long */
+	uint32_t tail;
+	uint32_t length;
+	
+	int pending_snake_segments;
+	
+	/*
+	 * `dir` is the direction of the last move, `next_dir` the one the next
+	 * move will take. Turns are always relative to `dir`.
+	*/
+	direction_T dir;
+	direction_T next_dir;
+	
+	bool controls_reversed;
+	bool alive;
+	bool human;
+	
+	int score;
+	
+	uint32_t moved_tick;
+	
+	/*
+	 * What happened to the snake, for anyone watching the game (e.g. the
+	 * telemetry): the last ticks it ate an apple and a powerup, what the
+	 * powerup did, and how and where (the cell it was moving into) it
+	 * died. None of it is saved, or affects the game.
+	*/
+	uint32_t apple_tick;
+	uint32_t powerup_tick;
+	powerup_outcome_T powerup_outcome;
+	
+	death_cause_T death_cause;
+	uint32_t death_cell;
+} snake_T;
+
+typedef struct
+{
+	int cols;
+	int rows;
+	
+	int num_snakes;
+	int num_humans; /* snakes [0, num_humans) are human, the rest bots */
+	int max_snake_length;
+	
+	int num_apples;
+	int max_rocks;
+	
+	/* new objects never spawn within this many cells of a snake */
+	int spawn_clearance;
+	
+	int score_multiplier;
+	
+	/* put dead bots back on the board instead of leaving them dead */
+	bool respawn_bots;
+} board_config_T;
+
+typedef struct board_S board_T;
+
+/*
+ * Steers the bots and moves every snake, the part of a tick that goes
+ * through all of them. Boards of a few common sizes get a kernel compiled
+ * for just that size (see board_kernel.h).
+*/
+typedef void (*board_kernel_T)(board_T *);
+
+struct board_S
+{
+	board_config_T config;
+	board_kernel_T kernel;
+	
+	/* the block all of the arrays below are carved out of */
+	void *memory;
+	bool owns_memory;
+	
+	uint32_t *grid;
+	
+	snake_T *snake;
+	uint32_t *run_pool;
+	
+	uint32_t *apple;
+	
+	int num_rocks;
+	uint32_t *rock;
+	
+	/*
+	 * Rocks are never placed where they'd cut the cells that aren't rocks
+	 * in two, so every apple and powerup stays reachable. Whether one would
+	 * is decided from its 8 neighbours and a union-find of the (8-connected)
+	 * groups of rocks. Rocks only ever go in reverse order of placement, so
+	 * the union-find has no path compression, and the unions each rock made
+	 * are logged to be undone when it goes.
+	*/
+	uint32_t *rock_parent; /* per cell, only meaningful for rocks */
+	uint8_t *rock_rank;
+	uint32_t *rock_log_start; /* per rock, its first entry in the log */
+	uint32_t *union_log;
+	uint32_t union_log_len;
+	
+	powerup_T powerup;
+	
+	/*
+	 * Everything that happens some time after something else: the powerup
+	 * turning up and going again, and reversed controls wearing off.
+	*/
+	wheel_T timers;
+	
+	/* per-tick scratch lists */
+	int num_eaten;
+	int *eaten;
+	int num_dead;
+	int *dead;
+	int pending_rocks;
+	
+	int humans_alive;
+	
+	uint32_t tick;
+	uint32_t rng;
+};
+
+/* the score multiplier for a speed setting of 0 (slowest) to 4 */
+static inline int speed_score_multiplier(int speed_human) { return 30 + speed_human * 5; }
+
+/* the rules of the classic single-player game on a `cols` x `rows` board */
+void board_default_config(board_config_T *, int cols, int rows);
+
+/* returns false if the board couldn't be allocated */
+bool board_init(board_T *, const board_config_T *, uint32_t seed);
+
+/*
+ * As `board_init()`, but takes the board's memory from the arena (if not
+ * NULL) instead of the heap. Such a board lives until the arena is reset.
+*/
+bool board_init_in(board_T *, const board_config_T *, uint32_t seed, arena_T *);
+size_t board_memory_size(const board_config_T *);
+
+void board_free(board_T *);
+
+/*
+ * Makes `dst` an exact copy of `src`, which must have been set up with the
+ * same config. Boards keep everything in one block, so this is a single
+ * copy of it and never allocates.
+*/
+void board_copy(board_T *dst, const board_T *src);
+
+void board_turn(board_T *, int snake, turn_T);
+
+/* advance the game by one move of every snake */
+void board_tick(board_T *);
+
+uint32_t board_rand(board_T *);
+
+/*
+ * Checks that the board is consistent: everything on it is on the grid
+ * where it says it is and nothing else is, no two things share a cell,
+ * snakes are unbroken and within their limits, and the timers agree with
+ * what they time. Returns what's wrong, or NULL if nothing is. Costs a
+ * pass over the grid, so it's for testing (see board_fuzz.c).
+*/
+const char *board_check(const board_T *);
+
+/* e.g. to measure the specialised kernels against it */
+void board_use_generic_kernel(board_T *);
+
+/* the size the board's kernel is specialised for, or "generic" */
+const char *board_kernel_name(const board_T *);
+
+/* the cell one move from `cell` in `dir`, wrapping round the edges */
+uint32_t board_step(const board_T *, uint32_t cell, direction_T);
+
+/*
+ * Snapshots of the whole board state. `board_load()` needs a board set up
+ * with the same config as the saved one, and returns false on a corrupt
+ * snapshot.
+*/
+size_t board_save_bound(const board_config_T *);
+size_t board_save(const board_T *, uint8_t *buf);
+bool board_load(board_T *, const uint8_t *buf, size_t size);
+
+static inline int cell_x(const board_T *board, uint32_t cell) { return cell % board->config.cols; }
+static inline int cell_y(const board_T *board, uint32_t cell) { return cell / board->config.cols; }
+
+/* run `i` of the snake, counting from its tail */
+static inline uint32_t snake_run(const snake_T *snake, uint32_t i)
+{
+	return snake->runs[(snake->first_run + i) & snake->mask];
+}
+#endif
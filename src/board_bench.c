@@ -0,0 +1,111 @@
+/*
+ * Headless arena benchmark: runs a board full of bots and reports how many
+ * ticks per second it manages against the 60 ticks/second target. Boards
+ * with a specialised kernel are run again on the generic one to compare.
+ *
+ * usage: board_bench [snakes] [cols] [rows] [ticks]
+*/
+#define _POSIX_C_SOURCE 199309L
+
+#include "board.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+/* returns the seconds taken */
+static double run(board_T *board, int num_ticks)
+{
+	double worst = 0;
+	double start = now();
+	
+	for (int i = 0; i < num_ticks; i++)
+	{
+		double tick_start = now();
+		board_tick(board);
+		
+		double elapsed = now() - tick_start;
+		if (elapsed > worst)
+			worst = elapsed;
+	}
+	
+	double total = now() - start;
+	
+	printf("  %-8s kernel: %.0f ticks/s, mean %.1fus, worst %.1fus per tick (60 ticks/s budget: 16667us)\n",
+		board_kernel_name(board), num_ticks / total, total / num_ticks * 1e6, worst * 1e6);
+	
+	return total;
+}
+
+int main(int argc, const char *argv[])
+{
+	int num_snakes = (argc > 1 ? atoi(argv[1]) : 1000);
+	int cols       = (argc > 2 ? atoi(argv[2]) : 512);
+	int rows       = (argc > 3 ? atoi(argv[3]) : 512);
+	int num_ticks  = (argc > 4 ? atoi(argv[4]) : 6000);
+	
+	board_config_T config;
+	board_default_config(&config, cols, rows);
+	
+	config.num_snakes = num_snakes;
+	config.num_humans = 0;
+	config.num_apples = num_snakes / 2 + 1;
+	config.max_rocks = cols * rows / 8;
+	config.spawn_clearance = 2;
+	config.respawn_bots = true;
+	
+	board_T board;
+	board_T generic;
+	
+	if (board_init(&board, &config, 12345) == false ||
+	    board_init(&generic, &config, 12345) == false)
+	{
+		printf("Could not allocate a %dx%d board.\n", cols, rows);
+		return 1;
+	}
+	
+	board_use_generic_kernel(&generic);
+	
+	printf("%d snakes on %dx%d, %d ticks\n", num_snakes, cols, rows, num_ticks);
+	
+	double total = run(&board, num_ticks);
+	
+	if (board.kernel != generic.kernel)
+	{
+		double generic_total = run(&generic, num_ticks);
+		
+		/* the same game, however it was played */
+		size_t bound = board_save_bound(&config);
+		uint8_t *a = malloc(bound);
+		uint8_t *b = malloc(bound);
+		
+		size_t len = board_save(&board, a);
+		bool same = (len == board_save(&generic, b) && memcmp(a, b, len) == 0);
+		
+		printf("  %.2fx the generic kernel's ticks/s, %s\n", generic_total / total,
+			(same ? "same final board" : "FINAL BOARDS DIFFER"));
+		
+		free(a);
+		free(b);
+	}
+	
+	int alive = 0;
+	for (int i = 0; i < num_snakes; i++)
+		alive += board.snake[i].alive;
+	
+	printf("  %d snakes alive, %d rocks\n", alive, board.num_rocks);
+	
+	board_free(&board);
+	board_free(&generic);
+	
+	return 0;
+}
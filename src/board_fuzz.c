@@ -0,0 +1,496 @@
+/*
+ * Property-based fuzzer for the game rules.
+ *
+ * Plays random games (random board configs and seeds, random turns for
+ * the human snakes) and checks after every tick that
+ *
+ *   - the board is consistent (`board_check()`): everything is on the
+ *     grid, nothing overlaps, snakes are unbroken and within their limits
+ *   - no snake's score went down, other than by dying
+ *   - every so often, that the cells that aren't rocks are all connected,
+ *     and that a board saved and loaded again, or copied, plays on exactly
+ *     like the original
+ *
+ * The first failure found is shrunk to the fewest ticks and turns that
+ * still fail the same way, and written out as a replay, so `replay_seek()`
+ * can take a debugger straight to the tick before it. Games run in
+ * parallel, one per thread; build with sanitizers for the most out of it,
+ * e.g.
+ *
+ *     make board_fuzz CFLAGS="-std=c99 -g -O1 -fsanitize=address,undefined"
+ *
+ * usage: board_fuzz [seconds] [threads] [first seed]
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include "board.h"
+#include "replay.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_TICKS   4000
+#define MAX_HUMANS  2
+
+/* ticks between the checks that cost more than a tick */
+#define DEEP_CHECK_INTERVAL 256
+
+typedef struct
+{
+	uint32_t seed;
+	board_config_T config;
+	
+	/* the turn each human makes before each tick */
+	int num_ticks;
+	uint8_t turns[MAX_TICKS][MAX_HUMANS];
+} case_T;
+
+typedef struct
+{
+	uint32_t tick; /* the tick it failed on, 0 if it didn't */
+	const char *why;
+} failure_T;
+
+/* scratch space for one thread's games */
+typedef struct
+{
+	board_T board;
+	board_T other;
+	
+	uint8_t *save;
+	uint8_t *other_save;
+	uint32_t *stack;
+	uint8_t *seen;
+	
+	int scores[64];
+} game_T;
+
+static struct
+{
+	double deadline;
+	uint32_t next_seed;
+	
+	unsigned long long ticks;
+	unsigned long long games;
+	
+	/* the first failure, claimed by whichever thread finds one first */
+	bool failed;
+	case_T failing;
+} fuzz;
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static uint32_t next_rand(uint32_t *rng)
+{
+	uint32_t x = *rng;
+	
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	
+	return *rng = x;
+}
+
+/*
+ * A random game. Mostly small, crowded boards with low limits, as that's
+ * where the edge cases are, sometimes the sizes with kernels of their own.
+*/
+static void random_case(case_T *c, uint32_t seed)
+{
+	static const int sizes[][2] = { { 43, 32 }, { 64, 64 } };
+	
+	uint32_t rng = (seed * 2654435761u) | 1;
+	
+	c->seed = seed;
+	
+	int cols, rows;
+	if (next_rand(&rng) % 4 == 0)
+	{
+		int size = next_rand(&rng) % 2;
+		cols = sizes[size][0];
+		rows = sizes[size][1];
+	}
+	else
+	{
+		cols = 3 + next_rand(&rng) % 30;
+		rows = 3 + next_rand(&rng) % 30;
+	}
+	
+	board_config_T *config = &c->config;
+	board_default_config(config, cols, rows);
+	
+	config->num_humans = next_rand(&rng) % (MAX_HUMANS + 1);
+	config->num_snakes = config->num_humans + next_rand(&rng) % 6;
+	config->max_snake_length = 1 + next_rand(&rng) % 40;
+	config->num_apples = next_rand(&rng) % 5;
+	config->max_rocks = next_rand(&rng) % (cols * rows / 2 + 1);
+	config->spawn_clearance = next_rand(&rng) % 4;
+	config->score_multiplier = 30 + next_rand(&rng) % 5 * 5;
+	config->respawn_bots = next_rand(&rng) % 2;
+	
+	if (config->num_snakes == 0)
+		config->num_snakes = 1;
+	
+	c->num_ticks = MAX_TICKS;
+	
+	/* humans mostly go straight on, as players do */
+	for (int t = 0; t < MAX_TICKS; t++)
+		for (int h = 0; h < MAX_HUMANS; h++)
+		{
+			uint32_t r = next_rand(&rng) % 8;
+			c->turns[t][h] = (r < 6 ? TURN_NONE : (r == 6 ? TURN_LEFT : TURN_RIGHT));
+		}
+}
+
+/* a flood fill from the first cell that isn't a rock */
+static bool free_cells_connected(game_T *game, const board_T *board)
+{
+	uint32_t num_cells = (uint32_t) board->config.cols * board->config.rows;
+	
+	memset(game->seen, 0, num_cells);
+	
+	uint32_t num_free = 0;
+	uint32_t start = NO_CELL;
+	
+	for (uint32_t cell = 0; cell < num_cells; cell++)
+		if (CELL_KIND(board->grid[cell]) != CELL_ROCK)
+		{
+			num_free++;
+			if (start == NO_CELL)
+				start = cell;
+		}
+	
+	if (num_free == 0)
+		return true;
+	
+	uint32_t num_stacked = 0;
+	uint32_t num_reached = 1;
+	
+	game->stack[num_stacked++] = start;
+	game->seen[start] = 1;
+	
+	while (num_stacked > 0)
+	{
+		uint32_t cell = game->stack[--num_stacked];
+		
+		for (int dir = 0; dir < 4; dir++)
+		{
+			uint32_t next = board_step(board, cell, dir);
+			
+			if (game->seen[next] || CELL_KIND(board->grid[next]) == CELL_ROCK)
+				continue;
+			
+			game->seen[next] = 1;
+			game->stack[num_stacked++] = next;
+			num_reached++;
+		}
+	}
+	
+	return num_reached == num_free;
+}
+
+/* the same game, however it was got to */
+static bool same_board(game_T *game, const board_T *a, const board_T *b)
+{
+	size_t len = board_save(a, game->save);
+	
+	return len == board_save(b, game->other_save) && memcmp(game->save, game->other_save, len) == 0;
+}
+
+/* sets up the game's boards for the case; false if they couldn't be */
+static bool start_case(game_T *game, const case_T *c)
+{
+	board_free(&game->board);
+	board_free(&game->other);
+	
+	free(game->save);
+	free(game->other_save);
+	free(game->stack);
+	free(game->seen);
+	
+	size_t num_cells = (size_t) c->config.cols * c->config.rows;
+	size_t bound = board_save_bound(&c->config);
+	
+	game->save = malloc(bound);
+	game->other_save = malloc(bound);
+	game->stack = malloc(4 * num_cells * sizeof(uint32_t));
+	game->seen = malloc(num_cells);
+	
+	return game->save != NULL && game->other_save != NULL && game->stack != NULL && game->seen != NULL &&
+	       board_init(&game->board, &c->config, c->seed) &&
+	       board_init(&game->other, &c->config, c->seed);
+}
+
+/* plays the case from the start, checking everything after every tick */
+static failure_T run_case(game_T *game, const case_T *c)
+{
+	failure_T failure = { 0, NULL };
+	
+	if (start_case(game, c) == false)
+	{
+		failure.why = "couldn't allocate the board";
+		return failure;
+	}
+	
+	board_T *board = &game->board;
+	const char *why = board_check(board);
+	
+	for (int i = 0; i < c->config.num_snakes; i++)
+		game->scores[i] = board->snake[i].score;
+	
+	for (int t = 0; t < c->num_ticks && why == NULL; t++)
+	{
+		for (int h = 0; h < c->config.num_humans; h++)
+			board_turn(board, h, c->turns[t][h]);
+		
+		bool play_alongside = (t % DEEP_CHECK_INTERVAL == 0);
+		
+		/* play the same tick on a copy, or on a saved and loaded board */
+		if (play_alongside)
+		{
+			if (t % (2 * DEEP_CHECK_INTERVAL) == 0)
+				board_copy(&game->other, board);
+			else if (board_load(&game->other, game->save, board_save(board, game->save)) == false)
+				why = "a saved board didn't load";
+		}
+		
+		board_tick(board);
+		
+		if (play_alongside && why == NULL)
+		{
+			board_tick(&game->other);
+			
+			if (same_board(game, board, &game->other) == false)
+				why = "a copied or reloaded board played on differently";
+		}
+		
+		if (why == NULL)
+			why = board_check(board);
+		
+		/* a snake's score only goes down when it dies and starts again */
+		for (int i = 0; i < c->config.num_snakes && why == NULL; i++)
+		{
+			bool died = false;
+			for (int j = 0; j < board->num_dead; j++)
+				died |= (board->dead[j] == i);
+			
+			if (died == false && board->snake[i].score < game->scores[i])
+				why = "a score went down";
+			
+			game->scores[i] = board->snake[i].score;
+		}
+		
+		if (why == NULL && t % DEEP_CHECK_INTERVAL == DEEP_CHECK_INTERVAL - 1 &&
+		    free_cells_connected(game, board) == false)
+			why = "rocks cut the board in two";
+		
+		if (why != NULL)
+		{
+			failure.tick = board->tick;
+			failure.why = why;
+		}
+		
+		/* nothing left to play */
+		if (c->config.num_humans > 0 && board->humans_alive == 0)
+			break;
+	}
+	
+	return failure;
+}
+
+static bool fails_the_same(game_T *game, const case_T *c, const failure_T *failure)
+{
+	failure_T again = run_case(game, c);
+	return again.why != NULL && strcmp(again.why, failure->why) == 0;
+}
+
+/*
+ * Shrinks a failing case: cuts it off at the failing tick, then takes out
+ * as many turns as it can, in ever smaller runs, keeping it failing the
+ * same way.
+*/
+static failure_T minimise(game_T *game, case_T *c, failure_T failure)
+{
+	c->num_ticks = failure.tick;
+	
+	for (int run = c->num_ticks; run >= 1; run /= 2)
+	{
+		for (int start = 0; start < c->num_ticks; start += run)
+		{
+			uint8_t saved[MAX_TICKS][MAX_HUMANS];
+			int end = (start + run < c->num_ticks ? start + run : c->num_ticks);
+			bool any = false;
+			
+			for (int t = start; t < end; t++)
+				for (int h = 0; h < MAX_HUMANS; h++)
+				{
+					saved[t][h] = c->turns[t][h];
+					any |= (c->turns[t][h] != TURN_NONE);
+					c->turns[t][h] = TURN_NONE;
+				}
+			
+			if (any == false)
+				continue;
+			
+			if (fails_the_same(game, c, &failure))
+				continue;
+			
+			for (int t = start; t < end; t++)
+				for (int h = 0; h < MAX_HUMANS; h++)
+					c->turns[t][h] = saved[t][h];
+		}
+	}
+	
+	/* with fewer turns it may well fail sooner */
+	failure = run_case(game, c);
+	c->num_ticks = failure.tick;
+	
+	return failure;
+}
+
+/* records the case as a replay, turns and all */
+static bool write_replay(const case_T *c, const char *path)
+{
+	/* played back at the middle speed */
+	replay_header_T header = { c->seed, 2, REPLAY_KEYFRAME_INTERVAL, c->config };
+	
+	board_T board;
+	replay_writer_T writer;
+	
+	if (board_init(&board, &c->config, c->seed) == false)
+		return false;
+	
+	/* from an earlier run of the same seed */
+	remove(path);
+	
+	if (replay_writer_open(&writer, path, &header, NULL) == false)
+	{
+		board_free(&board);
+		return false;
+	}
+	
+	for (int t = 0; t < c->num_ticks; t++)
+	{
+		for (int h = 0; h < c->config.num_humans; h++)
+		{
+			if (c->turns[t][h] == TURN_NONE)
+				continue;
+			
+			board_turn(&board, h, c->turns[t][h]);
+			replay_record_turn(&writer, &board, h, c->turns[t][h]);
+		}
+		
+		board_tick(&board);
+		replay_record_tick(&writer, &board);
+	}
+	
+	replay_writer_close(&writer, &board);
+	board_free(&board);
+	
+	return true;
+}
+
+static void *worker(void *arg)
+{
+	(void) arg;
+	
+	game_T game;
+	memset(&game, 0, sizeof(game_T));
+	
+	case_T *c = malloc(sizeof(case_T));
+	
+	while (c != NULL && now() < fuzz.deadline && __atomic_load_n(&fuzz.failed, __ATOMIC_ACQUIRE) == false)
+	{
+		random_case(c, __sync_fetch_and_add(&fuzz.next_seed, 1));
+		
+		failure_T failure = run_case(&game, c);
+		
+		__sync_fetch_and_add(&fuzz.ticks, game.board.tick);
+		__sync_fetch_and_add(&fuzz.games, 1);
+		
+		if (failure.why == NULL)
+			continue;
+		
+		if (__atomic_exchange_n(&fuzz.failed, true, __ATOMIC_ACQ_REL) == false)
+		{
+			printf("seed %u failed on tick %u: %s\n", c->seed, failure.tick, failure.why);
+			
+			minimise(&game, c, failure);
+			fuzz.failing = *c;
+		}
+	}
+	
+	board_free(&game.board);
+	board_free(&game.other);
+	
+	free(game.save);
+	free(game.other_save);
+	free(game.stack);
+	free(game.seen);
+	free(c);
+	
+	return NULL;
+}
+
+int main(int argc, const char *argv[])
+{
+	double seconds  = (argc > 1 ? atof(argv[1]) : 10);
+	int num_threads = (argc > 2 ? atoi(argv[2]) : (int) sysconf(_SC_NPROCESSORS_ONLN));
+	fuzz.next_seed  = (argc > 3 ? strtoul(argv[3], NULL, 10) : (uint32_t) time(NULL));
+	
+	if (num_threads < 1)
+		num_threads = 1;
+	
+	uint32_t first_seed = fuzz.next_seed;
+	
+	double start = now();
+	fuzz.deadline = start + seconds;
+	
+	pthread_t threads[num_threads];
+	for (int i = 0; i < num_threads; i++)
+		pthread_create(&threads[i], NULL, worker, NULL);
+	
+	for (int i = 0; i < num_threads; i++)
+		pthread_join(threads[i], NULL);
+	
+	double elapsed = now() - start;
+	
+	printf("%llu games (seeds %u to %u), %llu ticks in %.1fs on %d threads: %.0f ticks/s\n",
+		fuzz.games, first_seed, fuzz.next_seed - 1, fuzz.ticks, elapsed, num_threads, fuzz.ticks / elapsed);
+	
+	if (fuzz.failed == false)
+		return 0;
+	
+	const case_T *c = &fuzz.failing;
+	
+	int num_turns = 0;
+	for (int t = 0; t < c->num_ticks; t++)
+		for (int h = 0; h < c->config.num_humans; h++)
+			num_turns += (c->turns[t][h] != TURN_NONE);
+	
+	char path[64];
+	snprintf(path, sizeof(path), "fuzz-%u.snr", c->seed);
+	
+	printf("shrunk to %d ticks and %d turns on a %dx%d board with %d snakes (%d human)\n",
+		c->num_ticks, num_turns, c->config.cols, c->config.rows, c->config.num_snakes, c->config.num_humans);
+	
+	/* replays end when the last human does */
+	if (c->config.num_humans == 0)
+		printf("no human snakes to replay; \"board_fuzz 1 1 %u\" plays it again\n", c->seed);
+	else if (write_replay(c, path))
+		printf("written to %s\n", path);
+	else
+		printf("couldn't write %s\n", path);
+	
+	return 1;
+}
@@ -0,0 +1,48 @@
+#include "canvas.h"
+#include "globals.h"
+#include "sdlhelperfuncs.h"
+#include "trace.h"
+
+bool canvas_init(canvas_T *canvas, SDL_Surface *background)
+{
+	TRACE_SCOPE("canvas_init");
+	
+	canvas->background = background;
+	canvas->surface = SDL_DisplayFormat(background);
+	
+	return canvas->surface != NULL;
+}
+
+void canvas_free(canvas_T *canvas)
+{
+	SDL_FreeSurface(canvas->surface);
+	canvas->surface = NULL;
+}
+
+void canvas_clear(canvas_T *canvas, SDL_Rect *region)
+{
+	if (region == NULL)
+	{
+		SDL_BlitSurface(canvas->background, NULL, canvas->surface, NULL);
+		return;
+	}
+	
+	SDL_Rect src = { region->x * screen_scale, region->y * screen_scale,
+	                 region->w * screen_scale, region->h * screen_scale };
+	
+	/* SDL_BlitSurface() clips the destination rectangle it's given */
+	SDL_Rect dst = src;
+	SDL_BlitSurface(canvas->background, &src, canvas->surface, &dst);
+}
+
+void canvas_draw(canvas_T *canvas, int x, int y, SDL_Surface *src)
+{
+	apply_surface(x * screen_scale, y * screen_scale, src, canvas->surface);
+}
+
+void canvas_show(canvas_T *canvas)
+{
+	TRACE_SCOPE("canvas_show");
+	
+	apply_surface(0, 0, canvas->surface, screen);
+}
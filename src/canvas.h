@@ -0,0 +1,35 @@
+#ifndef CANVAS_H
+#define CANVAS_H
+
+#include <SDL/SDL.h>
+
+#include <stdbool.h>
+
+/*
+ * A retained screen. Everything on it is composed once into an off-screen
+ * surface, and afterwards only the regions that change are redrawn, so
+ * showing the screen again is a single blit however much is on it.
+*/
+typedef struct
+{
+	SDL_Surface *surface;
+	SDL_Surface *background; /* what cleared regions are restored from */
+} canvas_T;
+
+/* starts the canvas off as a copy of `background`, which it doesn't own */
+bool canvas_init(canvas_T *, SDL_Surface *background);
+void canvas_free(canvas_T *);
+
+/*
+ * Positions and regions are in unscaled units (see `screen_scale`), the
+ * surfaces drawn already the size they should be.
+*/
+
+/* puts the background back over a region, or the whole canvas if NULL */
+void canvas_clear(canvas_T *, SDL_Rect *region);
+
+void canvas_draw(canvas_T *, int x, int y, SDL_Surface *);
+
+/* blits the whole canvas to the screen, for the frame being drawn */
+void canvas_show(canvas_T *);
+#endif
@@ -1,6 +0,0 @@
-#ifndef CONSTANTS_H
-#define CONSTANTS_H
-
-typedef enum { QUIT_ID, MENU_ID, GAME_ID, HIGHSCORE_ID } nav_vars_T;
-
-#endif
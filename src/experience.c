@@ -0,0 +1,463 @@
+#define _DEFAULT_SOURCE
+
+#include "experience.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+/* sizeof(experience_record_T) must be EXPERIENCE_RECORD_SIZE, as trainers rely on it */
+typedef char record_size_check[sizeof(experience_record_T) == EXPERIENCE_RECORD_SIZE ? 1 : -1];
+typedef char header_size_check[sizeof(experience_header_T) <= EXPERIENCE_HEADER_SIZE ? 1 : -1];
+
+/* longest a worker sleeps between looks at a full ring */
+#define MAX_BACKOFF_NS 1000000
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static size_t ring_size(uint32_t capacity)
+{
+	return EXPERIENCE_HEADER_SIZE +
+	       EXPERIENCE_MAX_WORKERS * sizeof(experience_worker_T) +
+	       (size_t) capacity * (sizeof(uint64_t) + sizeof(experience_record_T));
+}
+
+/* points the ring's arrays into its mapping */
+static void lay_out(experience_T *experience)
+{
+	uint8_t *memory = experience->memory;
+	
+	experience->header  = (experience_header_T *) memory;
+	experience->workers = (experience_worker_T *) (memory + EXPERIENCE_HEADER_SIZE);
+	experience->seq     = (uint64_t *) (experience->workers + EXPERIENCE_MAX_WORKERS);
+	experience->records = (experience_record_T *) (experience->seq + experience->header->capacity);
+}
+
+/* maps the ring's file, and closes it whether or not that worked */
+static bool map(experience_T *experience, int fd, size_t size)
+{
+	experience->memory = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	
+	if (experience->memory == MAP_FAILED)
+	{
+		experience->memory = NULL;
+		return false;
+	}
+	
+	experience->size = size;
+	return true;
+}
+
+bool experience_create(experience_T *experience, const char *name, uint32_t capacity)
+{
+	memset(experience, 0, sizeof(experience_T));
+	experience->worker = -1;
+	
+	uint32_t slots = 1;
+	while (slots < capacity)
+		slots <<= 1;
+	
+	/* a ring left behind by a trainer that died is of no use to anyone */
+	shm_unlink(name);
+	
+	int fd = shm_open(name, O_RDWR | O_CREAT | O_EXCL, 0600);
+	
+	if (fd < 0)
+		return false;
+	
+	if (ftruncate(fd, ring_size(slots)) != 0)
+	{
+		close(fd);
+		shm_unlink(name);
+		return false;
+	}
+	
+	if (map(experience, fd, ring_size(slots)) == false)
+	{
+		shm_unlink(name);
+		return false;
+	}
+	
+	experience_header_T *header = experience->memory;
+	
+	memcpy(header->magic, EXPERIENCE_MAGIC, sizeof(EXPERIENCE_MAGIC));
+	header->record_size = sizeof(experience_record_T);
+	header->capacity    = slots;
+	header->max_workers = EXPERIENCE_MAX_WORKERS;
+	header->view        = EXPERIENCE_VIEW;
+	header->trainer_pid = getpid();
+	
+	lay_out(experience);
+	
+	/* the version goes in last: workers take the ring as ready once it's there */
+	__atomic_store_n(&header->version, EXPERIENCE_VERSION, __ATOMIC_RELEASE);
+	
+	return true;
+}
+
+uint32_t experience_acquire(experience_T *experience, uint32_t max, const experience_record_T **records)
+{
+	uint64_t tail = experience->header->tail;
+	uint32_t mask = experience->header->capacity - 1;
+	uint32_t start = tail & mask;
+	
+	/* a batch is contiguous, so it stops at the end of the ring */
+	if (max > mask + 1 - start)
+		max = mask + 1 - start;
+	
+	uint32_t count = 0;
+	
+	while (count < max &&
+	       __atomic_load_n(&experience->seq[start + count], __ATOMIC_ACQUIRE) == tail + count + 1)
+		count++;
+	
+	*records = &experience->records[start];
+	return count;
+}
+
+void experience_release(experience_T *experience, uint32_t count)
+{
+	__atomic_store_n(&experience->header->tail, experience->header->tail + count, __ATOMIC_RELEASE);
+}
+
+static bool is_running(const experience_worker_T *worker)
+{
+	return __atomic_load_n(&worker->state, __ATOMIC_ACQUIRE) == WORKER_RUNNING;
+}
+
+/* whether a running worker is claiming or writing slot `pos` */
+static bool claimed(const experience_T *experience, uint64_t pos)
+{
+	for (int i = 0; i < EXPERIENCE_MAX_WORKERS; i++)
+	{
+		const experience_worker_T *worker = &experience->workers[i];
+		
+		if (is_running(worker) == false)
+			continue;
+		
+		uint64_t claiming = __atomic_load_n(&worker->claiming, __ATOMIC_SEQ_CST);
+		uint64_t length   = __atomic_load_n(&worker->claim_length, __ATOMIC_SEQ_CST);
+		
+		if (claiming != EXPERIENCE_NOT_CLAIMING && pos - claiming < length)
+			return true;
+	}
+	
+	return false;
+}
+
+int experience_sweep(experience_T *experience)
+{
+	experience_header_T *header = experience->header;
+	int found = 0;
+	
+	for (int i = 0; i < EXPERIENCE_MAX_WORKERS; i++)
+	{
+		experience_worker_T *worker = &experience->workers[i];
+		uint32_t running = WORKER_RUNNING;
+		
+		if (is_running(worker) == false || worker->pid <= 0 ||
+		    kill(worker->pid, 0) == 0 || errno != ESRCH)
+			continue;
+		
+		if (__atomic_compare_exchange_n(&worker->state, &running, WORKER_CRASHED, false,
+		                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+			found++;
+	}
+	
+	if (found == 0)
+		return 0;
+	
+	/*
+	 * Every slot claimed but not written, that no running worker says it's
+	 * claiming, was a dead worker's. Running workers only clear their claim
+	 * after writing, so if the slot is still unwritten after looking, its
+	 * writer is dead.
+	*/
+	uint32_t mask = header->capacity - 1;
+	uint64_t head = __atomic_load_n(&header->head, __ATOMIC_SEQ_CST);
+	
+	for (uint64_t pos = header->tail; pos < head; pos++)
+	{
+		uint64_t *seq = &experience->seq[pos & mask];
+		
+		if (__atomic_load_n(seq, __ATOMIC_ACQUIRE) == pos + 1 || claimed(experience, pos))
+			continue;
+		
+		if (__atomic_load_n(seq, __ATOMIC_SEQ_CST) == pos + 1)
+			continue;
+		
+		experience_record_T *record = &experience->records[pos & mask];
+		
+		memset(record, 0, sizeof(experience_record_T));
+		record->worker = UINT32_MAX;
+		record->flags = EXPERIENCE_ABANDONED;
+		
+		__atomic_store_n(seq, pos + 1, __ATOMIC_RELEASE);
+		header->abandoned++;
+	}
+	
+	return found;
+}
+
+void experience_close(experience_T *experience, const char *name)
+{
+	__atomic_store_n(&experience->header->closing, 1, __ATOMIC_RELEASE);
+	shm_unlink(name);
+}
+
+bool experience_join(experience_T *experience, const char *name)
+{
+	memset(experience, 0, sizeof(experience_T));
+	experience->worker = -1;
+	
+	int fd = shm_open(name, O_RDWR, 0);
+	
+	if (fd < 0)
+		return false;
+	
+	struct stat st;
+	
+	if (fstat(fd, &st) != 0 || (size_t) st.st_size < ring_size(0))
+	{
+		close(fd);
+		return false;
+	}
+	
+	if (map(experience, fd, st.st_size) == false)
+		return false;
+	
+	const experience_header_T *header = experience->memory;
+	
+	if (memcmp(header->magic, EXPERIENCE_MAGIC, sizeof(EXPERIENCE_MAGIC)) != 0 ||
+	    __atomic_load_n(&header->version, __ATOMIC_ACQUIRE) != EXPERIENCE_VERSION ||
+	    header->record_size != sizeof(experience_record_T) || header->view != EXPERIENCE_VIEW ||
+	    header->capacity == 0 || (header->capacity & (header->capacity - 1)) != 0 ||
+	    ring_size(header->capacity) != experience->size)
+	{
+		experience_detach(experience);
+		return false;
+	}
+	
+	lay_out(experience);
+	
+	/* entries of workers that have gone, cleanly or not, are free again */
+	for (int i = 0; i < EXPERIENCE_MAX_WORKERS; i++)
+	{
+		experience_worker_T *worker = &experience->workers[i];
+		uint32_t state = __atomic_load_n(&worker->state, __ATOMIC_ACQUIRE);
+		
+		if (state == WORKER_RUNNING || state == WORKER_JOINING ||
+		    __atomic_compare_exchange_n(&worker->state, &state, WORKER_JOINING, false,
+		                                __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST) == false)
+			continue;
+		
+		worker->claiming     = EXPERIENCE_NOT_CLAIMING;
+		worker->claim_length = 0;
+		worker->records      = 0;
+		worker->episodes     = 0;
+		worker->stalled_ns   = 0;
+		worker->heartbeat    = now_ns();
+		worker->pid          = getpid();
+		
+		__atomic_store_n(&worker->state, WORKER_RUNNING, __ATOMIC_RELEASE);
+		
+		experience->worker = i;
+		return true;
+	}
+	
+	experience_detach(experience);
+	return false;
+}
+
+bool experience_write(experience_T *experience, experience_record_T *records, uint32_t count)
+{
+	experience_header_T *header = experience->header;
+	experience_worker_T *worker = &experience->workers[experience->worker];
+	uint32_t mask = header->capacity - 1;
+	
+	for (uint32_t i = 0; i < count; i++)
+	{
+		records[i].worker = experience->worker;
+		records[i].flags = 0;
+	}
+	
+	int64_t waiting_since = 0;
+	long backoff = 1000;
+	uint64_t pos;
+	
+	while (1)
+	{
+		if (__atomic_load_n(&header->closing, __ATOMIC_ACQUIRE))
+			return false;
+		
+		pos = __atomic_load_n(&header->head, __ATOMIC_RELAXED);
+		
+		/* full: wait for the trainer, more patiently the longer it takes */
+		if (pos + count - __atomic_load_n(&header->tail, __ATOMIC_ACQUIRE) > mask + 1)
+		{
+			int64_t now = now_ns();
+			
+			if (waiting_since == 0)
+				waiting_since = now;
+			
+			__atomic_store_n(&worker->heartbeat, now, __ATOMIC_RELAXED);
+			
+			struct timespec ts = { 0, backoff };
+			nanosleep(&ts, NULL);
+			
+			backoff = (backoff * 2 < MAX_BACKOFF_NS ? backoff * 2 : MAX_BACKOFF_NS);
+			continue;
+		}
+		
+		/* say which slots before taking them, so they're never unaccounted for */
+		__atomic_store_n(&worker->claim_length, count, __ATOMIC_SEQ_CST);
+		__atomic_store_n(&worker->claiming, pos, __ATOMIC_SEQ_CST);
+		
+		if (__atomic_compare_exchange_n(&header->head, &pos, pos + count, false,
+		                                __ATOMIC_SEQ_CST, __ATOMIC_RELAXED))
+			break;
+		
+		/*
+		 * Those slots went to another worker. Left claimed, they'd look like
+		 * ours to `experience_sweep()` for as long as we wait on a full ring,
+		 * and if that worker died they'd never be filled in.
+		*/
+		__atomic_store_n(&worker->claiming, EXPERIENCE_NOT_CLAIMING, __ATOMIC_SEQ_CST);
+	}
+	
+	uint32_t start = pos & mask;
+	uint32_t first = (count < mask + 1 - start ? count : mask + 1 - start);
+	
+	memcpy(&experience->records[start], records, first * sizeof(experience_record_T));
+	memcpy(&experience->records[0], records + first, (count - first) * sizeof(experience_record_T));
+	
+	for (uint32_t i = 0; i < count; i++)
+		__atomic_store_n(&experience->seq[(pos + i) & mask], pos + i + 1, __ATOMIC_RELEASE);
+	
+	__atomic_store_n(&worker->claiming, EXPERIENCE_NOT_CLAIMING, __ATOMIC_SEQ_CST);
+	
+	int64_t now = now_ns();
+	
+	__atomic_store_n(&worker->records, worker->records + count, __ATOMIC_RELAXED);
+	__atomic_store_n(&worker->heartbeat, now, __ATOMIC_RELAXED);
+	
+	if (waiting_since != 0)
+		__atomic_store_n(&worker->stalled_ns, worker->stalled_ns + (now - waiting_since), __ATOMIC_RELAXED);
+	
+	return true;
+}
+
+void experience_leave(experience_T *experience)
+{
+	if (experience->worker >= 0)
+		__atomic_store_n(&experience->workers[experience->worker].state, WORKER_EXITED, __ATOMIC_RELEASE);
+	
+	experience_detach(experience);
+}
+
+void experience_detach(experience_T *experience)
+{
+	if (experience->memory != NULL)
+		munmap(experience->memory, experience->size);
+	
+	memset(experience, 0, sizeof(experience_T));
+	experience->worker = -1;
+}
+
+/* `dir`'s way ahead, and the way to its right, in x and y */
+static const int ahead_x[4] = { 1,  0, -1, 0 };
+static const int ahead_y[4] = { 0, -1,  0, 1 };
+static const int right_x[4] = { 0,  1,  0, -1 };
+static const int right_y[4] = { 1,  0, -1, 0 };
+
+/* the shortest way from `from` to `to` along a wrapping axis `size` long */
+static int wrapped_delta(int from, int to, int size)
+{
+	int delta = ((to - from) % size + size) % size;
+	return (delta > size / 2 ? delta - size : delta);
+}
+
+void experience_observe(const board_T *board, int i, experience_record_T *record)
+{
+	const snake_T *snake = &board->snake[i];
+	int cols = board->config.cols;
+	int rows = board->config.rows;
+	int x = cell_x(board, snake->head);
+	int y = cell_y(board, snake->head);
+	direction_T dir = snake->dir;
+	
+	const int radius = EXPERIENCE_VIEW / 2;
+	uint8_t *seen = record->observation;
+	
+	for (int row = 0; row < EXPERIENCE_VIEW; row++)
+	{
+		int ahead = radius - row;
+		
+		for (int col = 0; col < EXPERIENCE_VIEW; col++)
+		{
+			int right = col - radius;
+			int cx = ((x + ahead * ahead_x[dir] + right * right_x[dir]) % cols + cols) % cols;
+			int cy = ((y + ahead * ahead_y[dir] + right * right_y[dir]) % rows + rows) % rows;
+			uint32_t cell = (uint32_t) cy * cols + cx;
+			uint32_t contents = board->grid[cell];
+			
+			switch (CELL_KIND(contents))
+			{
+				case CELL_ROCK:    *seen = SEEN_ROCK;    break;
+				case CELL_APPLE:   *seen = SEEN_APPLE;   break;
+				case CELL_POWERUP: *seen = SEEN_POWERUP; break;
+				
+				case CELL_SNAKE:
+					if ((int) CELL_INDEX(contents) != i)
+						*seen = SEEN_OTHER_SNAKE;
+					else
+						*seen = (cell == snake->head ? SEEN_HEAD : SEEN_BODY);
+					break;
+				
+				default:
+					*seen = SEEN_EMPTY;
+					break;
+			}
+			
+			seen++;
+		}
+	}
+	
+	/* the nearest apple, however far outside the view */
+	int best = -1;
+	record->apple_ahead = 0;
+	record->apple_right = 0;
+	
+	for (int j = 0; j < board->config.num_apples; j++)
+	{
+		if (board->apple[j] == NO_CELL)
+			continue;
+		
+		int dx = wrapped_delta(x, cell_x(board, board->apple[j]), cols);
+		int dy = wrapped_delta(y, cell_y(board, board->apple[j]), rows);
+		int distance = abs(dx) + abs(dy);
+		
+		if (best == -1 || distance < best)
+		{
+			best = distance;
+			record->apple_ahead = dx * ahead_x[dir] + dy * ahead_y[dir];
+			record->apple_right = dx * right_x[dir] + dy * right_y[dir];
+		}
+	}
+	
+	record->dir = dir;
+	record->length = snake->length;
+}
@@ -0,0 +1,206 @@
+#ifndef EXPERIENCE_H
+#define EXPERIENCE_H
+
+#include "board.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Experience for training a player on: what a snake saw, what it did, and
+ * what came of it, a record per snake per tick. Headless workers play
+ * games under the board's rules and write the records into a ring in POSIX
+ * shared memory; the trainer, another process, maps the same memory and
+ * reads them where they lie, a batch at a time, without them ever going
+ * through a pipe or being copied again.
+ *
+ * The ring takes any number of writers and one reader. A worker plays a
+ * batch of records into memory of its own, claims that many slots by
+ * moving `head` on with a compare and swap, copies the batch in and marks
+ * each slot as written. The trainer reads the written slots from `tail`
+ * on, and moves `tail` past them once it's done with them. Nothing is
+ * locked: a worker only ever waits for the trainer, when the ring is full
+ * (back-pressure: it sleeps until there's room rather than dropping
+ * anything), and the trainer only waits for workers to finish copying.
+ *
+ * A worker that dies between claiming slots and marking them written would
+ * leave a hole the trainer never got past, so workers say which slots
+ * they're claiming before they claim them, and `experience_sweep()` fills
+ * in the slots of workers that are no longer running with records marked
+ * EXPERIENCE_ABANDONED.
+ *
+ * The layout is fixed so a trainer in any language can map it: the header
+ * (a page), the workers (a cache line each), the slot sequence numbers,
+ * then the records, all little-endian as written by the machine.
+*/
+
+#define EXPERIENCE_MAGIC   "SNKEXP"
+#define EXPERIENCE_VERSION 1
+
+#define EXPERIENCE_MAX_WORKERS 64
+
+/* the observation is the cells around the snake's head, this many a side */
+#define EXPERIENCE_VIEW 11
+
+/* what's in each cell of an observation */
+typedef enum
+{
+	SEEN_EMPTY,
+	SEEN_ROCK,
+	SEEN_APPLE,
+	SEEN_POWERUP,
+	SEEN_HEAD, /* the snake's own */
+	SEEN_BODY,
+	SEEN_OTHER_SNAKE
+} seen_T;
+
+/* `flags` bits */
+#define EXPERIENCE_ABANDONED 1 /* its worker died before writing it; nothing else in it is set */
+
+/*
+ * A snake's step: the observation from before the tick, the turn it took,
+ * and the score it got for it (less EXPERIENCE_DEATH_PENALTY if it died).
+ * The next observation is that of the record with the same worker and
+ * episode and the next step, unless `done`.
+*/
+typedef struct
+{
+	uint32_t worker;
+	uint32_t episode; /* counted per worker */
+	uint32_t step;
+	int32_t reward;
+	
+	uint8_t action; /* turn_T */
+	uint8_t done;
+	uint8_t flags;
+	uint8_t dir; /* direction_T the snake was heading in */
+	
+	/* the nearest apple, in moves ahead and to the right */
+	int16_t apple_ahead;
+	int16_t apple_right;
+	
+	uint32_t length;
+	
+	/*
+	 * seen_T, turned so the snake is heading up the view: row 0 is the
+	 * furthest ahead, and the head is in the middle.
+	*/
+	uint8_t observation[EXPERIENCE_VIEW * EXPERIENCE_VIEW];
+	
+	uint8_t padding[11];
+} experience_record_T;
+
+#define EXPERIENCE_RECORD_SIZE 160
+
+#define EXPERIENCE_DEATH_PENALTY 100
+
+/* a joining worker is setting its entry up, and isn't looked at until it's running */
+typedef enum { WORKER_FREE, WORKER_JOINING, WORKER_RUNNING, WORKER_EXITED, WORKER_CRASHED } worker_state_T;
+
+#define EXPERIENCE_NOT_CLAIMING UINT64_MAX
+
+/* a worker's entry, written by the worker other than `state` */
+typedef struct
+{
+	uint32_t state; /* worker_state_T */
+	int32_t pid;
+	
+	/* the slots it's claiming or writing, from `claiming` */
+	uint64_t claiming;
+	uint64_t claim_length;
+	
+	uint64_t records;
+	uint64_t episodes;
+	int64_t stalled_ns; /* waiting for room in the ring */
+	int64_t heartbeat;  /* CLOCK_MONOTONIC ns, as of its last batch or wait */
+	
+	uint8_t padding[8];
+} experience_worker_T;
+
+typedef struct
+{
+	char magic[8];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t capacity; /* slots, a power of two */
+	uint32_t max_workers;
+	uint32_t view;
+	
+	uint32_t closing; /* set by the trainer to tell the workers to stop */
+	int32_t trainer_pid;
+	
+	/* kept on lines of their own, as writers fight over `head` */
+	uint8_t line0[64 - 9 * 4];
+	uint64_t head; /* slots claimed, ever */
+	uint8_t line1[56];
+	uint64_t tail; /* slots read, ever */
+	uint64_t abandoned;
+	uint8_t line2[48];
+} experience_header_T;
+
+#define EXPERIENCE_HEADER_SIZE 4096
+
+typedef struct
+{
+	experience_header_T *header;
+	experience_worker_T *workers;
+	uint64_t *seq; /* slot i holds the record claimed as number n once seq[i] == n + 1 */
+	experience_record_T *records;
+	
+	void *memory;
+	size_t size;
+	
+	int worker; /* the entry joined as, -1 for the trainer */
+} experience_T;
+
+/*
+ * The trainer's side. Creates the ring under `name` (e.g. "/snake") with
+ * room for `capacity` records, rounded up to a power of two, replacing any
+ * left over from before. Returns false if it couldn't.
+*/
+bool experience_create(experience_T *, const char *name, uint32_t capacity);
+
+/*
+ * Up to `max` written records from `tail` on, where they lie in the ring,
+ * stopping at the first that isn't written yet or at the end of the ring.
+ * Returns how many, and sets `*records` to the first.
+*/
+uint32_t experience_acquire(experience_T *, uint32_t max, const experience_record_T **records);
+
+/* done with the first `count` records acquired; workers may reuse their slots */
+void experience_release(experience_T *, uint32_t count);
+
+/*
+ * Looks for workers that died while running, marks them crashed, and
+ * fills in any slots they left claimed but unwritten. Returns how many
+ * workers were found dead; call it now and again, e.g. when the ring has
+ * gone quiet.
+*/
+int experience_sweep(experience_T *);
+
+/* tells the workers to stop, and unlinks the ring so it goes once everyone detaches */
+void experience_close(experience_T *, const char *name);
+
+/*
+ * The workers' side. Maps the ring the trainer created and takes a free
+ * worker entry. Returns false if there isn't one, or no such ring.
+*/
+bool experience_join(experience_T *, const char *name);
+
+/*
+ * Copies `count` records (at most the ring's capacity) into the ring, with
+ * this worker's number, waiting for room if it's full. Returns false if
+ * the trainer is closing the ring, in which case they weren't written.
+*/
+bool experience_write(experience_T *, experience_record_T *, uint32_t count);
+
+/* marks this worker as finished, not crashed, and unmaps the ring */
+void experience_leave(experience_T *);
+
+/* unmaps the ring, e.g. in the trainer once it's closed */
+void experience_detach(experience_T *);
+
+/* `snake`'s view of the board, as the observation and apple fields of `record` */
+void experience_observe(const board_T *, int snake, experience_record_T *record);
+#endif
@@ -0,0 +1,423 @@
+/*
+ * Headless experience workers, and a trainer to run them against.
+ *
+ * Each worker is a process of its own playing the classic game on the
+ * game's board, over and over, with an epsilon-greedy player: it heads
+ * for the nearest apple without running into anything, but one move in
+ * EPSILON is random. Every move becomes a record in the shared ring (see
+ * experience.h).
+ *
+ * Run on its own it creates the ring, starts the workers and stands in for
+ * the trainer: it takes every record, checks that each worker's records
+ * come in order, reads every byte of them as a trainer would, and reports
+ * each worker's throughput every second. A worker killed along the way
+ * (e.g. `kill -9`) is reported as crashed, and the rest carry on.
+ *
+ * With "attach" it only runs workers, for a trainer that created the ring
+ * itself, until the trainer closes it.
+ *
+ * usage: experience_sim [seconds] [workers] [name]
+ *        experience_sim attach <name> [workers]
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include "experience.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+
+#define DEFAULT_NAME "/snake-experience"
+
+/* the game's board, which covers every cell a block fits into on a 640x475 screen */
+#define COLS 43
+#define ROWS 32
+
+#define CAPACITY 65536 /* records in the ring */
+#define BATCH    256   /* records a worker writes at a time */
+#define EPSILON  8
+
+/* records the trainer takes at a time, at most */
+#define TRAIN_BATCH 4096
+
+static double now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void pause_briefly(long ns)
+{
+	struct timespec ts = { 0, ns };
+	nanosleep(&ts, NULL);
+}
+
+static uint32_t next_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	
+	return *state = x;
+}
+
+/*
+ * Straight on, left or right, whichever is safe and closest to the apple,
+ * going by what the snake sees; now and again a random one instead.
+*/
+static turn_T choose(const experience_record_T *record, uint32_t *rng)
+{
+	if (next_rand(rng) % EPSILON == 0)
+		return next_rand(rng) % 3;
+	
+	const int radius = EXPERIENCE_VIEW / 2;
+	const uint8_t *seen = record->observation;
+	
+	uint8_t next[3] =
+	{
+		[TURN_NONE]  = seen[(radius - 1) * EXPERIENCE_VIEW + radius],
+		[TURN_LEFT]  = seen[radius * EXPERIENCE_VIEW + radius - 1],
+		[TURN_RIGHT] = seen[radius * EXPERIENCE_VIEW + radius + 1],
+	};
+	
+	int ahead = record->apple_ahead;
+	int right = record->apple_right;
+	
+	int distance[3] =
+	{
+		[TURN_NONE]  = abs(ahead - 1) + abs(right),
+		[TURN_LEFT]  = abs(ahead) + abs(right + 1),
+		[TURN_RIGHT] = abs(ahead) + abs(right - 1),
+	};
+	
+	turn_T best = TURN_NONE;
+	int best_distance = -1;
+	
+	for (int turn = 0; turn < 3; turn++)
+	{
+		bool solid = (next[turn] == SEEN_ROCK || next[turn] == SEEN_BODY || next[turn] == SEEN_OTHER_SNAKE);
+		
+		/* solid cells only if there's nothing else */
+		int score = distance[turn] + (solid ? 4 * (COLS + ROWS) : 0);
+		
+		if (best_distance == -1 || score < best_distance)
+		{
+			best = turn;
+			best_distance = score;
+		}
+	}
+	
+	return best;
+}
+
+/* plays games into the ring until the trainer closes it */
+static int run_worker(const char *name, uint32_t seed)
+{
+	experience_T experience;
+	
+	if (experience_join(&experience, name) == false)
+	{
+		fprintf(stderr, "couldn't join the ring %s\n", name);
+		return 1;
+	}
+	
+	experience_worker_T *worker = &experience.workers[experience.worker];
+	experience_record_T *batch = calloc(BATCH, sizeof(experience_record_T));
+	
+	board_config_T config;
+	board_default_config(&config, COLS, ROWS);
+	config.score_multiplier = speed_score_multiplier(2);
+	
+	uint32_t rng = seed;
+	uint32_t episode = 0;
+	int count = 0;
+	bool open = (batch != NULL);
+	
+	while (open)
+	{
+		board_T board;
+		
+		if (board_init(&board, &config, next_rand(&rng)) == false)
+			break;
+		
+		const snake_T *snake = &board.snake[0];
+		
+		for (uint32_t step = 0; snake->alive && open; step++)
+		{
+			experience_record_T *record = &batch[count++];
+			
+			experience_observe(&board, 0, record);
+			record->episode = episode;
+			record->step = step;
+			record->action = choose(record, &rng);
+			
+			int score = snake->score;
+			
+			board_turn(&board, 0, record->action);
+			board_tick(&board);
+			
+			record->reward = snake->score - score - (snake->alive ? 0 : EXPERIENCE_DEATH_PENALTY);
+			record->done = (snake->alive == false);
+			
+			if (count == BATCH)
+			{
+				open = experience_write(&experience, batch, count);
+				count = 0;
+			}
+		}
+		
+		board_free(&board);
+		
+		episode++;
+		__atomic_store_n(&worker->episodes, episode, __ATOMIC_RELAXED);
+	}
+	
+	free(batch);
+	experience_leave(&experience);
+	
+	return 0;
+}
+
+/* forks `num_workers` workers, returning how many started */
+static int start_workers(const char *name, int num_workers, pid_t *pids)
+{
+	uint32_t seed = (uint32_t) time(NULL);
+	
+	for (int i = 0; i < num_workers; i++)
+	{
+		pids[i] = fork();
+		
+		if (pids[i] == 0)
+			exit(run_worker(name, seed * 2654435761u + i + 1));
+		
+		if (pids[i] < 0)
+			return i;
+	}
+	
+	return num_workers;
+}
+
+typedef struct
+{
+	/* what each worker sent last, to check the next follows on */
+	uint32_t episode[EXPERIENCE_MAX_WORKERS];
+	uint32_t step[EXPERIENCE_MAX_WORKERS];
+	bool done[EXPERIENCE_MAX_WORKERS];
+	bool seen[EXPERIENCE_MAX_WORKERS];
+	
+	uint64_t records;
+	uint64_t out_of_order;
+	uint64_t checksum;
+} trainer_T;
+
+/* what a trainer does with a batch, as far as the memory's concerned: reads all of it */
+static void train(trainer_T *trainer, const experience_record_T *records, uint32_t count)
+{
+	uint64_t sum = 0;
+	
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const experience_record_T *record = &records[i];
+		
+		if (record->flags & EXPERIENCE_ABANDONED)
+			continue;
+		
+		uint32_t w = record->worker % EXPERIENCE_MAX_WORKERS;
+		
+		/* a worker's records follow on, or start a new episode after the last one ended */
+		if (trainer->seen[w])
+		{
+			bool next_step    = (record->episode == trainer->episode[w] && record->step == trainer->step[w] + 1);
+			bool next_episode = (trainer->done[w] && record->step == 0);
+			
+			if (next_step == false && next_episode == false)
+				trainer->out_of_order++;
+		}
+		
+		trainer->seen[w]    = true;
+		trainer->episode[w] = record->episode;
+		trainer->step[w]    = record->step;
+		trainer->done[w]    = record->done;
+		
+		for (int j = 0; j < EXPERIENCE_VIEW * EXPERIENCE_VIEW; j++)
+			sum += record->observation[j];
+		
+		sum += record->reward + record->action;
+	}
+	
+	trainer->records += count;
+	trainer->checksum += sum;
+}
+
+static const char *state_name(uint32_t state)
+{
+	switch (state)
+	{
+		case WORKER_JOINING: return "joining";
+		case WORKER_RUNNING: return "running";
+		case WORKER_EXITED:  return "exited";
+		case WORKER_CRASHED: return "crashed";
+		default:             return "free";
+	}
+}
+
+/* each worker's throughput since the last report */
+static void report(const experience_T *experience, uint64_t *last_records, int64_t *last_stalled, double elapsed)
+{
+	for (int i = 0; i < EXPERIENCE_MAX_WORKERS; i++)
+	{
+		const experience_worker_T *worker = &experience->workers[i];
+		uint32_t state = __atomic_load_n(&worker->state, __ATOMIC_ACQUIRE);
+		
+		if (state == WORKER_FREE)
+			continue;
+		
+		uint64_t records = __atomic_load_n(&worker->records, __ATOMIC_RELAXED);
+		int64_t stalled  = __atomic_load_n(&worker->stalled_ns, __ATOMIC_RELAXED);
+		
+		printf("  worker %2d (pid %6d, %-7s): %9.0f records/s, %7.1f MB/s, %5.1f%% stalled, %llu episodes\n",
+			i, (int) worker->pid, state_name(state),
+			(records - last_records[i]) / elapsed,
+			(records - last_records[i]) * sizeof(experience_record_T) / elapsed / 1e6,
+			(stalled - last_stalled[i]) / (elapsed * 1e7),
+			(unsigned long long) __atomic_load_n(&worker->episodes, __ATOMIC_RELAXED));
+		
+		last_records[i] = records;
+		last_stalled[i] = stalled;
+	}
+}
+
+static int run_trainer(const char *name, double seconds, int num_workers)
+{
+	experience_T experience;
+	
+	if (experience_create(&experience, name, CAPACITY) == false)
+	{
+		fprintf(stderr, "couldn't create the ring %s\n", name);
+		return 1;
+	}
+	
+	pid_t *pids = calloc(num_workers, sizeof(pid_t));
+	num_workers = start_workers(name, num_workers, pids);
+	
+	printf("%d workers writing %zu byte records into %s (%u slots)\n",
+		num_workers, sizeof(experience_record_T), name, experience.header->capacity);
+	
+	trainer_T trainer;
+	memset(&trainer, 0, sizeof(trainer));
+	
+	uint64_t last_records[EXPERIENCE_MAX_WORKERS] = { 0 };
+	int64_t last_stalled[EXPERIENCE_MAX_WORKERS] = { 0 };
+	
+	int crashed = 0;
+	double start = now();
+	double last_report = start;
+	uint64_t reported_records = 0;
+	
+	while (now() - start < seconds)
+	{
+		const experience_record_T *records;
+		uint32_t count = experience_acquire(&experience, TRAIN_BATCH, &records);
+		
+		if (count > 0)
+		{
+			train(&trainer, records, count);
+			experience_release(&experience, count);
+		}
+		else
+		{
+			/*
+			 * Nothing to read: a worker is mid-copy, or one has died holding
+			 * slots. Dead workers are reaped first, as the sweep can't tell a
+			 * zombie from a worker that's running.
+			*/
+			while (waitpid(-1, NULL, WNOHANG) > 0)
+				;
+			
+			crashed += experience_sweep(&experience);
+			pause_briefly(20000);
+		}
+		
+		double elapsed = now() - last_report;
+		
+		if (elapsed >= 1)
+		{
+			printf("%.0fs: %.0f records/s, %.1f MB/s taken\n", now() - start,
+				(trainer.records - reported_records) / elapsed,
+				(trainer.records - reported_records) * sizeof(experience_record_T) / elapsed / 1e6);
+			
+			report(&experience, last_records, last_stalled, elapsed);
+			
+			reported_records = trainer.records;
+			last_report = now();
+		}
+	}
+	
+	double elapsed = now() - start;
+	
+	experience_close(&experience, name);
+	
+	for (int i = 0; i < num_workers; i++)
+		waitpid(pids[i], NULL, 0);
+	
+	crashed += experience_sweep(&experience);
+	
+	printf("%llu records in %.1fs: %.0f records/s, %.1f MB/s; %llu abandoned, %d workers crashed, "
+	       "%llu out of order (checksum %llx)\n",
+		(unsigned long long) trainer.records, elapsed, trainer.records / elapsed,
+		trainer.records * sizeof(experience_record_T) / elapsed / 1e6,
+		(unsigned long long) experience.header->abandoned, crashed,
+		(unsigned long long) trainer.out_of_order, (unsigned long long) trainer.checksum);
+	
+	int status = (trainer.out_of_order == 0 ? 0 : 1);
+	
+	experience_detach(&experience);
+	free(pids);
+	
+	return status;
+}
+
+int main(int argc, const char *argv[])
+{
+	if (argc > 1 && strcmp(argv[1], "attach") == 0)
+	{
+		if (argc < 3)
+		{
+			printf("usage: %s attach <name> [workers]\n", argv[0]);
+			return 1;
+		}
+		
+		int num_workers = (argc > 3 ? atoi(argv[3]) : (int) sysconf(_SC_NPROCESSORS_ONLN) - 1);
+		
+		if (num_workers < 1)
+			num_workers = 1;
+		
+		pid_t *pids = calloc(num_workers, sizeof(pid_t));
+		
+		num_workers = start_workers(argv[2], num_workers, pids);
+		
+		for (int i = 0; i < num_workers; i++)
+			waitpid(pids[i], NULL, 0);
+		
+		free(pids);
+		return 0;
+	}
+	
+	double seconds  = (argc > 1 ? atof(argv[1]) : 10);
+	int num_workers = (argc > 2 ? atoi(argv[2]) : (int) sysconf(_SC_NPROCESSORS_ONLN) - 1);
+	const char *name = (argc > 3 ? argv[3] : DEFAULT_NAME);
+	
+	if (num_workers < 1)
+		num_workers = 1;
+	
+	if (num_workers > EXPERIENCE_MAX_WORKERS)
+		num_workers = EXPERIENCE_MAX_WORKERS;
+	
+	return run_trainer(name, seconds, num_workers);
+}
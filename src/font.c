@@ -0,0 +1,190 @@
+#include "font.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+font_T *open_font(int size)
+{
+	font_T *font = malloc(sizeof(font_T));
+	
+	font->size = size;
+	font->atlas = asset_cache_font(size);
+	font->ttf = NULL;
+	
+	if (font->atlas == NULL)
+	{
+		TRACE_SCOPE("TTF_OpenFont");
+		font->ttf = TTF_OpenFont(FONT_FILE, size);
+	}
+	
+	return font;
+}
+
+void close_font(font_T *font)
+{
+	if (font->ttf != NULL)
+		TTF_CloseFont(font->ttf);
+	
+	free(font);
+}
+
+/* the font file, for text the atlas can't draw */
+static TTF_Font *fallback(font_T *font)
+{
+	if (font->ttf == NULL)
+	{
+		TRACE_SCOPE("TTF_OpenFont");
+		font->ttf = TTF_OpenFont(FONT_FILE, font->size);
+	}
+	
+	return font->ttf;
+}
+
+/*
+ * Lays the text out from the atlas into a coverage map, one byte per pixel.
+ * Returns NULL if there's no atlas or it lacks one of the characters.
+*/
+static uint8_t *compose(const font_T *font, const char *text, int *w, int *h)
+{
+	const cached_font_T *atlas = font->atlas;
+	if (atlas == NULL)
+		return NULL;
+	
+	int pen = 0;
+	int left = 0;
+	int right = 0;
+	
+	for (const char *c = text; *c != '\0'; c++)
+	{
+		if (*c < FIRST_GLYPH || *c >= FIRST_GLYPH + NUM_GLYPHS)
+			return NULL;
+		
+		const cached_glyph_T *glyph = &atlas->glyph[*c - FIRST_GLYPH];
+		
+		if (pen + glyph->xoffset < left)
+			left = pen + glyph->xoffset;
+		
+		if (pen + glyph->xoffset + glyph->w > right)
+			right = pen + glyph->xoffset + glyph->w;
+		
+		pen += glyph->advance;
+	}
+	
+	*w = (right > pen ? right : pen) - left;
+	*h = atlas->height;
+	
+	if (*w <= 0 || *h <= 0)
+		return NULL;
+	
+	uint8_t *coverage = calloc((size_t) *w * *h, 1);
+	if (coverage == NULL)
+		return NULL;
+	
+	pen = -left;
+	
+	for (const char *c = text; *c != '\0'; c++)
+	{
+		const cached_glyph_T *glyph = &atlas->glyph[*c - FIRST_GLYPH];
+		const uint8_t *src = asset_cache_coverage(glyph);
+		
+		int x0 = pen + glyph->xoffset;
+		int rows = (glyph->h < *h ? glyph->h : *h);
+		
+		/* glyphs can overlap a little, where the darker one wins */
+		for (int y = 0; y < rows; y++)
+		{
+			uint8_t *dst = coverage + y * *w + x0;
+			
+			for (int x = 0; x < glyph->w; x++)
+				if (src[y * glyph->w + x] > dst[x])
+					dst[x] = src[y * glyph->w + x];
+		}
+		
+		pen += glyph->advance;
+	}
+	
+	return coverage;
+}
+
+SDL_Surface *render_text_blended(font_T *font, const char *text, SDL_Color colour)
+{
+	/* SDL_ttf doesn't render empty text either */
+	if (text[0] == '\0')
+		return NULL;
+	
+	TRACE_SCOPE("render_text_blended");
+	
+	int w, h;
+	uint8_t *coverage = compose(font, text, &w, &h);
+	
+	if (coverage == NULL)
+		return TTF_RenderText_Blended(fallback(font), text, colour);
+	
+	SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE | SDL_SRCALPHA, w, h, 32,
+		0x00FF0000, 0x0000FF00, 0x000000FF, 0xFF000000);
+	
+	if (surface != NULL)
+	{
+		Uint32 rgb = ((Uint32) colour.r << 16) | ((Uint32) colour.g << 8) | colour.b;
+		
+		SDL_LockSurface(surface);
+		
+		for (int y = 0; y < h; y++)
+		{
+			Uint32 *row = (Uint32 *) ((uint8_t *) surface->pixels + y * surface->pitch);
+			
+			for (int x = 0; x < w; x++)
+				row[x] = ((Uint32) coverage[y * w + x] << 24) | rgb;
+		}
+		
+		SDL_UnlockSurface(surface);
+	}
+	
+	free(coverage);
+	return surface;
+}
+
+SDL_Surface *render_text_shaded(font_T *font, const char *text, SDL_Color fg, SDL_Color bg)
+{
+	/* SDL_ttf doesn't render empty text either */
+	if (text[0] == '\0')
+		return NULL;
+	
+	TRACE_SCOPE("render_text_shaded");
+	
+	int w, h;
+	uint8_t *coverage = compose(font, text, &w, &h);
+	
+	if (coverage == NULL)
+		return TTF_RenderText_Shaded(fallback(font), text, fg, bg);
+	
+	SDL_Surface *surface = SDL_CreateRGBSurface(SDL_SWSURFACE, w, h, 32,
+		0x00FF0000, 0x0000FF00, 0x000000FF, 0);
+	
+	if (surface != NULL)
+	{
+		SDL_LockSurface(surface);
+		
+		for (int y = 0; y < h; y++)
+		{
+			Uint32 *row = (Uint32 *) ((uint8_t *) surface->pixels + y * surface->pitch);
+			
+			for (int x = 0; x < w; x++)
+			{
+				int a = coverage[y * w + x];
+				
+				Uint32 r = (fg.r * a + bg.r * (255 - a)) / 255;
+				Uint32 g = (fg.g * a + bg.g * (255 - a)) / 255;
+				Uint32 b = (fg.b * a + bg.b * (255 - a)) / 255;
+				
+				row[x] = (r << 16) | (g << 8) | b;
+			}
+		}
+		
+		SDL_UnlockSurface(surface);
+	}
+	
+	free(coverage);
+	return surface;
+}
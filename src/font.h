@@ -0,0 +1,28 @@
+#ifndef FONT_H
+#define FONT_H
+
+#include "assetcache.h"
+
+#include <SDL/SDL.h>
+#include <SDL/SDL_ttf.h>
+
+/*
+ * The game's font at one size. Text is put together from the asset
+ * cache's pre-rasterised glyphs when it has them, and the font file is
+ * only opened for anything the cache can't draw.
+*/
+typedef struct
+{
+	int size;
+	
+	const cached_font_T *atlas; /* NULL without a cache */
+	TTF_Font *ttf;              /* NULL until needed, if there's an atlas */
+} font_T;
+
+font_T *open_font(int size);
+void close_font(font_T *);
+
+/* as `TTF_RenderText_Blended()` and `TTF_RenderText_Shaded()` */
+SDL_Surface *render_text_blended(font_T *, const char *, SDL_Color);
+SDL_Surface *render_text_shaded (font_T *, const char *, SDL_Color fg, SDL_Color bg);
+#endif
@@ -0,0 +1,211 @@
+#include "framebuffer.h"
+#include "board.h"
+#include "trace.h"
+
+/* the gaps between cells, right of and below their blocks */
+#define GAP (CELL_SIZE - BLOCK_SIZE - 1)
+
+static void paint_cell(framebuffer_T *, SDL_Surface *screen, uint32_t cell, uint8_t contents,
+                       const uint32_t *mapped, bool direct);
+
+size_t framebuffer_memory_size(int cols, int rows)
+{
+	return arena_size((size_t) cols * rows) * 3;
+}
+
+void framebuffer_init_in(framebuffer_T *frame, int cols, int rows, int scale, SDL_Surface *background, arena_T *arena)
+{
+	size_t num_cells = (size_t) cols * rows;
+	
+	frame->cols = cols;
+	frame->rows = rows;
+	frame->scale = scale;
+	frame->background = background;
+	
+	frame->cells = arena_alloc(arena, num_cells);
+	frame->shown[0] = arena_alloc(arena, num_cells);
+	frame->shown[1] = arena_alloc(arena, num_cells);
+	
+	framebuffer_clear(frame);
+	
+	frame->valid[0] = false;
+	frame->valid[1] = false;
+	
+	memset(frame->palette, 0, sizeof(frame->palette));
+}
+
+void framebuffer_present(framebuffer_T *frame, SDL_Surface *screen, int buffer)
+{
+	TRACE_SCOPE("framebuffer_present");
+	
+	size_t num_cells = (size_t) frame->cols * frame->rows;
+	uint8_t *shown = frame->shown[buffer];
+	uint32_t *shown_palette = frame->shown_palette[buffer];
+	
+	/* what's there is anyone's guess, so start again from the background */
+	if (frame->valid[buffer] == false)
+	{
+		SDL_BlitSurface(frame->background, NULL, screen, NULL);
+		memset(shown, 0, num_cells);
+		memset(shown_palette, 0, sizeof(frame->shown_palette[buffer]));
+	}
+	
+	uint32_t mapped[FRAMEBUFFER_COLOURS];
+	bool swapped[FRAMEBUFFER_COLOURS];
+	
+	for (int i = 0; i < FRAMEBUFFER_COLOURS; i++)
+	{
+		uint32_t colour = frame->palette[i];
+		
+		mapped[i] = SDL_MapRGB(screen->format, colour >> 24, colour >> 16, colour >> 8);
+		swapped[i] = (colour != shown_palette[i]);
+	}
+	
+	/* pixels are written straight in when the background's in the screen's format, else blitted */
+	const SDL_PixelFormat *format = screen->format;
+	const SDL_PixelFormat *background = frame->background->format;
+	
+	bool direct = (format->BytesPerPixel == 4 && background->BytesPerPixel == 4 &&
+	               format->Rmask == background->Rmask && format->Gmask == background->Gmask &&
+	               format->Bmask == background->Bmask);
+	
+	if (direct && SDL_MUSTLOCK(screen))
+		direct = (SDL_LockSurface(screen) == 0);
+	
+	for (size_t i = 0; i < num_cells; i++)
+	{
+		uint8_t contents = frame->cells[i];
+		
+		if (contents == shown[i] && swapped[FRAMEBUFFER_COLOUR(contents)] == false)
+			continue;
+		
+		paint_cell(frame, screen, i, contents, mapped, direct);
+		shown[i] = contents;
+	}
+	
+	if (direct && SDL_MUSTLOCK(screen))
+		SDL_UnlockSurface(screen);
+	
+	memcpy(shown_palette, frame->palette, sizeof(frame->palette));
+	frame->valid[buffer] = true;
+}
+
+void framebuffer_damage(framebuffer_T *frame, int buffer, const SDL_Rect *region)
+{
+	if (frame->valid[buffer] == false)
+		return;
+	
+	/* every cell whose square, gaps and all, the region touches */
+	int cell_size = CELL_SIZE * frame->scale;
+	
+	int x0 = region->x / cell_size;
+	int y0 = region->y / cell_size;
+	int x1 = (region->x + region->w - 1) / cell_size;
+	int y1 = (region->y + region->h - 1) / cell_size;
+	
+	/* and the cells left of and above it, whose gaps it may cover */
+	x0 = (x0 > 0 ? x0 - 1 : 0);
+	y0 = (y0 > 0 ? y0 - 1 : 0);
+	x1 = (x1 < frame->cols - 1 ? x1 : frame->cols - 1);
+	y1 = (y1 < frame->rows - 1 ? y1 : frame->rows - 1);
+	
+	for (int y = y0; y <= y1; y++)
+		for (int x = x0; x <= x1; x++)
+			frame->shown[buffer][y * frame->cols + x] = FRAMEBUFFER_UNKNOWN;
+}
+
+/* `rect` clipped to the surface; false if nothing's left of it */
+static bool clip(const SDL_Surface *surface, SDL_Rect *rect, int x, int y, int w, int h)
+{
+	if (x + w > surface->w)
+		w = surface->w - x;
+	if (y + h > surface->h)
+		h = surface->h - y;
+	
+	if (w <= 0 || h <= 0)
+		return false;
+	
+	rect->x = x;
+	rect->y = y;
+	rect->w = w;
+	rect->h = h;
+	
+	return true;
+}
+
+static void fill(SDL_Surface *screen, SDL_Rect *rect, uint32_t colour, bool direct)
+{
+	if (direct == false)
+	{
+		SDL_FillRect(screen, rect, colour);
+		return;
+	}
+	
+	for (int y = 0; y < rect->h; y++)
+	{
+		uint32_t *row = (uint32_t *) ((uint8_t *) screen->pixels + (rect->y + y) * screen->pitch) + rect->x;
+		
+		for (int x = 0; x < rect->w; x++)
+			row[x] = colour;
+	}
+}
+
+static void restore(framebuffer_T *frame, SDL_Surface *screen, SDL_Rect *rect, bool direct)
+{
+	SDL_Surface *background = frame->background;
+	
+	if (direct == false)
+	{
+		SDL_Rect dst = *rect;
+		SDL_BlitSurface(background, rect, screen, &dst);
+		return;
+	}
+	
+	for (int y = 0; y < rect->h; y++)
+	{
+		uint8_t *to = (uint8_t *) screen->pixels + (rect->y + y) * screen->pitch + rect->x * 4;
+		const uint8_t *from = (const uint8_t *) background->pixels + (rect->y + y) * background->pitch + rect->x * 4;
+		
+		memcpy(to, from, rect->w * 4);
+	}
+}
+
+/* the cell's block and the gaps after it, in its colour or the background, and the corner between */
+static void paint_cell(framebuffer_T *frame, SDL_Surface *screen, uint32_t cell, uint8_t contents,
+                       const uint32_t *mapped, bool direct)
+{
+	int block = (BLOCK_SIZE + 1) * frame->scale;
+	int gap = GAP * frame->scale;
+	
+	int x = cell % frame->cols * CELL_SIZE * frame->scale;
+	int y = cell / frame->cols * CELL_SIZE * frame->scale;
+	int colour = FRAMEBUFFER_COLOUR(contents);
+	SDL_Rect rect;
+	
+	if (clip(screen, &rect, x, y, block, block))
+	{
+		if (colour != 0)
+			fill(screen, &rect, mapped[colour], direct);
+		else
+			restore(frame, screen, &rect, direct);
+	}
+	
+	if (clip(screen, &rect, x + block, y, gap, block))
+	{
+		if (colour != 0 && (contents & FRAMEBUFFER_JOIN_RIGHT))
+			fill(screen, &rect, mapped[colour], direct);
+		else
+			restore(frame, screen, &rect, direct);
+	}
+	
+	if (clip(screen, &rect, x, y + block, block, gap))
+	{
+		if (colour != 0 && (contents & FRAMEBUFFER_JOIN_DOWN))
+			fill(screen, &rect, mapped[colour], direct);
+		else
+			restore(frame, screen, &rect, direct);
+	}
+	
+	if (clip(screen, &rect, x + block, y + block, gap, gap))
+		restore(frame, screen, &rect, direct);
+}
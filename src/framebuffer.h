@@ -0,0 +1,88 @@
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "arena.h"
+
+#include <SDL/SDL.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/*
+ * The board's picture as a byte per cell: an index into a palette of a
+ * few flat colours, and whether the gap to the next cell right or down is
+ * filled in too (between two cells of a snake's run). A frame is drawn by
+ * setting the cells, then `framebuffer_present()` converts it to the
+ * screen's format in one pass, writing only the cells that differ from
+ * what that buffer of the screen already shows, or whose colour changed in
+ * the palette. So changing a colour everywhere it's used (a snake going
+ * pink with reversed controls) is only a palette change, and a tick where
+ * the snake moves costs a few cells however big the board.
+ *
+ * With a double buffered screen each buffer is tracked on its own, as
+ * either may be drawn into next (see present.h). Anything else drawn over
+ * the cells (the score, messages) has to be marked with
+ * `framebuffer_damage()`, so those cells are painted again next time.
+ *
+ * Cells are painted `scale` times their size in pixels, blocks and gaps
+ * alike, over a background that's already been scaled to match.
+*/
+
+#define FRAMEBUFFER_COLOURS 64 /* the last is kept back, see FRAMEBUFFER_UNKNOWN */
+
+#define FRAMEBUFFER_JOIN_RIGHT 0x40
+#define FRAMEBUFFER_JOIN_DOWN  0x80
+#define FRAMEBUFFER_COLOUR(c)  ((c) & 0x3F)
+
+/* shown for a cell whose pixels aren't known, so it's never what's wanted */
+#define FRAMEBUFFER_UNKNOWN 0xFF
+
+typedef struct
+{
+	int cols;
+	int rows;
+	int scale;
+	
+	uint8_t *cells;    /* the frame being drawn */
+	uint8_t *shown[2]; /* what each of the screen's buffers shows */
+	bool valid[2];     /* whether `shown` is known at all, e.g. not after a menu */
+	
+	uint32_t palette[FRAMEBUFFER_COLOURS]; /* 0xRRGGBBAA, as for SDL_gfx; colour 0 is the background */
+	uint32_t shown_palette[2][FRAMEBUFFER_COLOURS];
+	
+	SDL_Surface *background; /* what colour 0 and the gaps show */
+} framebuffer_T;
+
+size_t framebuffer_memory_size(int cols, int rows);
+
+/* every cell starts off background, and nothing is taken as shown yet */
+void framebuffer_init_in(framebuffer_T *, int cols, int rows, int scale, SDL_Surface *background, arena_T *);
+
+static inline void framebuffer_clear(framebuffer_T *frame)
+{
+	memset(frame->cells, 0, (size_t) frame->cols * frame->rows);
+}
+
+static inline void framebuffer_set(framebuffer_T *frame, uint32_t cell, uint8_t colour)
+{
+	frame->cells[cell] = colour;
+}
+
+static inline void framebuffer_join(framebuffer_T *frame, uint32_t cell, uint8_t join)
+{
+	frame->cells[cell] |= join;
+}
+
+/* a cell's colour, keeping its joins */
+static inline void framebuffer_recolour(framebuffer_T *frame, uint32_t cell, uint8_t colour)
+{
+	frame->cells[cell] = (frame->cells[cell] & ~0x3F) | colour;
+}
+
+/* converts the frame into the screen's buffer number `buffer` */
+void framebuffer_present(framebuffer_T *, SDL_Surface *screen, int buffer);
+
+/* something else was drawn over `region` (in pixels) of buffer number `buffer` */
+void framebuffer_damage(framebuffer_T *, int buffer, const SDL_Rect *region);
+#endif
@@ -1,741 +1,1232 @@
 #include "game.h"
 #include "sdlhelperfuncs.h"
 #include "globals.h"
+#include "board.h"
+#include "framebuffer.h"
+#include "lookahead.h"
+#include "planner.h"
+#include "replay.h"
+#include "rewind.h"
+#include "arena.h"
+#include "highscores.h"
+#include "latency.h"
+#include "present.h"
+#include "scene.h"
+#include "telemetry.h"
+#include "trace.h"
 
 #include <SDL/SDL.h>
 #include <SDL/SDL_image.h>
-#include <SDL/SDL_gfxPrimitives.h>
 #include <SDL/SDL_ttf.h>
 #include <time.h>
 #include <stdbool.h>
+#include <unistd.h>
 
-/* time in number of snake moves (aka. game ticks) */
-const int POWERUP_FREQUENCY = 150;
-const int POWERUP_DURATION = 75;
+/* number of bot snakes sharing the board in arena mode */
+#define ARENA_BOTS 7
 
-/* size to grow snake by when food consumed */
-const int SNAKE_LENGTH_INCREMENT = 3;
+/* share of the time between ticks the autopilot spends choosing a move */
+#define AUTOPILOT_BUDGET_PERCENT 50
 
-#define NUM_APPLES 3
-#define MAX_SNAKE_SIZE 400
+#define TELEMETRY_PATH "telemetry.log"
+
+/* how far back practice games can be rewound, and the room to do it in */
+#define REWIND_SECONDS 60
+#define REWIND_BYTES   (64 * 1024)
 
 typedef struct
 {
-	int x;
-	int y;
-} xy_T;
+	board_T board;
+	framebuffer_T frame;
+	bool stale; /* the board has changed since the frame's cells were set */
+	replay_writer_T replay;
+	rewind_T rewind; /* practice games only */
+} game_T;
 
-typedef struct
+/* the board's palette: a head and body colour per snake after the rest, up to 28 snakes */
+enum { COLOUR_BACKGROUND, COLOUR_APPLE, COLOUR_ROCK, COLOUR_BANANA, COLOUR_GRAPE, COLOUR_MYSTERY, COLOUR_SNAKES };
+
+/* what can be done once a game's over, each line of the game over screen */
+#define NUM_END_OPTIONS 5
+
+/*
+ * Surfaces every game uses, loaded by the first game and kept until
+ * `clean_up_game_assets()`. The score is drawn from pre-rendered digits so
+ * a changing score never renders text mid-game.
+*/
+static struct
 {
-	int x;
-	int y;
-	
-	bool active;
+	bool loaded;
 	
-	int type;
+	SDL_Surface *game_bg;
+	SDL_Surface *digits[10];
 	
-	int time_until_active;
-	int time_active;
-} powerup_T;
+	SDL_Surface *go_msg;
+	SDL_Surface *paused_msg;
+	SDL_Surface *rewind_msg;
+	SDL_Surface *end_options[NUM_END_OPTIONS];
+} assets;
 
-typedef struct
+/* backs everything that lives as long as a game, reset between games */
+static arena_T game_arena;
+
+/* where the last game played was recorded, empty if it wasn't */
+static char last_replay[64];
+
+/* practice games can be rewound, so they aren't recorded or ranked */
+static bool practising;
+
+/*
+ * The game going on, and what its scene needs to keep from one pass of the
+ * loop to the next (see scene.h).
+*/
+static struct
 {
-	SDL_Surface *game_bg;
-	SDL_Surface *score_display;
+	game_T *game; /* NULL between games */
+	int num_bots; /* as the game was started, for playing again */
 	
-	/*
-	 * For keeping track of which direction the snake is moving.
-	 * Will be reversed when the snake eats a bad powerup.
-	*/
-	int snake_x_vel;
-	int snake_y_vel;
-	int old_snake_x_vel;
-	int old_snake_y_vel;
+	clock_t move_timer; /* when the next tick's due */
+	clock_t paused_for; /* what was left of the wait for the tick when it was paused */
+	clock_t next_step;  /* of rewinding */
 	
-	bool controls_reversed;
+	bool autopilot_on;
+	bool planner_on;
+	bool choose_next; /* an autopilot has the move after the tick just shown to choose */
 	
-	int num_rocks;
-	xy_T rock[400];
+	SDL_Surface *message; /* over the board, "Go!" until the first tick */
+	SDL_Surface *end_message;
 	
-	int snake_length;
-	int pending_snake_segments;
+	bool over;
+	bool died; /* for `run_latency_game()` */
+} play;
+
+/* the replay being watched */
+static struct
+{
+	game_T *game;
+	replay_reader_T reader;
+	replay_cursor_T cursor;
 	
-	xy_T snake[MAX_SNAKE_SIZE];
-	xy_T apple[NUM_APPLES];
+	bool paused;
+	clock_t move_timer;
+} watching;
+
+/*
+ * The Monte Carlo player, started the first time "o" is pressed in a game,
+ * and the Hamiltonian cycle one, set up for the game's board the first
+ * time "h" is. Games either played any of don't go on the leaderboard.
+*/
+static struct
+{
+	bool started;
+	bool played;
+	lookahead_T lookahead;
 	
-	powerup_T powerup;
-} game_T;
+	bool planning; /* the planner is set up for the game going on */
+	planner_T planner;
+} autopilot;
 
-/* 
- * Returns NULL on GAME_OVER, or a nav_vars_T if the user explicitly chooses
- * a navigation value.
+/*
+ * The telemetry log, opened by the first game, and the details every
+ * record of the game going on is logged with.
 */
-static nav_vars_T *start_game(void);
+static struct
+{
+	bool opened;
+	telemetry_T log;
+	
+	telemetry_record_T game;
+	clock_t start;
+	
+	bool logging; /* the game going on, which the latency harness's aren't */
+} telemetry;
 
-static nav_vars_T end_game(void);
+static void open_play(int num_bots, bool practice);
+static void start_game(int num_bots, bool practice);
+static void choose_move(game_T *);
+static void end_game(void);
+static void load_game_assets(void);
+static game_T *new_game(const board_config_T *, const replay_header_T *);
 static void draw_game(game_T *);
+static void draw_over(game_T *, SDL_Surface *, int x, int y);
+static void draw_message(game_T *, SDL_Surface *message);
 static void clean_up_game(game_T *);
+static void toggle_autopilot(game_T *, bool *on);
+static void toggle_planner(game_T *, bool *on);
+
+static void game_event(scene_T *, const SDL_Event *);
+static void game_update(scene_T *, clock_t now);
+static void game_draw(scene_T *);
+static void game_presented(scene_T *);
+static void game_leave(scene_T *);
+
+static void pause_event(scene_T *, const SDL_Event *);
+static void pause_draw(scene_T *);
 
-static void handle_input(game_T *game, int multiplier);
+static void rewind_event(scene_T *, const SDL_Event *);
+static void rewind_update(scene_T *, clock_t now);
+static void rewind_draw(scene_T *);
 
-static void add_rock(game_T *);
-static void add_food(game_T *, int);
-static void add_power_up(game_T *);
+static void end_event(scene_T *, const SDL_Event *);
+static void end_draw(scene_T *);
+static void end_leave(scene_T *);
+
+static void watch_event(scene_T *, const SDL_Event *);
+static void watch_update(scene_T *, clock_t now);
+static void watch_draw(scene_T *);
+static void watch_leave(scene_T *);
+
+/*
+ * A game, and what goes over it when it stops: paused, rewinding after
+ * dying in practice, and the game over screen. The game stays under them
+ * as it was last drawn.
+*/
+static scene_T game_scene =
+{
+	.opaque = true, .event = game_event, .update = game_update, .draw = game_draw,
+	.presented = game_presented, .leave = game_leave
+};
+
+static scene_T pause_scene  = { .event = pause_event, .draw = pause_draw };
+static scene_T rewind_scene = { .event = rewind_event, .update = rewind_update, .draw = rewind_draw };
+static scene_T end_scene    = { .event = end_event, .draw = end_draw, .leave = end_leave };
+
+static scene_T watch_scene =
+{
+	.opaque = true, .event = watch_event, .update = watch_update, .draw = watch_draw, .leave = watch_leave
+};
+
+static telemetry_record_T game_record(const board_T *, telemetry_kind_T, uint32_t cell);
+static void log_game_start(const board_T *, const replay_header_T *);
+static void log_tick(const board_T *, int64_t tick_time);
+static void log_game_end(const board_T *, bool quit);
 
 /* returns -1 on no new highscore set, else returns position of new highscore */
 static int highscores_io(void);
 
-nav_vars_T run_game()
+void open_game(void)
+{
+	open_play(0, false);
+}
+
+void open_arena(void)
+{
+	open_play(ARENA_BOTS, false);
+}
+
+void open_practice(void)
 {
-	nav_vars_T *navigation = start_game();
+	open_play(0, true);
+}
+
+/* no end screen, as nobody's watching */
+bool run_latency_game(void)
+{
+	start_game(0, false);
+	play.died = false;
 	
-	if (navigation == NULL)
-		return end_game();
+	scene_push(&game_scene);
+	scene_run();
 	
-	nav_vars_T ret = *navigation;
-	free(navigation);
-	return ret;
+	return play.died == false;
 }
 
-static nav_vars_T *start_game(void)
+static void open_play(int num_bots, bool practice)
 {
-	game_T *game = malloc(sizeof(game_T));
+	start_game(num_bots, practice);
+	scene_push(&game_scene);
+}
+
+/* sets a new game going, in place of any there was */
+static void start_game(int num_bots, bool practice)
+{
+	load_game_assets();
 	
-	/* initialise the game structure variables */
-	game->snake_x_vel = 15;
-	game->snake_y_vel = 0;
-	game->old_snake_x_vel = 15;
-	game->old_snake_y_vel = 0;
+	if (play.game != NULL)
+		clean_up_game(play.game);
 	
-	game->num_rocks = 0;
+	/* the board covers every cell a block fits into on screen */
+	board_config_T config;
+	board_default_config(&config,
+		(SCREEN_WIDTH  - BLOCK_SIZE) / CELL_SIZE + 1,
+		(SCREEN_HEIGHT - BLOCK_SIZE) / CELL_SIZE + 1);
 	
-	game->controls_reversed = false;
+	config.num_snakes += num_bots;
+	config.score_multiplier = score_multiplier;
 	
-	#define STARTING_SNAKE_LEN 4
-	game->snake_length = STARTING_SNAKE_LEN;
-	game->pending_snake_segments = 0;
+	practising = practice;
 	
-	/* set up the snake */
-	for (int i = 0, j = 195; i < STARTING_SNAKE_LEN; i++)
-	{
-		game->snake[i].x = j;
-		game->snake[i].y = 195;
-		
-		j -= 15;
-	}
+	/* record the game so it can be watched back, unless it can be rewound or it's the latency harness's */
+	replay_header_T header = { rand(), speed_human, REPLAY_KEYFRAME_INTERVAL, config };
 	
-	/* pick random apple starting positions */
-	for (int i = 0; i < NUM_APPLES; i++)
+	if (practising || latency_enabled)
+		last_replay[0] = '\0';
+	else
 	{
-		game->apple[i].x = ((rand() %(SCREEN_WIDTH / 10)) * 10);
-		game->apple[i].y = ((rand() %(SCREEN_HEIGHT / 10)) * 10);
-		game->apple[i].x = game->apple[i].x - (game->apple[i].x % 15);
-		game->apple[i].y = game->apple[i].y - (game->apple[i].y % 15);
+		/* unique to this game even if another starts the same second, here or in another instance */
+		static int games_recorded = 0;
+		
+		snprintf(last_replay, sizeof(last_replay), "replays/%ld-%ld-%d.snr",
+			(long) time(NULL), (long) getpid(), games_recorded++);
 	}
 	
-	/* set up the powerup */
-	game->powerup.time_until_active = POWERUP_FREQUENCY;
-	game->powerup.active = false;
-	game->powerup.time_active = 0;
-	
-	/* load the score text */
-	game->score_display = TTF_RenderText_Blended(font_small, "0", black_colour);
-	
-	/* load the images */
-	game->game_bg = load_image("images/game_bg.png");
-	
-	draw_game(game);
+	play.game = new_game(&config, &header);
+	play.num_bots = num_bots;
+	log_game_start(&play.game->board, &header);
 	
 	/* reset the score */
 	score = 0;
 	
-	/* holds the score as a string for display */
-	#define SCORE_STRING_LEN 15
-	char score_string[SCORE_STRING_LEN];
-	
-	/* draw the "Go!" message */
-	SDL_Surface *go_msg = TTF_RenderText_Blended(font_large, "Go!", black_colour);
-	apply_surface((SCREEN_WIDTH  - go_msg->w) / 2,
-	              (SCREEN_HEIGHT - go_msg->h) / 2,
-	               go_msg, screen);
-	SDL_FreeSurface(go_msg);
+	present_reset();
 	
-	SDL_Flip(screen);
-	
-	/* game loop */
 	/*
-	 * For keeping track of when the next game tick is, speed is added
-	 * to move_Timer after each game tick.
-	 * 
-	 * Starting value of +500 so the player has enough time to get
-	 * ready.
+	 * The game with the "Go!" message over it until the first tick, which
+	 * is +500 so the player has enough time to get ready.
 	*/
-	clock_t timer = SDL_GetTicks();
-	clock_t move_timer = timer + 500;
-	
-	SDL_Event event;
-	bool paused = false;
-	while (1)
-	{
-		/* 
-		 * Poll for events for a certain amount of time (as specified
-		 * in the `speed` variable). Then draw the game.
-		 */
-		while (timer < move_timer)
-		{
-			/* 
-			 * If the game is paused, don't update the time. This
-			 * "fools" the game into thinking no time has passed, 
-			 * it will then continue to poll for events until we
-			 * unpause.
-			 */
-			if (paused == false)
-				timer = SDL_GetTicks();
-			
-			if (SDL_PollEvent(&event))
-			{
-				if (event.key.type == SDL_KEYDOWN)
-				{
-					switch (event.key.keysym.sym)
-					{
-						case SDLK_a: handle_input(game, (game->controls_reversed ? -1 :  1)); break;
-						case SDLK_d: handle_input(game, (game->controls_reversed ?  1 : -1)); break;
-						
-						case SDLK_m:
-						{
-							clean_up_game(game);
-							nav_vars_T *ret = malloc(sizeof(nav_vars_T));
-							*ret = MENU_ID;
-							return ret;
-						};
-						
-						case SDLK_p:
-						{
-							if (paused == false)
-							{
-								SDL_Surface *text = TTF_RenderText_Blended(font_medium, "paused", black_colour);
-								
-								apply_surface(SCREEN_WIDTH  / 2 - text->w / 2,
-											  SCREEN_HEIGHT / 2 - text->h / 2,
-											  text, screen);
-								SDL_FreeSurface(text);
-								
-								SDL_Flip(screen);
-							}
-							paused = !paused;
-							break;
-						}
-						
-						default: break;
-					}
-				}
-				else if (event.type == SDL_QUIT)
-				{
-					clean_up_game(game);
-					nav_vars_T *ret = malloc(sizeof(nav_vars_T));
-					*ret = QUIT_ID;
-					return ret;
-				}
-			}
+	play.message = assets.go_msg;
+	play.move_timer = SDL_GetTicks() + 500;
+	
+	play.autopilot_on = false;
+	play.planner_on = false;
+	play.choose_next = false;
+	play.over = false;
+	autopilot.played = false;
+}
+
+static void game_event(scene_T *scene, const SDL_Event *event)
+{
+	game_T *game = play.game;
+	
+	if (event->type != SDL_KEYDOWN)
+		return;
+	
+	switch (event->key.keysym.sym)
+	{
+		case SDLK_a:
+			play.autopilot_on = false;
+			play.planner_on = false;
+			board_turn(&game->board, 0, TURN_LEFT);
+			replay_record_turn(&game->replay, &game->board, 0, TURN_LEFT);
+			break;
 		
-			SDL_Delay(5);
-		}
+		case SDLK_d:
+			play.autopilot_on = false;
+			play.planner_on = false;
+			board_turn(&game->board, 0, TURN_RIGHT);
+			replay_record_turn(&game->replay, &game->board, 0, TURN_RIGHT);
+			break;
 		
-		/* add any pending snake segments */
-		if (game->pending_snake_segments > 0)
-		{
-			game->pending_snake_segments--;
-			game->snake_length++;
-		}
+		/* leaving ends the game */
+		case SDLK_m: scene_pop(); break;
 		
-		/*
-		 * Move the snake.
-		 * Get each segment to assume the x,y of the segment before it.
-		*/
-		for (int j = game->snake_length - 1; j > 0; j--)
+		case SDLK_p:
 		{
-			game->snake[j].x = game->snake[j - 1].x;
-			game->snake[j].y = game->snake[j - 1].y;
+			clock_t now = SDL_GetTicks();
+			
+			play.paused_for = (play.move_timer > now ? play.move_timer - now : 0);
+			scene_push(&pause_scene);
+			break;
 		}
 		
-		/* move the head in whatever direction was chosen */
-		game->snake[0].x += game->snake_x_vel;
-		game->snake[0].y += game->snake_y_vel;
+		/* one autopilot at a time */
+		case SDLK_o:
+			play.planner_on = false;
+			toggle_autopilot(game, &play.autopilot_on);
+			break;
 		
-		/* move the snake to the opposite edge of the screen if it goes off */
-		if      (game->snake[0].x < 0)             game->snake[0].x = SCREEN_WIDTH  + 5;
-		else if (game->snake[0].x > SCREEN_WIDTH)  game->snake[0].x = 0;
-		else if (game->snake[0].y > SCREEN_HEIGHT) game->snake[0].y = 0;
-		else if (game->snake[0].y < 0)             game->snake[0].y = SCREEN_HEIGHT + 5;
-		
-		/* if theres a collision */
-		for (int i = 1; i < game->snake_length; i++)
-			if (game->snake[0].x == game->snake[i].x && game->snake[0].y == game->snake[i].y)
-			{
-				clean_up_game(game);
-				return NULL;
-			}
-		
-		/* if the snake is over rock */
-		for (int i = 0; i < game->num_rocks; i++)
-			if (game->snake[0].x == game->rock[i].x && game->snake[0].y == game->rock[i].y)
-			{
-				clean_up_game(game);
-				return NULL;
-			}
-		
-		/* if the snake head is over an apple */
-		for (int i = 0; i < NUM_APPLES; i++)
-		{
-			if (game->snake[0].x == game->apple[i].x && game->snake[0].y == game->apple[i].y)
-			{
-				score += score_multiplier;
-				game->pending_snake_segments += SNAKE_LENGTH_INCREMENT;
-				
-				snprintf(score_string, SCORE_STRING_LEN, "%d", score);
-				
-				SDL_FreeSurface(game->score_display);
-				game->score_display = TTF_RenderText_Blended(font_small, score_string, black_colour);
-				
-				add_food(game, i);
-				add_rock(game);
-			}
-		}
+		case SDLK_h:
+			play.autopilot_on = false;
+			toggle_planner(game, &play.planner_on);
+			break;
 		
-		/* if there's a powerup in-game & snake head is over power-up */
-		if ((game->powerup.active == true) && 
-		    (game->snake[0].x == game->powerup.x &&
-		     game->snake[0].y == game->powerup.y))
-		{
-			switch (game->powerup.type)
-			{
-				case 0: /* banana */
-				{
-					score += score_multiplier * 3;
-					game->pending_snake_segments += SNAKE_LENGTH_INCREMENT;
-					add_rock(game);
-					break;
-				}
-				
-				case 1: /* grape */
-				{
-					score += score_multiplier;
-					game->pending_snake_segments += SNAKE_LENGTH_INCREMENT;
-					game->num_rocks *= 0.8;
-					break;
-				}
-				
-				case 2: /* mystery box */
-				{
-					if (rand() % 2) /* pick a random outcome */
-					{
-						score += score_multiplier * 10;
-						game->pending_snake_segments += SNAKE_LENGTH_INCREMENT;
-						add_rock(game);
-					}
-					else /* reverse the controls */
-					{
-						score += score_multiplier;
-						game->pending_snake_segments += SNAKE_LENGTH_INCREMENT;
-						add_rock(game);
-						
-						game->controls_reversed = true;
-					}
-					break;
-				}
-				
-				default:
-				{
-					printf("invalid powerup type %d\n", game->powerup.type);
-					exit(1);
-				}
-			}
-			
-			snprintf(score_string, SCORE_STRING_LEN, "%d", score);
-			
-			SDL_FreeSurface(game->score_display);
-			game->score_display = TTF_RenderText_Blended(font_small, score_string, black_colour);
-			
-			game->powerup.active = false;
-			game->powerup.time_until_active = POWERUP_FREQUENCY;
-			game->powerup.time_active = 0;
-		}
+		default: break;
+	}
+}
+
+static void game_update(scene_T *scene, clock_t now)
+{
+	game_T *game = play.game;
+	
+	/* chosen now the frame of the tick before is out of the way, well before the next */
+	if (play.choose_next)
+	{
+		choose_move(game);
+		play.choose_next = false;
+	}
+	
+	/* the harness's key presses go in with everything else */
+	if (latency_enabled)
+		latency_poll(&game->board, play.move_timer);
+	
+	scene->wake = play.move_timer;
+	
+	if (now < play.move_timer)
+		return;
+	
+	/* nothing from here to the next poll may touch the heap */
+	ALLOC_WATCH_BEGIN();
+	
+	int64_t tick_start = telemetry_now();
+	present_tick_start();
+	
+	board_tick(&game->board);
+	replay_record_tick(&game->replay, &game->board);
+	
+	if (practising)
+		rewind_record(&game->rewind, &game->board);
+	
+	score = game->board.snake[0].score;
+	
+	/* a game that's over is left as it was last drawn */
+	bool game_over = (game->board.humans_alive == 0);
+	if (game_over == false)
+	{
+		game->stale = true;
+		play.message = NULL;
+		play.choose_next = (play.autopilot_on || play.planner_on);
 		
-		/* is it time for a new powerup? */
-		game->powerup.time_until_active--;
-		if (game->powerup.time_until_active == 0)
-		{
-			game->powerup.active = true;
-			
-			game->powerup.type = rand() % 3;
-			
-			add_power_up(game);
-			
-			/* if controls have been reversed, reset them */
-			game->controls_reversed = false;
-		}
+		scene_redraw();
+	}
+	
+	log_tick(&game->board, telemetry_now() - tick_start);
+	
+	ALLOC_WATCH_END("a game tick");
+	
+	/* in practice, dying is a chance to go back and try again */
+	if (game_over && practising)
+	{
+		play.next_step = now;
+		scene_push(&rewind_scene);
+		return;
+	}
+	
+	if (game_over)
+	{
+		end_game();
+		return;
+	}
+	
+	/* reset the delay, to the refresh if there's vsync; no waiting if there's a move to choose */
+	play.move_timer = present_align(now + speed);
+	scene->wake = (play.choose_next ? now : play.move_timer);
+}
+
+static void choose_move(game_T *game)
+{
+	ALLOC_WATCH_BEGIN();
+	
+	if (play.autopilot_on)
+	{
+		int budget = speed * 1000 * AUTOPILOT_BUDGET_PERCENT / 100;
+		turn_T turn = lookahead_choose(&autopilot.lookahead, &game->board, 0, budget);
 		
-		if (game->powerup.active == true)
-		{
-			game->powerup.time_active++;
-			if (game->powerup.time_active == POWERUP_DURATION)
-			{
-				game->powerup.active = false;
-				game->powerup.time_active = 0;
-				game->powerup.time_until_active = POWERUP_FREQUENCY;
-			}
-		}
+		board_turn(&game->board, 0, turn);
+		replay_record_turn(&game->replay, &game->board, 0, turn);
+	}
+	
+	if (play.planner_on)
+	{
+		turn_T turn = planner_choose(&autopilot.planner, &game->board, 0);
 		
-		/* reset the delay */
-		move_timer = timer + speed;
+		board_turn(&game->board, 0, turn);
+		replay_record_turn(&game->replay, &game->board, 0, turn);
+	}
+	
+	ALLOC_WATCH_END("choosing a move");
+}
+
+static void game_draw(scene_T *scene)
+{
+	ALLOC_WATCH_BEGIN();
+	
+	draw_game(play.game);
+	
+	if (play.message != NULL)
+		draw_message(play.game, play.message);
+	
+	/* while it's still the frame drawn that's on the screen surface, before a flip swaps it */
+	if (latency_enabled)
+		latency_drawn(screen, &play.game->board, play.game->frame.palette[COLOUR_SNAKES]);
+	
+	ALLOC_WATCH_END("drawing a game");
+}
+
+static void game_presented(scene_T *scene)
+{
+	if (latency_enabled)
+		latency_presented();
+}
+
+/* leaving a game before it's over is quitting it */
+static void game_leave(scene_T *scene)
+{
+	if (play.over == false)
+		log_game_end(&play.game->board, true);
+	
+	clean_up_game(play.game);
+	play.game = NULL;
+}
+
+static void pause_event(scene_T *scene, const SDL_Event *event)
+{
+	if (event->type != SDL_KEYDOWN)
+		return;
+	
+	switch (event->key.keysym.sym)
+	{
+		/* with as long to go to the next tick as there was */
+		case SDLK_p:
+			play.move_timer = SDL_GetTicks() + play.paused_for;
+			scene_pop();
+			break;
 		
-		game->old_snake_x_vel = game->snake_x_vel;
-		game->old_snake_y_vel = game->snake_y_vel;
+		case SDLK_m:
+			scene_pop();
+			scene_pop();
+			break;
 		
-		draw_game(game);
+		default: break;
 	}
 }
 
-static void draw_game(game_T *game)
+static void pause_draw(scene_T *scene)
 {
-	apply_surface(0, 0, game->game_bg, screen);
-	apply_surface(6, 2, game->score_display, screen);
+	draw_message(play.game, assets.paused_msg);
+}
+
+static void load_game_assets(void)
+{
+	if (assets.loaded)
+		return;
 	
-	/* apples */
-	for (int i = 0; i < NUM_APPLES; i++)
+	TRACE_SCOPE("load_game_assets");
+	
+	assets.game_bg = load_image("images/game_bg.png");
+	
+	for (int i = 0; i < 10; i++)
 	{
-		boxColor(screen,
-			game->apple[i].x,      game->apple[i].y,
-			game->apple[i].x + 10, game->apple[i].y + 10,
-			0xFF0000FF);
+		char digit[2] = { '0' + i, '\0' };
+		assets.digits[i] = render_text_blended(font_small, digit, black_colour);
 	}
 	
-	/* rocks */
-	for (int i = 0; i < game->num_rocks; i++)
+	assets.go_msg     = render_text_blended(font_large,  "Go!",    black_colour);
+	assets.paused_msg = render_text_blended(font_medium, "paused", black_colour);
+	assets.rewind_msg = render_text_blended(font_small,
+		"hold left/right to rewind, space to play on, enter to end", black_colour);
+	
+	char *end_options[NUM_END_OPTIONS] =
+	{
+		"\"s\" to play again",
+		"\"h\" for the highscores",
+		"\"m\" for the main menu",
+		"\"r\" to watch the replay",
+		"\"q\" to quit"
+	};
+	
+	for (int i = 0; i < NUM_END_OPTIONS; i++)
+		assets.end_options[i] = render_text_shaded(font_small, end_options[i], white_colour, black_colour);
+	
+	assets.loaded = true;
+}
+
+void clean_up_game_assets(void)
+{
+	if (assets.loaded == false)
+		return;
+	
+	SDL_FreeSurface(assets.game_bg);
+	
+	for (int i = 0; i < 10; i++)
+		SDL_FreeSurface(assets.digits[i]);
+	
+	SDL_FreeSurface(assets.go_msg);
+	SDL_FreeSurface(assets.paused_msg);
+	SDL_FreeSurface(assets.rewind_msg);
+	
+	for (int i = 0; i < NUM_END_OPTIONS; i++)
+		SDL_FreeSurface(assets.end_options[i]);
+	
+	arena_free(&game_arena);
+	
+	if (autopilot.started)
+		lookahead_free(&autopilot.lookahead);
+	
+	autopilot.started = false;
+	
+	if (telemetry.opened)
+		telemetry_close(&telemetry.log);
+	
+	telemetry.opened = false;
+	
+	assets.loaded = false;
+}
+
+static void toggle_autopilot(game_T *game, bool *on)
+{
+	if (*on)
 	{
-		boxColor(screen,
-			game->rock[i].x,      game->rock[i].y,
-			game->rock[i].x + 10, game->rock[i].y + 10,
-			0x000000FF);
+		*on = false;
+		return;
 	}
 	
-	/* powerups */
-	if (game->powerup.active == true)
+	/* the search's boards are made for one board config, arena or not */
+	if (autopilot.started &&
+	    autopilot.lookahead.config.num_snakes != game->board.config.num_snakes)
+	{
+		lookahead_free(&autopilot.lookahead);
+		autopilot.started = false;
+	}
+	
+	if (autopilot.started == false)
 	{
-		unsigned int colour;
-		switch (game->powerup.type)
+		int num_threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+		
+		if (lookahead_init(&autopilot.lookahead, &game->board.config, num_threads) == false)
 		{
-			case 0: colour = 0xFFFF00FF; break; /* yellow */
-			case 1: colour = 0x9C00FFFF; break; /* purple */
-			case 2: colour = 0xFFAC00FF; break; /* orange */
+			printf("Could not allocate the autopilot.\n");
+			return;
 		}
 		
-		boxColor(screen,
-			game->powerup.x,      game->powerup.y,
-			game->powerup.x + 10, game->powerup.y + 10,
-			colour);
+		autopilot.started = true;
 	}
 	
-	/* snake */
-	unsigned int head_colour;
-	unsigned int body_colour;
-	
-	if (game->controls_reversed == true)
+	*on = true;
+	autopilot.played = true;
+}
+
+static void toggle_planner(game_T *game, bool *on)
+{
+	if (*on)
 	{
-		head_colour = 0xAE0080FF; /* dark  pink */
-		body_colour = 0xFF6AD8FF; /* light pink */
+		*on = false;
+		return;
 	}
-	else
+	
+	if (autopilot.planning == false)
 	{
-		head_colour = 0x005917FF; /* dark  green */
-		body_colour = 0x00AE2DFF; /* light green */
+		if (planner_init(&autopilot.planner, &game->board) == false)
+		{
+			printf("Could not set up the planner.\n");
+			return;
+		}
+		
+		autopilot.planning = true;
 	}
 	
-	boxColor(screen,
-			game->snake[0].x,      game->snake[0].y,
-			game->snake[0].x + 10, game->snake[0].y + 10,
-			head_colour);
+	*on = true;
+	autopilot.played = true;
+}
+
+/* a record of the game going on, as at the board's current tick */
+static telemetry_record_T game_record(const board_T *board, telemetry_kind_T kind, uint32_t cell)
+{
+	telemetry_record_T record = telemetry.game;
 	
-	for (int i = 1; i < game->snake_length; i++)
-		boxColor(screen,
-			game->snake[i].x,      game->snake[i].y,
-			game->snake[i].x + 10, game->snake[i].y + 10,
-			body_colour);
-			
-	SDL_Flip(screen);
+	record.kind = kind;
+	record.tick = board->tick;
+	record.cell = cell;
+	
+	if (autopilot.played)
+		record.flags |= TELEMETRY_AUTOPILOT;
+	
+	return record;
 }
 
-static nav_vars_T end_game()
+static void log_game_start(const board_T *board, const replay_header_T *header)
 {
-	SDL_Surface *message;
+	/* nobody plays the harness's games, so they'd only skew the figures */
+	telemetry.logging = (latency_enabled == false);
 	
-	/* get the highscore position */
-	int position = highscores_io();
+	if (telemetry.logging == false)
+		return;
 	
-	/* If a new highscore wasn't set, insult the player! Hahahaha....*/
-	if (position == -1)
+	if (telemetry.opened == false && telemetry_open(&telemetry.log, TELEMETRY_PATH) == false)
+		printf("Couldn't open the telemetry log %s\n", TELEMETRY_PATH);
+	
+	/* once tried, it isn't tried again until the next run */
+	telemetry.opened = true;
+	
+	telemetry_record_T game =
 	{
-		#define NUM_INSULTS 7
-		char *insults[NUM_INSULTS] =
+		.speed_human = header->speed_human,
+		.game = header->seed,
+		.flags = (board->config.num_snakes > board->config.num_humans ? TELEMETRY_ARENA : 0) |
+		         (practising ? TELEMETRY_PRACTICE : 0)
+	};
+	
+	telemetry.game = game;
+	telemetry.start = SDL_GetTicks();
+	
+	telemetry_record_T record = game_record(board, TELEMETRY_GAME_START, NO_CELL);
+	record.value[0] = board->config.num_snakes;
+	record.value[1] = (int32_t) time(NULL);
+	
+	telemetry_log(&telemetry.log, &record);
+}
+
+/* whatever happened to the players on the tick just played, and how long it took (ns) */
+static void log_tick(const board_T *board, int64_t tick_time)
+{
+	if (telemetry.logging == false)
+		return;
+	
+	for (int i = 0; i < board->config.num_humans; i++)
+	{
+		const snake_T *snake = &board->snake[i];
+		
+		if (snake->apple_tick == board->tick)
 		{
-			"Baffoon!",
-			"Take a long, hard look at yourself.",
-			"You're a complete disgrace!",
-			"Bloody incompetent old fool!",
-			"Twerp!",
-			"Ninconpoop!",
-			"Nitwit!"
-		};
+			telemetry_record_T record = game_record(board, TELEMETRY_APPLE, snake->head);
+			record.value[0] = snake->score;
+			record.value[1] = snake->length;
+			
+			telemetry_log(&telemetry.log, &record);
+		}
 		
-		int insultNum = rand() % NUM_INSULTS;
-		message = TTF_RenderText_Shaded(font_medium,
-					insults[insultNum], white_colour, black_colour);
+		if (snake->powerup_tick == board->tick)
+		{
+			telemetry_record_T record = game_record(board, TELEMETRY_POWERUP, snake->head);
+			record.detail = snake->powerup_outcome;
+			record.value[0] = snake->score;
+			
+			telemetry_log(&telemetry.log, &record);
+		}
 	}
-	else /* a new highscore was set */
+	
+	for (int i = 0; i < board->num_dead; i++)
 	{
-		char string[30];
-		snprintf(string, 30, "New highscore! Position - %d", position);
-		message = TTF_RenderText_Shaded(font_medium, string, white_colour, black_colour);
+		const snake_T *snake = &board->snake[board->dead[i]];
+		
+		if (snake->human == false)
+			continue;
+		
+		telemetry_record_T record = game_record(board, TELEMETRY_DEATH, snake->death_cell);
+		record.detail = snake->death_cause;
+		record.value[0] = snake->score;
+		record.value[1] = board->config.cols;
+		record.value[2] = board->config.rows;
+		
+		telemetry_log(&telemetry.log, &record);
 	}
 	
-	apply_surface(50, 180, message, screen);
-	SDL_FreeSurface(message);
+	telemetry_record_T latency = game_record(board, TELEMETRY_LATENCY, NO_CELL);
+	telemetry_tick_time(&telemetry.log, &latency, tick_time);
+}
+
+/* `quit` if the player left the game before it was over */
+static void log_game_end(const board_T *board, bool quit)
+{
+	if (telemetry.logging == false)
+		return;
+	
+	telemetry_record_T record = game_record(board, TELEMETRY_LATENCY, NO_CELL);
+	telemetry_end_window(&telemetry.log, &record);
 	
-	apply_text_shaded(50, 227, "\"s\" to play again",      font_small, white_colour, black_colour, screen);
-	apply_text_shaded(50, 251, "\"h\" for the highscores", font_small, white_colour, black_colour, screen);
-	apply_text_shaded(50, 275, "\"m\" for the main menu",  font_small, white_colour, black_colour, screen);
-	apply_text_shaded(50, 299, "\"q\" to quit",            font_small, white_colour, black_colour, screen);
+	record.kind = TELEMETRY_GAME_END;
+	record.detail = quit;
+	record.value[0] = board->snake[0].score;
+	record.value[1] = (int32_t) (SDL_GetTicks() - telemetry.start);
 	
-	SDL_Flip(screen);
+	telemetry_log(&telemetry.log, &record);
 	
-	SDL_Event event;
-	while (1)
+	/* the game's over, so now's the time to write it all out */
+	telemetry_flush(&telemetry.log);
+}
+
+/*
+ * Lets a player who died in practice go back: holding left rewinds, right
+ * goes forward again, and space plays on from there. Enter ends the game.
+*/
+static void rewind_event(scene_T *scene, const SDL_Event *event)
+{
+	if (event->type != SDL_KEYDOWN)
+		return;
+	
+	switch (event->key.keysym.sym)
 	{
-		SDL_Delay(5);
-		while (SDL_PollEvent(&event))
-		{
-			if (event.type == SDL_QUIT)
-				return QUIT_ID;
-			
-			switch (event.key.keysym.sym)
+		case SDLK_SPACE:
+			if (play.game->board.humans_alive > 0)
 			{
-				case SDLK_m: return MENU_ID;
-				case SDLK_s: return GAME_ID;
-				case SDLK_h: return HIGHSCORE_ID;
-				case SDLK_q: return QUIT_ID;
-				default: break;
+				score = play.game->board.snake[0].score;
+				play.move_timer = SDL_GetTicks() + 500;
+				
+				scene_pop();
 			}
-		}
+			break;
+		
+		case SDLK_RETURN:
+		case SDLK_ESCAPE:
+			scene_pop();
+			end_game();
+			break;
+		
+		default: break;
 	}
 }
 
-static void clean_up_game(game_T *game)
+static void rewind_update(scene_T *scene, clock_t now)
 {
-	SDL_FreeSurface(screen);
-	SDL_FreeSurface(game->game_bg);
-	SDL_FreeSurface(game->score_display);
+	game_T *game = play.game;
+	
+	/* a tick per step, four times as fast as the game plays */
+	Uint8 *keys = SDL_GetKeyState(NULL);
 	
-	free(game);
+	if (now >= play.next_step && (keys[SDLK_LEFT] || keys[SDLK_RIGHT]))
+	{
+		bool moved = (keys[SDLK_LEFT] ? rewind_back(&game->rewind, &game->board)
+		                              : rewind_forward(&game->rewind, &game->board));
+		
+		if (moved)
+		{
+			game->stale = true;
+			scene_redraw();
+		}
+		
+		play.next_step = now + speed / 4;
+	}
 }
 
-static void handle_input(game_T *game, int multiplier)
+static void rewind_draw(scene_T *scene)
+{
+	draw_message(play.game, assets.rewind_msg);
+}
+
+/*
+ * Sets up a game, its board and its recording in the game arena. The arena
+ * only grows the first time a game this size is played.
+*/
+static game_T *new_game(const board_config_T *config, const replay_header_T *header)
 {
-	if (game->old_snake_x_vel == -15)
+	TRACE_SCOPE("new_game");
+	
+	uint32_t rewind_ticks = (practising ? REWIND_SECONDS * 1000 / speed : 0);
+	
+	size_t size = arena_size(sizeof(game_T)) +
+	              arena_size(board_memory_size(config)) +
+	              arena_size(framebuffer_memory_size(config->cols, config->rows)) +
+	              arena_size(replay_writer_memory_size(header)) +
+	              (practising ? arena_size(rewind_memory_size(config, rewind_ticks, REWIND_BYTES)) : 0);
+	
+	if (arena_reserve(&game_arena, size) == false)
 	{
-		game->snake_x_vel = 0;
-		game->snake_y_vel = 15 * multiplier;
+		printf("Could not allocate the game.\n");
+		exit(1);
 	}
-	else if (game->old_snake_x_vel == 15)
+	
+	arena_reset(&game_arena);
+	
+	game_T *game = arena_alloc(&game_arena, sizeof(game_T));
+	board_init_in(&game->board, config, header->seed, &game_arena);
+	framebuffer_init_in(&game->frame, config->cols, config->rows, screen_scale, assets.game_bg, &game_arena);
+	game->stale = true;
+	
+	if (last_replay[0] != '\0' && replay_writer_open(&game->replay, last_replay, header, &game_arena) == false)
 	{
-		game->snake_x_vel = 0;
-		game->snake_y_vel = -15 * multiplier;
+		printf("Couldn't create the replay file %s\n", last_replay);
+		last_replay[0] = '\0';
 	}
-	else if (game->old_snake_y_vel == -15)
+	
+	if (practising)
+		rewind_init(&game->rewind, &game->board, rewind_ticks, REWIND_BYTES, &game_arena);
+	
+	return game;
+}
+
+/*
+ * Plays back the last recorded game. Left and right skip back and forward
+ * ten seconds, space pauses.
+*/
+void open_replay(void)
+{
+	if (last_replay[0] == '\0' || replay_open(&watching.reader, last_replay) == false)
 	{
-		game->snake_x_vel = -15 * multiplier;
-		game->snake_y_vel = 0;
+		printf("Couldn't open the replay %s\n", last_replay);
+		return;
 	}
-	else if (game->old_snake_y_vel == 15)
+	
+	load_game_assets();
+	
+	const board_config_T *config = &watching.reader.header.config;
+	size_t size = arena_size(sizeof(game_T)) + arena_size(framebuffer_memory_size(config->cols, config->rows));
+	
+	if (arena_reserve(&game_arena, size) == false)
+	{
+		printf("Could not allocate the game.\n");
+		exit(1);
+	}
+	
+	arena_reset(&game_arena);
+	
+	/* the board itself comes from the heap, its size depends on the file */
+	game_T *game = arena_alloc(&game_arena, sizeof(game_T));
+	
+	framebuffer_init_in(&game->frame, config->cols, config->rows, screen_scale, assets.game_bg, &game_arena);
+	
+	if (replay_start(&watching.reader, &game->board, &watching.cursor) == false)
 	{
-		game->snake_x_vel = 15 * multiplier;
-		game->snake_y_vel = 0;
+		printf("Could not allocate the game board.\n");
+		exit(1);
 	}
+	
+	game->stale = true;
+	
+	watching.game = game;
+	watching.paused = false;
+	watching.move_timer = SDL_GetTicks() + speed;
+	
+	scene_push(&watch_scene);
 }
 
-static bool far_enough_from_snake(int x, int y, xy_T *snake, int snake_length)
+static void watch_event(scene_T *scene, const SDL_Event *event)
 {
-	for (int i = 0; i < snake_length; i++)
+	game_T *game = watching.game;
+	
+	if (event->type != SDL_KEYDOWN)
+		return;
+	
+	const uint32_t SKIP_TICKS = 10000 / speed;
+	uint32_t tick = game->board.tick;
+	
+	switch (event->key.keysym.sym)
 	{
-		if (x <= snake[i].x + 120 &&
-			x >= snake[i].x - 120 &&
-			y <= snake[i].y + 120 &&
-			y >= snake[i].y - 120)
-				return false;
+		case SDLK_LEFT:
+			replay_seek(&watching.reader, &game->board, &watching.cursor, (tick > SKIP_TICKS ? tick - SKIP_TICKS : 0));
+			game->stale = true;
+			scene_redraw();
+			break;
+		
+		case SDLK_RIGHT:
+			replay_advance(&watching.reader, &game->board, &watching.cursor, tick + SKIP_TICKS);
+			game->stale = true;
+			scene_redraw();
+			break;
+		
+		case SDLK_SPACE: watching.paused = !watching.paused; break;
+		
+		case SDLK_m: scene_pop();  break;
+		case SDLK_q: scene_quit(); break;
+		
+		default: break;
 	}
-	
-	return true;
 }
 
-static bool not_colliding_with(int x, int y, xy_T *objects, int num_objects)
+static void watch_update(scene_T *scene, clock_t now)
 {
-	for (int i = 0; i < num_objects; i++)
+	game_T *game = watching.game;
+	
+	if (watching.paused)
 	{
-		if (x == objects[i].x && y == objects[i].y)
-			return false;
+		scene->wake = 0;
+		return;
 	}
 	
-	return true;
+	if (now >= watching.move_timer)
+	{
+		present_tick_start();
+		replay_advance(&watching.reader, &game->board, &watching.cursor, game->board.tick + 1);
+		watching.move_timer = present_align(SDL_GetTicks() + speed);
+		
+		game->stale = true;
+		scene_redraw();
+	}
+	
+	scene->wake = watching.move_timer;
 }
 
-static void add_rock(game_T *game)
+static void watch_draw(scene_T *scene)
 {
-	int x, y;
+	draw_game(watching.game);
+}
+
+static void watch_leave(scene_T *scene)
+{
+	clean_up_game(watching.game);
+	replay_close(&watching.reader);
 	
-	while (1)
+	watching.game = NULL;
+}
+
+/*
+ * Sets the cells of a run of a snake's body, from the cell it leaves, and
+ * joins each to the one before where they're side by side on screen (not
+ * where the run goes off one edge and comes back on at the other). Returns
+ * the cell it ends in.
+*/
+static uint32_t draw_run(framebuffer_T *frame, const board_T *board, uint32_t cell, uint32_t run, uint8_t colour)
+{
+	uint32_t cols = board->config.cols;
+	direction_T dir = RUN_DIR(run);
+	
+	for (uint32_t i = 0; i < RUN_LENGTH(run); i++)
 	{
-		x = ((rand() % (SCREEN_WIDTH / 10)) * 10);
-		y = ((rand() % (SCREEN_HEIGHT / 10)) * 10);
-		
-		/* make sure the rock falls on the 15px grid that the game runs on */
-		x -= x % 15;
-		y -= y % 15;
-		
-		if (far_enough_from_snake(x, y, game->snake, game->snake_length) == false)
-			continue;
-		
-		if (not_colliding_with(x, y, game->apple, NUM_APPLES) == false)
-			continue;
+		uint32_t next = board_step(board, cell, dir);
+		framebuffer_set(frame, next, colour);
 		
-		if (not_colliding_with(x, y, game->rock, game->num_rocks) == false)
-			continue;
+		switch (dir)
+		{
+			case DIR_RIGHT: if (next % cols != 0) framebuffer_join(frame, cell, FRAMEBUFFER_JOIN_RIGHT); break;
+			case DIR_LEFT:  if (cell % cols != 0) framebuffer_join(frame, next, FRAMEBUFFER_JOIN_RIGHT); break;
+			case DIR_DOWN:  if (next >= cols)     framebuffer_join(frame, cell, FRAMEBUFFER_JOIN_DOWN);  break;
+			case DIR_UP:    if (cell >= cols)     framebuffer_join(frame, next, FRAMEBUFFER_JOIN_DOWN);  break;
+		}
 		
-		break;
+		cell = next;
 	}
 	
-	game->rock[game->num_rocks].x = x;
-	game->rock[game->num_rocks].y = y;
-	game->num_rocks++;
+	return cell;
 }
 
-static void add_food(game_T *game, int food)
+/* returns the region it was drawn over */
+static SDL_Rect draw_score(int value)
 {
-	int x, y;
+	char score_string[12];
+	int len = snprintf(score_string, sizeof(score_string), "%d", value);
+	
+	SDL_Rect region = { 6 * screen_scale, 2 * screen_scale, 0, 0 };
 	
-	while (1)
+	int x = region.x;
+	for (int i = 0; i < len; i++)
 	{
-		x = ((rand() % (SCREEN_WIDTH / 10)) * 10);
-		y = ((rand() % (SCREEN_HEIGHT / 10)) * 10);
+		SDL_Surface *digit = assets.digits[score_string[i] - '0'];
 		
-		/* make sure the rock falls on the 15px grid that the game runs on */
-		x -= x % 15;
-		y -= y % 15;
+		apply_surface(x, region.y, digit, screen);
+		x += digit->w;
 		
-		if (far_enough_from_snake(x, y, game->snake, game->snake_length) == false)
-			continue;
-		
-		if (not_colliding_with(x, y, game->rock, game->num_rocks) == false)
-			continue;
-		
-		break;
+		if (digit->h > region.h)
+			region.h = digit->h;
 	}
 	
-	game->apple[food].x = x;
-	game->apple[food].y = y;
+	region.w = x - region.x;
+	
+	return region;
 }
 
-static void add_power_up(game_T *game)
+/* the frame's cells, from the board as it is */
+static void set_cells(game_T *game)
 {
-	int x, y;
+	board_T *board = &game->board;
+	framebuffer_T *frame = &game->frame;
+	
+	framebuffer_clear(frame);
+	
+	frame->palette[COLOUR_APPLE]   = 0xFF0000FF;
+	frame->palette[COLOUR_ROCK]    = 0x000000FF;
+	frame->palette[COLOUR_BANANA]  = 0xFFFF00FF; /* yellow */
+	frame->palette[COLOUR_GRAPE]   = 0x9C00FFFF; /* purple */
+	frame->palette[COLOUR_MYSTERY] = 0xFFAC00FF; /* orange */
 	
-	while (1)
+	/* apples */
+	for (int i = 0; i < board->config.num_apples; i++)
+		if (board->apple[i] != NO_CELL)
+			framebuffer_set(frame, board->apple[i], COLOUR_APPLE);
+	
+	/* rocks */
+	for (int i = 0; i < board->num_rocks; i++)
+		framebuffer_set(frame, board->rock[i], COLOUR_ROCK);
+	
+	/* powerups */
+	if (board->powerup.active == true && board->powerup.cell != NO_CELL)
 	{
-		x = ((rand() % (SCREEN_WIDTH / 10)) * 10);
-		y = ((rand() % (SCREEN_HEIGHT / 10)) * 10);
+		uint8_t colour;
+		switch (board->powerup.type)
+		{
+			case POWERUP_BANANA:  colour = COLOUR_BANANA;  break;
+			case POWERUP_GRAPE:   colour = COLOUR_GRAPE;   break;
+			case POWERUP_MYSTERY: colour = COLOUR_MYSTERY; break;
+		}
 		
-		/* make sure the rock falls on the 15px grid that the game runs on */
-		x -= x % 15;
-		y -= y % 15;
+		framebuffer_set(frame, board->powerup.cell, colour);
+	}
+	
+	/* snakes */
+	for (int i = 0; i < board->config.num_snakes; i++)
+	{
+		snake_T *snake = &board->snake[i];
 		
-		if (far_enough_from_snake(x, y, game->snake, game->snake_length) == false)
+		if (snake->alive == false)
 			continue;
 		
-		if (not_colliding_with(x, y, game->apple, NUM_APPLES) == false)
-			continue;
+		uint8_t head = COLOUR_SNAKES + 2 * i;
+		uint8_t body = head + 1;
 		
-		if (not_colliding_with(x, y, game->rock, game->num_rocks) == false)
-			continue;
+		/* going pink only swaps the snake's colours, its cells stay as they are */
+		if (snake->controls_reversed == true)
+		{
+			frame->palette[head] = 0xAE0080FF; /* dark  pink */
+			frame->palette[body] = 0xFF6AD8FF; /* light pink */
+		}
+		else if (snake->human == true)
+		{
+			frame->palette[head] = 0x005917FF; /* dark  green */
+			frame->palette[body] = 0x00AE2DFF; /* light green */
+		}
+		else
+		{
+			frame->palette[head] = 0x00307AFF; /* dark  blue */
+			frame->palette[body] = 0x3D7FE0FF; /* light blue */
+		}
+		
+		uint32_t cell = snake->tail;
+		framebuffer_set(frame, cell, body);
+		
+		for (uint32_t j = 0; j < snake->num_runs; j++)
+			cell = draw_run(frame, board, cell, snake_run(snake, j), body);
 		
-		break;
+		framebuffer_recolour(frame, snake->head, head);
 	}
 	
-	game->powerup.x = x;
-	game->powerup.y = y;
+	game->stale = false;
 }
 
-static int highscores_io(void)
+/* into the frame being drawn; the cells are only set again if the board's changed */
+static void draw_game(game_T *game)
 {
-	int ret_val = -1;
+	TRACE_SCOPE("draw_game");
 	
-	const int NUM_HIGHSCORES = 10;
-	char *highscores_strings[NUM_HIGHSCORES];
+	if (game->stale)
+		set_cells(game);
 	
-	FILE *highscores_file;
-	highscores_file = fopen("highscores", "r");
+	int buffer = present_back_buffer();
+	framebuffer_present(&game->frame, screen, buffer);
 	
-	if (highscores_file == NULL)
+	/* the score goes over the board, so the cells under it are painted again next time */
+	SDL_Rect region = draw_score(game->board.snake[0].score);
+	framebuffer_damage(&game->frame, buffer, &region);
+}
+
+/* `surface` over the board at (x, y) in pixels, likewise */
+static void draw_over(game_T *game, SDL_Surface *surface, int x, int y)
+{
+	SDL_Rect region = { x, y, surface->w, surface->h };
+	
+	apply_surface(x, y, surface, screen);
+	framebuffer_damage(&game->frame, present_back_buffer(), &region);
+}
+
+/* `message` in the middle of the board */
+static void draw_message(game_T *game, SDL_Surface *message)
+{
+	draw_over(game, message,
+		(SCREEN_WIDTH  * screen_scale - message->w) / 2,
+		(SCREEN_HEIGHT * screen_scale - message->h) / 2);
+}
+
+/* once the player's snake has died, or they've stopped rewinding */
+static void end_game(void)
+{
+	present_report();
+	
+	if (autopilot.played && autopilot.started)
+		printf("autopilot: %.0f rollouts/s\n", lookahead_rate(&autopilot.lookahead));
+	
+	log_game_end(&play.game->board, false);
+	play.over = true;
+	
+	/* nobody's watching the harness's games, so it's straight on to the next */
+	if (latency_enabled)
 	{
-		printf("Couldn't open/find the highscores file");
-		fclose(highscores_file);
-		return -1;
+		play.died = true;
+		scene_pop();
+		return;
 	}
 	
-	/* read the highscores file and populate a string array from it */
-	for (int i = 0; i < NUM_HIGHSCORES; i++)
+	SDL_Surface *message;
+	
+	/* get the highscore position */
+	int position = highscores_io();
+	
+	/* If a new highscore wasn't set, insult the player! Hahahaha....*/
+	if (position == -1)
 	{
-		highscores_strings[i] = malloc(15);
-		fgets(highscores_strings[i], 15, highscores_file);
+		#define NUM_INSULTS 7
+		char *insults[NUM_INSULTS] =
+		{
+			"Baffoon!",
+			"Take a long, hard look at yourself.",
+			"You're a complete disgrace!",
+			"Bloody incompetent old fool!",
+			"Twerp!",
+			"Ninconpoop!",
+			"Nitwit!"
+		};
+		
+		int insultNum = rand() % NUM_INSULTS;
+		message = render_text_shaded(font_medium,
+					insults[insultNum], white_colour, black_colour);
+	}
+	else /* a new highscore was set */
+	{
+		char string[30];
+		snprintf(string, 30, "New highscore! Position - %d", position);
+		message = render_text_shaded(font_medium, string, white_colour, black_colour);
 	}
 	
-	fclose(highscores_file);
+	play.end_message = message;
+	scene_push(&end_scene);
+}
+
+/* the game over screen goes over the game, which is only left once it's done with */
+static void end_event(scene_T *scene, const SDL_Event *event)
+{
+	if (event->type != SDL_KEYDOWN)
+		return;
 	
-	/*
-	 * If the new score is greater than the last place in the highscores
-	 * find it's exact place.
-	 * Else return -1.
-	*/
-	if (score > atoi(highscores_strings[NUM_HIGHSCORES - 1]))
+	switch (event->key.keysym.sym)
 	{
-		int position;
-		/* get exact position */
-		for (position = NUM_HIGHSCORES - 1;
-		     score > atoi(highscores_strings[position]) &&
-		     position != -1; position--)
-			;
+		case SDLK_s:
+			scene_pop();
+			start_game(play.num_bots, practising);
+			break;
 		
-		position++;
+		case SDLK_m: scene_pop(); scene_pop();                    break;
+		case SDLK_h: scene_pop(); scene_pop(); open_highscores(); break;
+		case SDLK_r: scene_pop(); scene_pop(); open_replay();     break;
+		case SDLK_q: scene_quit();                                break;
 		
-		/* move all the scores down one to accomodate the new score */
-		for (int i = 9; i >= position; i--)
-			snprintf(highscores_strings[i], NUM_HIGHSCORES, "%d\n", atoi(highscores_strings[i - 1]));
-		
-		/* put the new score on the string array ready for writing to the file */
-		snprintf(highscores_strings[position], NUM_HIGHSCORES, "%d\n", score);
-		
-		/* write the changes to the file */
-		highscores_file = fopen("highscores", "r+");
-		
-		if (highscores_file == NULL)
-			printf("Couldn't open/find the highscores file");
-		else for (int i = 0; i < NUM_HIGHSCORES; i++)
-			fprintf(highscores_file, "%s", highscores_strings[i]);
-		
-		fclose(highscores_file);
-		
-		ret_val = position + 1;
+		default: break;
 	}
+}
+
+static void end_draw(scene_T *scene)
+{
+	draw_over(play.game, play.end_message, 50 * screen_scale, 180 * screen_scale);
+	
+	for (int i = 0; i < NUM_END_OPTIONS; i++)
+		draw_over(play.game, assets.end_options[i], 50 * screen_scale, (227 + 24 * i) * screen_scale);
+}
 
-	for (int i = 0; i < NUM_HIGHSCORES; i++)
-		free(highscores_strings[i]);
+static void end_leave(scene_T *scene)
+{
+	SDL_FreeSurface(play.end_message);
+	play.end_message = NULL;
+}
+
+static void clean_up_game(game_T *game)
+{
+	replay_writer_close(&game->replay, &game->board);
+	board_free(&game->board);
+	
+	/* the planner's cycle is for this game's board */
+	if (autopilot.planning)
+		planner_free(&autopilot.planner);
+	
+	autopilot.planning = false;
+	
+	arena_reset(&game_arena);
+}
+
+static int highscores_io(void)
+{
+	TRACE_SCOPE("highscores_io");
+	
+	/* the autopilot's scores aren't the player's, nor are ones rewound to */
+	if (autopilot.played || practising)
+		return -1;
+	
+	uint64_t rank = submit_score(score);
+	
+	if (rank == 0 || rank > NUM_HIGHSCORES)
+		return -1;
 	
-	return ret_val;
+	return (int) rank;
 }
@@ -1,8 +1,26 @@
 #ifndef GAME_H
 #define GAME_H
 
-#include "constants.h"
+#include <stdbool.h>
 
-nav_vars_T run_game (void);
+/* each pushes its scene (see scene.h), popped again once the player's done */
+void open_game (void);
+void open_arena(void);
+
+/* single-player, but dying rewinds instead of ending the game */
+void open_practice(void);
+
+/* the last game played, if it was recorded */
+void open_replay(void);
+
+/*
+ * A single-player game for the latency harness (see latency.h) to play,
+ * run by a loop of its own. Returns false once the snake dies, true once
+ * the harness quits it.
+*/
+bool run_latency_game(void);
+
+/* frees what games keep loaded between them, call on exit */
+void clean_up_game_assets(void);
 
 #endif
@@ -7,6 +7,9 @@ const int SCREEN_WIDTH = 640;
 const int SCREEN_HEIGHT = 475;
 const int SCREEN_BPP = 32;
 
+/* set once at startup, before the video mode */
+int screen_scale = 1;
+
 SDL_Surface *screen = NULL;
 
 /* ----------------------------------------------------- */
@@ -20,9 +23,9 @@ int speed = -1; /* the delay between game ticks */
 /* ----------------------------------------------------- */
 /* misc */
 
-TTF_Font *font_small = NULL;
-TTF_Font *font_medium = NULL;
-TTF_Font *font_large = NULL;
+font_T *font_small = NULL;
+font_T *font_medium = NULL;
+font_T *font_large = NULL;
 
 SDL_Color white_colour = {255, 255, 255};
 SDL_Color black_colour = {0, 0, 0};
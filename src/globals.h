@@ -1,13 +1,20 @@
 #ifndef GLOBALS_H
 #define GLOBALS_H
 
+#include "font.h"
+
 #include <SDL/SDL.h>
-#include <SDL/SDL_ttf.h>
 
 extern const int SCREEN_BPP;
 extern const int SCREEN_WIDTH;
 extern const int SCREEN_HEIGHT;
 
+/*
+ * The screen is SCREEN_WIDTH by SCREEN_HEIGHT times this in pixels. Layout
+ * is all in unscaled units; images and text come out already scaled.
+*/
+extern int screen_scale;
+
 extern SDL_Surface *screen;
 
 extern int score;
@@ -16,9 +23,9 @@ extern int score_multiplier; /* changed according to the speed of the game */
 extern int speed_human; /* the human readable speed value, 1-5 */
 extern int speed;       /* the delay between game steps */
 
-extern TTF_Font *font_small;
-extern TTF_Font *font_medium;
-extern TTF_Font *font_large;
+extern font_T *font_small;
+extern font_T *font_medium;
+extern font_T *font_large;
 
 extern SDL_Color black_colour;
 extern SDL_Color white_colour;
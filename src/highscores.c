@@ -1,109 +1,678 @@
+#define _POSIX_C_SOURCE 200809L
+
 #include "highscores.h"
 #include "globals.h"
 #include "sdlhelperfuncs.h"
+#include "leaderboard.h"
+#include "canvas.h"
+#include "scene.h"
+#include "trace.h"
 
 #include <SDL/SDL.h>
 #include <SDL/SDL_image.h>
 #include <SDL/SDL_ttf.h>
+#include <pthread.h>
+#include <string.h>
+#include <time.h>
+
+#define LEADERBOARD_FILE "leaderboard"
+
+/* the old top ten, one score per line, imported into a new leaderboard */
+#define OLD_HIGHSCORES_FILE "highscores"
+
+#define ENTRIES_PER_PAGE 10
+
+/* games whose scores haven't been saved yet; submitting waits if it's full */
+#define SAVE_QUEUE_SIZE 64
+
+/* entries read at a time when reading every score in */
+#define SCORES_PER_READ 256
+
+/* the rows of scores, starting a line below the last line of help */
+#define FIRST_ROW_Y 168
+#define ROW_HEIGHT  25
+
+#define COUNT_Y 438
 
+/*
+ * The screen is kept composed on a canvas between visits. Coming back to
+ * it, or to a page nobody has added a score to since, is a single blit;
+ * otherwise only the rows that changed are redrawn.
+*/
 typedef struct
 {
 	SDL_Surface *highscores_bg;
+	canvas_T canvas;
+	
+	leaderboard_T leaderboard;
+	uint64_t first_rank; /* of the page to show */
+	
+	/* what's on the canvas */
+	bool drawn;
+	uint64_t shown_count;
+	uint64_t shown_first_rank;
+	uint64_t shown_last_rank;
+	int num_shown;
+	leaderboard_entry_T shown[ENTRIES_PER_PAGE];
 } highscores_T;
 
-static void clean_up_highscores(highscores_T *);
+static highscores_T *highscores = NULL;
+
+/*
+ * Scores are saved by a background thread, so the game over screen never
+ * waits for the disk. The rank it shows straight away comes from a copy of
+ * every score in the leaderboard that the thread reads in when it starts
+ * and keeps up to date after every sync, counting the scores queued or
+ * being saved ahead of it. Everything in here is guarded by `lock`.
+*/
+static struct
+{
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;  /* something was queued, or it's time to stop */
+	pthread_cond_t space; /* the queue has room again */
+	
+	bool running;
+	bool stopping;
+	
+	leaderboard_entry_T queue[SAVE_QUEUE_SIZE];
+	int queue_start;
+	int queue_len;
+	
+	/* the batch taken off the queue, until it's in `scores` */
+	int saving[SAVE_QUEUE_SIZE];
+	int num_saving;
+	
+	/* every score in the leaderboard, best first; NULL until they've been read */
+	int *scores;
+	uint64_t num_scores;
+	uint64_t max_scores;
+	
+	/* rank of the last score submitted, 0 if there hasn't been one */
+	uint64_t last_rank;
+} saver = { .lock = PTHREAD_MUTEX_INITIALIZER, .wake = PTHREAD_COND_INITIALIZER, .space = PTHREAD_COND_INITIALIZER };
+
+static bool open_leaderboard(leaderboard_T *);
+static uint64_t get_last_rank(void);
+static highscores_T *load_highscores(void);
+static void refresh_page(highscores_T *);
+static void update_page(highscores_T *, uint64_t count, uint64_t last_rank);
+
+static void highscores_event(scene_T *, const SDL_Event *);
+static void draw_highscores(scene_T *);
+
+static scene_T highscores_scene = { .opaque = true, .event = highscores_event, .draw = draw_highscores };
+
+/* the page with `rank` in the middle */
+static uint64_t page_around(uint64_t rank)
+{
+	return (rank > ENTRIES_PER_PAGE / 2 ? rank - ENTRIES_PER_PAGE / 2 + 1 : 1);
+}
+
+void open_highscores(void)
+{
+	if (highscores == NULL && (highscores = load_highscores()) == NULL)
+		return;
+	
+	/* start around the last score played, else at the top */
+	highscores->first_rank = page_around(get_last_rank());
+	refresh_page(highscores);
+	
+	scene_push(&highscores_scene);
+}
+
+static void highscores_event(scene_T *scene, const SDL_Event *event)
+{
+	if (event->type != SDL_KEYDOWN)
+		return;
+	
+	uint64_t first_rank = highscores->first_rank;
+	
+	switch (event->key.keysym.sym)
+	{
+		case SDLK_q: scene_quit(); return;
+		case SDLK_m: scene_pop();  return;
+		
+		case SDLK_LEFT:
+		case SDLK_PAGEUP:
+			first_rank = (first_rank > ENTRIES_PER_PAGE ? first_rank - ENTRIES_PER_PAGE : 1);
+			break;
+		
+		case SDLK_RIGHT:
+		case SDLK_PAGEDOWN:
+			if (first_rank + ENTRIES_PER_PAGE <= leaderboard_count(&highscores->leaderboard))
+				first_rank += ENTRIES_PER_PAGE;
+			break;
+		
+		case SDLK_t: first_rank = 1; break;
+		case SDLK_y: first_rank = page_around(get_last_rank()); break;
+		
+		default: break;
+	}
+	
+	if (first_rank != highscores->first_rank)
+	{
+		highscores->first_rank = first_rank;
+		refresh_page(highscores);
+		scene_redraw();
+	}
+}
 
-nav_vars_T run_highscores_menu(void)
+static highscores_T *load_highscores(void)
 {
+	TRACE_SCOPE("load_highscores");
+	
 	highscores_T *highscores = malloc(sizeof(highscores_T));
 	
+	if (open_leaderboard(&highscores->leaderboard) == false)
+	{
+		printf("Couldn't open/find the leaderboard file\n");
+		
+		free(highscores);
+		return NULL;
+	}
+	
 	highscores->highscores_bg = load_image("images/menu_bg.png");
-	apply_surface(0, 0, highscores->highscores_bg, screen);
+	
+	if (canvas_init(&highscores->canvas, highscores->highscores_bg) == false)
+	{
+		printf("Could not allocate the highscores.\n");
+		exit(1);
+	}
+	
+	highscores->drawn = false;
+	highscores->num_shown = 0;
 	
 	/* draw the highscore menu labels */
-	apply_text_blended(20, 15, "Highscores",       font_medium, white_colour, screen);
-	apply_text_blended(20, 70, "\"m\" to go back", font_small,  white_colour, screen);
-	apply_text_blended(20, 94, "\"q\" to quit",    font_small,  white_colour, screen);
+	SDL_Surface *canvas = highscores->canvas.surface;
 	
-	/* read the highscores file and render the results on-screen: */
-	FILE *highscores_file;
-	highscores_file = fopen("highscores", "r+");
+	apply_text_blended(20, 15,  "Highscores",                                   font_medium, white_colour, canvas);
+	apply_text_blended(20, 70,  "\"m\" to go back",                             font_small,  white_colour, canvas);
+	apply_text_blended(20, 94,  "\"q\" to quit",                                font_small,  white_colour, canvas);
+	apply_text_blended(20, 118, "left and right to turn the page",              font_small,  white_colour, canvas);
+	apply_text_blended(20, 142, "\"t\" for the top, \"y\" for your last score", font_small,  white_colour, canvas);
 	
-	if (highscores_file != NULL)
+	return highscores;
+}
+
+/* brings the canvas up to date with the page to show */
+static void refresh_page(highscores_T *highscores)
+{
+	TRACE_SCOPE("refresh highscores page");
+	
+	/* scores are never removed, so an unchanged count means unchanged pages */
+	uint64_t count = leaderboard_count(&highscores->leaderboard);
+	uint64_t last_rank = get_last_rank();
+	
+	if (highscores->drawn == false ||
+	    count != highscores->shown_count ||
+	    last_rank != highscores->shown_last_rank ||
+	    highscores->first_rank != highscores->shown_first_rank)
+		update_page(highscores, count, last_rank);
+}
+
+static void draw_highscores(scene_T *scene)
+{
+	canvas_show(&highscores->canvas);
+}
+
+static void draw_row(highscores_T *highscores, const leaderboard_entry_T *entry, uint64_t rank, int y, bool mine)
+{
+	SDL_Surface *canvas = highscores->canvas.surface;
+	
+	char place[24];
+	snprintf(place, sizeof(place), "%llu.", (unsigned long long) rank);
+	
+	char score_string[12];
+	snprintf(score_string, sizeof(score_string), "%d", entry->score);
+	
+	/* scores imported from the old highscores file have no speed or date */
+	char speed_string[12] = "";
+	if (entry->speed_human >= 0 && entry->speed_human <= 4)
+		snprintf(speed_string, sizeof(speed_string), "speed %d", entry->speed_human + 1);
+	
+	char date_string[16] = "";
+	if (entry->date != 0)
 	{
-		/* same y value as the "press e for help" text in the main menu */
-		int y = 168;
+		time_t date = (time_t) entry->date;
+		struct tm tm;
 		
-		const int HIGHSCORE_ENTRIES = 10;
-		char highscores_strings[HIGHSCORE_ENTRIES][20];
+		if (localtime_r(&date, &tm) != NULL)
+			strftime(date_string, sizeof(date_string), "%d %b %Y", &tm);
+	}
+	
+	apply_text_blended(20,  y, place,        font_small, white_colour, canvas);
+	apply_text_blended(90,  y, (char *) entry->name, font_small, white_colour, canvas);
+	apply_text_blended(290, y, score_string, font_small, white_colour, canvas);
+	apply_text_blended(380, y, speed_string, font_small, white_colour, canvas);
+	apply_text_blended(480, y, date_string,  font_small, white_colour, canvas);
+	
+	/* point out the player's own last score */
+	if (mine)
+		apply_text_blended(600, y, "<", font_small, white_colour, canvas);
+}
+
+/* redraws the rows that differ from what's on the canvas */
+static void update_page(highscores_T *highscores, uint64_t count, uint64_t last_rank)
+{
+	leaderboard_entry_T entries[ENTRIES_PER_PAGE];
+	int num_entries = leaderboard_get(&highscores->leaderboard, highscores->first_rank, ENTRIES_PER_PAGE, entries);
+	
+	bool same_page = highscores->drawn && highscores->first_rank == highscores->shown_first_rank;
+	
+	for (int i = 0; i < ENTRIES_PER_PAGE; i++)
+	{
+		uint64_t rank = highscores->first_rank + i;
 		
-		/*
-		 * Read the highscores from the file and discard the '\n' from
-		 *  each line as TTF_RenderText can't render '\n' and will just
-		 *  display an error character '[]'.
-		*/
-		for (int i = 0; i < HIGHSCORE_ENTRIES; i++)
+		bool had = (i < highscores->num_shown);
+		bool has = (i < num_entries);
+		
+		if (had == false && has == false)
+			continue;
+		
+		if (same_page && had && has &&
+		    entries[i].seq == highscores->shown[i].seq &&
+		    (rank == last_rank) == (rank == highscores->shown_last_rank))
+			continue;
+		
+		SDL_Rect row = { 0, FIRST_ROW_Y + i * ROW_HEIGHT, SCREEN_WIDTH, ROW_HEIGHT };
+		canvas_clear(&highscores->canvas, &row);
+		
+		if (has)
+			draw_row(highscores, &entries[i], rank, row.y, rank == last_rank);
+	}
+	
+	if (highscores->drawn == false || count != highscores->shown_count)
+	{
+		SDL_Rect footer = { 0, COUNT_Y, SCREEN_WIDTH, SCREEN_HEIGHT - COUNT_Y };
+		canvas_clear(&highscores->canvas, &footer);
+		
+		char count_string[48];
+		snprintf(count_string, sizeof(count_string), "%llu scores", (unsigned long long) count);
+		
+		apply_text_blended(20, COUNT_Y, count_string, font_small, white_colour, highscores->canvas.surface);
+	}
+	
+	memcpy(highscores->shown, entries, num_entries * sizeof(leaderboard_entry_T));
+	highscores->num_shown = num_entries;
+	
+	highscores->shown_count = count;
+	highscores->shown_first_rank = highscores->first_rank;
+	highscores->shown_last_rank = last_rank;
+	highscores->drawn = true;
+}
+
+void clean_up_highscores_assets(void)
+{
+	if (highscores == NULL)
+		return;
+	
+	leaderboard_close(&highscores->leaderboard);
+	canvas_free(&highscores->canvas);
+	
+	SDL_FreeSurface(highscores->highscores_bg);
+	free(highscores);
+	
+	highscores = NULL;
+}
+
+static void player_name(char *name)
+{
+	const char *player = getenv("SNAKE_PLAYER");
+	
+	if (player == NULL)
+		player = getenv("USER");
+	
+	if (player == NULL)
+		player = "player";
+	
+	snprintf(name, LEADERBOARD_NAME_LEN + 1, "%s", player);
+}
+
+static uint64_t get_last_rank(void)
+{
+	pthread_mutex_lock(&saver.lock);
+	uint64_t rank = saver.last_rank;
+	pthread_mutex_unlock(&saver.lock);
+	
+	return rank;
+}
+
+/* how many of the copy's scores are as good as `score`, which a new one comes after */
+static uint64_t scores_at_least(int score)
+{
+	uint64_t low = 0, high = saver.num_scores;
+	
+	while (low < high)
+	{
+		uint64_t middle = low + (high - low) / 2;
+		
+		if (saver.scores[middle] >= score)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	
+	return low;
+}
+
+/*
+ * Reads every score in the leaderboard into a new copy, in place of the
+ * old one and the batch it was missing. Only the worker calls this, and it
+ * only takes `saver.lock` to swap the copies over.
+*/
+static void read_scores(leaderboard_T *leaderboard)
+{
+	TRACE_SCOPE("read_scores");
+	
+	uint64_t max_scores = leaderboard_count(leaderboard) + SAVE_QUEUE_SIZE;
+	int *scores = malloc(sizeof(int) * max_scores);
+	
+	if (scores == NULL)
+	{
+		printf("Could not allocate the scores.\n");
+		exit(1);
+	}
+	
+	leaderboard_entry_T entries[SCORES_PER_READ];
+	uint64_t num_scores = 0;
+	int num_read;
+	
+	/* until a read comes up short, as other games may add scores meanwhile */
+	do
+	{
+		num_read = leaderboard_get(leaderboard, num_scores + 1, SCORES_PER_READ, entries);
+		
+		if (num_scores + num_read > max_scores)
 		{
-			char in = 'a';
-			for (int t = 0; t < 20; t++)
+			max_scores = (num_scores + num_read) * 2;
+			scores = realloc(scores, sizeof(int) * max_scores);
+			
+			if (scores == NULL)
 			{
-				in = fgetc(highscores_file);
-				
-				if (in == '\n')
-				{
-					highscores_strings[i][t] = 0;
-					break;
-				}
-				
-				highscores_strings[i][t] = in;
+				printf("Could not allocate the scores.\n");
+				exit(1);
 			}
-			
-			/* draw the place number and the score */
-			char place[4];
-			snprintf(place, 4, "%d.", i + 1);
-			
-			apply_text_blended(20, y, place,                 font_small, white_colour, screen);
-			apply_text_blended(42, y, highscores_strings[i], font_small, white_colour, screen);
-			
-			y += 25; /* move down to the next line */
 		}
 		
-		fclose(highscores_file);
+		for (int i = 0; i < num_read; i++)
+			scores[num_scores++] = entries[i].score;
+	}
+	while (num_read == SCORES_PER_READ);
+	
+	pthread_mutex_lock(&saver.lock);
+	
+	int *old = saver.scores;
+	
+	saver.scores = scores;
+	saver.num_scores = num_scores;
+	saver.max_scores = max_scores;
+	saver.num_saving = 0;
+	
+	pthread_mutex_unlock(&saver.lock);
+	
+	free(old);
+}
+
+/*
+ * Puts the batch just saved into the copy, each after the scores as good
+ * as it, as the leaderboard does. Called with `saver.lock` held.
+*/
+static void add_saved_scores(void)
+{
+	if (saver.num_scores + saver.num_saving > saver.max_scores)
+	{
+		saver.max_scores = saver.max_scores * 2 + saver.num_saving;
+		saver.scores = realloc(saver.scores, sizeof(int) * saver.max_scores);
+		
+		if (saver.scores == NULL)
+		{
+			printf("Could not allocate the scores.\n");
+			exit(1);
+		}
+	}
+	
+	for (int i = 0; i < saver.num_saving; i++)
+	{
+		int score = saver.saving[i];
+		uint64_t at = scores_at_least(score);
+		
+		memmove(saver.scores + at + 1, saver.scores + at, sizeof(int) * (saver.num_scores - at));
+		saver.scores[at] = score;
+		saver.num_scores++;
+	}
+	
+	saver.num_saving = 0;
+}
+
+static void *save_scores(void *unused)
+{
+	leaderboard_T leaderboard;
+	bool opened = open_leaderboard(&leaderboard);
+	
+	/* before anything's submitted, so the first game over doesn't wait for it */
+	if (opened)
+		read_scores(&leaderboard);
+	
+	pthread_mutex_lock(&saver.lock);
+	
+	while (1)
+	{
+		while (saver.queue_len == 0 && saver.stopping == false)
+			pthread_cond_wait(&saver.wake, &saver.lock);
+		
+		/* only stop once everything queued has been saved */
+		if (saver.queue_len == 0)
+			break;
 		
-		SDL_Flip(screen);
+		/* take everything queued and save it as one batch, with one sync */
+		leaderboard_entry_T batch[SAVE_QUEUE_SIZE];
+		int batch_len = saver.queue_len;
 		
-		SDL_Event event;
-		while (1)
+		for (int i = 0; i < batch_len; i++)
 		{
-			SDL_Delay(5);
+			batch[i] = saver.queue[(saver.queue_start + i) % SAVE_QUEUE_SIZE];
+			saver.saving[i] = batch[i].score;
+		}
+		
+		saver.num_saving = batch_len;
+		saver.queue_start = (saver.queue_start + batch_len) % SAVE_QUEUE_SIZE;
+		saver.queue_len = 0;
+		
+		pthread_cond_broadcast(&saver.space);
+		pthread_mutex_unlock(&saver.lock);
+		
+		uint64_t rank = 0;
+		uint64_t count = 0;
+		
+		{
+			TRACE_SCOPE("save scores");
+			
+			if (opened == false)
+				opened = open_leaderboard(&leaderboard);
 			
-			while (SDL_PollEvent(&event))
+			if (opened)
 			{
-				if (event.type == SDL_QUIT || event.key.keysym.sym == SDLK_q)
-				{
-					clean_up_highscores(highscores);
-					return QUIT_ID;
-				}
-				else if (event.key.keysym.sym == SDLK_m)
-				{
-					clean_up_highscores(highscores);
-					return MENU_ID;
-				}
+				for (int i = 0; i < batch_len; i++)
+					rank = leaderboard_insert(&leaderboard, &batch[i]);
+				
+				leaderboard_sync(&leaderboard);
+				count = leaderboard_count(&leaderboard);
 			}
+			
+			if (rank == 0)
+				printf("Couldn't save %d score(s) to the leaderboard file\n", batch_len);
 		}
+		
+		/*
+		 * Only this thread changes the copy, so it can look at it unlocked.
+		 * If other games sharing the file saved scores meanwhile, or it
+		 * hasn't been read yet, it's read again.
+		*/
+		bool stale = (opened && (saver.scores == NULL || (rank != 0 && count != saver.num_scores + batch_len)));
+		
+		if (stale)
+			read_scores(&leaderboard);
+		
+		pthread_mutex_lock(&saver.lock);
+		
+		if (stale == false && rank != 0)
+			add_saved_scores();
+		
+		saver.num_saving = 0;
+		
+		/*
+		 * The rank the score really got, which differs from the provisional
+		 * one if other games sharing the file saved scores meanwhile.
+		*/
+		if (rank != 0 && saver.queue_len == 0)
+			saver.last_rank = rank;
 	}
-	/* Else the highscores file can't be opened: */
-	else
+	
+	pthread_mutex_unlock(&saver.lock);
+	
+	if (opened)
+		leaderboard_close(&leaderboard);
+	
+	return NULL;
+}
+
+void start_saving_scores(void)
+{
+	saver.stopping = false;
+	
+	saver.running = (pthread_create(&saver.thread, NULL, save_scores, NULL) == 0);
+	
+	if (saver.running == false)
+		printf("Couldn't start the score saving thread, scores will be saved as they're submitted\n");
+}
+
+void stop_saving_scores(void)
+{
+	if (saver.running == false)
+		return;
+	
+	TRACE_SCOPE("stop_saving_scores");
+	
+	pthread_mutex_lock(&saver.lock);
+	saver.stopping = true;
+	pthread_cond_signal(&saver.wake);
+	pthread_mutex_unlock(&saver.lock);
+	
+	pthread_join(saver.thread, NULL);
+	saver.running = false;
+	
+	free(saver.scores);
+	saver.scores = NULL;
+	saver.num_scores = 0;
+	saver.max_scores = 0;
+}
+
+/*
+ * The rank a new score will get once it's saved, 0 if it can't be told
+ * yet: after every score in the leaderboard, and every one being saved or
+ * queued before it, that's as good. Never touches the file. Called with
+ * `saver.lock` held.
+*/
+static uint64_t provisional_rank(int new_score)
+{
+	if (saver.scores == NULL)
+		return 0;
+	
+	uint64_t rank = scores_at_least(new_score) + 1;
+	
+	for (int i = 0; i < saver.num_saving; i++)
+		if (saver.saving[i] >= new_score)
+			rank++;
+	
+	for (int i = 0; i < saver.queue_len; i++)
+		if (saver.queue[(saver.queue_start + i) % SAVE_QUEUE_SIZE].score >= new_score)
+			rank++;
+	
+	return rank;
+}
+
+uint64_t submit_score(int new_score)
+{
+	TRACE_SCOPE("submit_score");
+	
+	leaderboard_entry_T entry;
+	memset(&entry, 0, sizeof(leaderboard_entry_T));
+	
+	entry.score = new_score;
+	entry.speed_human = speed_human;
+	entry.date = time(NULL);
+	player_name(entry.name);
+	
+	/* without the worker, fall back to saving right here */
+	if (saver.running == false)
 	{
-		printf("Couldn't open/find the highscores file");
+		leaderboard_T leaderboard;
+		uint64_t rank = 0;
+		
+		if (open_leaderboard(&leaderboard))
+		{
+			rank = leaderboard_insert(&leaderboard, &entry);
+			leaderboard_sync(&leaderboard);
+			leaderboard_close(&leaderboard);
+		}
+		else
+			printf("Couldn't open/find the leaderboard file\n");
 		
-		clean_up_highscores(highscores);
-		return MENU_ID;
+		pthread_mutex_lock(&saver.lock);
+		saver.last_rank = rank;
+		pthread_mutex_unlock(&saver.lock);
+		
+		return rank;
 	}
+	
+	pthread_mutex_lock(&saver.lock);
+	
+	while (saver.queue_len == SAVE_QUEUE_SIZE)
+		pthread_cond_wait(&saver.space, &saver.lock);
+	
+	uint64_t rank = provisional_rank(new_score);
+	saver.last_rank = rank;
+	
+	saver.queue[(saver.queue_start + saver.queue_len) % SAVE_QUEUE_SIZE] = entry;
+	saver.queue_len++;
+	
+	pthread_cond_signal(&saver.wake);
+	pthread_mutex_unlock(&saver.lock);
+	
+	return rank;
 }
 
-static void clean_up_highscores(highscores_T *highscores)
+/* opens the leaderboard, seeding a new one with the old highscores file */
+static bool open_leaderboard(leaderboard_T *leaderboard)
 {
-	SDL_FreeSurface(highscores->highscores_bg);
-	free(highscores);
+	TRACE_SCOPE("open_leaderboard");
+	
+	/* only used if the leaderboard is new, which `leaderboard_open()` decides under its lock */
+	leaderboard_entry_T old[NUM_HIGHSCORES];
+	int num_old = 0;
+	
+	FILE *old_file = fopen(OLD_HIGHSCORES_FILE, "r");
+	
+	if (old_file != NULL)
+	{
+		char line[20];
+		
+		while (num_old < NUM_HIGHSCORES && fgets(line, sizeof(line), old_file) != NULL)
+		{
+			leaderboard_entry_T *entry = &old[num_old];
+			memset(entry, 0, sizeof(leaderboard_entry_T));
+			
+			entry->score = atoi(line);
+			entry->speed_human = -1;
+			strcpy(entry->name, "-");
+			
+			if (entry->score > 0)
+				num_old++;
+		}
+		
+		fclose(old_file);
+	}
+	
+	return leaderboard_open(leaderboard, LEADERBOARD_FILE, old, num_old);
 }
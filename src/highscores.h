@@ -1,7 +1,26 @@
 #ifndef HIGHSCORES_H
 #define HIGHSCORES_H
 
-#include "constants.h"
+#include <stdint.h>
 
-nav_vars_T run_highscores_menu (void);
+/* a score ranked this high or better counts as a new highscore */
+#define NUM_HIGHSCORES 10
+
+/* pushes the highscores screen, at the page with the last score played on it */
+void open_highscores(void);
+
+/*
+ * Queues a score to be saved to the leaderboard under the player's name
+ * (SNAKE_PLAYER, else the login name), and returns straight away with its
+ * provisional rank, or 0 if the leaderboard hasn't been read yet or can't
+ * be.
+*/
+uint64_t submit_score(int score);
+
+/* the thread that saves submitted scores; stopping waits for it to finish */
+void start_saving_scores(void);
+void stop_saving_scores(void);
+
+/* frees the highscores screen, which is otherwise kept between visits */
+void clean_up_highscores_assets(void);
 #endif
@@ -0,0 +1,231 @@
+#include "latency.h"
+#include "game.h"
+#include "globals.h"
+#include "telemetry.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+bool latency_enabled = false;
+
+static struct
+{
+	int probes;
+	int64_t *samples; /* ns */
+	int num_samples;
+	int lost;
+	bool quitting;
+	
+	/* the tick the next probe's planned for, and when in the wait it's pushed */
+	uint32_t planned_tick;
+	Uint32 push_at;
+	
+	/* the probe waiting to show, and whether it's in the frame being flipped */
+	bool in_flight;
+	bool drawn;
+	uint32_t tick;
+	direction_T dir; /* the way the snake goes once it's turned */
+	int64_t pushed;
+} harness;
+
+static void report(void);
+static Uint32 get_pixel(SDL_Surface *, int x, int y);
+
+bool latency_run(int probes)
+{
+	harness.probes = probes;
+	harness.samples = malloc(sizeof(int64_t) * probes);
+	
+	if (harness.samples == NULL)
+		return false;
+	
+	latency_enabled = true;
+	
+	for (speed_human = 0; speed_human < 5; speed_human++)
+	{
+		/* as `set_speed()` in the menu */
+		speed = 220 - speed_human * 35;
+		score_multiplier = speed_score_multiplier(speed_human);
+		
+		harness.num_samples = 0;
+		harness.lost = 0;
+		harness.quitting = false;
+		
+		/* dying only means another game */
+		while (run_latency_game() == false)
+		{
+			if (harness.in_flight)
+				harness.lost++;
+			
+			harness.in_flight = false;
+			harness.planned_tick = UINT32_MAX;
+		}
+		
+		harness.in_flight = false;
+		report();
+	}
+	
+	latency_enabled = false;
+	
+	free(harness.samples);
+	harness.samples = NULL;
+	
+	return true;
+}
+
+void latency_poll(const board_T *board, clock_t move_timer)
+{
+	const snake_T *snake = &board->snake[0];
+	
+	if (harness.num_samples == harness.probes)
+	{
+		if (harness.quitting == false)
+		{
+			SDL_Event quit = { .type = SDL_QUIT };
+			SDL_PushEvent(&quit);
+			
+			harness.quitting = true;
+		}
+		
+		return;
+	}
+	
+	if (harness.in_flight || snake->alive == false)
+		return;
+	
+	/* a random point in the wait for each tick, the first time round after the last */
+	if (harness.planned_tick != board->tick + 1)
+	{
+		harness.planned_tick = board->tick + 1;
+		harness.push_at = move_timer - speed + rand() % speed;
+	}
+	
+	if (SDL_GetTicks() < harness.push_at)
+		return;
+	
+	/* one probe per tick at most, pushed or not */
+	harness.push_at = UINT32_MAX;
+	
+	direction_T left = (snake->dir + 1) & 3;
+	direction_T right = (snake->dir + 3) & 3;
+	
+	cell_kind_T left_kind = CELL_KIND(board->grid[board_step(board, snake->head, left)]);
+	cell_kind_T right_kind = CELL_KIND(board->grid[board_step(board, snake->head, right)]);
+	
+	bool left_clear = (left_kind != CELL_ROCK && left_kind != CELL_SNAKE);
+	bool right_clear = (right_kind != CELL_ROCK && right_kind != CELL_SNAKE);
+	
+	if (left_clear == false && right_clear == false)
+		return;
+	
+	bool go_left = (left_clear && (right_clear == false || rand() % 2 == 0));
+	
+	/* reversed controls swap the keys */
+	SDL_Event event = { .type = SDL_KEYDOWN };
+	event.key.state = SDL_PRESSED;
+	event.key.keysym.sym = ((go_left != snake->controls_reversed) ? SDLK_a : SDLK_d);
+	
+	if (SDL_PushEvent(&event) != 0)
+		return;
+	
+	harness.in_flight = true;
+	harness.tick = board->tick;
+	harness.dir = (go_left ? left : right);
+	harness.pushed = telemetry_now();
+}
+
+void latency_drawn(SDL_Surface *screen, const board_T *board, unsigned int head_colour)
+{
+	const snake_T *snake = &board->snake[0];
+	
+	if (harness.in_flight == false || harness.drawn || board->tick == harness.tick)
+		return;
+	
+	/* a key pushed just before the tick isn't seen until after it, so it may take two */
+	if (snake->dir != harness.dir)
+	{
+		if (board->tick > harness.tick + 1)
+		{
+			harness.lost++;
+			harness.in_flight = false;
+		}
+		
+		return;
+	}
+	
+	int x = ((snake->head % board->config.cols) * CELL_SIZE + BLOCK_SIZE / 2) * screen_scale;
+	int y = ((snake->head / board->config.cols) * CELL_SIZE + BLOCK_SIZE / 2) * screen_scale;
+	
+	Uint32 head = SDL_MapRGB(screen->format, head_colour >> 24, head_colour >> 16, head_colour >> 8);
+	
+	if (get_pixel(screen, x, y) == head)
+		harness.drawn = true;
+	else
+	{
+		harness.lost++;
+		harness.in_flight = false;
+	}
+}
+
+void latency_presented(void)
+{
+	if (harness.drawn == false)
+		return;
+	
+	harness.samples[harness.num_samples++] = telemetry_now() - harness.pushed;
+	
+	harness.drawn = false;
+	harness.in_flight = false;
+}
+
+static Uint32 get_pixel(SDL_Surface *surface, int x, int y)
+{
+	SDL_LockSurface(surface);
+	
+	int bytes = surface->format->BytesPerPixel;
+	Uint8 *p = (Uint8 *) surface->pixels + y * surface->pitch + x * bytes;
+	Uint32 pixel;
+	
+	switch (bytes)
+	{
+		case 1:  pixel = *p;                            break;
+		case 2:  pixel = *(Uint16 *) p;                 break;
+		case 3:  pixel = p[0] | p[1] << 8 | p[2] << 16; break;
+		default: pixel = *(Uint32 *) p;                 break;
+	}
+	
+	SDL_UnlockSurface(surface);
+	
+	return pixel;
+}
+
+static int compare_samples(const void *a, const void *b)
+{
+	int64_t x = *(const int64_t *) a;
+	int64_t y = *(const int64_t *) b;
+	
+	return (x > y) - (x < y);
+}
+
+static void report(void)
+{
+	int n = harness.num_samples;
+	
+	printf("speed %d (%3dms ticks): %d probes, %d lost", speed_human + 1, speed, n, harness.lost);
+	
+	if (n == 0)
+	{
+		printf("\n");
+		return;
+	}
+	
+	qsort(harness.samples, n, sizeof(int64_t), compare_samples);
+	
+	int64_t total = 0;
+	for (int i = 0; i < n; i++)
+		total += harness.samples[i];
+	
+	printf("\n  min %.1fms, median %.1fms, p90 %.1fms, p99 %.1fms, max %.1fms, mean %.1fms\n",
+		harness.samples[0] / 1e6, harness.samples[n / 2] / 1e6, harness.samples[n * 9 / 10] / 1e6,
+		harness.samples[n * 99 / 100] / 1e6, harness.samples[n - 1] / 1e6, total / 1e6 / n);
+}
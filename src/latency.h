@@ -0,0 +1,47 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include "board.h"
+
+#include <SDL/SDL.h>
+#include <stdbool.h>
+#include <time.h>
+
+/*
+ * Keypress-to-pixel latency: how long a turn takes from the key going down
+ * to the turned head being on screen, through the poll loop, the wait for
+ * the tick, the tick, `draw_game()` and SDL_Flip.
+ *
+ * `main --latency [probes]` plays games at each speed in turn, on the dummy
+ * video driver so it needs no display. While a game's waiting for its next
+ * tick, the harness pushes an "a" or "d" key event with SDL_PushEvent at a
+ * random point in the wait, toward whichever side is clear. Every frame,
+ * it reads the screen where the turn puts the head once the frame's drawn
+ * but before it's flipped, as after the flip a double buffered screen
+ * holds the frame before. Once it's the head's colour, the time from the
+ * push to the flip is a sample. A probe is lost if the tick that should've
+ * turned the snake doesn't (say it died).
+ *
+ * The harness's games aren't recorded or logged to telemetry, as nobody
+ * played them.
+ *
+ * The samples are reported per speed as a distribution. Waiting for the
+ * tick is most of it, so expect about half a tick on average.
+*/
+
+#define LATENCY_PROBES 200 /* per speed, by default */
+
+extern bool latency_enabled;
+
+/* plays the games and reports; returns false if one couldn't be played */
+bool latency_run(int probes);
+
+/* the game's hooks: every time round the poll loop, until `move_timer` */
+void latency_poll(const board_T *, clock_t move_timer);
+
+/* and once every frame's drawn, with the colour the human's head is drawn in */
+void latency_drawn(SDL_Surface *screen, const board_T *, unsigned int head_colour);
+
+/* and once it's flipped */
+void latency_presented(void);
+#endif
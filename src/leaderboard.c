@@ -0,0 +1,566 @@
+#define _DEFAULT_SOURCE
+
+#include "leaderboard.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+#define LEADERBOARD_MAGIC   "SNKL"
+#define LEADERBOARD_VERSION 1
+
+/*
+ * Page 0 is the header:
+ *
+ *   "SNKL", u32 version, u32 page size, u32 root page, u32 number of pages,
+ *   u64 number of entries, u64 next sequence number
+ *
+ * Every other page is a node: u8 kind, u8 unused, u16 number of items,
+ * u32 next leaf (leaves only, 0 for the last one), 8 unused bytes, then
+ * the items. All numbers are little endian.
+*/
+#define NODE_HEADER_SIZE 16
+
+/* score, seq, date, speed, name */
+#define ENTRY_SIZE (4 + 8 + 8 + 1 + LEADERBOARD_NAME_LEN)
+
+/* first key of the child, child page, number of entries under the child */
+#define BRANCH_SIZE (4 + 8 + 4 + 4)
+
+#define LEAF_MAX   ((LEADERBOARD_PAGE_SIZE - NODE_HEADER_SIZE) / ENTRY_SIZE)
+#define BRANCH_MAX ((LEADERBOARD_PAGE_SIZE - NODE_HEADER_SIZE) / BRANCH_SIZE)
+
+enum { NODE_LEAF = 1, NODE_BRANCH = 2 };
+
+typedef struct
+{
+	int32_t score;
+	uint64_t seq;
+} key_T;
+
+typedef struct
+{
+	key_T key;
+	uint32_t child;
+	uint32_t size;
+} branch_T;
+
+/* a decoded page, with room for one item too many before it's split */
+typedef struct
+{
+	bool leaf;
+	int count;
+	uint32_t next;
+	
+	leaderboard_entry_T entry[LEAF_MAX + 1];
+	branch_T branch[BRANCH_MAX + 1];
+} node_T;
+
+/* what a node that overflowed handed to its new right sibling */
+typedef struct
+{
+	bool happened;
+	
+	key_T key;
+	uint32_t page;
+	uint32_t size;
+} split_T;
+
+static bool read_header(leaderboard_T *);
+static bool write_header(leaderboard_T *);
+static uint64_t insert_entry(leaderboard_T *, leaderboard_entry_T *);
+static bool read_node(leaderboard_T *, uint32_t page, node_T *);
+static bool write_node(leaderboard_T *, uint32_t page, const node_T *);
+
+static void put_le(uint8_t *buf, uint64_t value, int len)
+{
+	for (int i = 0; i < len; i++)
+		buf[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *buf, int len)
+{
+	uint64_t value = 0;
+	
+	for (int i = 0; i < len; i++)
+		value |= (uint64_t) buf[i] << (8 * i);
+	
+	return value;
+}
+
+/* true if `a` ranks above `b` */
+static bool before(key_T a, key_T b)
+{
+	return a.score > b.score || (a.score == b.score && a.seq < b.seq);
+}
+
+static key_T entry_key(const leaderboard_entry_T *entry)
+{
+	key_T key = { entry->score, entry->seq };
+	return key;
+}
+
+/* the number of entries in a leaf that rank above `key` */
+static int leaf_position(const node_T *node, key_T key)
+{
+	int low = 0;
+	int high = node->count;
+	
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+		
+		if (before(entry_key(&node->entry[mid]), key))
+			low = mid + 1;
+		else
+			high = mid;
+	}
+	
+	return low;
+}
+
+/* the child of a branch node whose subtree `key` belongs in */
+static int branch_position(const node_T *node, key_T key)
+{
+	/* the first child's key is never compared, it covers everything above */
+	int low = 1;
+	int high = node->count;
+	
+	while (low < high)
+	{
+		int mid = (low + high) / 2;
+		
+		if (before(key, node->branch[mid].key))
+			high = mid;
+		else
+			low = mid + 1;
+	}
+	
+	return low - 1;
+}
+
+bool leaderboard_open(leaderboard_T *lb, const char *path, const leaderboard_entry_T *seed, int num_seed)
+{
+	memset(lb, 0, sizeof(leaderboard_T));
+	
+	lb->fd = open(path, O_RDWR | O_CREAT, 0644);
+	if (lb->fd == -1)
+		return false;
+	
+	flock(lb->fd, LOCK_EX);
+	
+	bool ok;
+	
+	if (lseek(lb->fd, 0, SEEK_END) == 0)
+	{
+		/* a new file: the header and an empty leaf as the root */
+		node_T *root = calloc(1, sizeof(node_T));
+		
+		lb->root = 1;
+		lb->num_pages = 2;
+		
+		ok = (root != NULL);
+		
+		if (ok)
+		{
+			root->leaf = true;
+			ok = write_node(lb, 1, root) && write_header(lb);
+		}
+		
+		free(root);
+		
+		/* still under the lock, so nobody else can see the file before it's seeded */
+		for (int i = 0; i < num_seed && ok; i++)
+		{
+			leaderboard_entry_T entry = seed[i];
+			ok = (insert_entry(lb, &entry) != 0);
+		}
+	}
+	else
+		ok = read_header(lb);
+	
+	flock(lb->fd, LOCK_UN);
+	
+	if (ok == false)
+	{
+		close(lb->fd);
+		lb->fd = -1;
+	}
+	
+	return ok;
+}
+
+void leaderboard_close(leaderboard_T *lb)
+{
+	if (lb->fd != -1)
+		close(lb->fd);
+	
+	lb->fd = -1;
+}
+
+uint64_t leaderboard_count(leaderboard_T *lb)
+{
+	flock(lb->fd, LOCK_SH);
+	read_header(lb);
+	flock(lb->fd, LOCK_UN);
+	
+	return lb->count;
+}
+
+static void split_node(leaderboard_T *lb, node_T *node, node_T *right, split_T *split)
+{
+	int half = node->count / 2;
+	
+	right->leaf = node->leaf;
+	right->count = node->count - half;
+	node->count = half;
+	
+	split->happened = true;
+	split->page = lb->num_pages++;
+	split->size = 0;
+	
+	if (node->leaf)
+	{
+		memcpy(right->entry, &node->entry[half], right->count * sizeof(leaderboard_entry_T));
+		
+		right->next = node->next;
+		node->next = split->page;
+		
+		split->key = entry_key(&right->entry[0]);
+		split->size = right->count;
+	}
+	else
+	{
+		memcpy(right->branch, &node->branch[half], right->count * sizeof(branch_T));
+		
+		right->next = 0;
+		
+		split->key = right->branch[0].key;
+		for (int i = 0; i < right->count; i++)
+			split->size += right->branch[i].size;
+	}
+}
+
+/*
+ * Inserts the entry somewhere under `page`, adding the number of entries
+ * ranked above it in that subtree to `rank`.
+*/
+static bool insert_under(leaderboard_T *lb, uint32_t page, const leaderboard_entry_T *entry,
+                         uint64_t *rank, split_T *split)
+{
+	node_T node;
+	if (read_node(lb, page, &node) == false)
+		return false;
+	
+	key_T key = entry_key(entry);
+	split->happened = false;
+	
+	if (node.leaf)
+	{
+		int i = leaf_position(&node, key);
+		
+		memmove(&node.entry[i + 1], &node.entry[i], (node.count - i) * sizeof(leaderboard_entry_T));
+		node.entry[i] = *entry;
+		node.count++;
+		
+		*rank += i;
+	}
+	else
+	{
+		int i = branch_position(&node, key);
+		
+		for (int j = 0; j < i; j++)
+			*rank += node.branch[j].size;
+		
+		split_T child_split;
+		if (insert_under(lb, node.branch[i].child, entry, rank, &child_split) == false)
+			return false;
+		
+		node.branch[i].size++;
+		
+		if (child_split.happened)
+		{
+			node.branch[i].size -= child_split.size;
+			
+			memmove(&node.branch[i + 2], &node.branch[i + 1], (node.count - i - 1) * sizeof(branch_T));
+			node.branch[i + 1].key = child_split.key;
+			node.branch[i + 1].child = child_split.page;
+			node.branch[i + 1].size = child_split.size;
+			node.count++;
+		}
+	}
+	
+	if (node.count > (node.leaf ? LEAF_MAX : BRANCH_MAX))
+	{
+		node_T right;
+		split_node(lb, &node, &right, split);
+		
+		if (write_node(lb, split->page, &right) == false)
+			return false;
+	}
+	
+	return write_node(lb, page, &node);
+}
+
+uint64_t leaderboard_insert(leaderboard_T *lb, leaderboard_entry_T *entry)
+{
+	flock(lb->fd, LOCK_EX);
+	
+	uint64_t rank = (read_header(lb) ? insert_entry(lb, entry) : 0);
+	
+	flock(lb->fd, LOCK_UN);
+	return rank;
+}
+
+/* `leaderboard_insert()` with the file already locked and the header read */
+static uint64_t insert_entry(leaderboard_T *lb, leaderboard_entry_T *entry)
+{
+	uint64_t rank = 0;
+	
+	entry->seq = lb->next_seq++;
+	
+	split_T split;
+	bool ok = insert_under(lb, lb->root, entry, &rank, &split);
+	
+	if (ok)
+	{
+		lb->count++;
+		
+		/* the root split, so the tree grows a level */
+		if (split.happened)
+		{
+			node_T root;
+			memset(&root, 0, sizeof(node_T));
+			
+			root.count = 2;
+			
+			root.branch[0].child = lb->root;
+			root.branch[0].size = lb->count - split.size;
+			
+			root.branch[1].key = split.key;
+			root.branch[1].child = split.page;
+			root.branch[1].size = split.size;
+			
+			lb->root = lb->num_pages++;
+			ok = write_node(lb, lb->root, &root);
+		}
+	}
+	
+	return (ok && write_header(lb) ? rank + 1 : 0);
+}
+
+bool leaderboard_sync(leaderboard_T *lb)
+{
+	return fdatasync(lb->fd) == 0;
+}
+
+uint64_t leaderboard_rank(leaderboard_T *lb, int score)
+{
+	flock(lb->fd, LOCK_SH);
+	
+	/* a new entry comes after every existing one with the same score */
+	key_T key = { score, UINT64_MAX };
+	
+	uint64_t rank = 1;
+	
+	if (read_header(lb))
+	{
+		uint32_t page = lb->root;
+		node_T node;
+		
+		while (read_node(lb, page, &node))
+		{
+			if (node.leaf)
+			{
+				rank += leaf_position(&node, key);
+				break;
+			}
+			
+			int i = branch_position(&node, key);
+			
+			for (int j = 0; j < i; j++)
+				rank += node.branch[j].size;
+			
+			page = node.branch[i].child;
+		}
+	}
+	
+	flock(lb->fd, LOCK_UN);
+	return rank;
+}
+
+int leaderboard_get(leaderboard_T *lb, uint64_t rank, int n, leaderboard_entry_T *entries)
+{
+	flock(lb->fd, LOCK_SH);
+	
+	int num_read = 0;
+	
+	if (rank >= 1 && read_header(lb) && rank <= lb->count)
+	{
+		/* find the leaf holding the entry at `rank` */
+		uint64_t skip = rank - 1;
+		uint32_t page = lb->root;
+		
+		node_T node;
+		bool ok;
+		
+		while ((ok = read_node(lb, page, &node)) && node.leaf == false)
+		{
+			int i = 0;
+			
+			while (i < node.count - 1 && skip >= node.branch[i].size)
+				skip -= node.branch[i++].size;
+			
+			page = node.branch[i].child;
+		}
+		
+		/* then read along the leaves */
+		while (ok && num_read < n)
+		{
+			for (int i = (int) skip; i < node.count && num_read < n; i++)
+				entries[num_read++] = node.entry[i];
+			
+			skip = 0;
+			
+			if (node.next == 0)
+				break;
+			
+			ok = read_node(lb, node.next, &node);
+		}
+	}
+	
+	flock(lb->fd, LOCK_UN);
+	return num_read;
+}
+
+static bool read_header(leaderboard_T *lb)
+{
+	uint8_t page[LEADERBOARD_PAGE_SIZE];
+	
+	if (pread(lb->fd, page, sizeof(page), 0) != sizeof(page))
+		return false;
+	
+	if (memcmp(page, LEADERBOARD_MAGIC, 4) != 0 ||
+	    get_le(page + 4, 4) != LEADERBOARD_VERSION ||
+	    get_le(page + 8, 4) != LEADERBOARD_PAGE_SIZE)
+		return false;
+	
+	lb->root      = get_le(page + 12, 4);
+	lb->num_pages = get_le(page + 16, 4);
+	lb->count     = get_le(page + 20, 8);
+	lb->next_seq  = get_le(page + 28, 8);
+	
+	return lb->root != 0 && lb->root < lb->num_pages;
+}
+
+static bool write_header(leaderboard_T *lb)
+{
+	uint8_t page[LEADERBOARD_PAGE_SIZE];
+	memset(page, 0, sizeof(page));
+	
+	memcpy(page, LEADERBOARD_MAGIC, 4);
+	put_le(page + 4,  LEADERBOARD_VERSION, 4);
+	put_le(page + 8,  LEADERBOARD_PAGE_SIZE, 4);
+	put_le(page + 12, lb->root, 4);
+	put_le(page + 16, lb->num_pages, 4);
+	put_le(page + 20, lb->count, 8);
+	put_le(page + 28, lb->next_seq, 8);
+	
+	return pwrite(lb->fd, page, sizeof(page), 0) == sizeof(page);
+}
+
+static bool read_node(leaderboard_T *lb, uint32_t page_num, node_T *node)
+{
+	uint8_t page[LEADERBOARD_PAGE_SIZE];
+	
+	if (page_num == 0 || page_num >= lb->num_pages ||
+	    pread(lb->fd, page, sizeof(page), (off_t) page_num * LEADERBOARD_PAGE_SIZE) != sizeof(page))
+		return false;
+	
+	node->leaf = (page[0] == NODE_LEAF);
+	node->count = get_le(page + 2, 2);
+	node->next = get_le(page + 4, 4);
+	
+	if (page[0] != NODE_LEAF && page[0] != NODE_BRANCH)
+		return false;
+	
+	if (node->leaf ? node->count > LEAF_MAX : (node->count < 1 || node->count > BRANCH_MAX))
+		return false;
+	
+	const uint8_t *item = page + NODE_HEADER_SIZE;
+	
+	for (int i = 0; i < node->count; i++)
+	{
+		if (node->leaf)
+		{
+			leaderboard_entry_T *entry = &node->entry[i];
+			
+			entry->score       = (int32_t) get_le(item, 4);
+			entry->seq         = get_le(item + 4, 8);
+			entry->date        = (int64_t) get_le(item + 12, 8);
+			entry->speed_human = item[20];
+			
+			memcpy(entry->name, item + 21, LEADERBOARD_NAME_LEN);
+			entry->name[LEADERBOARD_NAME_LEN] = '\0';
+			
+			item += ENTRY_SIZE;
+		}
+		else
+		{
+			branch_T *branch = &node->branch[i];
+			
+			branch->key.score = (int32_t) get_le(item, 4);
+			branch->key.seq   = get_le(item + 4, 8);
+			branch->child     = get_le(item + 12, 4);
+			branch->size      = get_le(item + 16, 4);
+			
+			item += BRANCH_SIZE;
+		}
+	}
+	
+	return true;
+}
+
+static bool write_node(leaderboard_T *lb, uint32_t page_num, const node_T *node)
+{
+	uint8_t page[LEADERBOARD_PAGE_SIZE];
+	memset(page, 0, sizeof(page));
+	
+	page[0] = (node->leaf ? NODE_LEAF : NODE_BRANCH);
+	put_le(page + 2, node->count, 2);
+	put_le(page + 4, node->next, 4);
+	
+	uint8_t *item = page + NODE_HEADER_SIZE;
+	
+	for (int i = 0; i < node->count; i++)
+	{
+		if (node->leaf)
+		{
+			const leaderboard_entry_T *entry = &node->entry[i];
+			
+			put_le(item,      (uint32_t) entry->score, 4);
+			put_le(item + 4,  entry->seq, 8);
+			put_le(item + 12, (uint64_t) entry->date, 8);
+			item[20] = (uint8_t) entry->speed_human;
+			
+			strncpy((char *) item + 21, entry->name, LEADERBOARD_NAME_LEN);
+			
+			item += ENTRY_SIZE;
+		}
+		else
+		{
+			const branch_T *branch = &node->branch[i];
+			
+			put_le(item,      (uint32_t) branch->key.score, 4);
+			put_le(item + 4,  branch->key.seq, 8);
+			put_le(item + 12, branch->child, 4);
+			put_le(item + 16, branch->size, 4);
+			
+			item += BRANCH_SIZE;
+		}
+	}
+	
+	return pwrite(lb->fd, page, sizeof(page), (off_t) page_num * LEADERBOARD_PAGE_SIZE) == sizeof(page);
+}
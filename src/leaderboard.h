@@ -0,0 +1,79 @@
+#ifndef LEADERBOARD_H
+#define LEADERBOARD_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Every score ever submitted, ranked.
+ *
+ * The file is a B+ tree of fixed size pages, ordered best score first (and
+ * on equal scores, earliest first). Every internal page keeps the number of
+ * entries under each of its children, so finding an entry by rank, or the
+ * rank of a score, only reads one page per level, as does an insert. A
+ * million entries is a tree three pages deep.
+ *
+ * Every call takes a lock on the file for its duration, so several games
+ * can share one leaderboard, e.g. over a network filesystem.
+*/
+
+#define LEADERBOARD_PAGE_SIZE 4096
+#define LEADERBOARD_NAME_LEN  19
+
+typedef struct
+{
+	int score;
+	int speed_human;
+	int64_t date; /* seconds since the epoch */
+	char name[LEADERBOARD_NAME_LEN + 1];
+	
+	/* order of submission, breaks ties between equal scores */
+	uint64_t seq;
+} leaderboard_entry_T;
+
+typedef struct
+{
+	int fd;
+	
+	/* from the header page, reread at the start of every call */
+	uint32_t root;
+	uint32_t num_pages;
+	uint64_t count;
+	uint64_t next_seq;
+} leaderboard_T;
+
+/*
+ * Creates the file if needed, starting it with the `num_seed` entries in
+ * `seed` (e.g. scores from before there was a leaderboard). Seeding only
+ * happens to a file this call created, before anyone else can read it, so
+ * several games opening a new file at once don't each add them. Returns
+ * false if the file can't be opened.
+*/
+bool leaderboard_open(leaderboard_T *, const char *path, const leaderboard_entry_T *seed, int num_seed);
+void leaderboard_close(leaderboard_T *);
+
+/* the number of entries */
+uint64_t leaderboard_count(leaderboard_T *);
+
+/*
+ * Adds an entry, filling in its `seq`. Returns its rank, counting from 1,
+ * or 0 if the file couldn't be written.
+*/
+uint64_t leaderboard_insert(leaderboard_T *, leaderboard_entry_T *);
+
+/*
+ * Writes go to the operating system's cache; this waits until everything
+ * written so far is on the disk.
+*/
+bool leaderboard_sync(leaderboard_T *);
+
+/* the rank a score submitted now would get */
+uint64_t leaderboard_rank(leaderboard_T *, int score);
+
+/*
+ * Reads up to `n` entries starting at `rank` (counting from 1), e.g. rank
+ * 1 for the top n, or a little before a player's rank for the scores
+ * around theirs. Returns the number read.
+*/
+int leaderboard_get(leaderboard_T *, uint64_t rank, int n, leaderboard_entry_T *);
+#endif
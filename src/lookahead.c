@@ -0,0 +1,361 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "lookahead.h"
+#include "trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * What dying in a rollout costs, in apples: the whole of it for dying
+ * straight away, half of it for dying on the last move played out.
+*/
+#define DEATH_COST 20
+
+static const turn_T candidates[3] = { TURN_NONE, TURN_LEFT, TURN_RIGHT };
+
+static void *run_worker(void *);
+static void search(lookahead_worker_T *);
+
+static int64_t now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/* xorshift, as `board_rand()` */
+static uint32_t next_rand(uint32_t *rng)
+{
+	uint32_t x = *rng;
+	
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	
+	return *rng = x;
+}
+
+bool lookahead_init(lookahead_T *lookahead, const board_config_T *config, int num_threads)
+{
+	memset(lookahead, 0, sizeof(lookahead_T));
+	
+	lookahead->config = *config;
+	
+	if (num_threads < 1)
+		num_threads = 1;
+	
+	lookahead->workers = calloc(num_threads, sizeof(lookahead_worker_T));
+	
+	if (lookahead->workers == NULL)
+		return false;
+	
+	pthread_mutex_init(&lookahead->lock, NULL);
+	pthread_cond_init(&lookahead->start, NULL);
+	pthread_cond_init(&lookahead->finished, NULL);
+	
+	uint32_t seed = (uint32_t) now();
+	
+	for (int i = 0; i < num_threads; i++)
+	{
+		lookahead_worker_T *worker = &lookahead->workers[i];
+		
+		worker->lookahead = lookahead;
+		worker->rng = (seed ^ (0x9E3779B9 * (i + 1))) | 1;
+		
+		if (board_init(&worker->board, config, 1) == false)
+		{
+			lookahead_free(lookahead);
+			return false;
+		}
+		
+		/* worker 0 is the caller */
+		if (i > 0 && pthread_create(&worker->thread, NULL, run_worker, worker) != 0)
+		{
+			board_free(&worker->board);
+			break;
+		}
+		
+		lookahead->num_workers++;
+	}
+	
+	return true;
+}
+
+void lookahead_free(lookahead_T *lookahead)
+{
+	pthread_mutex_lock(&lookahead->lock);
+	lookahead->stopping = true;
+	pthread_cond_broadcast(&lookahead->start);
+	pthread_mutex_unlock(&lookahead->lock);
+	
+	for (int i = 1; i < lookahead->num_workers; i++)
+		pthread_join(lookahead->workers[i].thread, NULL);
+	
+	for (int i = 0; i < lookahead->num_workers; i++)
+		board_free(&lookahead->workers[i].board);
+	
+	free(lookahead->workers);
+	
+	pthread_mutex_destroy(&lookahead->lock);
+	pthread_cond_destroy(&lookahead->start);
+	pthread_cond_destroy(&lookahead->finished);
+	
+	memset(lookahead, 0, sizeof(lookahead_T));
+}
+
+/* the cell the snake would move into if it turned this way */
+static uint32_t turn_cell(const board_T *board, const snake_T *snake, turn_T turn)
+{
+	direction_T dir = snake->dir;
+	
+	if (turn != TURN_NONE)
+	{
+		/* reversed controls swap left and right, as in `board_turn()` */
+		bool left = ((turn == TURN_LEFT) != snake->controls_reversed);
+		dir = (dir + (left ? 1 : 3)) & 3;
+	}
+	
+	return board_step(board, snake->head, dir);
+}
+
+static bool is_solid(const board_T *board, uint32_t cell)
+{
+	int kind = CELL_KIND(board->grid[cell]);
+	return kind == CELL_SNAKE || kind == CELL_ROCK;
+}
+
+/* moves to the nearest apple, the short way round the edges if need be */
+static int apple_distance(const board_T *board, uint32_t cell)
+{
+	int cols = board->config.cols;
+	int rows = board->config.rows;
+	
+	int nearest = cols + rows;
+	
+	for (int i = 0; i < board->config.num_apples; i++)
+	{
+		if (board->apple[i] == NO_CELL)
+			continue;
+		
+		int dx = abs(cell_x(board, cell) - cell_x(board, board->apple[i]));
+		int dy = abs(cell_y(board, cell) - cell_y(board, board->apple[i]));
+		
+		int distance = (dx < cols - dx ? dx : cols - dx) +
+		               (dy < rows - dy ? dy : rows - dy);
+		
+		if (distance < nearest)
+			nearest = distance;
+	}
+	
+	return nearest;
+}
+
+/* the turn nothing solid is in the way of, else straight on */
+static turn_T safe_turn(const board_T *board, int snake)
+{
+	for (int i = 0; i < 3; i++)
+		if (is_solid(board, turn_cell(board, &board->snake[snake], candidates[i])) == false)
+			return candidates[i];
+	
+	return TURN_NONE;
+}
+
+turn_T lookahead_choose(lookahead_T *lookahead, const board_T *board, int snake, int budget_us)
+{
+	TRACE_SCOPE("lookahead_choose");
+	
+	int64_t start = now();
+	
+	pthread_mutex_lock(&lookahead->lock);
+	
+	lookahead->root = board;
+	lookahead->snake = snake;
+	lookahead->deadline = start + (int64_t) budget_us * 1000;
+	
+	memset(lookahead->total, 0, sizeof(lookahead->total));
+	memset(lookahead->count, 0, sizeof(lookahead->count));
+	
+	lookahead->search++;
+	lookahead->num_searching = lookahead->num_workers;
+	pthread_cond_broadcast(&lookahead->start);
+	
+	pthread_mutex_unlock(&lookahead->lock);
+	
+	search(&lookahead->workers[0]);
+	
+	pthread_mutex_lock(&lookahead->lock);
+	
+	while (lookahead->num_searching > 0)
+		pthread_cond_wait(&lookahead->finished, &lookahead->lock);
+	
+	pthread_mutex_unlock(&lookahead->lock);
+	
+	/* best average, only out of turns that were tried at all */
+	turn_T best = safe_turn(board, snake);
+	double best_value = 0;
+	bool found = false;
+	
+	for (int i = 0; i < 3; i++)
+	{
+		if (lookahead->count[i] == 0)
+			continue;
+		
+		double value = (double) lookahead->total[i] / lookahead->count[i];
+		
+		if (found == false || value > best_value)
+		{
+			best = candidates[i];
+			best_value = value;
+			found = true;
+		}
+		
+		lookahead->rollouts += lookahead->count[i];
+	}
+	
+	lookahead->search_time += now() - start;
+	lookahead->moves++;
+	
+	return best;
+}
+
+double lookahead_rate(const lookahead_T *lookahead)
+{
+	if (lookahead->search_time == 0)
+		return 0;
+	
+	return lookahead->rollouts / (lookahead->search_time / 1e9);
+}
+
+static void *run_worker(void *arg)
+{
+	lookahead_worker_T *worker = arg;
+	lookahead_T *lookahead = worker->lookahead;
+	
+	uint32_t searched = 0;
+	
+	while (1)
+	{
+		pthread_mutex_lock(&lookahead->lock);
+		
+		while (lookahead->stopping == false && lookahead->search == searched)
+			pthread_cond_wait(&lookahead->start, &lookahead->lock);
+		
+		searched = lookahead->search;
+		bool stopping = lookahead->stopping;
+		
+		pthread_mutex_unlock(&lookahead->lock);
+		
+		if (stopping)
+			return NULL;
+		
+		search(worker);
+	}
+}
+
+/*
+ * Makes the candidate turn and plays on from there. Each move is one that
+ * doesn't run into anything solid if there is one: half the time the one
+ * heading for the nearest apple, otherwise any of them at random. Returns
+ * the number of moves the snake survived, LOOKAHEAD_DEPTH + 1 if it's
+ * still alive at the end.
+*/
+static int play_out(lookahead_worker_T *worker, int snake, turn_T turn)
+{
+	board_T *board = &worker->board;
+	
+	board_turn(board, snake, turn);
+	
+	for (int move = 0; move <= LOOKAHEAD_DEPTH; move++)
+	{
+		if (move > 0)
+		{
+			uint32_t r = next_rand(&worker->rng);
+			
+			turn_T options[3];
+			int num_options = 0;
+			
+			turn_T closest = TURN_NONE;
+			int closest_distance = -1;
+			
+			for (int i = 0; i < 3; i++)
+			{
+				uint32_t cell = turn_cell(board, &board->snake[snake], candidates[i]);
+				
+				if (is_solid(board, cell))
+					continue;
+				
+				options[num_options++] = candidates[i];
+				
+				int distance = apple_distance(board, cell);
+				if (closest_distance == -1 || distance < closest_distance)
+				{
+					closest = candidates[i];
+					closest_distance = distance;
+				}
+			}
+			
+			if (num_options > 0)
+				board_turn(board, snake, (r & 1 ? closest : options[(r >> 1) % num_options]));
+		}
+		
+		board_tick(board);
+		
+		if (board->snake[snake].alive == false)
+			return move;
+	}
+	
+	return LOOKAHEAD_DEPTH + 1;
+}
+
+/* rollouts until the deadline, taking the candidate turns in turn */
+static void search(lookahead_worker_T *worker)
+{
+	lookahead_T *lookahead = worker->lookahead;
+	
+	const board_T *root = lookahead->root;
+	int snake = lookahead->snake;
+	
+	const int horizon = LOOKAHEAD_DEPTH + 1;
+	int death_cost = lookahead->config.score_multiplier * DEATH_COST;
+	int start_score = root->snake[snake].score;
+	
+	int64_t total[3] = { 0, 0, 0 };
+	int64_t count[3] = { 0, 0, 0 };
+	
+	/* workers start on different candidates, so short searches cover them all */
+	for (int i = worker - lookahead->workers; now() < lookahead->deadline; i++)
+	{
+		int candidate = i % 3;
+		board_T *board = &worker->board;
+		
+		board_copy(board, root);
+		
+		/* each rollout gets its own apples, rocks and mystery boxes */
+		board->rng = next_rand(&worker->rng);
+		
+		int survived = play_out(worker, snake, candidates[candidate]);
+		int value = board->snake[snake].score - start_score;
+		
+		if (survived < horizon)
+			value -= death_cost * (2 * horizon - survived) / (2 * horizon);
+		
+		total[candidate] += value;
+		count[candidate]++;
+	}
+	
+	for (int i = 0; i < 3; i++)
+	{
+		__atomic_fetch_add(&lookahead->total[i], total[i], __ATOMIC_RELAXED);
+		__atomic_fetch_add(&lookahead->count[i], count[i], __ATOMIC_RELAXED);
+	}
+	
+	pthread_mutex_lock(&lookahead->lock);
+	
+	if (--lookahead->num_searching == 0)
+		pthread_cond_signal(&lookahead->finished);
+	
+	pthread_mutex_unlock(&lookahead->lock);
+}
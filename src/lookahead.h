@@ -0,0 +1,82 @@
+#ifndef LOOKAHEAD_H
+#define LOOKAHEAD_H
+
+#include "board.h"
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Monte Carlo lookahead player. Every move it plays many random games out
+ * from copies of the real board, under the real rules (rocks after every
+ * apple, mystery box outcomes, powerups expiring), and takes whichever of
+ * straight on, left and right did best on average.
+ *
+ * The rollouts are spread over a pool of threads, each with its own board
+ * to play on and its own random numbers. Their results are added into the
+ * totals with atomic adds, so nothing is locked while searching.
+*/
+
+/* moves played out after the candidate move, unless the snake dies first */
+#define LOOKAHEAD_DEPTH 40
+
+typedef struct lookahead_S lookahead_T;
+
+typedef struct
+{
+	lookahead_T *lookahead;
+	pthread_t thread;
+	
+	board_T board; /* played on by this thread's rollouts */
+	uint32_t rng;
+} lookahead_worker_T;
+
+struct lookahead_S
+{
+	board_config_T config;
+	
+	int num_workers; /* worker 0 is whichever thread is choosing the move */
+	lookahead_worker_T *workers;
+	
+	pthread_mutex_t lock;
+	pthread_cond_t start;    /* a new search, or time to stop */
+	pthread_cond_t finished; /* the last worker is done */
+	
+	uint32_t search; /* bumped for every search */
+	int num_searching;
+	bool stopping;
+	
+	/* the search going on */
+	const board_T *root;
+	int snake;
+	int64_t deadline; /* ns, CLOCK_MONOTONIC */
+	
+	/* per candidate turn, added to atomically */
+	int64_t total[3];
+	int64_t count[3];
+	
+	/* since `lookahead_init()` */
+	uint64_t rollouts;
+	int64_t search_time; /* ns */
+	uint64_t moves;
+};
+
+/*
+ * Starts `num_threads` - 1 threads (the caller of `lookahead_choose()`
+ * searches too) for boards with this config. Returns false if the boards
+ * couldn't be allocated; if threads can't be started it searches with
+ * fewer.
+*/
+bool lookahead_init(lookahead_T *, const board_config_T *, int num_threads);
+void lookahead_free(lookahead_T *);
+
+/*
+ * The turn for `snake` to make next, having searched for `budget_us`
+ * microseconds (plus at most one rollout).
+*/
+turn_T lookahead_choose(lookahead_T *, const board_T *, int snake, int budget_us);
+
+/* rollouts per second of searching so far */
+double lookahead_rate(const lookahead_T *);
+#endif
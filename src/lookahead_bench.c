@@ -0,0 +1,69 @@
+/*
+ * Headless lookahead benchmark: lets the Monte Carlo player play a game on
+ * its own and reports how many rollouts per second it manages, and so how
+ * many it gets through in the time it has at each game speed.
+ *
+ * usage: lookahead_bench [threads] [budget us] [moves]
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include "lookahead.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+/* as the real game's board, see `start_game()` */
+#define COLS 43
+#define ROWS 32
+
+int main(int argc, const char *argv[])
+{
+	int num_threads = (argc > 1 ? atoi(argv[1]) : (int) sysconf(_SC_NPROCESSORS_ONLN));
+	int budget      = (argc > 2 ? atoi(argv[2]) : 5000);
+	int max_moves   = (argc > 3 ? atoi(argv[3]) : 2000);
+	
+	board_config_T config;
+	board_default_config(&config, COLS, ROWS);
+	
+	board_T board;
+	lookahead_T lookahead;
+	
+	if (board_init(&board, &config, 12345) == false ||
+	    lookahead_init(&lookahead, &config, num_threads) == false)
+	{
+		printf("Could not allocate the board.\n");
+		return 1;
+	}
+	
+	int moves = 0;
+	while (board.humans_alive > 0 && moves < max_moves)
+	{
+		board_turn(&board, 0, lookahead_choose(&lookahead, &board, 0, budget));
+		board_tick(&board);
+		
+		moves++;
+	}
+	
+	double rate = lookahead_rate(&lookahead);
+	
+	printf("%d threads, %dus per move: %d moves, %s with a score of %d\n",
+		lookahead.num_workers, budget, moves,
+		(board.humans_alive > 0 ? "still alive" : "died"), board.snake[0].score);
+	printf("  %.0f rollouts/s, %.0f per move, mean search %.1fus\n",
+		rate, (double) lookahead.rollouts / lookahead.moves,
+		lookahead.search_time / 1e3 / lookahead.moves);
+	
+	/* what the game gets, searching for half of every tick */
+	for (int speed_human = 0; speed_human < 5; speed_human++)
+	{
+		int tick = 220 - speed_human * 35;
+		printf("  speed %d: %3dms per tick, ~%.0f rollouts per move\n",
+			speed_human + 1, tick, rate * tick / 2 / 1e3);
+	}
+	
+	lookahead_free(&lookahead);
+	board_free(&board);
+	
+	return 0;
+}
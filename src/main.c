@@ -1,52 +1,107 @@
+#include <string.h>
 #include <time.h>
 
-#include "constants.h"
+#include "assetcache.h"
 #include "globals.h"
+#include "latency.h"
+#include "menu.h"
+#include "present.h"
+#include "scale.h"
+#include "scene.h"
 #include "sdlhelperfuncs.h"
+#include "trace.h"
 
-extern nav_vars_T run_menu();
-extern nav_vars_T run_highscores_menu();
-extern nav_vars_T run_game();
+extern void clean_up_game_assets();
+extern void clean_up_menu_assets();
+extern void clean_up_highscores_assets();
+extern void start_saving_scores();
+extern void stop_saving_scores();
 
 void initialise(const char *);
+static int take_scale_option(int argc, const char *argv[]);
+static int filter_events(const SDL_Event *);
 
 int main(int argc, const char *argv[])
 {
+	startup_log("start");
+	trace_init();
+	
+	argc = take_scale_option(argc, argv);
+	
+	/* `main --latency [probes]` measures keypress-to-pixel latency, with no display */
+	bool latency = (argc > 1 && strcmp(argv[1], "--latency") == 0);
+	
+	if (latency)
+		SDL_putenv("SDL_VIDEODRIVER=dummy");
+	
 	initialise("Snake");
+	startup_log("video mode set");
+	
+	/* `main --bake` just writes the asset cache */
+	if (argc > 1 && strcmp(argv[1], "--bake") == 0)
+	{
+		bool baked = asset_cache_bake();
+		
+		SDL_Quit();
+		TTF_Quit();
+		
+		return (baked ? 0 : 1);
+	}
+	
+	bool cached = asset_cache_open();
 	
 	error_Texture = load_image("images/error.png");
 	
-	font_small  = TTF_OpenFont("coolvetica.ttf", 20);
-	font_medium = TTF_OpenFont("coolvetica.ttf", 40);
-	font_large  = TTF_OpenFont("coolvetica.ttf", 60);
+	font_small  = open_font(20 * screen_scale);
+	font_medium = open_font(40 * screen_scale);
+	font_large  = open_font(60 * screen_scale);
+	
+	startup_log(cached ? "assets (from cache)" : "assets (no cache)");
 	
-	nav_vars_T navigation = run_menu();
-	do
+	start_saving_scores();
+	
+	if (latency && latency_run(argc > 2 ? atoi(argv[2]) : LATENCY_PROBES) == false)
+		printf("Could not run the latency harness.\n");
+	
+	/* every screen's opened from the menu, and the game's over once it's closed (see scene.h) */
+	if (latency == false)
 	{
-		switch (navigation)
-		{
-			case MENU_ID:      navigation = run_menu();            break;
-			case GAME_ID:      navigation = run_game();            break;
-			case HIGHSCORE_ID: navigation = run_highscores_menu(); break;
-			default: break;
-		}
-	} while (navigation != QUIT_ID);
+		open_menu();
+		scene_run();
+	}
+	
+	clean_up_game_assets();
+	clean_up_menu_assets();
+	clean_up_highscores_assets();
+	
+	/* don't lose a score that's still waiting to be saved */
+	stop_saving_scores();
 	
 	SDL_FreeSurface(screen);
 	SDL_FreeSurface(error_Texture);
 	
-	TTF_CloseFont(font_small);
-	TTF_CloseFont(font_medium);
-	TTF_CloseFont(font_large);
+	close_font(font_small);
+	close_font(font_medium);
+	close_font(font_large);
+	
+	/* baked on the way out, so the next launch starts fast */
+	if (cached)
+		asset_cache_close();
+	else
+		asset_cache_bake();
 	
 	SDL_Quit();
 	TTF_Quit();
 	
+	trace_flush();
+	
 	return 0;
 }
 
 void initialise(const char *window_name)
 {
+	TRACE_SCOPE("initialise");
+	
 	if (SDL_Init(SDL_INIT_VIDEO) == -1)
 	{
 		printf("Could not load SDL.\n");
@@ -59,15 +114,73 @@ void initialise(const char *window_name)
 		exit(1);
 	}
 	
-	if ((screen = SDL_SetVideoMode(SCREEN_WIDTH, SCREEN_HEIGHT,
-		SCREEN_BPP, SDL_SWSURFACE)) == NULL)
+	/* as big as fits on the desktop, if that's what was asked for */
+	if (screen_scale == 0)
+	{
+		const SDL_VideoInfo *info = SDL_GetVideoInfo();
+		
+		screen_scale = 1;
+		while (screen_scale < SCALE_MAX &&
+		       SCREEN_WIDTH  * (screen_scale + 1) <= info->current_w &&
+		       SCREEN_HEIGHT * (screen_scale + 1) <= info->current_h)
+			screen_scale++;
+	}
+	
+	int width = SCREEN_WIDTH * screen_scale;
+	int height = SCREEN_HEIGHT * screen_scale;
+	
+	/* double buffered if it can be, see present.h */
+	if ((screen = present_set_video_mode(width, height, SCREEN_BPP)) == NULL)
 	{
 		printf("Could not initialise the screen.(%dx%dx%d)\n",
-			SCREEN_WIDTH, SCREEN_HEIGHT, SCREEN_BPP);
+			width, height, SCREEN_BPP);
 		exit(1);
 	}
 	
 	SDL_WM_SetCaption(window_name, NULL);
+	SDL_SetEventFilter(filter_events);
 	
 	srand(time(NULL));
 }
+
+/*
+ * `--scale n` anywhere on the command line draws everything n times the
+ * size, or as big as fits with `--scale max`. It's taken out of the
+ * arguments, leaving the rest where they'd be without it.
+*/
+static int take_scale_option(int argc, const char *argv[])
+{
+	for (int i = 1; i < argc - 1; i++)
+	{
+		if (strcmp(argv[i], "--scale") != 0)
+			continue;
+		
+		int scale = atoi(argv[i + 1]);
+		
+		if (strcmp(argv[i + 1], "max") == 0)
+			screen_scale = 0; /* worked out once SDL's started, see `initialise()` */
+		else if (scale >= 1 && scale <= SCALE_MAX)
+			screen_scale = scale;
+		else
+			printf("The scale has to be 1 to %d, or max.\n", SCALE_MAX);
+		
+		for (int j = i; j + 2 <= argc; j++)
+			argv[j] = argv[j + 2];
+		
+		return argc - 2;
+	}
+	
+	return argc;
+}
+
+/* hotkeys that work on every screen, handled before any screen sees them */
+static int filter_events(const SDL_Event *event)
+{
+	if (event->type == SDL_KEYDOWN && event->key.keysym.sym == SDLK_F12)
+	{
+		trace_hotkey();
+		return 0;
+	}
+	
+	return 1;
+}
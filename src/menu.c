@@ -1,39 +1,129 @@
 #include "menu.h"
 #include "globals.h"
 #include "sdlhelperfuncs.h"
+#include "board.h"
+#include "assetcache.h"
+#include "canvas.h"
+#include "game.h"
+#include "highscores.h"
+#include "scene.h"
+#include "trace.h"
 
+/*
+ * The menu is composed once and kept for as long as the game runs, so
+ * coming back to it is a single blit. Only the speed label ever changes.
+*/
 typedef struct
 {
 	SDL_Surface *menu_bg;
-	SDL_Surface *title_text;
-	
-	SDL_Surface *start_instruction;
-	SDL_Surface *highscores_instruction;
-	SDL_Surface *speed_instruction;
-	
-	SDL_Surface *help_instruction;
-	SDL_Surface *quit_instruction;
+	canvas_T canvas;
 	
 	SDL_Surface *speed_display;
 } menu_T;
 
+static menu_T *menu = NULL;
+
+static void load_menu(menu_T *);
 static void set_speed(menu_T *, int speed);
-static void draw_menu(menu_T *);
 static void clean_up_menu(menu_T *);
 
-nav_vars_T run_menu(void)
+static void menu_event(scene_T *, const SDL_Event *);
+static void draw_menu(scene_T *);
+static void menu_presented(scene_T *);
+
+static scene_T menu_scene = { .opaque = true, .event = menu_event, .draw = draw_menu, .presented = menu_presented };
+
+void open_menu(void)
 {
-	menu_T *menu = malloc(sizeof(menu_T));
+	if (menu == NULL)
+	{
+		menu = malloc(sizeof(menu_T));
+		load_menu(menu);
+	}
 	
-	/* load the text */
-	menu->title_text = TTF_RenderText_Blended(font_medium, "Snake", white_colour);
+	scene_push(&menu_scene);
+}
+
+static void menu_event(scene_T *scene, const SDL_Event *event)
+{
+	if (event->type != SDL_KEYDOWN)
+		return;
 	
-	menu->start_instruction      = TTF_RenderText_Blended(font_small, "\"s\" to start the game",         white_colour);
-	menu->highscores_instruction = TTF_RenderText_Blended(font_small, "\"h\" for the highscores",        white_colour);
-	menu->speed_instruction      = TTF_RenderText_Blended(font_small, "1 through 5 to change the speed", white_colour);
+	switch (event->key.keysym.sym)
+	{
+		case SDLK_1: set_speed(menu, 0); scene_redraw(); break;
+		case SDLK_2: set_speed(menu, 1); scene_redraw(); break;
+		case SDLK_3: set_speed(menu, 2); scene_redraw(); break;
+		case SDLK_4: set_speed(menu, 3); scene_redraw(); break;
+		case SDLK_5: set_speed(menu, 4); scene_redraw(); break;
+		
+		case SDLK_q: scene_quit();       break;
+		case SDLK_s: open_game();        break;
+		case SDLK_h: open_highscores();  break;
+		case SDLK_b: open_arena();       break;
+		case SDLK_p: open_practice();    break;
+		
+		case SDLK_e:
+			printf(
+			"'a' - turn left\n"
+			"'d' - turn right\n"
+			"'p' - pause\n"
+			"'o' - let the autopilot play (any turn takes back control)\n"
+			"'h' - let the cycle-following autopilot play instead\n"
+			"'m' - go to the main menu\n\n"
+			"In the arena you share the board with bots (blue), and\n"
+			"running into any snake's body ends the game.\n\n"
+			"In practice, dying lets you rewind: hold left to go back,\n"
+			"right to go forward again, and press space to play on.\n"
+			"Practice games don't count for the highscores.\n\n"
+			"Left and right are relative to the direction the snake is heading.\n\n"
+			"--------------------\n\n"
+			"The score multiplier is based upon the speed of the game.\n\n"
+			"Red block    - 1x points\n"
+			"Yellow block - 3x points\n"
+			"Purple block - 1x points and will get rid of 20%% of the obstacles\n"
+			"Orange block - Either 10x points or controls temporarily reversed\n");
+			break;
+		
+		default: break;
+	}
+}
+
+static void load_menu(menu_T *menu)
+{
+	TRACE_SCOPE("load_menu");
+	
+	/* load the images */
+	menu->menu_bg = load_image("images/menu_bg.png");
+	
+	if (canvas_init(&menu->canvas, menu->menu_bg) == false)
+	{
+		printf("Could not allocate the menu.\n");
+		exit(1);
+	}
 	
-	menu->help_instruction = TTF_RenderText_Blended(font_small, "\"e\" for help", white_colour);
-	menu->quit_instruction = TTF_RenderText_Blended(font_small, "\"q\" to quit",  white_colour);
+	/* the text never changes, so it's only needed until it's on the canvas */
+	struct { int y; font_T *font; char *text; } labels[] =
+	{
+		{ 15,  font_medium, "Snake" },
+		
+		{ 70,  font_small, "\"s\" to start the game" },
+		{ 94,  font_small, "\"h\" for the highscores" },
+		{ 118, font_small, "1 through 5 to change the speed" },
+		{ 142, font_small, "\"b\" to play against bots" },
+		{ 166, font_small, "\"p\" to practise, rewinding when you die" },
+		
+		{ 192, font_small, "\"e\" for help" },
+		{ 215, font_small, "\"q\" to quit" }
+	};
+	
+	for (size_t i = 0; i < sizeof(labels) / sizeof(labels[0]); i++)
+	{
+		SDL_Surface *text = render_text_blended(labels[i].font, labels[i].text, white_colour);
+		
+		canvas_draw(&menu->canvas, 20, labels[i].y, text);
+		SDL_FreeSurface(text);
+	}
 	
 	menu->speed_display = NULL;
 	
@@ -42,110 +132,61 @@ nav_vars_T run_menu(void)
 	 * value, else use the old speed value.
 	 */
 	set_speed(menu, (speed_human == -1 ? 2 : speed_human));
-	
-	/* load the images */
-	menu->menu_bg = load_image("images/menu_bg.png");
-	
-	draw_menu(menu);
-	
-	SDL_Event event;
-	while (1)
-	{
-		SDL_Delay(5); /* we don't need the loop running at 100% CPU */
-		
-		if (SDL_PollEvent(&event))
-		{
-			if (event.key.type == SDL_KEYDOWN)
-			{
-				switch (event.key.keysym.sym)
-				{
-					case SDLK_1: set_speed(menu, 0); draw_menu(menu); break;
-					case SDLK_2: set_speed(menu, 1); draw_menu(menu); break;
-					case SDLK_3: set_speed(menu, 2); draw_menu(menu); break;
-					case SDLK_4: set_speed(menu, 3); draw_menu(menu); break;
-					case SDLK_5: set_speed(menu, 4); draw_menu(menu); break;
-					
-					case SDLK_q: clean_up_menu(menu); return QUIT_ID;
-					case SDLK_s: clean_up_menu(menu); return GAME_ID;
-					case SDLK_h: clean_up_menu(menu); return HIGHSCORE_ID;
-					
-					case SDLK_e:
-						printf(
-						"'a' - turn left\n"
-						"'d' - turn right\n"
-						"'p' - pause\n"
-						"'m' - go to the main menu\n\n"
-						"Left and right are relative to the direction the snake is heading.\n\n"
-						"--------------------\n\n"
-						"The score multiplier is based upon the speed of the game.\n\n"
-						"Red block    - 1x points\n"
-						"Yellow block - 3x points\n"
-						"Purple block - 1x points and will get rid of 20%% of the obstacles\n"
-						"Orange block - Either 10x points or controls temporarily reversed\n");
-						break;
-					
-					default: break;
-				}
-			}
-			else if (event.type == SDL_QUIT)
-			{
-				clean_up_menu(menu);
-				return QUIT_ID;
-			}
-		}
-	}
 }
 
 static void set_speed(menu_T *menu, int speed_human_A)
 {
+	TRACE_SCOPE("set_speed");
+	
 	const int BASE_TIME_BETWEEN_TICKS = 220;
 	const int SPEED_STEP = 35;
 	
-	const int BASE_SCORE = 30;
-	const int SCORE_STEP = 5;
-	
 	speed_human = speed_human_A;
 	speed = BASE_TIME_BETWEEN_TICKS - (speed_human * SPEED_STEP);
-	score_multiplier = BASE_SCORE   + (speed_human * SCORE_STEP);
+	score_multiplier = speed_score_multiplier(speed_human);
 	
 	char speed_string[10];
 	snprintf(speed_string, 10, "Speed - %d", speed_human + 1);
 	
+	/* only the old label's corner of the canvas, which has nothing else in it, needs redrawing */
 	if (menu->speed_display != NULL)
+	{
+		SDL_Rect old_label = { 20, 438, SCREEN_WIDTH - 20, SCREEN_HEIGHT - 438 };
+		canvas_clear(&menu->canvas, &old_label);
+		
 		SDL_FreeSurface(menu->speed_display);
+	}
 	
-	menu->speed_display = TTF_RenderText_Blended(font_small, speed_string, white_colour);
+	menu->speed_display = render_text_blended(font_small, speed_string, white_colour);
+	canvas_draw(&menu->canvas, 20, 438, menu->speed_display);
 }
 
-static void draw_menu(menu_T *menu)
+static void draw_menu(scene_T *scene)
 {
-	apply_surface(0, 0, menu->menu_bg, screen);
-	
-	apply_surface(20, 15, menu->title_text, screen);
-	
-	apply_surface(20, 70, menu->start_instruction,      screen);
-	apply_surface(20, 94, menu->highscores_instruction, screen);
-	apply_surface(20, 118, menu->speed_instruction,     screen);
-	
-	apply_surface(20, 168, menu->help_instruction, screen);
-	apply_surface(20, 191, menu->quit_instruction, screen);
-	apply_surface(20, 438, menu->speed_display,    screen);
+	TRACE_SCOPE("draw_menu");
 	
-	SDL_Flip(screen);
+	canvas_show(&menu->canvas);
+}
+
+static void menu_presented(scene_T *scene)
+{
+	startup_log("first frame");
 }
 
 static void clean_up_menu(menu_T *menu)
 {
-	SDL_FreeSurface(menu->menu_bg);
-	SDL_FreeSurface(menu->title_text);
-	
-	SDL_FreeSurface(menu->start_instruction);
-	SDL_FreeSurface(menu->highscores_instruction);
-	SDL_FreeSurface(menu->help_instruction);
-	SDL_FreeSurface(menu->speed_instruction);
-	SDL_FreeSurface(menu->quit_instruction);
+	canvas_free(&menu->canvas);
 	
+	SDL_FreeSurface(menu->menu_bg);
 	SDL_FreeSurface(menu->speed_display);
 	
 	free(menu);
 }
+
+void clean_up_menu_assets(void)
+{
+	if (menu != NULL)
+		clean_up_menu(menu);
+	
+	menu = NULL;
+}
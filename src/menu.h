@@ -1,7 +1,9 @@
 #ifndef MENU_H
 #define MENU_H
 
-#include "constants.h"
+/* pushes the main menu, the scene every other screen is opened over (see scene.h) */
+void open_menu(void);
 
-nav_vars_T run_menu(void);
+/* frees the menu, which is otherwise kept between visits */
+void clean_up_menu_assets(void);
 #endif
@@ -0,0 +1,1661 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "planner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#define CACHE_MAGIC   "SNKC"
+#define CACHE_VERSION 1
+
+/*
+ * The tree search: changes tried, and the trips between random cells that
+ * each tree is scored on (the fewer moves they take, cutting across where
+ * the cycle allows, the better).
+*/
+#define SEARCH_ITERATIONS 3000
+#define SEARCH_TRIPS      256
+
+typedef struct
+{
+	char magic[4];
+	uint32_t version;
+	int32_t cols;
+	int32_t rows;
+	uint64_t hash;
+} cache_header_T;
+
+static void search_tree(planner_T *);
+static bool load_tree(planner_T *, const char *path);
+static void save_tree(const planner_T *, const char *path);
+static bool sync_rocks(planner_T *, const board_T *);
+static void join_tree(planner_T *);
+
+#define NUM_BLOCKS(p) ((p)->block_cols * (p)->block_rows)
+
+static uint32_t next_rand(uint32_t *state)
+{
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	
+	return *state = x;
+}
+
+/* as `board_step()` */
+static uint32_t step(const planner_T *planner, uint32_t cell, direction_T dir)
+{
+	int cols = planner->cols;
+	int rows = planner->rows;
+	int x = cell % cols;
+	int y = cell / cols;
+	
+	switch (dir)
+	{
+		case DIR_RIGHT: x = (x + 1 == cols ? 0 : x + 1);        break;
+		case DIR_LEFT:  x = (x == 0        ? cols - 1 : x - 1); break;
+		case DIR_DOWN:  y = (y + 1 == rows ? 0 : y + 1);        break;
+		case DIR_UP:    y = (y == 0        ? rows - 1 : y - 1); break;
+	}
+	
+	return (uint32_t) y * cols + x;
+}
+
+static direction_T opposite(direction_T dir)
+{
+	return (dir + 2) & 3;
+}
+
+/*
+ * The block next to `block`, or -1. Blocks only link round the edge of the
+ * board when there's no odd column or row in the way, and there are enough
+ * of them that it isn't the same neighbour both ways.
+*/
+static int block_neighbour(const planner_T *planner, int block, direction_T dir)
+{
+	int cols = planner->block_cols;
+	int rows = planner->block_rows;
+	int x = block % cols;
+	int y = block / cols;
+	
+	bool wrap_x = (planner->cols % 2 == 0 && cols > 2);
+	bool wrap_y = (planner->rows % 2 == 0 && rows > 2);
+	
+	switch (dir)
+	{
+		case DIR_RIGHT: return (x + 1 < cols ? block + 1    : wrap_x ? block - x : -1);
+		case DIR_LEFT:  return (x > 0        ? block - 1    : wrap_x ? block + cols - 1 : -1);
+		case DIR_DOWN:  return (y + 1 < rows ? block + cols : wrap_y ? x : -1);
+		case DIR_UP:    return (y > 0        ? block - cols : wrap_y ? (rows - 1) * cols + x : -1);
+	}
+	
+	return -1;
+}
+
+static void link_blocks(planner_T *planner, int block, direction_T dir)
+{
+	planner->links[block] |= 1 << dir;
+	planner->links[block_neighbour(planner, block, dir)] |= 1 << opposite(dir);
+}
+
+static void unlink_blocks(planner_T *planner, int block, direction_T dir)
+{
+	planner->links[block] &= ~(1 << dir);
+	planner->links[block_neighbour(planner, block, dir)] &= ~(1 << opposite(dir));
+}
+
+/* whether the odd column's pair of cells next to block row `y` is on the cycle */
+static bool column_pair_on(const planner_T *planner, int y)
+{
+	return planner->cols % 2 == 1 && planner->pair_rocks[y] == 0 &&
+	       planner->block_rocks[y * planner->block_cols + planner->block_cols - 1] == 0;
+}
+
+static bool row_pair_on(const planner_T *planner, int x)
+{
+	return planner->rows % 2 == 1 && planner->pair_rocks[planner->block_rows + x] == 0 &&
+	       planner->block_rocks[(planner->block_rows - 1) * planner->block_cols + x] == 0;
+}
+
+/*
+ * The cell after `cell` on its cycle, or NO_CELL if it isn't on one. Each
+ * block goes round clockwise, except where it's linked to a neighbour: the
+ * side facing it is swapped for a way there and a way back.
+*/
+static uint32_t next_cell(const planner_T *planner, uint32_t cell)
+{
+	int x = cell % planner->cols;
+	int y = cell / planner->cols;
+	int block_x = x / 2;
+	int block_y = y / 2;
+	direction_T dir;
+	
+	if (block_x < planner->block_cols && block_y < planner->block_rows)
+	{
+		int block = block_y * planner->block_cols + block_x;
+		uint8_t links = planner->links[block];
+		
+		if (planner->block_rocks[block] != 0)
+			return NO_CELL;
+		
+		bool last_x = (block_x == planner->block_cols - 1);
+		bool last_y = (block_y == planner->block_rows - 1);
+		
+		switch ((x & 1) | (y & 1) << 1)
+		{
+			case 0: /* top left */
+				dir = (links & 1 << DIR_UP ? DIR_UP : DIR_RIGHT);
+				break;
+			
+			case 1: /* top right */
+				dir = (links & 1 << DIR_RIGHT || (last_x && column_pair_on(planner, block_y)) ? DIR_RIGHT : DIR_DOWN);
+				break;
+			
+			case 3: /* bottom right */
+				dir = (links & 1 << DIR_DOWN || (last_y && row_pair_on(planner, block_x)) ? DIR_DOWN : DIR_LEFT);
+				break;
+			
+			default: /* bottom left */
+				dir = (links & 1 << DIR_LEFT ? DIR_LEFT : DIR_UP);
+				break;
+		}
+	}
+	else if (block_y < planner->block_rows && x == planner->cols - 1)
+	{
+		if (column_pair_on(planner, block_y) == false)
+			return NO_CELL;
+		
+		dir = (y & 1 ? DIR_LEFT : DIR_DOWN);
+	}
+	else if (block_x < planner->block_cols && y == planner->rows - 1)
+	{
+		if (row_pair_on(planner, block_x) == false)
+			return NO_CELL;
+		
+		dir = (x & 1 ? DIR_LEFT : DIR_UP);
+	}
+	else
+		return NO_CELL; /* the corner left over when both are odd */
+	
+	return step(planner, cell, dir);
+}
+
+/* numbers the cells along the cycle through `start` */
+static void number_cycle(planner_T *planner, uint32_t start)
+{
+	uint32_t num_cells = (uint32_t) planner->cols * planner->rows;
+	
+	for (uint32_t i = 0; i < num_cells; i++)
+		planner->order[i] = NO_CELL;
+	
+	planner->length = 0;
+	
+	if (start == NO_CELL)
+		return;
+	
+	uint32_t cell = start;
+	
+	do
+	{
+		planner->order[cell] = planner->length++;
+		cell = next_cell(planner, cell);
+	} while (cell != start);
+}
+
+/* how far `cell` is along the cycle from place `from` */
+static uint32_t distance(const planner_T *planner, uint32_t from, uint32_t cell)
+{
+	return (planner->order[cell] + planner->length - from) % planner->length;
+}
+
+static uint32_t find(uint32_t *parent, uint32_t i)
+{
+	while (parent[i] != i)
+		i = parent[i] = parent[parent[i]];
+	
+	return i;
+}
+
+bool planner_init(planner_T *planner, const board_T *board)
+{
+	memset(planner, 0, sizeof(planner_T));
+	
+	planner->cols = board->config.cols;
+	planner->rows = board->config.rows;
+	planner->block_cols = planner->cols / 2;
+	planner->block_rows = planner->rows / 2;
+	planner->max_rocks = board->config.max_rocks;
+	
+	if (planner->block_cols == 0 || planner->block_rows == 0)
+		return false;
+	
+	size_t num_cells = (size_t) planner->cols * planner->rows;
+	size_t num_blocks = NUM_BLOCKS(planner);
+	size_t num_pairs = planner->block_cols + planner->block_rows;
+	
+	/* the arrays of uint32_t first, for alignment */
+	planner->memory = calloc(1, sizeof(uint32_t) * (6 * num_cells + planner->max_rocks + 4 * num_blocks) +
+	                            2 * num_blocks + num_pairs);
+	
+	if (planner->memory == NULL)
+		return false;
+	
+	uint32_t *words = planner->memory;
+	
+	planner->order     = words; words += num_cells;
+	planner->latest    = words; words += num_cells;
+	planner->seen      = words; words += num_cells;
+	planner->fill      = words; words += num_cells;
+	planner->came_from = words; words += num_cells;
+	planner->body_at   = words; words += num_cells;
+	planner->rocks     = words; words += planner->max_rocks;
+	planner->component = words; words += num_blocks;
+	planner->queue     = words; words += num_blocks;
+	planner->parent    = words; words += num_blocks;
+	planner->joins     = words; words += num_blocks;
+	
+	uint8_t *bytes = (uint8_t *) words;
+	
+	planner->links       = bytes; bytes += num_blocks;
+	planner->block_rocks = bytes; bytes += num_blocks;
+	planner->pair_rocks  = bytes;
+	
+	char path[sizeof(PLANNER_CACHE_DIR) + 32];
+	snprintf(path, sizeof(path), "%s/%dx%d.cycle", PLANNER_CACHE_DIR, planner->cols, planner->rows);
+	
+	if (load_tree(planner, path) == false)
+	{
+		search_tree(planner);
+		save_tree(planner, path);
+	}
+	
+	sync_rocks(planner, board);
+	join_tree(planner);
+	
+	planner->last_tick = board->tick - 1;
+	planner->last_place = NO_CELL;
+	
+	return true;
+}
+
+void planner_free(planner_T *planner)
+{
+	free(planner->memory);
+	memset(planner, 0, sizeof(planner_T));
+}
+
+/*
+ * Moves taken to go from `from` to `to` on an empty board, cutting across
+ * to whichever neighbour is furthest along the cycle without passing `to`.
+*/
+static uint32_t trip_length(const planner_T *planner, uint32_t from, uint32_t to)
+{
+	uint32_t moves = 0;
+	
+	while (from != to)
+	{
+		uint32_t place = planner->order[from];
+		uint32_t target = distance(planner, place, to);
+		uint32_t best = next_cell(planner, from);
+		uint32_t best_distance = 1;
+		
+		for (direction_T dir = 0; dir < 4; dir++)
+		{
+			uint32_t cell = step(planner, from, dir);
+			
+			if (planner->order[cell] == NO_CELL)
+				continue;
+			
+			uint32_t d = distance(planner, place, cell);
+			
+			if (d <= target && d > best_distance)
+			{
+				best = cell;
+				best_distance = d;
+			}
+		}
+		
+		from = best;
+		moves++;
+	}
+	
+	return moves;
+}
+
+static uint64_t score_tree(planner_T *planner, const uint32_t *trips)
+{
+	number_cycle(planner, 0);
+	
+	uint64_t moves = 0;
+	
+	for (int i = 0; i < SEARCH_TRIPS; i++)
+		moves += trip_length(planner, trips[2 * i], trips[2 * i + 1]);
+	
+	return moves;
+}
+
+/*
+ * The blocks on the tree's path from `from` to `to`, in `parent`, by a
+ * search from `to`; with `from` -1, the way to every block it reaches.
+*/
+static void tree_path(planner_T *planner, int from, int to)
+{
+	int num_blocks = NUM_BLOCKS(planner);
+	
+	for (int i = 0; i < num_blocks; i++)
+		planner->parent[i] = NO_CELL;
+	
+	int head = 0, tail = 0;
+	planner->queue[tail++] = to;
+	planner->parent[to] = to;
+	
+	while (head < tail && (from < 0 || planner->parent[from] == NO_CELL))
+	{
+		int block = planner->queue[head++];
+		
+		for (direction_T dir = 0; dir < 4; dir++)
+		{
+			int next = block_neighbour(planner, block, dir);
+			
+			if ((planner->links[block] & 1 << dir) && planner->parent[next] == NO_CELL)
+			{
+				planner->parent[next] = block;
+				planner->queue[tail++] = next;
+			}
+		}
+	}
+}
+
+static direction_T direction_to(const planner_T *planner, int from, int to)
+{
+	direction_T dir = 0;
+	
+	while (block_neighbour(planner, from, dir) != to)
+		dir++;
+	
+	return dir;
+}
+
+/*
+ * Local search for the tree whose cycle gives the shortest trips: starting
+ * from a random spanning tree, repeatedly link two blocks that aren't, cut
+ * a random link on the loop that makes, and keep the change if the trips
+ * got no longer. Deterministic for a board size, so the cache only saves
+ * time.
+*/
+static void search_tree(planner_T *planner)
+{
+	int num_blocks = NUM_BLOCKS(planner);
+	uint32_t num_cells = (uint32_t) planner->cols * planner->rows;
+	uint32_t rng = 0x9E3779B9 ^ num_cells;
+	
+	/* a random spanning tree to start from, adding links in a random order */
+	memset(planner->links, 0, num_blocks);
+	
+	for (int i = 0; i < num_blocks; i++)
+		planner->parent[i] = i;
+	
+	uint32_t *edges = malloc(sizeof(uint32_t) * 2 * num_blocks);
+	uint32_t *trips = malloc(sizeof(uint32_t) * 2 * SEARCH_TRIPS);
+	
+	if (edges == NULL || trips == NULL)
+	{
+		free(edges);
+		free(trips);
+		
+		/* no search, just the first tree that comes to hand */
+		for (int i = 0; i < num_blocks; i++)
+			for (direction_T dir = 0; dir < 4; dir++)
+			{
+				int next = block_neighbour(planner, i, dir);
+				
+				if (next >= 0 && find(planner->parent, i) != find(planner->parent, next))
+				{
+					planner->parent[find(planner->parent, i)] = find(planner->parent, next);
+					link_blocks(planner, i, dir);
+				}
+			}
+		
+		return;
+	}
+	
+	int num_edges = 0;
+	
+	for (int i = 0; i < num_blocks; i++)
+	{
+		if (block_neighbour(planner, i, DIR_RIGHT) >= 0)
+			edges[num_edges++] = (uint32_t) i << 2 | DIR_RIGHT;
+		if (block_neighbour(planner, i, DIR_DOWN) >= 0)
+			edges[num_edges++] = (uint32_t) i << 2 | DIR_DOWN;
+	}
+	
+	for (int i = num_edges - 1; i > 0; i--)
+	{
+		int j = next_rand(&rng) % (i + 1);
+		uint32_t edge = edges[i];
+		edges[i] = edges[j];
+		edges[j] = edge;
+	}
+	
+	for (int i = 0; i < num_edges; i++)
+	{
+		int block = edges[i] >> 2;
+		direction_T dir = edges[i] & 3;
+		uint32_t a = find(planner->parent, block);
+		uint32_t b = find(planner->parent, block_neighbour(planner, block, dir));
+		
+		if (a != b)
+		{
+			planner->parent[a] = b;
+			link_blocks(planner, block, dir);
+		}
+	}
+	
+	/* the trips, between cells that are on the cycle */
+	number_cycle(planner, 0);
+	
+	for (int i = 0; i < 2 * SEARCH_TRIPS; i++)
+	{
+		do
+			trips[i] = next_rand(&rng) % num_cells;
+		while (planner->order[trips[i]] == NO_CELL);
+	}
+	
+	uint64_t best = score_tree(planner, trips);
+	
+	for (int i = 0; i < SEARCH_ITERATIONS && num_edges > num_blocks - 1; i++)
+	{
+		int block = edges[next_rand(&rng) % num_edges] >> 2;
+		direction_T dir = next_rand(&rng) & 3;
+		int next = block_neighbour(planner, block, dir);
+		
+		if (next < 0 || (planner->links[block] & 1 << dir))
+			continue;
+		
+		/* cut a random link on the path between them, then link them */
+		tree_path(planner, block, next);
+		
+		int length = 0;
+		for (int b = block; b != next; b = planner->parent[b])
+			length++;
+		
+		int cut = block;
+		for (int n = next_rand(&rng) % length; n > 0; n--)
+			cut = planner->parent[cut];
+		
+		direction_T cut_dir = direction_to(planner, cut, planner->parent[cut]);
+		
+		unlink_blocks(planner, cut, cut_dir);
+		link_blocks(planner, block, dir);
+		
+		uint64_t score = score_tree(planner, trips);
+		
+		if (score <= best)
+			best = score;
+		else
+		{
+			unlink_blocks(planner, block, dir);
+			link_blocks(planner, cut, cut_dir);
+		}
+	}
+	
+	free(edges);
+	free(trips);
+}
+
+static uint64_t fnv1a(const uint8_t *data, size_t len)
+{
+	uint64_t hash = 0xCBF29CE484222325;
+	
+	for (size_t i = 0; i < len; i++)
+		hash = (hash ^ data[i]) * 0x100000001B3;
+	
+	return hash;
+}
+
+/* whether the links are a spanning tree of the blocks */
+static bool valid_tree(planner_T *planner)
+{
+	int num_blocks = NUM_BLOCKS(planner);
+	int num_links = 0;
+	
+	for (int i = 0; i < num_blocks; i++)
+		for (direction_T dir = 0; dir < 4; dir++)
+		{
+			if ((planner->links[i] & 1 << dir) == 0)
+				continue;
+			
+			int next = block_neighbour(planner, i, dir);
+			
+			if (next < 0 || (planner->links[next] & 1 << opposite(dir)) == 0)
+				return false;
+			
+			num_links++;
+		}
+	
+	if (num_links != 2 * (num_blocks - 1))
+		return false;
+	
+	/* as many links as a tree has, so it's one if they reach every block */
+	tree_path(planner, -1, 0);
+	
+	for (int i = 0; i < num_blocks; i++)
+		if (planner->parent[i] == NO_CELL)
+			return false;
+	
+	return true;
+}
+
+static bool load_tree(planner_T *planner, const char *path)
+{
+	FILE *file = fopen(path, "rb");
+	if (file == NULL)
+		return false;
+	
+	cache_header_T header;
+	size_t num_blocks = NUM_BLOCKS(planner);
+	
+	bool ok = fread(&header, sizeof(header), 1, file) == 1 &&
+	          memcmp(header.magic, CACHE_MAGIC, 4) == 0 &&
+	          header.version == CACHE_VERSION &&
+	          header.cols == planner->cols && header.rows == planner->rows &&
+	          fread(planner->links, 1, num_blocks, file) == num_blocks &&
+	          fnv1a(planner->links, num_blocks) == header.hash;
+	
+	fclose(file);
+	
+	return ok && valid_tree(planner);
+}
+
+/* written next to the cache and renamed over it once complete, like the asset cache */
+static void save_tree(const planner_T *planner, const char *path)
+{
+	cache_header_T header;
+	size_t num_blocks = NUM_BLOCKS(planner);
+	
+	memcpy(header.magic, CACHE_MAGIC, 4);
+	header.version = CACHE_VERSION;
+	header.cols = planner->cols;
+	header.rows = planner->rows;
+	header.hash = fnv1a(planner->links, num_blocks);
+	
+	char temp_path[sizeof(PLANNER_CACHE_DIR) + 48];
+	snprintf(temp_path, sizeof(temp_path), "%s.new", path);
+	
+	mkdir(PLANNER_CACHE_DIR, 0755);
+	
+	FILE *file = fopen(temp_path, "wb");
+	if (file == NULL)
+		return;
+	
+	bool ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+	          fwrite(planner->links, 1, num_blocks, file) == num_blocks;
+	
+	ok = (fclose(file) == 0) && ok;
+	
+	if (ok == false || rename(temp_path, path) != 0)
+		remove(temp_path);
+}
+
+/* the rock count of whatever `cell` belongs to, or NULL for the corner left over */
+static uint8_t *rock_count(planner_T *planner, uint32_t cell)
+{
+	int x = cell % planner->cols / 2;
+	int y = cell / planner->cols / 2;
+	
+	if (x < planner->block_cols && y < planner->block_rows)
+		return &planner->block_rocks[y * planner->block_cols + x];
+	
+	if (y < planner->block_rows)
+		return &planner->pair_rocks[y];
+	
+	if (x < planner->block_cols)
+		return &planner->pair_rocks[planner->block_rows + x];
+	
+	return NULL;
+}
+
+static void count_rock(planner_T *planner, uint32_t cell, int change)
+{
+	uint8_t *count = rock_count(planner, cell);
+	
+	if (count != NULL)
+		*count += change;
+}
+
+/*
+ * Brings the rock counts up to date, and returns whether anything changed.
+ * Rocks only ever go from the end of the board's list (when some are
+ * cleared) or come on to it, so once the count and the last rock agree
+ * nothing else needs looking at.
+*/
+static bool sync_rocks(planner_T *planner, const board_T *board)
+{
+	int num_rocks = board->num_rocks;
+	
+	if (num_rocks == planner->num_rocks &&
+	    (num_rocks == 0 || board->rock[num_rocks - 1] == planner->rocks[num_rocks - 1]))
+		return false;
+	
+	int same = 0;
+	
+	while (same < num_rocks && same < planner->num_rocks && board->rock[same] == planner->rocks[same])
+		same++;
+	
+	for (int i = same; i < planner->num_rocks; i++)
+		count_rock(planner, planner->rocks[i], -1);
+	
+	for (int i = same; i < num_rocks; i++)
+	{
+		planner->rocks[i] = board->rock[i];
+		count_rock(planner, board->rock[i], 1);
+	}
+	
+	planner->num_rocks = num_rocks;
+	
+	return true;
+}
+
+/*
+ * Takes blocks with rocks out of the tree and joins what's left back up
+ * (and any blocks free of rocks again on to it) with the fewest new links,
+ * then numbers the cycle round the biggest part, if it couldn't all be
+ * joined.
+*/
+static void join_tree(planner_T *planner)
+{
+	int num_blocks = NUM_BLOCKS(planner);
+	
+	for (int i = 0; i < num_blocks; i++)
+		if (planner->block_rocks[i] != 0)
+			for (direction_T dir = 0; dir < 4; dir++)
+				if (planner->links[i] & 1 << dir)
+					unlink_blocks(planner, i, dir);
+	
+	/* what's still linked together */
+	uint32_t num_components = 0;
+	
+	for (int i = 0; i < num_blocks; i++)
+		planner->component[i] = NO_CELL;
+	
+	for (int i = 0; i < num_blocks; i++)
+	{
+		if (planner->block_rocks[i] != 0 || planner->component[i] != NO_CELL)
+			continue;
+		
+		int head = 0, tail = 0;
+		planner->queue[tail++] = i;
+		planner->component[i] = num_components;
+		
+		while (head < tail)
+		{
+			int block = planner->queue[head++];
+			
+			for (direction_T dir = 0; dir < 4; dir++)
+			{
+				int next = block_neighbour(planner, block, dir);
+				
+				if ((planner->links[block] & 1 << dir) && planner->component[next] == NO_CELL)
+				{
+					planner->component[next] = num_components;
+					planner->queue[tail++] = next;
+				}
+			}
+		}
+		
+		planner->parent[num_components] = num_components;
+		num_components++;
+	}
+	
+	/* link neighbouring parts until there's nothing left to join */
+	planner->num_joins = 0;
+	
+	for (int i = 0; i < num_blocks; i++)
+	{
+		if (planner->block_rocks[i] != 0)
+			continue;
+		
+		for (direction_T dir = 0; dir < 4; dir++)
+		{
+			int next = block_neighbour(planner, i, dir);
+			
+			if (next < 0 || planner->block_rocks[next] != 0)
+				continue;
+			
+			uint32_t a = find(planner->parent, planner->component[i]);
+			uint32_t b = find(planner->parent, planner->component[next]);
+			
+			if (a != b)
+			{
+				planner->parent[a] = b;
+				link_blocks(planner, i, dir);
+				
+				planner->joins[planner->num_joins++] = (uint32_t) i * 4 + dir;
+			}
+		}
+	}
+	
+	/* the biggest part left, if rocks have walled some off */
+	for (uint32_t i = 0; i < num_components; i++)
+		planner->queue[i] = 0;
+	
+	int biggest = -1;
+	
+	for (int i = 0; i < num_blocks; i++)
+	{
+		if (planner->block_rocks[i] != 0)
+			continue;
+		
+		uint32_t root = find(planner->parent, planner->component[i]);
+		planner->queue[root]++;
+		
+		if (biggest == -1 || planner->queue[root] > planner->queue[find(planner->parent, planner->component[biggest])])
+			biggest = i;
+	}
+	
+	if (biggest == -1)
+	{
+		number_cycle(planner, NO_CELL);
+		return;
+	}
+	
+	/* the block's top left cell */
+	int x = biggest % planner->block_cols * 2;
+	int y = biggest / planner->block_cols * 2;
+	
+	number_cycle(planner, (uint32_t) y * planner->cols + x);
+}
+
+/* whether the tail stays put this tick; snakes stop growing at their longest */
+static bool growing(const board_T *board, const snake_T *snake)
+{
+	return snake->pending_snake_segments > 0 && snake->length < (uint32_t) board->config.max_snake_length;
+}
+
+static bool solid(const board_T *board, const snake_T *snake, uint32_t cell)
+{
+	uint32_t contents = board->grid[cell];
+	
+	if (CELL_KIND(contents) == CELL_ROCK)
+		return true;
+	
+	/* the tail moves out of the way first */
+	if (CELL_KIND(contents) == CELL_SNAKE)
+		return cell != snake->tail || growing(board, snake) || snake->length == 1;
+	
+	return false;
+}
+
+/*
+ * How many of the body's cells, up to `most`, could be in the way if the
+ * snake followed the cycle for ever from `cell`, with its head there
+ * `moves` moves from now, however long it grows; `most` if it can't follow
+ * it at all. The body's `k`th cell from the tail is gone once it's moved
+ * `k` + 1 times without growing, and it can only grow by as much as it's
+ * short of its longest, so it's out of the way if it's further along the
+ * cycle than that. Cells off the cycle are never stepped into.
+*/
+static uint32_t in_the_way(const planner_T *planner, const board_T *board, const snake_T *snake,
+                           uint32_t cell, uint32_t moves, uint32_t most)
+{
+	uint32_t longest = (uint32_t) board->config.max_snake_length;
+	longest = (snake->length > longest ? snake->length : longest);
+	
+	uint32_t grow = longest - snake->length;
+	
+	/* the cycle has to hold it at its longest */
+	if (planner->order[cell] == NO_CELL || planner->length <= longest)
+		return most;
+	
+	uint32_t from = planner->order[cell];
+	uint32_t body = snake->tail;
+	uint32_t count = 0;
+	
+	/* the head it's at now is where it'll be, not in the way */
+	uint32_t last = (moves == 0 ? snake->length - 1 : snake->length);
+	
+	for (uint32_t k = 0, i = 0, j = 0; k < last; k++)
+	{
+		if (planner->order[body] != NO_CELL && distance(planner, from, body) + moves <= k + grow &&
+		    ++count == most)
+			return count;
+		
+		/* on to the next cell of the body, and the next run once that's done */
+		while (i < snake->num_runs && j == RUN_LENGTH(snake_run(snake, i)))
+		{
+			i++;
+			j = 0;
+		}
+		
+		if (i < snake->num_runs)
+		{
+			body = board_step(board, body, RUN_DIR(snake_run(snake, i)));
+			j++;
+		}
+	}
+	
+	return count;
+}
+
+/*
+ * Whether the snake could follow the cycle for ever from `cell`, `moves`
+ * from now, see `in_the_way()`.
+*/
+static bool safe_after(const planner_T *planner, const board_T *board, const snake_T *snake,
+                       uint32_t cell, uint32_t moves)
+{
+	return in_the_way(planner, board, snake, cell, moves, 1) == 0;
+}
+
+/* a new mark for the cells seen, rather than clearing them all */
+static void new_mark(planner_T *planner)
+{
+	if (++planner->mark == 0)
+	{
+		memset(planner->seen, 0, sizeof(uint32_t) * planner->cols * planner->rows);
+		planner->mark = 1;
+	}
+}
+
+/* free cells reachable from `start`, counting up to `most` */
+static uint32_t room(planner_T *planner, const board_T *board, const snake_T *snake, uint32_t start, uint32_t most)
+{
+	uint32_t head = 0, tail = 0;
+	
+	new_mark(planner);
+	
+	planner->fill[tail++] = start;
+	planner->seen[start] = planner->mark;
+	
+	while (head < tail && tail < most)
+	{
+		uint32_t cell = planner->fill[head++];
+		
+		for (direction_T dir = 0; dir < 4; dir++)
+		{
+			uint32_t next = board_step(board, cell, dir);
+			
+			if (planner->seen[next] != planner->mark && solid(board, snake, next) == false)
+			{
+				planner->seen[next] = planner->mark;
+				planner->fill[tail++] = next;
+			}
+		}
+	}
+	
+	return tail;
+}
+
+static bool listed(const uint32_t *cells, int num_cells, uint32_t cell)
+{
+	for (int i = 0; i < num_cells; i++)
+		if (cells[i] == cell)
+			return true;
+	
+	return false;
+}
+
+/*
+ * A way from `start` through free cells off the cycle to `goal`, or if
+ * that's NO_CELL, back on to the cycle at most `limit` along from place
+ * `from`, not through any of `avoid`. Searches a few cells at most, as
+ * they're only ever the odd blocks with rocks in. Writes the way to `way`
+ * from the cell after `start`, and returns how long it is, or 0 if there
+ * isn't one at most `most` long.
+*/
+static int find_way(planner_T *planner, const board_T *board, const snake_T *snake, uint32_t start, uint32_t goal,
+                    uint32_t from, uint32_t limit, const uint32_t *avoid, int num_avoid, uint32_t *way, int most)
+{
+	int num_found = 0;
+	int head = 0;
+	
+	planner->found[num_found] = start;
+	planner->found_from[num_found++] = -1;
+	
+	while (head < num_found)
+	{
+		int at = head++;
+		
+		for (direction_T dir = 0; dir < 4; dir++)
+		{
+			uint32_t cell = board_step(board, planner->found[at], dir);
+			
+			if (solid(board, snake, cell) || listed(avoid, num_avoid, cell) ||
+			    listed(planner->found, num_found, cell))
+				continue;
+			
+			bool on_cycle = (planner->order[cell] != NO_CELL);
+			bool done = (goal == NO_CELL ? on_cycle && distance(planner, from, cell) - 1 < limit : cell == goal);
+			
+			if (done == false && (on_cycle || num_found == PLANNER_DETOUR_SEARCH))
+				continue;
+			
+			if (done)
+			{
+				int length = 1;
+				
+				for (int j = at; j > 0; j = planner->found_from[j])
+					length++;
+				
+				if (length > most)
+					return 0;
+				
+				way[length - 1] = cell;
+				
+				for (int j = at, k = length - 2; j > 0; j = planner->found_from[j], k--)
+					way[k] = planner->found[j];
+				
+				return length;
+			}
+			
+			planner->found[num_found] = cell;
+			planner->found_from[num_found++] = at;
+		}
+	}
+	
+	return 0;
+}
+
+/*
+ * A way off the cycle from the head to an apple off it and back on again,
+ * if there is one that leaves it safe to follow the cycle, in `detour`.
+*/
+static bool plan_detour(planner_T *planner, const board_T *board, const snake_T *snake, uint32_t from, uint32_t limit)
+{
+	uint32_t avoid[PLANNER_MAX_DETOUR + 2];
+	
+	for (int j = 0; j < board->config.num_apples; j++)
+	{
+		uint32_t apple = board->apple[j];
+		
+		if (apple == NO_CELL || planner->order[apple] != NO_CELL)
+			continue;
+		
+		/* it can't turn back on itself, even when there's nothing behind it */
+		avoid[0] = snake->head;
+		avoid[1] = board_step(board, snake->head, opposite(snake->dir));
+		
+		int there = find_way(planner, board, snake, snake->head, apple, from, limit, avoid, 2, planner->detour,
+		                     PLANNER_MAX_DETOUR - 1);
+		
+		if (there == 0)
+			continue;
+		
+		for (int k = 0; k < there - 1; k++)
+			avoid[2 + k] = planner->detour[k];
+		
+		int back = find_way(planner, board, snake, apple, NO_CELL, from, limit, avoid, there + 1,
+		                    planner->detour + there, PLANNER_MAX_DETOUR - there);
+		
+		if (back > 0 &&
+		    safe_after(planner, board, snake, planner->detour[there + back - 1], there + back))
+		{
+			planner->detour_length = there + back;
+			planner->detour_at = 0;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+/*
+ * Whether the way found to `cell`, `moves` long, ends somewhere it's safe
+ * to follow the cycle from. The way there is body by then too, the cell
+ * `back` moves before the end gone once it's moved as many times without
+ * growing as the snake's longest less `back`.
+*/
+static bool safe_way(const planner_T *planner, const board_T *board, const snake_T *snake,
+                     uint32_t cell, uint32_t moves, uint32_t longest)
+{
+	if (planner->order[cell] == NO_CELL)
+		return false;
+	
+	uint32_t back = 1;
+	
+	for (uint32_t way = planner->came_from[cell]; way != snake->head; way = planner->came_from[way], back++)
+		if (planner->order[way] != NO_CELL && distance(planner, planner->order[cell], way) + back < longest)
+			return false;
+	
+	return safe_after(planner, board, snake, cell, moves);
+}
+
+/*
+ * A way from the head to somewhere on the cycle it's safe to follow from,
+ * more than `past` along it, through cells that are free or that the
+ * body's out of by the time it gets there (and aren't past `past`
+ * themselves), in `detour`. Searched breadth first, so each cell's only
+ * tried on the first move it can be got to on.
+*/
+static bool find_escape(planner_T *planner, const board_T *board, const snake_T *snake, uint32_t past)
+{
+	uint32_t longest = (uint32_t) board->config.max_snake_length;
+	longest = (snake->length > longest ? snake->length : longest);
+	
+	uint32_t grow = longest - snake->length;
+	uint32_t index = (uint32_t) (snake - board->snake);
+	
+	/* how far each of the body's cells is from the tail */
+	uint32_t cell = snake->tail;
+	uint32_t k = 0;
+	
+	planner->body_at[cell] = k;
+	
+	for (uint32_t i = 0; i < snake->num_runs; i++)
+	{
+		uint32_t run = snake_run(snake, i);
+		
+		for (uint32_t j = 0; j < RUN_LENGTH(run); j++)
+		{
+			cell = board_step(board, cell, RUN_DIR(run));
+			planner->body_at[cell] = ++k;
+		}
+	}
+	
+	new_mark(planner);
+	
+	uint32_t head = 0, tail = 0;
+	planner->fill[tail++] = snake->head;
+	planner->seen[snake->head] = planner->mark;
+	
+	/* it can't turn back on itself, even when there's nothing behind it */
+	planner->seen[board_step(board, snake->head, opposite(snake->dir))] = planner->mark;
+	
+	for (uint32_t moves = 1; moves <= PLANNER_MAX_DETOUR && head < tail; moves++)
+	{
+		/* the cells got to in a move fewer */
+		uint32_t end = tail;
+		
+		while (head < end)
+		{
+			uint32_t from = planner->fill[head++];
+			
+			for (direction_T dir = 0; dir < 4; dir++)
+			{
+				uint32_t next = board_step(board, from, dir);
+				uint32_t contents = board->grid[next];
+				
+				if (planner->seen[next] == planner->mark || CELL_KIND(contents) == CELL_ROCK)
+					continue;
+				
+				/* the body's cell `k` from the tail is gone after `k` + 1 moves it doesn't grow on */
+				if (CELL_KIND(contents) == CELL_SNAKE &&
+				    (CELL_INDEX(contents) != index || moves < planner->body_at[next] + 1 + grow))
+					continue;
+				
+				planner->seen[next] = planner->mark;
+				planner->came_from[next] = from;
+				
+				/* anywhere more than `past` along is only somewhere to end up, not to go through */
+				bool beyond = (past == 0 || (planner->order[next] != NO_CELL &&
+				                             distance(planner, planner->order[snake->head], next) > past));
+				
+				if (past == 0 || beyond == false)
+					planner->fill[tail++] = next;
+				
+				if (beyond && safe_way(planner, board, snake, next, moves, longest))
+				{
+					uint32_t way = next;
+					
+					for (uint32_t j = moves; j > 0; j--, way = planner->came_from[way])
+						planner->detour[j - 1] = way;
+					
+					planner->detour_length = moves;
+					planner->detour_at = 0;
+					
+					return true;
+				}
+			}
+		}
+	}
+	
+	return false;
+}
+
+static turn_T turn_to(const board_T *board, const snake_T *snake, uint32_t cell)
+{
+	direction_T left = (snake->dir + 1) & 3;
+	direction_T right = (snake->dir + 3) & 3;
+	turn_T turn = TURN_NONE;
+	
+	if (board_step(board, snake->head, left) == cell)
+		turn = TURN_LEFT;
+	else if (board_step(board, snake->head, right) == cell)
+		turn = TURN_RIGHT;
+	
+	/* reversed controls swap them back */
+	if (snake->controls_reversed && turn != TURN_NONE)
+		turn = (turn == TURN_LEFT ? TURN_RIGHT : TURN_LEFT);
+	
+	return turn;
+}
+
+/* swaps the cycle followed for the latest one */
+static void swap_cycles(planner_T *planner)
+{
+	uint32_t *order = planner->order;
+	uint32_t length = planner->length;
+	
+	planner->order = planner->latest;
+	planner->length = planner->latest_length;
+	planner->latest = order;
+	planner->latest_length = length;
+}
+
+/* follows the latest cycle from now on, places along the old one meaning nothing on it */
+static void take_latest(planner_T *planner)
+{
+	swap_cycles(planner);
+	
+	planner->pending = false;
+	planner->last_place = NO_CELL;
+	planner->detour_length = 0;
+}
+
+/*
+ * Tries each link `join_tree()` just added against every other that could
+ * join the same two parts, keeping whichever leaves fewest of the body's
+ * cells in the way along the cycle. Where the links go only matters to the
+ * snake near the blocks the rocks came or went from, and each try renumbers
+ * the cycle, so it stops as soon as none are.
+*/
+static void rejoin_tree(planner_T *planner, const board_T *board, const snake_T *snake)
+{
+	int num_blocks = NUM_BLOCKS(planner);
+	uint32_t best = snake->length + 1;
+	
+	for (uint32_t j = 0; j < planner->num_joins && planner->order[snake->head] != NO_CELL; j++)
+	{
+		int block = planner->joins[j] / 4;
+		direction_T dir = planner->joins[j] % 4;
+		int other = block_neighbour(planner, block, dir);
+		
+		/* the block's top left cell, to number the cycle from; a part walled off isn't on it */
+		uint32_t start = (uint32_t) (block / planner->block_cols * 2) * planner->cols + block % planner->block_cols * 2;
+		
+		if (planner->order[start] == NO_CELL)
+			continue;
+		
+		best = in_the_way(planner, board, snake, snake->head, 0, best);
+		
+		if (best == 0)
+			return;
+		
+		/* the two parts it joins, one in `component` and the other in `parent` */
+		unlink_blocks(planner, block, dir);
+		
+		tree_path(planner, -1, block);
+		memcpy(planner->component, planner->parent, sizeof(uint32_t) * num_blocks);
+		tree_path(planner, -1, other);
+		
+		int best_block = block;
+		direction_T best_dir = dir;
+		
+		for (int i = 0; i < num_blocks && best > 0; i++)
+		{
+			if (planner->component[i] == NO_CELL)
+				continue;
+			
+			for (direction_T d = 0; d < 4 && best > 0; d++)
+			{
+				int next = block_neighbour(planner, i, d);
+				
+				if (next < 0 || planner->parent[next] == NO_CELL || (i == block && d == dir))
+					continue;
+				
+				link_blocks(planner, i, d);
+				number_cycle(planner, start);
+				
+				uint32_t count = in_the_way(planner, board, snake, snake->head, 0, best);
+				
+				if (count < best)
+				{
+					best = count;
+					best_block = i;
+					best_dir = d;
+				}
+				
+				unlink_blocks(planner, i, d);
+			}
+		}
+		
+		link_blocks(planner, best_block, best_dir);
+		number_cycle(planner, start);
+	}
+}
+
+/*
+ * Takes `rock` out of the cycle by joining two cells either side of it
+ * that are next to each other, leaving out as few as it can between them.
+ * What's left is in the same order, so the body's only nearer the head
+ * along it by as many as are left out. Nothing's left out from where the
+ * head next is on the cycle (the end of a detour it's on) round to where
+ * it last was. Returns false if there's nowhere near the rock to do it.
+*/
+static bool splice_rock(planner_T *planner, const board_T *board, const snake_T *snake, uint32_t rock)
+{
+	uint32_t num_cells = (uint32_t) planner->cols * planner->rows;
+	uint32_t length = planner->length;
+	
+	uint32_t next = snake->head;
+	uint32_t last = planner->last_place;
+	
+	if (planner->order[next] == NO_CELL)
+	{
+		if (planner->detour_length == 0 || last == NO_CELL)
+			return false;
+		
+		next = planner->detour[planner->detour_length - 1];
+	}
+	else
+		last = planner->order[next];
+	
+	if (planner->order[next] == NO_CELL)
+		return false;
+	
+	/* each place's cell */
+	uint32_t *cells = planner->fill;
+	
+	for (uint32_t cell = 0; cell < num_cells; cell++)
+		if (planner->order[cell] != NO_CELL)
+			cells[planner->order[cell]] = cell;
+	
+	uint32_t start = planner->order[next];
+	uint32_t last_cell = cells[last];
+	uint32_t end = (last == start ? length : distance(planner, start, last_cell));
+	uint32_t rock_at = distance(planner, start, rock);
+	
+	uint32_t best_from = 0, best_to = 0;
+	
+	for (uint32_t back = 1; back <= rock_at && back <= PLANNER_DETOUR_SEARCH; back++)
+	{
+		uint32_t from = rock_at - back;
+		uint32_t cell = cells[(start + from) % length];
+		
+		for (direction_T dir = 0; dir < 4; dir++)
+		{
+			uint32_t to = board_step(board, cell, dir);
+			
+			if (planner->order[to] == NO_CELL || CELL_KIND(board->grid[to]) == CELL_ROCK)
+				continue;
+			
+			uint32_t d = distance(planner, start, to);
+			
+			if (d > rock_at && d < end && (best_to == 0 || d - from < best_to - best_from))
+			{
+				best_from = from;
+				best_to = d;
+			}
+		}
+	}
+	
+	if (best_to == 0)
+		return false;
+	
+	/* number what's left from the head's next place on */
+	uint32_t place = 0;
+	
+	for (uint32_t i = 0; i < length; i++)
+	{
+		uint32_t cell = cells[(start + i) % length];
+		planner->order[cell] = (i > best_from && i < best_to ? NO_CELL : place++);
+	}
+	
+	planner->length = place;
+	planner->last_place = planner->order[last_cell];
+	
+	return true;
+}
+
+/*
+ * Keeps the old cycle clear of the rocks that have come on to it, as long
+ * as it stays safe to follow, see `splice_rock()`. Returns false, with the
+ * cycle as it was, if it can't.
+*/
+static bool splice_rocks(planner_T *planner, const board_T *board, const snake_T *snake)
+{
+	size_t size = sizeof(uint32_t) * planner->cols * planner->rows;
+	
+	/* the cycle as it was, to go back to */
+	memcpy(planner->body_at, planner->order, size);
+	uint32_t length = planner->length;
+	uint32_t last_place = planner->last_place;
+	
+	bool safe = true;
+	
+	for (int i = 0; i < planner->num_rocks && safe; i++)
+	{
+		uint32_t rock = planner->rocks[i];
+		
+		if (planner->order[rock] != NO_CELL)
+			safe = splice_rock(planner, board, snake, rock);
+	}
+	
+	/* where it's going to be on the cycle has to be safe to follow it from */
+	if (safe && planner->order[snake->head] != NO_CELL)
+		safe = safe_after(planner, board, snake, snake->head, 0);
+	else if (safe)
+		safe = safe_after(planner, board, snake, planner->detour[planner->detour_length - 1],
+		                  (uint32_t) (planner->detour_length - planner->detour_at));
+	
+	if (safe == false)
+	{
+		memcpy(planner->order, planner->body_at, size);
+		planner->length = length;
+		planner->last_place = last_place;
+	}
+	
+	return safe;
+}
+
+/*
+ * Joins the tree up around the rocks as they are now. If it isn't safe to
+ * follow the new cycle straight away but was the old one, the old one's
+ * kept to, taken round any new rocks in its way, until it is.
+*/
+static void change_cycle(planner_T *planner, const board_T *board, const snake_T *snake)
+{
+	/* number it in place of the latest, if there's one waiting */
+	swap_cycles(planner);
+	join_tree(planner);
+	rejoin_tree(planner, board, snake);
+	
+	bool safe = safe_after(planner, board, snake, snake->head, 0);
+	swap_cycles(planner);
+	
+	if (planner->safe && safe == false)
+	{
+		planner->pending = true;
+		splice_rocks(planner, board, snake);
+	}
+	else
+	{
+		take_latest(planner);
+		planner->safe = safe;
+	}
+}
+
+/* how far along the cycle the first rock on it is from the head, or its length if there's none */
+static uint32_t rock_ahead(const planner_T *planner, const snake_T *snake)
+{
+	uint32_t nearest = planner->length;
+	
+	for (int i = 0; i < planner->num_rocks; i++)
+	{
+		uint32_t rock = planner->rocks[i];
+		
+		if (planner->order[rock] != NO_CELL && distance(planner, planner->order[snake->head], rock) < nearest)
+			nearest = distance(planner, planner->order[snake->head], rock);
+	}
+	
+	return nearest;
+}
+
+/* the cell after the head along the cycle, if it's next to it */
+static uint32_t cycle_next(const planner_T *planner, const board_T *board, const snake_T *snake)
+{
+	if (planner->order[snake->head] == NO_CELL)
+		return NO_CELL;
+	
+	for (direction_T dir = 0; dir < 4; dir++)
+	{
+		uint32_t cell = board_step(board, snake->head, dir);
+		
+		if (planner->order[cell] != NO_CELL && distance(planner, planner->order[snake->head], cell) == 1)
+			return cell;
+	}
+	
+	return NO_CELL;
+}
+
+turn_T planner_choose(planner_T *planner, const board_T *board, int i)
+{
+	const snake_T *snake = &board->snake[i];
+	
+	/* moves it didn't choose may have put it anywhere */
+	if (board->tick != planner->last_tick + 1)
+	{
+		planner->safe = false;
+		planner->detour_length = 0;
+	}
+	
+	planner->last_tick = board->tick;
+	
+	/* take the new cycle as soon as it's safe to, or there's a way to where it is */
+	if (planner->pending)
+	{
+		swap_cycles(planner);
+		
+		bool safe = safe_after(planner, board, snake, snake->head, 0);
+		bool escape = (safe == false && find_escape(planner, board, snake, 0));
+		int escape_length = planner->detour_length;
+		
+		swap_cycles(planner);
+		
+		if (safe || escape)
+		{
+			take_latest(planner);
+			planner->safe = true;
+			
+			if (escape)
+			{
+				planner->detour_length = escape_length;
+				planner->detour_at = 0;
+			}
+		}
+		
+		/*
+		 * Failing that, a way round a rock in the old one's way back on to it
+		 * past the rock leaves it safe on the old one for another time round.
+		*/
+		else if (planner->order[snake->head] != NO_CELL && planner->detour_length == 0)
+		{
+			uint32_t rock = rock_ahead(planner, snake);
+			
+			if (rock < PLANNER_MAX_DETOUR && find_escape(planner, board, snake, rock) == false)
+			{
+				take_latest(planner);
+				planner->safe = false;
+			}
+		}
+	}
+	
+	if (sync_rocks(planner, board))
+		change_cycle(planner, board, snake);
+	
+	/* or straight away, if a rock's in the way of the old one */
+	if (planner->pending && planner->detour_length == 0 && planner->order[snake->head] != NO_CELL)
+	{
+		uint32_t next = cycle_next(planner, board, snake);
+		
+		if (next == NO_CELL || solid(board, snake, next))
+		{
+			take_latest(planner);
+			planner->safe = false;
+		}
+	}
+	
+	uint32_t head = snake->head;
+	bool on_cycle = (planner->order[head] != NO_CELL);
+	
+	/* until it's safe again, see each move whether it is */
+	if (planner->safe == false && on_cycle)
+		planner->safe = safe_after(planner, board, snake, head, 0);
+	
+	/* off the cycle for an apple, it's still going from where it left it */
+	uint32_t from = (on_cycle ? planner->order[head] : planner->last_place);
+	planner->last_place = from;
+	
+	/* keep to a detour while it's still clear */
+	if (planner->detour_length > 0)
+	{
+		uint32_t cell = planner->detour[planner->detour_at];
+		
+		if (solid(board, snake, cell) == false)
+		{
+			if (++planner->detour_at == planner->detour_length)
+				planner->detour_length = 0;
+			
+			return turn_to(board, snake, cell);
+		}
+		
+		planner->detour_length = 0;
+		planner->safe = false;
+	}
+	
+	/* shortcuts and detours only while it's safe, and not while it's waiting to take a new cycle */
+	bool free_to_cut = (planner->safe && planner->pending == false && on_cycle);
+	
+	/* a detour can't come back on to the cycle past the tail */
+	uint32_t tail = (planner->order[snake->tail] != NO_CELL ? distance(planner, from, snake->tail) : 0);
+	
+	if (free_to_cut && tail > 1 && plan_detour(planner, board, snake, from, tail - 1))
+	{
+		uint32_t cell = planner->detour[planner->detour_at++];
+		return turn_to(board, snake, cell);
+	}
+	
+	/* the nearest apple along the cycle, or way off it to one */
+	uint32_t target = (from != NO_CELL ? planner->length : 0);
+	
+	for (int j = 0; j < board->config.num_apples && from != NO_CELL; j++)
+	{
+		uint32_t apple = board->apple[j];
+		
+		if (apple == NO_CELL)
+			continue;
+		
+		if (planner->order[apple] != NO_CELL)
+		{
+			if (distance(planner, from, apple) < target)
+				target = distance(planner, from, apple);
+			
+			continue;
+		}
+		
+		for (direction_T dir = 0; dir < 4; dir++)
+		{
+			uint32_t cell = board_step(board, apple, dir);
+			
+			if (planner->order[cell] != NO_CELL && cell != head && distance(planner, from, cell) < target)
+				target = distance(planner, from, cell);
+		}
+	}
+	
+	direction_T options[3] = { snake->dir, (snake->dir + 1) & 3, (snake->dir + 3) & 3 };
+	uint32_t best = NO_CELL;
+	uint32_t best_distance = 0;
+	
+	/* the ones it could take, best first */
+	uint32_t cells[3];
+	uint32_t distances[3];
+	int num_cells = 0;
+	
+	for (int j = 0; j < 3; j++)
+	{
+		uint32_t cell = board_step(board, head, options[j]);
+		
+		if (solid(board, snake, cell))
+			continue;
+		
+		if (planner->order[cell] == NO_CELL)
+			continue;
+		
+		uint32_t d = (from != NO_CELL ? distance(planner, from, cell) : planner->length);
+		
+		/* while it's safe, only cutting across can make it not */
+		if (d == 0 || (d > 1 && free_to_cut == false && planner->safe))
+			continue;
+		
+		/* as far along as it can go without passing the apple, else as little as it can */
+		int at = num_cells++;
+		
+		for (; at > 0; at--)
+		{
+			uint32_t other = distances[at - 1];
+			bool better = ((d <= target && (other > target || d > other)) ||
+			               (d > target && other > target && d < other));
+			
+			if (better == false)
+				break;
+			
+			cells[at] = cells[at - 1];
+			distances[at] = other;
+		}
+		
+		cells[at] = cell;
+		distances[at] = d;
+	}
+	
+	/*
+	 * Following the cycle keeps it safe, and cutting across has to be
+	 * checked; once it isn't, any move that makes it safe again will do.
+	*/
+	for (int j = 0; j < num_cells && best == NO_CELL; j++)
+	{
+		bool along = (planner->safe && distances[j] == 1);
+		
+		if (along || safe_after(planner, board, snake, cells[j], 1))
+		{
+			best = cells[j];
+			best_distance = distances[j];
+			planner->safe = true;
+		}
+	}
+	
+	/* or it follows the cycle anyway, as long as there's room that way */
+	for (int j = 0; j < num_cells && best == NO_CELL; j++)
+	{
+		if (distances[j] == 1)
+		{
+			best = cells[j];
+			best_distance = 1;
+		}
+	}
+	
+	/* if it's stuck by a rock and can't follow the cycle, there may still be a way round */
+	if (planner->safe == false && find_escape(planner, board, snake, 0))
+	{
+		planner->safe = true;
+		
+		uint32_t cell = planner->detour[planner->detour_at++];
+		return turn_to(board, snake, cell);
+	}
+	
+	/*
+	 * Until it's safe, following the cycle may still run the snake into
+	 * itself, so it goes where there's most room if there's not enough for
+	 * it that way.
+	*/
+	if (best == NO_CELL || planner->safe == false)
+	{
+		uint32_t need = snake->length + 1;
+		uint32_t most = (best == NO_CELL ? 0 : room(planner, board, snake, best, need));
+		
+		for (int j = 0; j < 3 && most < need; j++)
+		{
+			uint32_t cell = board_step(board, head, options[j]);
+			
+			if (cell == best || solid(board, snake, cell))
+				continue;
+			
+			uint32_t space = room(planner, board, snake, cell, need);
+			
+			if (space > most)
+			{
+				best = cell;
+				best_distance = 0;
+				most = space;
+			}
+		}
+	}
+	
+	/* anything but along the cycle or a safe shortcut may not be safe */
+	if (best_distance == 0)
+		planner->safe = false;
+	
+	return (best == NO_CELL ? TURN_NONE : turn_to(board, snake, best));
+}
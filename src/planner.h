@@ -0,0 +1,128 @@
+#ifndef PLANNER_H
+#define PLANNER_H
+
+#include "board.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Hamiltonian cycle player: follows a cycle through the board's cells, so
+ * it doesn't run into itself, and cuts across it towards the apple when
+ * that can't put its head behind its own tail, however long it grows.
+ *
+ * The cycle is built on the board cut into 2x2 blocks. Any spanning tree
+ * of the blocks gives a cycle that goes round the tree, every cell's next
+ * one depending only on which of its block's neighbours the tree links it
+ * to; an odd column or row left over is taken in a pair of cells at a time
+ * from the blocks next to it. Links can wrap round the edges of the board
+ * like everything else does.
+ *
+ * How good the shortcuts are depends on the shape of the tree, so the tree
+ * for an empty board of each size is searched for once and kept on disk,
+ * in PLANNER_CACHE_DIR. Rocks take their blocks out of the tree, which is
+ * joined up again around them (and back through them once they're gone)
+ * by adding as few links as it takes; the cycle stays the same elsewhere.
+ * Cells off the cycle are only ever stepped into for an apple, on a way
+ * there and back on again that's searched for when one's next to it.
+ *
+ * New rocks or rocks gone renumber the cycle, which can leave the body out
+ * of order along it. The links joining the tree up again are chosen so it
+ * isn't, where they can be; otherwise the snake keeps following the old
+ * cycle, with new rocks spliced out of it, until it's safe to take the new
+ * one. A rock just ahead on the old cycle that can't be got round, back on
+ * to it past the rock, makes it take the new one early. It then looks for
+ * a way to somewhere on the new cycle it's safe to follow from, through
+ * cells that are free or will be by the time it gets there, and failing
+ * that makes sure of its room by a flood fill each move until it's safe.
+ * A rock landing where it walls the snake in with its own body can still
+ * leave it nowhere to go.
+ *
+ * Choosing a move costs the same however big the board, and a pass over
+ * the body to check a shortcut is safe before it's taken.
+*/
+
+/* the makefile points it at the top of the tree, so it's the same wherever it's run from */
+#ifndef PLANNER_CACHE_DIR
+#define PLANNER_CACHE_DIR "cycles"
+#endif
+
+/* the longest way off the cycle and back it takes for an apple, and the cells searched for one */
+#define PLANNER_MAX_DETOUR   32
+#define PLANNER_DETOUR_SEARCH 64
+
+typedef struct
+{
+	int cols;
+	int rows;
+	int block_cols;
+	int block_rows;
+	
+	uint8_t *links;       /* per block, a bit per direction_T linked to in the tree */
+	uint8_t *block_rocks; /* per block; a block with rocks isn't in the tree */
+	uint8_t *pair_rocks;  /* per pair of cells of the odd column, then of the odd row */
+	
+	/* each cell's place along the cycle from the biggest part of the tree, NO_CELL if not on it */
+	uint32_t *order;
+	uint32_t length;
+	
+	/* the cycle for the rocks as they are now, while the old one's still followed */
+	uint32_t *latest;
+	uint32_t latest_length;
+	bool pending;
+	
+	/* the board's rocks, as of the last move chosen */
+	uint32_t *rocks;
+	int num_rocks;
+	int max_rocks;
+	
+	/*
+	 * Whether following the cycle from here can't run the snake into
+	 * itself, however long it grows; shortcuts and detours are only taken
+	 * if they keep it so.
+	*/
+	bool safe;
+	uint32_t last_tick;
+	uint32_t last_place; /* the head's place when it was last on the cycle */
+	
+	/* the way it's taking off the cycle to an apple and back on */
+	uint32_t detour[PLANNER_MAX_DETOUR];
+	int detour_length;
+	int detour_at;
+	
+	/* scratch for finding one */
+	uint32_t found[PLANNER_DETOUR_SEARCH];
+	int found_from[PLANNER_DETOUR_SEARCH];
+	
+	/* scratch for measuring the room around the head, cells seen as of `mark` */
+	uint32_t *seen;
+	uint32_t *fill;
+	
+	/* and for finding a way back to safety: where each cell was come to from, and where each of the body's is in it */
+	uint32_t *came_from;
+	uint32_t *body_at;
+	uint32_t mark;
+	
+	/* scratch for joining the tree up */
+	uint32_t *component;
+	uint32_t *queue;
+	uint32_t *parent;
+	
+	/* the links added the last time it was, each a block * 4 + direction_T */
+	uint32_t *joins;
+	uint32_t num_joins;
+	
+	void *memory;
+} planner_T;
+
+/*
+ * Sets up the cycle for the board's size, from the cache if it's there,
+ * and for the rocks on it. Returns false if the board is too small (less
+ * than 2x2) or the planner couldn't be allocated.
+*/
+bool planner_init(planner_T *, const board_T *);
+void planner_free(planner_T *);
+
+/* the turn for `snake` to make next; call every tick */
+turn_T planner_choose(planner_T *, const board_T *, int snake);
+#endif
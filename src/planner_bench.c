@@ -0,0 +1,109 @@
+/*
+ * Headless planner benchmark: lets the Hamiltonian cycle player play games
+ * on its own and reports how far it gets, how long it takes to choose each
+ * move, and how long setting it up takes with and without the cycle cache.
+ * Fails if the snake ever runs into itself, as the cycle should make sure
+ * it can't.
+ *
+ * usage: planner_bench [games] [max ticks] [cols] [rows]
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include "planner.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* as the real game's board, see `start_game()` */
+#define COLS 43
+#define ROWS 32
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int main(int argc, const char *argv[])
+{
+	int num_games = (argc > 1 ? atoi(argv[1]) : 10);
+	int max_ticks = (argc > 2 ? atoi(argv[2]) : 100000);
+	int cols      = (argc > 3 ? atoi(argv[3]) : COLS);
+	int rows      = (argc > 4 ? atoi(argv[4]) : ROWS);
+	
+	board_config_T config;
+	board_default_config(&config, cols, rows);
+	
+	int64_t slowest = 0, total = 0, ticks = 0;
+	int died = 0;
+	int ran_into_itself = 0;
+	
+	for (int game = 0; game < num_games; game++)
+	{
+		board_T board;
+		planner_T planner;
+		
+		if (board_init(&board, &config, 12345 + game) == false)
+		{
+			printf("Could not allocate the board.\n");
+			return 1;
+		}
+		
+		int64_t start = now_ns();
+		
+		if (planner_init(&planner, &board) == false)
+		{
+			printf("Could not set up the planner.\n");
+			return 1;
+		}
+		
+		/* the first game's set-up searches for the cycle, unless it's cached */
+		if (game == 0)
+			printf("set up in %.1fms\n", (now_ns() - start) / 1e6);
+		
+		/* as long as it got, as a dead snake's body is gone */
+		uint32_t length = 0;
+		
+		int tick = 0;
+		while (board.humans_alive > 0 && tick < max_ticks)
+		{
+			start = now_ns();
+			turn_T turn = planner_choose(&planner, &board, 0);
+			int64_t taken = now_ns() - start;
+			
+			total += taken;
+			slowest = (taken > slowest ? taken : slowest);
+			
+			length = board.snake[0].length;
+			
+			board_turn(&board, 0, turn);
+			board_tick(&board);
+			
+			tick++;
+		}
+		
+		ticks += tick;
+		died += (board.humans_alive == 0);
+		ran_into_itself += (board.humans_alive == 0 && board.snake[0].death_cause == DEATH_SELF);
+		
+		/* of the cells the snake could be on, how many it filled */
+		int free_cells = cols * rows - board.num_rocks;
+		
+		const char *outcome = (board.humans_alive > 0 ? "alive" :
+		                       board.snake[0].death_cause == DEATH_SELF ? "ran into itself" : "died");
+		
+		printf("game %d: %s after %d ticks, score %d, length %u (%.0f%% of the free cells), %d rocks\n",
+			game, outcome, tick, board.snake[0].score, length, 100.0 * length / free_cells, board.num_rocks);
+		
+		planner_free(&planner);
+		board_free(&board);
+	}
+	
+	printf("%d of %d games died, %d running into itself; %.2fus per move on average, %.1fus at worst\n",
+		died, num_games, ran_into_itself, total / 1e3 / (ticks > 0 ? ticks : 1), slowest / 1e3);
+	
+	return (ran_into_itself == 0 ? 0 : 1);
+}
@@ -0,0 +1,201 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "present.h"
+#include "trace.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+/* flips timed at startup, and the shortest refresh period taken for vsync (250Hz) */
+#define CALIBRATION_FLIPS 8
+#define MIN_PERIOD        4000000
+
+/* how early ticks start on top of how long they take: the poll loop sleeps 5ms at a time */
+#define ALIGN_MARGIN 6000000
+
+present_stats_T present_stats;
+
+static struct
+{
+	bool double_buffered;
+	int back; /* which buffer's being drawn into */
+	bool vsync;
+	int64_t period; /* ns */
+	
+	/* when the last flip returned, which with vsync is a vblank */
+	int64_t last_frame;
+	
+	int64_t tick_start;    /* 0 if no tick's started since the last frame */
+	int64_t target;        /* the vblank the next frame is lined up for, 0 if none */
+	int64_t work_estimate; /* a running average of ticks' work */
+} present;
+
+static int64_t now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+SDL_Surface *present_set_video_mode(int width, int height, int bpp)
+{
+	SDL_Surface *surface = SDL_SetVideoMode(width, height, bpp, SDL_HWSURFACE | SDL_DOUBLEBUF);
+	
+	if (surface == NULL)
+		surface = SDL_SetVideoMode(width, height, bpp, SDL_SWSURFACE);
+	
+	if (surface == NULL)
+		return NULL;
+	
+	present.double_buffered = ((surface->flags & SDL_DOUBLEBUF) != 0);
+	present.vsync = false;
+	
+	/* flips only take a refresh period each if they wait for the vblank */
+	if (present.double_buffered)
+	{
+		SDL_FillRect(surface, NULL, 0);
+		SDL_Flip(surface);
+		
+		int64_t start = now_ns();
+		
+		for (int i = 0; i < CALIBRATION_FLIPS; i++)
+		{
+			SDL_FillRect(surface, NULL, 0);
+			SDL_Flip(surface);
+		}
+		
+		present.last_frame = now_ns();
+		present.period = (present.last_frame - start) / CALIBRATION_FLIPS;
+		present.vsync = (present.period >= MIN_PERIOD);
+	}
+	
+	if (present.vsync)
+		printf("video: double buffered, vsync every %.2f ms\n", present.period / 1e6);
+	else
+		printf("video: %s, no vsync\n", (present.double_buffered ? "double buffered" : "single buffered"));
+	
+	present_reset();
+	
+	return surface;
+}
+
+void present_frame(void)
+{
+	TRACE_SCOPE("present_frame");
+	
+	int64_t start = now_ns();
+	SDL_Flip(SDL_GetVideoSurface());
+	int64_t end = now_ns();
+	
+	present_stats_T *stats = &present_stats;
+	int64_t flip = end - start;
+	int64_t work = 0;
+	
+	stats->frames++;
+	stats->flip_total += flip;
+	stats->flip_max = (flip > stats->flip_max ? flip : stats->flip_max);
+	
+	if (present.tick_start != 0)
+	{
+		work = start - present.tick_start;
+		
+		stats->work_total += work;
+		stats->work_max = (work > stats->work_max ? work : stats->work_max);
+		stats->work_frames++;
+		
+		present.work_estimate = (present.work_estimate == 0 ? work : (present.work_estimate * 7 + work) / 8);
+		present.tick_start = 0;
+	}
+	
+	/* counted from the first frame since the stats were reset */
+	if (stats->frames > 1)
+	{
+		int64_t interval = end - present.last_frame;
+		
+		stats->interval_total += interval;
+		stats->interval_squares += (interval / 1000) * (interval / 1000);
+		
+		if (interval > stats->interval_max)
+		{
+			stats->interval_max = interval;
+			stats->worst_work = work;
+			stats->worst_flip = flip;
+		}
+	}
+	
+	/* a frame shown a whole vblank or more after the one it was meant for */
+	if (present.vsync && present.target != 0 && end > present.target + present.period / 2)
+		stats->missed_vblanks++;
+	
+	present.target = 0;
+	present.last_frame = end;
+	
+	if (present.double_buffered)
+		present.back ^= 1;
+}
+
+int present_back_buffer(void)
+{
+	return present.back;
+}
+
+void present_tick_start(void)
+{
+	present.tick_start = now_ns();
+}
+
+clock_t present_align(clock_t due)
+{
+	if (present.vsync == false || present.last_frame == 0)
+		return due;
+	
+	/* SDL_GetTicks() is in ms from when SDL started, so go by the gap from now */
+	clock_t ms_now = SDL_GetTicks();
+	int64_t ns_now = now_ns();
+	int64_t due_ns = ns_now + (int64_t) (due - ms_now) * 1000000;
+	
+	int64_t vblanks = (due_ns - present.last_frame + present.period - 1) / present.period;
+	if (vblanks < 1)
+		vblanks = 1;
+	
+	present.target = present.last_frame + vblanks * present.period;
+	
+	int64_t start = present.target - present.work_estimate - ALIGN_MARGIN;
+	
+	return ms_now + (clock_t) ((start - ns_now) / 1000000);
+}
+
+void present_reset(void)
+{
+	memset(&present_stats, 0, sizeof(present_stats));
+	
+	present.tick_start = 0;
+	present.target = 0;
+}
+
+void present_report(void)
+{
+	const present_stats_T *stats = &present_stats;
+	
+	if (stats->frames < 2)
+		return;
+	
+	uint32_t intervals = stats->frames - 1;
+	double mean = (double) stats->interval_total / intervals / 1e3; /* us */
+	double spread = (double) stats->interval_squares / intervals - mean * mean;
+	
+	printf("frames: %u, %.1f ms apart (sd %.1f ms); the longest gap, %.1f ms, was %.1f ms of tick and %.1f ms of flip\n",
+		stats->frames, mean / 1e3, (spread > 0 ? sqrt(spread) : 0) / 1e3,
+		stats->interval_max / 1e6, stats->worst_work / 1e6, stats->worst_flip / 1e6);
+	
+	printf("  flips %.2f ms mean, %.2f ms max; ticks %.2f ms mean, %.2f ms max; ",
+		stats->flip_total / 1e6 / stats->frames, stats->flip_max / 1e6,
+		(stats->work_frames > 0 ? stats->work_total / 1e6 / stats->work_frames : 0), stats->work_max / 1e6);
+	
+	if (present.vsync)
+		printf("%u missed vblanks\n", stats->missed_vblanks);
+	else
+		printf("no vsync\n");
+}
@@ -0,0 +1,76 @@
+#ifndef PRESENT_H
+#define PRESENT_H
+
+#include <SDL/SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+
+/*
+ * Getting frames on to the display. The screen is asked for as a double
+ * buffered hardware surface, so a frame is only shown once it's whole, and
+ * falls back to a software surface where that isn't to be had. Whether
+ * flipping waits for the display's vertical blank (vsync) is found out by
+ * timing a few flips at startup, which also gives the refresh period.
+ *
+ * With vsync, a game's ticks are lined up with the refresh: each is run
+ * just soon enough, by how long ticks have been taking, to be shown at the
+ * first vblank after it's due, rather than wherever it happens to finish.
+ *
+ * Every frame is timed: the time from one to the next, how long the flip
+ * took, and how long the tick before it took to simulate and draw, so that
+ * uneven frames can be put down to one or the other. With vsync, a frame
+ * shown after the vblank it was lined up for is a missed vblank.
+ *
+ * With double buffering, what's on the screen surface after a flip is an
+ * older frame, so every frame has to be drawn whole.
+*/
+
+typedef struct
+{
+	uint32_t frames;
+	uint32_t missed_vblanks;
+	
+	/* ns */
+	int64_t interval_total;
+	int64_t interval_squares; /* us^2, for the spread */
+	int64_t interval_max;
+	
+	int64_t flip_total;
+	int64_t flip_max;
+	
+	int64_t work_total; /* from the tick starting to it being flipped */
+	int64_t work_max;
+	uint32_t work_frames;
+	
+	/* what the longest gap between frames was made of */
+	int64_t worst_work;
+	int64_t worst_flip;
+} present_stats_T;
+
+extern present_stats_T present_stats;
+
+/* sets the video mode as above; NULL if even a software surface can't be had */
+SDL_Surface *present_set_video_mode(int width, int height, int bpp);
+
+/* in place of SDL_Flip */
+void present_frame(void);
+
+/* which of the screen's buffers is being drawn into, always 0 if there's only the one */
+int present_back_buffer(void);
+
+/* call when a tick's work starts, so its frame's time is split into work and flip */
+void present_tick_start(void);
+
+/*
+ * When to start a tick that's due at `due` (SDL_GetTicks() time), to be
+ * shown at the first vblank after; `due` itself without vsync.
+*/
+clock_t present_align(clock_t due);
+
+/* starts the stats over, e.g. for a new game */
+void present_reset(void);
+
+/* prints the stats since the last reset */
+void present_report(void);
+#endif
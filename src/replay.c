@@ -0,0 +1,576 @@
+#define _POSIX_C_SOURCE 200809L
+
+#include "replay.h"
+#include "trace.h"
+#include "varint.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define REPLAY_MAGIC   "SNKR"
+#define TRAILER_MAGIC  "SNKI"
+/* 2: rocks no longer cut the board in two, 3: timers, 4: bodies as runs, 5: powerup and reversal timings as before 3 */
+#define REPLAY_VERSION 5
+
+#define INDEX_ENTRY_SIZE 12
+#define TRAILER_SIZE     28
+
+enum { RECORD_TURN_LEFT, RECORD_TURN_RIGHT, RECORD_KEYFRAME, RECORD_END };
+
+static void write_bytes(replay_writer_T *, const void *, size_t);
+static void write_varint(replay_writer_T *, uint64_t);
+static void write_record(replay_writer_T *, const board_T *, int kind);
+
+static bool parse_header(replay_reader_T *);
+static bool read_trailer(replay_reader_T *);
+static bool scan_records(replay_reader_T *);
+
+static void put_le(uint8_t *buf, uint64_t value, int len)
+{
+	for (int i = 0; i < len; i++)
+		buf[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint64_t get_le(const uint8_t *buf, int len)
+{
+	uint64_t value = 0;
+	
+	for (int i = 0; i < len; i++)
+		value |= (uint64_t) buf[i] << (8 * i);
+	
+	return value;
+}
+
+size_t replay_writer_memory_size(const replay_header_T *header)
+{
+	return arena_size(board_save_bound(&header->config)) +
+	       arena_size(REPLAY_BUFFER_SIZE) +
+	       arena_size(REPLAY_MAX_KEYFRAMES * sizeof(uint32_t)) +
+	       REPLAY_MAX_KEYFRAMES * sizeof(size_t);
+}
+
+bool replay_writer_open(replay_writer_T *writer, const char *path, const replay_header_T *header, arena_T *arena)
+{
+	memset(writer, 0, sizeof(replay_writer_T));
+	
+	size_t size = replay_writer_memory_size(header);
+	
+	if (arena == NULL)
+	{
+		writer->memory = calloc(1, size);
+		writer->owns_memory = true;
+	}
+	else
+		writer->memory = arena_alloc(arena, size);
+	
+	if (writer->memory == NULL)
+		return false;
+	
+	uint8_t *memory = writer->memory;
+	
+	writer->scratch = memory;
+	memory += arena_size(board_save_bound(&header->config));
+	
+	writer->buffer = (char *) memory;
+	memory += arena_size(REPLAY_BUFFER_SIZE);
+	
+	writer->keyframe_tick = (uint32_t *) memory;
+	memory += arena_size(REPLAY_MAX_KEYFRAMES * sizeof(uint32_t));
+	
+	writer->keyframe_offset = (size_t *) memory;
+	
+	/* never over another game's recording, e.g. from another instance sharing the directory */
+	int fd = open(path, O_WRONLY | O_CREAT | O_EXCL, 0644);
+	
+	writer->file = (fd == -1 ? NULL : fdopen(fd, "wb"));
+	if (writer->file == NULL)
+	{
+		if (fd != -1)
+			close(fd);
+		
+		if (writer->owns_memory)
+			free(writer->memory);
+		
+		return false;
+	}
+	
+	/* stop stdio allocating its own buffer on the first write */
+	setvbuf(writer->file, writer->buffer, _IOFBF, REPLAY_BUFFER_SIZE);
+	
+	writer->num_humans = header->config.num_humans;
+	writer->keyframe_interval = header->keyframe_interval;
+	
+	const board_config_T *config = &header->config;
+	
+	write_bytes(writer, REPLAY_MAGIC, 4);
+	write_varint(writer, REPLAY_VERSION);
+	
+	write_varint(writer, header->seed);
+	write_varint(writer, header->speed_human);
+	write_varint(writer, header->keyframe_interval);
+	
+	write_varint(writer, config->cols);
+	write_varint(writer, config->rows);
+	write_varint(writer, config->num_snakes);
+	write_varint(writer, config->num_humans);
+	write_varint(writer, config->max_snake_length);
+	write_varint(writer, config->num_apples);
+	write_varint(writer, config->max_rocks);
+	write_varint(writer, config->spawn_clearance);
+	write_varint(writer, config->score_multiplier);
+	write_varint(writer, config->respawn_bots);
+	
+	return true;
+}
+
+void replay_record_turn(replay_writer_T *writer, const board_T *board, int snake, turn_T turn)
+{
+	if (writer->file == NULL || turn == TURN_NONE)
+		return;
+	
+	write_record(writer, board, (turn == TURN_LEFT ? RECORD_TURN_LEFT : RECORD_TURN_RIGHT));
+	
+	if (writer->num_humans > 1)
+		write_varint(writer, snake);
+}
+
+void replay_record_tick(replay_writer_T *writer, const board_T *board)
+{
+	if (writer->file == NULL || writer->keyframe_interval == 0 ||
+	    board->tick % writer->keyframe_interval != 0)
+		return;
+	
+	if (writer->num_keyframes == REPLAY_MAX_KEYFRAMES)
+		return;
+	
+	TRACE_SCOPE("replay keyframe");
+	
+	writer->keyframe_tick[writer->num_keyframes] = board->tick;
+	writer->keyframe_offset[writer->num_keyframes] = writer->offset;
+	writer->num_keyframes++;
+	
+	size_t len = board_save(board, writer->scratch);
+	
+	write_record(writer, board, RECORD_KEYFRAME);
+	write_varint(writer, len);
+	write_bytes(writer, writer->scratch, len);
+	
+	/* so a crash loses at most the ticks since the last keyframe */
+	fflush(writer->file);
+}
+
+void replay_writer_close(replay_writer_T *writer, const board_T *board)
+{
+	if (writer->file == NULL)
+		return;
+	
+	int final_score = board->snake[0].score;
+	
+	write_record(writer, board, RECORD_END);
+	write_varint(writer, final_score);
+	
+	size_t index_offset = writer->offset;
+	
+	for (int i = 0; i < writer->num_keyframes; i++)
+	{
+		uint8_t entry[INDEX_ENTRY_SIZE];
+		
+		put_le(entry,     writer->keyframe_tick[i], 4);
+		put_le(entry + 4, writer->keyframe_offset[i], 8);
+		
+		write_bytes(writer, entry, INDEX_ENTRY_SIZE);
+	}
+	
+	uint8_t trailer[TRAILER_SIZE];
+	
+	put_le(trailer,      index_offset, 8);
+	put_le(trailer + 8,  writer->num_keyframes, 4);
+	put_le(trailer + 12, board->tick, 4);
+	put_le(trailer + 16, final_score, 4);
+	put_le(trailer + 20, 0, 4);
+	memcpy(trailer + 24, TRAILER_MAGIC, 4);
+	
+	write_bytes(writer, trailer, TRAILER_SIZE);
+	
+	fclose(writer->file);
+	
+	if (writer->owns_memory)
+		free(writer->memory);
+	
+	memset(writer, 0, sizeof(replay_writer_T));
+}
+
+static void write_bytes(replay_writer_T *writer, const void *buf, size_t len)
+{
+	fwrite(buf, 1, len, writer->file);
+	writer->offset += len;
+}
+
+static void write_varint(replay_writer_T *writer, uint64_t value)
+{
+	uint8_t buf[VARINT_MAX_LEN];
+	write_bytes(writer, buf, varint_put(buf, value));
+}
+
+static void write_record(replay_writer_T *writer, const board_T *board, int kind)
+{
+	write_varint(writer, ((uint64_t) (board->tick - writer->last_tick) << 2) | kind);
+	writer->last_tick = board->tick;
+}
+
+bool replay_open(replay_reader_T *reader, const char *path)
+{
+	memset(reader, 0, sizeof(replay_reader_T));
+	
+	int fd = open(path, O_RDONLY);
+	if (fd == -1)
+		return false;
+	
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size == 0)
+	{
+		close(fd);
+		return false;
+	}
+	
+	void *data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	
+	if (data == MAP_FAILED)
+		return false;
+	
+	reader->data = data;
+	reader->size = st.st_size;
+	
+	if (parse_header(reader) == false ||
+	    (read_trailer(reader) == false && scan_records(reader) == false))
+	{
+		replay_close(reader);
+		return false;
+	}
+	
+	return true;
+}
+
+void replay_close(replay_reader_T *reader)
+{
+	if (reader->data != NULL)
+		munmap((void *) reader->data, reader->size);
+	
+	free(reader->index);
+	
+	memset(reader, 0, sizeof(replay_reader_T));
+}
+
+bool replay_start(const replay_reader_T *reader, board_T *board, replay_cursor_T *cursor)
+{
+	board_free(board);
+	
+	if (board_init(board, &reader->header.config, reader->header.seed) == false)
+		return false;
+	
+	cursor->pos = reader->records_start;
+	cursor->tick = 0;
+	
+	return true;
+}
+
+bool replay_seek(const replay_reader_T *reader, board_T *board, replay_cursor_T *cursor, uint32_t tick)
+{
+	/* find the last keyframe at or before the tick */
+	int lo = 0;
+	int hi = reader->num_keyframes;
+	
+	while (lo < hi)
+	{
+		int mid = (lo + hi) / 2;
+		
+		if (reader->index[mid].tick <= tick)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	
+	bool restored = false;
+	
+	const uint8_t *snapshot;
+	size_t len;
+	
+	if (lo > 0 && replay_keyframe(reader, lo - 1, &snapshot, &len) &&
+	    board_load(board, snapshot, len))
+	{
+		cursor->pos = snapshot + len - reader->data;
+		cursor->tick = reader->index[lo - 1].tick;
+		restored = true;
+	}
+	
+	if (restored == false && replay_start(reader, board, cursor) == false)
+		return false;
+	
+	return replay_advance(reader, board, cursor, tick);
+}
+
+bool replay_keyframe(const replay_reader_T *reader, int i, const uint8_t **snapshot, size_t *len)
+{
+	size_t pos = reader->index[i].offset;
+	uint64_t value;
+	size_t n;
+	
+	/* skip the record header, then read the snapshot length */
+	if ((n = varint_get(reader->data + pos, reader->size - pos, &value)) == 0)
+		return false;
+	
+	pos += n;
+	
+	if ((n = varint_get(reader->data + pos, reader->size - pos, &value)) == 0 ||
+	    value > reader->size - pos - n)
+		return false;
+	
+	*snapshot = reader->data + pos + n;
+	*len = value;
+	
+	return true;
+}
+
+bool replay_advance(const replay_reader_T *reader, board_T *board, replay_cursor_T *cursor, uint32_t tick)
+{
+	if (board->tick > tick)
+		return false;
+	
+	while (1)
+	{
+		uint64_t record = 0;
+		size_t n = varint_get(reader->data + cursor->pos, reader->size - cursor->pos, &record);
+		
+		/* out of records: the recording was cut short */
+		if (n == 0)
+			return board->tick == tick;
+		
+		uint64_t next = cursor->tick + (record >> 2);
+		
+		while (board->tick < next && board->tick < tick && board->humans_alive > 0)
+			board_tick(board);
+		
+		if (board->tick == tick)
+			return true;
+		
+		if (board->tick < next)
+			return false; /* the game ended early */
+		
+		cursor->pos += n;
+		cursor->tick = next;
+		
+		switch (record & 3)
+		{
+			case RECORD_TURN_LEFT:
+			case RECORD_TURN_RIGHT:
+			{
+				uint64_t snake = 0;
+				
+				if (reader->header.config.num_humans > 1)
+				{
+					n = varint_get(reader->data + cursor->pos, reader->size - cursor->pos, &snake);
+					cursor->pos += n;
+					
+					if (n == 0 || snake >= (uint64_t) reader->header.config.num_snakes)
+						return false;
+				}
+				
+				board_turn(board, snake, ((record & 3) == RECORD_TURN_LEFT ? TURN_LEFT : TURN_RIGHT));
+				break;
+			}
+			
+			case RECORD_KEYFRAME:
+			{
+				uint64_t len;
+				n = varint_get(reader->data + cursor->pos, reader->size - cursor->pos, &len);
+				
+				if (n == 0 || len > reader->size - cursor->pos - n)
+					return false;
+				
+				cursor->pos += n + len;
+				break;
+			}
+			
+			case RECORD_END:
+				return false;
+		}
+	}
+}
+
+typedef struct
+{
+	const uint8_t *p;
+	const uint8_t *end;
+	bool ok;
+} parser_T;
+
+static uint64_t parse_varint(parser_T *parser, uint64_t max)
+{
+	uint64_t value = 0;
+	size_t n = (parser->ok ? varint_get(parser->p, parser->end - parser->p, &value) : 0);
+	
+	if (n == 0 || value > max)
+	{
+		parser->ok = false;
+		return 0;
+	}
+	
+	parser->p += n;
+	return value;
+}
+
+/* the limits keep a corrupt header from asking for absurd allocations */
+static bool parse_header(replay_reader_T *reader)
+{
+	if (reader->size < 5 || memcmp(reader->data, REPLAY_MAGIC, 4) != 0)
+		return false;
+	
+	parser_T parser = { reader->data + 4, reader->data + reader->size, true };
+	
+	if (parse_varint(&parser, UINT32_MAX) != REPLAY_VERSION)
+		return false;
+	
+	replay_header_T *header = &reader->header;
+	board_config_T *config = &header->config;
+	
+	header->seed              = parse_varint(&parser, UINT32_MAX);
+	header->speed_human       = parse_varint(&parser, 100);
+	header->keyframe_interval = parse_varint(&parser, UINT32_MAX);
+	
+	config->cols             = parse_varint(&parser, 1 << 15);
+	config->rows             = parse_varint(&parser, 1 << 15);
+	config->num_snakes       = parse_varint(&parser, 1 << 16);
+	config->num_humans       = parse_varint(&parser, config->num_snakes);
+	config->max_snake_length = parse_varint(&parser, 1 << 24);
+	config->num_apples       = parse_varint(&parser, 1 << 20);
+	config->max_rocks        = parse_varint(&parser, (uint64_t) config->cols * config->rows);
+	config->spawn_clearance  = parse_varint(&parser, 1 << 15);
+	config->score_multiplier = parse_varint(&parser, 1 << 20);
+	config->respawn_bots     = parse_varint(&parser, 1);
+	
+	if (config->cols == 0 || config->rows == 0 || config->num_snakes == 0 ||
+	    config->max_snake_length < STARTING_SNAKE_LEN)
+		return false;
+	
+	reader->records_start = parser.p - reader->data;
+	
+	return parser.ok;
+}
+
+static bool read_trailer(replay_reader_T *reader)
+{
+	if (reader->size < reader->records_start + TRAILER_SIZE)
+		return false;
+	
+	const uint8_t *trailer = reader->data + reader->size - TRAILER_SIZE;
+	
+	if (memcmp(trailer + 24, TRAILER_MAGIC, 4) != 0)
+		return false;
+	
+	uint64_t index_offset = get_le(trailer, 8);
+	uint64_t num_keyframes = get_le(trailer + 8, 4);
+	
+	if (index_offset < reader->records_start ||
+	    index_offset + num_keyframes * INDEX_ENTRY_SIZE != reader->size - TRAILER_SIZE)
+		return false;
+	
+	reader->index = malloc((num_keyframes + 1) * sizeof(replay_index_T));
+	if (reader->index == NULL)
+		return false;
+	
+	const uint8_t *entry = reader->data + index_offset;
+	
+	for (uint64_t i = 0; i < num_keyframes; i++, entry += INDEX_ENTRY_SIZE)
+	{
+		reader->index[i].tick   = get_le(entry, 4);
+		reader->index[i].offset = get_le(entry + 4, 8);
+		
+		if (reader->index[i].offset >= index_offset)
+			return false;
+	}
+	
+	reader->num_keyframes = num_keyframes;
+	reader->finished = true;
+	reader->end_tick = get_le(trailer + 12, 4);
+	reader->final_score = get_le(trailer + 16, 4);
+	
+	return true;
+}
+
+/* rebuilds the index of a replay that was never closed properly */
+static bool scan_records(replay_reader_T *reader)
+{
+	free(reader->index);
+	reader->index = NULL;
+	reader->num_keyframes = 0;
+	
+	int capacity = 0;
+	
+	size_t pos = reader->records_start;
+	uint64_t tick = 0;
+	
+	while (pos < reader->size)
+	{
+		uint64_t record, value;
+		size_t start = pos;
+		size_t n = varint_get(reader->data + pos, reader->size - pos, &record);
+		
+		if (n == 0)
+			break;
+		
+		pos += n;
+		tick += record >> 2;
+		
+		switch (record & 3)
+		{
+			case RECORD_TURN_LEFT:
+			case RECORD_TURN_RIGHT:
+				if (reader->header.config.num_humans > 1)
+					pos += varint_get(reader->data + pos, reader->size - pos, &value);
+				break;
+			
+			case RECORD_KEYFRAME:
+			{
+				n = varint_get(reader->data + pos, reader->size - pos, &value);
+				if (n == 0 || value > reader->size - pos - n)
+					return true; /* cut off mid-keyframe */
+				
+				pos += n + value;
+				
+				if (reader->num_keyframes == capacity)
+				{
+					capacity = (capacity == 0 ? 64 : capacity * 2);
+					
+					replay_index_T *index = realloc(reader->index, capacity * sizeof(replay_index_T));
+					if (index == NULL)
+						return false;
+					
+					reader->index = index;
+				}
+				
+				reader->index[reader->num_keyframes].tick = tick;
+				reader->index[reader->num_keyframes].offset = start;
+				reader->num_keyframes++;
+				break;
+			}
+			
+			case RECORD_END:
+			{
+				if (varint_get(reader->data + pos, reader->size - pos, &value) == 0)
+					return true;
+				
+				reader->finished = true;
+				reader->end_tick = tick;
+				reader->final_score = value;
+				return true;
+			}
+		}
+	}
+	
+	return true;
+}
@@ -0,0 +1,141 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include "board.h"
+
+#include <stdio.h>
+
+/*
+ * Recorded games.
+ *
+ * A replay file is a header (seed, speed, board config) followed by a
+ * stream of records, each starting with the varint `(tick delta << 2) |
+ * kind`:
+ *
+ *   turn left / turn right - a `board_turn()` of snake 0 (or of the
+ *                            snake given in a following varint, when
+ *                            there's more than one human)
+ *   keyframe               - varint length, then a `board_save()` snapshot
+ *   end                    - varint final score of snake 0; the record's
+ *                            tick is the tick the game ended on
+ *
+ * The file is only ever appended to while the game is played, and is
+ * flushed after every keyframe, so a crash loses at most the ticks since
+ * the last one. Closing the writer appends the keyframe index (fixed size
+ * little endian entries, for binary searching straight out of a mapped
+ * file) and a trailer pointing at it. A file without a trailer, e.g. from
+ * a crash, is still readable; its index is rebuilt by scanning the
+ * records.
+*/
+
+#define REPLAY_KEYFRAME_INTERVAL 256
+
+/* keyframes past this many are left out, which only makes seeking slower */
+#define REPLAY_MAX_KEYFRAMES 4096
+
+/* stdio buffer for the file being written */
+#define REPLAY_BUFFER_SIZE 16384
+
+typedef struct
+{
+	uint32_t seed;
+	int speed_human;
+	uint32_t keyframe_interval;
+	
+	board_config_T config;
+} replay_header_T;
+
+typedef struct
+{
+	FILE *file;
+	size_t offset;
+	
+	uint32_t last_tick;
+	int num_humans;
+	
+	/* everything below is allocated up front, writing never allocates */
+	void *memory;
+	bool owns_memory;
+	
+	uint8_t *scratch;
+	char *buffer;
+	
+	int num_keyframes;
+	uint32_t *keyframe_tick;
+	size_t *keyframe_offset;
+	
+	uint32_t keyframe_interval;
+} replay_writer_T;
+
+typedef struct
+{
+	uint32_t tick;
+	uint64_t offset;
+} replay_index_T;
+
+typedef struct
+{
+	const uint8_t *data;
+	size_t size;
+	
+	replay_header_T header;
+	size_t records_start;
+	
+	int num_keyframes;
+	replay_index_T *index;
+	
+	/* only known if the file has an end record */
+	bool finished;
+	uint32_t end_tick;
+	int final_score;
+} replay_reader_T;
+
+/* position in the record stream while playing a replay back */
+typedef struct
+{
+	size_t pos;
+	uint32_t tick; /* tick of the last record read */
+} replay_cursor_T;
+
+/*
+ * Returns false if the file couldn't be created, including if it already
+ * exists. The writer's memory comes from the arena if given, else from
+ * the heap.
+*/
+bool replay_writer_open(replay_writer_T *, const char *path, const replay_header_T *, arena_T *);
+size_t replay_writer_memory_size(const replay_header_T *);
+
+/* call alongside every `board_turn()` of a human snake */
+void replay_record_turn(replay_writer_T *, const board_T *, int snake, turn_T);
+
+/* call after every `board_tick()` */
+void replay_record_tick(replay_writer_T *, const board_T *);
+
+void replay_writer_close(replay_writer_T *, const board_T *);
+
+/* maps the file; returns false if it can't be read or isn't a replay */
+bool replay_open(replay_reader_T *, const char *path);
+void replay_close(replay_reader_T *);
+
+/*
+ * Sets up `board` as it was at the start of the game. The board must be
+ * zeroed or previously set up, as any old state is freed first.
+*/
+bool replay_start(const replay_reader_T *, board_T *, replay_cursor_T *);
+
+/*
+ * Restores the nearest keyframe at or before `tick` into `board` (which
+ * must have been set up by `replay_start()`) and plays forward from there.
+*/
+bool replay_seek(const replay_reader_T *, board_T *, replay_cursor_T *, uint32_t tick);
+
+/* finds the board snapshot stored in keyframe `i` of the index */
+bool replay_keyframe(const replay_reader_T *, int i, const uint8_t **snapshot, size_t *len);
+
+/*
+ * Plays the game forward until the board has done `tick` ticks. Turns
+ * made on that tick are left unapplied. Returns false if the game ended
+ * or the recording ran out first.
+*/
+bool replay_advance(const replay_reader_T *, board_T *, replay_cursor_T *, uint32_t tick);
+#endif
@@ -0,0 +1,297 @@
+/*
+ * Checks submitted scores by re-simulating their replays.
+ *
+ * Every .snr file in the directory is played back with the real game
+ * rules. A replay passes if its config is one the game actually plays,
+ * the snake dies on exactly the claimed tick with exactly the claimed
+ * score, and every keyframe matches the re-simulated board.
+ *
+ * usage: replay_verify <directory> [workers]
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include "board.h"
+#include "replay.h"
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* the board `start_game()` plays on, and the bots it adds in arena mode (see game.c) */
+#define GAME_COLS  43
+#define GAME_ROWS  32
+#define ARENA_BOTS 7
+
+typedef struct
+{
+	char *path;
+	
+	bool passed;
+	const char *reason;
+	
+	int score;
+	uint32_t end_tick;
+	
+	/* the first tick the recording and the re-simulation disagree on */
+	uint32_t divergent_tick;
+} result_T;
+
+typedef struct
+{
+	result_T *results;
+	int num_results;
+	int next; /* shared work counter */
+} job_T;
+
+static void verify(result_T *, board_T *, uint8_t **scratch, size_t *scratch_size);
+static bool standard_config(const replay_header_T *);
+
+static void *worker(void *arg)
+{
+	job_T *job = arg;
+	
+	board_T board;
+	memset(&board, 0, sizeof(board_T));
+	
+	uint8_t *scratch = NULL;
+	size_t scratch_size = 0;
+	
+	while (1)
+	{
+		int i = __sync_fetch_and_add(&job->next, 1);
+		if (i >= job->num_results)
+			break;
+		
+		verify(&job->results[i], &board, &scratch, &scratch_size);
+	}
+	
+	board_free(&board);
+	free(scratch);
+	
+	return NULL;
+}
+
+static void fail(result_T *result, const char *reason, uint32_t tick)
+{
+	result->passed = false;
+	result->reason = reason;
+	result->divergent_tick = tick;
+}
+
+static void verify(result_T *result, board_T *board, uint8_t **scratch, size_t *scratch_size)
+{
+	replay_reader_T reader;
+	
+	if (replay_open(&reader, result->path) == false)
+	{
+		fail(result, "not a readable replay", 0);
+		return;
+	}
+	
+	result->score = reader.final_score;
+	result->end_tick = reader.end_tick;
+	
+	if (reader.finished == false)
+		fail(result, "recording never finished", 0);
+	else if (standard_config(&reader.header) == false)
+		fail(result, "non-standard game settings", 0);
+	else
+	{
+		replay_cursor_T cursor;
+		result->passed = replay_start(&reader, board, &cursor);
+		
+		if (result->passed == false)
+			fail(result, "board too large", 0);
+		
+		size_t bound = board_save_bound(&reader.header.config);
+		if (*scratch_size < bound)
+		{
+			free(*scratch);
+			*scratch = malloc(bound);
+			*scratch_size = (*scratch == NULL ? 0 : bound);
+		}
+		
+		/* compare against every keyframe on the way */
+		for (int i = 0; i < reader.num_keyframes && result->passed; i++)
+		{
+			uint32_t tick = reader.index[i].tick;
+			
+			const uint8_t *snapshot;
+			size_t len;
+			
+			if (tick > reader.end_tick || replay_keyframe(&reader, i, &snapshot, &len) == false)
+				fail(result, "corrupt keyframe", tick);
+			else if (replay_advance(&reader, board, &cursor, tick) == false)
+				fail(result, "snake died early", board->tick);
+			else if (*scratch == NULL)
+				fail(result, "out of memory", 0);
+			else if (board_save(board, *scratch) != len || memcmp(*scratch, snapshot, len) != 0)
+				fail(result, "keyframe mismatch", tick);
+		}
+		
+		if (result->passed)
+		{
+			if (replay_advance(&reader, board, &cursor, reader.end_tick) == false)
+				fail(result, "snake died early", board->tick);
+			else if (board->humans_alive != 0)
+				fail(result, "snake still alive at the claimed death tick", reader.end_tick);
+			else if (board->snake[0].score != reader.final_score)
+				fail(result, "score mismatch", reader.end_tick);
+		}
+	}
+	
+	replay_close(&reader);
+}
+
+/* the settings `start_game()` plays with, in single-player or arena mode */
+static bool standard_config(const replay_header_T *header)
+{
+	const board_config_T *config = &header->config;
+	
+	if (header->speed_human < 0 || header->speed_human > 4)
+		return false;
+	
+	board_config_T expected;
+	board_default_config(&expected, GAME_COLS, GAME_ROWS);
+	
+	bool snakes = (config->num_snakes == expected.num_snakes ||
+	               config->num_snakes == expected.num_snakes + ARENA_BOTS);
+	
+	return config->cols             == expected.cols &&
+	       config->rows             == expected.rows &&
+	       snakes &&
+	       config->num_humans       == expected.num_humans &&
+	       config->max_snake_length == expected.max_snake_length &&
+	       config->num_apples       == expected.num_apples &&
+	       config->max_rocks        == expected.max_rocks &&
+	       config->spawn_clearance  == expected.spawn_clearance &&
+	       config->respawn_bots     == expected.respawn_bots &&
+	       config->score_multiplier == speed_score_multiplier(header->speed_human);
+}
+
+static int collect_replays(const char *directory, result_T **results)
+{
+	DIR *dir = opendir(directory);
+	if (dir == NULL)
+		return -1;
+	
+	int count = 0;
+	int capacity = 0;
+	*results = NULL;
+	
+	struct dirent *entry;
+	while ((entry = readdir(dir)) != NULL)
+	{
+		size_t len = strlen(entry->d_name);
+		if (len < 4 || strcmp(entry->d_name + len - 4, ".snr") != 0)
+			continue;
+		
+		if (count == capacity)
+		{
+			capacity = (capacity == 0 ? 256 : capacity * 2);
+			
+			result_T *grown = realloc(*results, capacity * sizeof(result_T));
+			if (grown == NULL)
+			{
+				printf("Could not allocate the list of replays.\n");
+				exit(1);
+			}
+			
+			*results = grown;
+		}
+		
+		result_T *result = &(*results)[count++];
+		memset(result, 0, sizeof(result_T));
+		
+		result->path = malloc(strlen(directory) + len + 2);
+		if (result->path == NULL)
+		{
+			printf("Could not allocate the list of replays.\n");
+			exit(1);
+		}
+		
+		sprintf(result->path, "%s/%s", directory, entry->d_name);
+	}
+	
+	closedir(dir);
+	return count;
+}
+
+static int compare_paths(const void *a, const void *b)
+{
+	return strcmp(((const result_T *) a)->path, ((const result_T *) b)->path);
+}
+
+int main(int argc, const char *argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: %s <directory> [workers]\n", argv[0]);
+		return 2;
+	}
+	
+	int num_workers = (argc > 2 ? atoi(argv[2]) : 4);
+	if (num_workers < 1)
+		num_workers = 1;
+	
+	job_T job = { NULL, 0, 0 };
+	
+	job.num_results = collect_replays(argv[1], &job.results);
+	if (job.num_results == -1)
+	{
+		printf("Couldn't open the directory %s\n", argv[1]);
+		return 2;
+	}
+	
+	qsort(job.results, job.num_results, sizeof(result_T), compare_paths);
+	
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	pthread_t *threads = malloc(num_workers * sizeof(pthread_t));
+	if (threads == NULL)
+	{
+		printf("Could not allocate the workers.\n");
+		exit(1);
+	}
+	
+	for (int i = 0; i < num_workers; i++)
+		pthread_create(&threads[i], NULL, worker, &job);
+	
+	for (int i = 0; i < num_workers; i++)
+		pthread_join(threads[i], NULL);
+	
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	int num_failed = 0;
+	
+	for (int i = 0; i < job.num_results; i++)
+	{
+		result_T *result = &job.results[i];
+		
+		if (result->passed)
+			printf("PASS %s score %d death tick %u\n", result->path, result->score, result->end_tick);
+		else
+		{
+			printf("FAIL %s score %d death tick %u: %s, first divergent tick %u\n",
+				result->path, result->score, result->end_tick, result->reason, result->divergent_tick);
+			num_failed++;
+		}
+		
+		free(result->path);
+	}
+	
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	
+	fprintf(stderr, "%d replays, %d failed, %.3fs with %d workers (%.0f replays/s)\n",
+		job.num_results, num_failed, elapsed, num_workers,
+		(elapsed > 0 ? job.num_results / elapsed : 0));
+	
+	free(threads);
+	free(job.results);
+	
+	return (num_failed == 0 ? 0 : 1);
+}
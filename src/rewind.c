@@ -0,0 +1,262 @@
+#include "rewind.h"
+#include "varint.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+/* bytes compared at a time, and so the smallest run kept */
+#define WORD 4
+
+static size_t state_size(const board_config_T *config)
+{
+	return sizeof(board_T) + board_memory_size(config);
+}
+
+/*
+ * A delta is at most every word changed, each run of them separated from
+ * the next by at least one unchanged word, and each costing two varints
+ * (of less than 5 bytes, as a board is far less than 2^35 bytes).
+*/
+static size_t scratch_size(const board_config_T *config)
+{
+	size_t size = state_size(config);
+	return size + (size / (2 * WORD) + 1) * 2 * 5;
+}
+
+size_t rewind_memory_size(const board_config_T *config, uint32_t max_ticks, size_t ring_size)
+{
+	return arena_size(max_ticks * sizeof(uint64_t)) +
+	       arena_size(state_size(config)) +
+	       arena_size(ring_size) +
+	       arena_size(scratch_size(config));
+}
+
+bool rewind_init(rewind_T *rewind, const board_T *board, uint32_t max_ticks, size_t ring_size, arena_T *arena)
+{
+	memset(rewind, 0, sizeof(rewind_T));
+	
+	size_t size = rewind_memory_size(&board->config, max_ticks, ring_size);
+	
+	if (arena == NULL)
+	{
+		rewind->memory = calloc(1, size);
+		rewind->owns_memory = true;
+	}
+	else
+		rewind->memory = arena_alloc(arena, size);
+	
+	if (rewind->memory == NULL)
+		return false;
+	
+	uint8_t *memory = rewind->memory;
+	
+	rewind->delta_end = (uint64_t *) memory;
+	rewind->max_ticks = max_ticks;
+	memory += arena_size(max_ticks * sizeof(uint64_t));
+	
+	rewind->previous = memory;
+	rewind->state_size = state_size(&board->config);
+	memory += arena_size(rewind->state_size);
+	
+	rewind->ring = memory;
+	rewind->ring_size = ring_size;
+	memory += arena_size(ring_size);
+	
+	rewind->scratch = memory;
+	rewind->scratch_size = scratch_size(&board->config);
+	
+	memcpy(rewind->previous, board, sizeof(board_T));
+	memcpy(rewind->previous + sizeof(board_T), board->memory, rewind->state_size - sizeof(board_T));
+	
+	return true;
+}
+
+void rewind_free(rewind_T *rewind)
+{
+	if (rewind->owns_memory)
+		free(rewind->memory);
+	
+	memset(rewind, 0, sizeof(rewind_T));
+}
+
+/*
+ * Appends the runs of words that differ between `now` and `before` to
+ * `out` as (gap since the last run, length, XORed bytes), and brings
+ * `before` up to date. `base` is where the region starts in the state and
+ * `*last` where the last run ended.
+*/
+static uint8_t *diff_region(uint8_t *out, const uint8_t *now, uint8_t *before, size_t len,
+                            size_t base, size_t *last)
+{
+	size_t i = 0;
+	
+	while (i < len)
+	{
+		size_t n = (len - i < WORD ? len - i : WORD);
+		
+		if (memcmp(now + i, before + i, n) == 0)
+		{
+			i += n;
+			continue;
+		}
+		
+		size_t start = i;
+		
+		while (i < len)
+		{
+			n = (len - i < WORD ? len - i : WORD);
+			
+			if (memcmp(now + i, before + i, n) == 0)
+				break;
+			
+			i += n;
+		}
+		
+		out += varint_put(out, base + start - *last);
+		out += varint_put(out, i - start);
+		
+		for (size_t j = start; j < i; j++)
+		{
+			*out++ = now[j] ^ before[j];
+			before[j] = now[j];
+		}
+		
+		*last = base + i;
+	}
+	
+	return out;
+}
+
+/* XORs a delta into the state made up of `head` and `body` */
+static void apply(const uint8_t *delta, size_t len, uint8_t *head, size_t head_size, uint8_t *body)
+{
+	size_t pos = 0;
+	size_t at = 0;
+	
+	while (pos < len)
+	{
+		uint64_t gap, run;
+		
+		pos += varint_get(delta + pos, len - pos, &gap);
+		pos += varint_get(delta + pos, len - pos, &run);
+		
+		at += gap;
+		
+		for (uint64_t j = 0; j < run; j++, at++)
+		{
+			uint8_t *byte = (at < head_size ? head + at : body + (at - head_size));
+			*byte ^= delta[pos++];
+		}
+	}
+}
+
+/* copies between the ring and the scratch space, going round the end of the ring */
+static void ring_copy(rewind_T *rewind, uint64_t pos, size_t len, bool to_ring)
+{
+	size_t start = pos % rewind->ring_size;
+	size_t first = (len < rewind->ring_size - start ? len : rewind->ring_size - start);
+	
+	if (to_ring)
+	{
+		memcpy(rewind->ring + start, rewind->scratch, first);
+		memcpy(rewind->ring, rewind->scratch + first, len - first);
+	}
+	else
+	{
+		memcpy(rewind->scratch, rewind->ring + start, first);
+		memcpy(rewind->scratch + first, rewind->ring, len - first);
+	}
+}
+
+static uint64_t delta_start(const rewind_T *rewind, uint64_t delta)
+{
+	return (delta == rewind->first_delta ? rewind->first_byte : rewind->delta_end[(delta - 1) % rewind->max_ticks]);
+}
+
+void rewind_record(rewind_T *rewind, const board_T *board)
+{
+	if (rewind->max_ticks == 0)
+		return;
+	
+	/* playing on from a rewound board forgets what was rewound */
+	if (rewind->current != rewind->next_delta)
+	{
+		rewind->next_byte = delta_start(rewind, rewind->current);
+		rewind->next_delta = rewind->current;
+	}
+	
+	size_t last = 0;
+	
+	uint8_t *end = diff_region(rewind->scratch, (const uint8_t *) board, rewind->previous, sizeof(board_T), 0, &last);
+	end = diff_region(end, board->memory, rewind->previous + sizeof(board_T),
+	                  rewind->state_size - sizeof(board_T), sizeof(board_T), &last);
+	
+	size_t len = end - rewind->scratch;
+	
+	/* a tick too big to keep can't be rewound past, nor can anything before it */
+	if (len > rewind->ring_size)
+	{
+		rewind->first_delta = rewind->next_delta;
+		rewind->first_byte = rewind->next_byte;
+		rewind->current = rewind->next_delta;
+		return;
+	}
+	
+	while (rewind->next_delta - rewind->first_delta == rewind->max_ticks ||
+	       rewind->next_byte + len - rewind->first_byte > rewind->ring_size)
+	{
+		rewind->first_byte = rewind->delta_end[rewind->first_delta % rewind->max_ticks];
+		rewind->first_delta++;
+	}
+	
+	ring_copy(rewind, rewind->next_byte, len, true);
+	
+	rewind->next_byte += len;
+	rewind->delta_end[rewind->next_delta % rewind->max_ticks] = rewind->next_byte;
+	rewind->next_delta++;
+	rewind->current = rewind->next_delta;
+}
+
+/* XORs delta `delta` into both the board and the copy of it */
+static void toggle_delta(rewind_T *rewind, board_T *board, uint64_t delta)
+{
+	uint64_t start = delta_start(rewind, delta);
+	size_t len = rewind->delta_end[delta % rewind->max_ticks] - start;
+	
+	ring_copy(rewind, start, len, false);
+	
+	apply(rewind->scratch, len, (uint8_t *) board, sizeof(board_T), board->memory);
+	apply(rewind->scratch, len, rewind->previous, sizeof(board_T), rewind->previous + sizeof(board_T));
+}
+
+bool rewind_back(rewind_T *rewind, board_T *board)
+{
+	if (rewind->current == rewind->first_delta)
+		return false;
+	
+	rewind->current--;
+	toggle_delta(rewind, board, rewind->current);
+	
+	return true;
+}
+
+bool rewind_forward(rewind_T *rewind, board_T *board)
+{
+	if (rewind->current == rewind->next_delta)
+		return false;
+	
+	toggle_delta(rewind, board, rewind->current);
+	rewind->current++;
+	
+	return true;
+}
+
+uint32_t rewind_ticks(const rewind_T *rewind)
+{
+	return rewind->current - rewind->first_delta;
+}
+
+size_t rewind_bytes(const rewind_T *rewind)
+{
+	return rewind->next_byte - rewind->first_byte;
+}
@@ -0,0 +1,85 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include "arena.h"
+#include "board.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Rewinding the last few seconds of a game, a tick at a time.
+ *
+ * After every tick, the board's state (the board itself and its memory
+ * block) is compared with how it was a tick before, and the runs of bytes
+ * that changed are kept, XORed with their old values, in a ring: a snake
+ * moving changes its head and tail cells in the grid, the runs at either
+ * end of its body and a few of its fields, so a tick costs tens of bytes.
+ * XORing a tick's runs back into the board takes it back to the tick
+ * before, and XORing them in again brings it forward, so rewinding or
+ * replaying n ticks only ever touches those n ticks' changes.
+ *
+ * The oldest ticks are dropped when the ring runs out of room or ticks. As
+ * rewinding always starts from the board as it is now, no full copies of
+ * the board are kept other than the one to compare the next tick with.
+*/
+
+typedef struct
+{
+	/* the board's struct then its memory block, as of the last tick recorded */
+	uint8_t *previous;
+	size_t state_size;
+	
+	/* XORed runs, `first_byte` to `next_byte` being in use */
+	uint8_t *ring;
+	size_t ring_size;
+	uint64_t first_byte;
+	uint64_t next_byte;
+	
+	/*
+	 * Deltas are numbered from 0, `first_delta` to `next_delta` being held;
+	 * `delta_end` is where each ends in the ring, by number modulo
+	 * `max_ticks`. The board is as it was before delta `current`, i.e.
+	 * deltas from there on have been rewound.
+	*/
+	uint64_t *delta_end;
+	uint32_t max_ticks;
+	uint64_t first_delta;
+	uint64_t next_delta;
+	uint64_t current;
+	
+	uint8_t *scratch; /* one tick's delta, unwrapped */
+	size_t scratch_size;
+	
+	void *memory;
+	bool owns_memory;
+} rewind_T;
+
+/*
+ * Room for up to `max_ticks` ticks in `ring_size` bytes, for boards with
+ * this config.
+*/
+size_t rewind_memory_size(const board_config_T *, uint32_t max_ticks, size_t ring_size);
+
+/*
+ * Starts recording the board as it is now. Takes its memory from the arena
+ * if given, else from the heap; returns false if there wasn't any.
+*/
+bool rewind_init(rewind_T *, const board_T *, uint32_t max_ticks, size_t ring_size, arena_T *);
+void rewind_free(rewind_T *);
+
+/*
+ * Call after every `board_tick()`. If the board has been rewound, the ticks
+ * that were rewound are forgotten and the game carries on from here.
+*/
+void rewind_record(rewind_T *, const board_T *);
+
+/* one tick back or forward again; false if there's none to go to */
+bool rewind_back(rewind_T *, board_T *);
+bool rewind_forward(rewind_T *, board_T *);
+
+/* how many ticks back the board can go, and the bytes they take */
+uint32_t rewind_ticks(const rewind_T *);
+size_t rewind_bytes(const rewind_T *);
+#endif
@@ -0,0 +1,80 @@
+#include "scale.h"
+#include "trace.h"
+
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+static void widen_row(const uint32_t *src, int w, uint32_t *dst, int factor);
+
+void scale_pixels(const uint32_t *src, int src_pitch, int w, int h,
+                  uint32_t *dst, int dst_pitch, int factor)
+{
+	TRACE_SCOPE("scale_pixels");
+	
+	size_t row_bytes = (size_t) w * factor * sizeof(uint32_t);
+	
+	for (int y = 0; y < h; y++)
+	{
+		const uint32_t *from = (const uint32_t *) ((const uint8_t *) src + (size_t) y * src_pitch);
+		uint8_t *to = (uint8_t *) dst + (size_t) y * factor * dst_pitch;
+		
+		widen_row(from, w, (uint32_t *) to, factor);
+		
+		for (int i = 1; i < factor; i++)
+			memcpy(to + (size_t) i * dst_pitch, to, row_bytes);
+	}
+}
+
+/* a row `factor` times as wide, each pixel repeated */
+static void widen_row(const uint32_t *src, int w, uint32_t *dst, int factor)
+{
+	int x = 0;
+
+#ifdef __SSE2__
+	/* the common factors as shuffles of four pixels, p0 p1 p2 p3, at a time */
+	switch (factor)
+	{
+		case 2:
+			for (; x + 4 <= w; x += 4, dst += 8)
+			{
+				__m128i p = _mm_loadu_si128((const __m128i *) (src + x));
+				
+				_mm_storeu_si128((__m128i *) dst,       _mm_unpacklo_epi32(p, p));
+				_mm_storeu_si128((__m128i *) (dst + 4), _mm_unpackhi_epi32(p, p));
+			}
+			break;
+		
+		case 3:
+			for (; x + 4 <= w; x += 4, dst += 12)
+			{
+				__m128i p = _mm_loadu_si128((const __m128i *) (src + x));
+				
+				_mm_storeu_si128((__m128i *) dst,       _mm_shuffle_epi32(p, _MM_SHUFFLE(1, 0, 0, 0)));
+				_mm_storeu_si128((__m128i *) (dst + 4), _mm_shuffle_epi32(p, _MM_SHUFFLE(2, 2, 1, 1)));
+				_mm_storeu_si128((__m128i *) (dst + 8), _mm_shuffle_epi32(p, _MM_SHUFFLE(3, 3, 3, 2)));
+			}
+			break;
+		
+		default:
+			/* four or more: each pixel is whole vectors of itself, the last one overlapping */
+			if (factor >= 4)
+				for (; x < w; x++, dst += factor)
+				{
+					__m128i p = _mm_set1_epi32((int) src[x]);
+					
+					for (int i = 0; i + 4 < factor; i += 4)
+						_mm_storeu_si128((__m128i *) (dst + i), p);
+					
+					_mm_storeu_si128((__m128i *) (dst + factor - 4), p);
+				}
+			break;
+	}
+#endif
+
+	for (; x < w; x++)
+		for (int i = 0; i < factor; i++)
+			*dst++ = src[x];
+}
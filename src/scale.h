@@ -0,0 +1,21 @@
+#ifndef SCALE_H
+#define SCALE_H
+
+#include <stdint.h>
+
+/*
+ * Nearest neighbour integer scaling of 32 bit pixels: every source pixel
+ * becomes a `factor` by `factor` square. Each row is widened once, four
+ * pixels at a time with SSE2 where there is it, and the copies below it
+ * are plain row copies.
+ *
+ * Nothing here knows about SDL, so it's shared by the game (for images,
+ * as they're loaded or baked into the asset cache) and scale_bench.
+*/
+
+#define SCALE_MAX 8
+
+/* pitches are in bytes; `dst` has to have room for w * factor by h * factor pixels */
+void scale_pixels(const uint32_t *src, int src_pitch, int w, int h,
+                  uint32_t *dst, int dst_pitch, int factor);
+#endif
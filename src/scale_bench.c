@@ -0,0 +1,75 @@
+/*
+ * Headless scaling benchmark: how long it takes to scale a screen's worth
+ * of pixels up to a 4K display, at every factor up to the one that fills
+ * it, and checks the result against the plain one-pixel-at-a-time way.
+ *
+ * usage: scale_bench [width] [height] [repeats]
+*/
+#define _POSIX_C_SOURCE 200809L
+
+#include "scale.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+/* as the game's screen, see globals.c */
+#define SCREEN_WIDTH  640
+#define SCREEN_HEIGHT 475
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+int main(int argc, const char *argv[])
+{
+	int display_w = (argc > 1 ? atoi(argv[1]) : 3840);
+	int display_h = (argc > 2 ? atoi(argv[2]) : 2160);
+	int repeats   = (argc > 3 ? atoi(argv[3]) : 50);
+	
+	int w = SCREEN_WIDTH;
+	int h = SCREEN_HEIGHT;
+	
+	uint32_t *src = malloc(sizeof(uint32_t) * w * h);
+	uint32_t *dst = malloc(sizeof(uint32_t) * display_w * display_h);
+	
+	if (src == NULL || dst == NULL)
+	{
+		printf("Could not allocate the pixels.\n");
+		return 1;
+	}
+	
+	for (int i = 0; i < w * h; i++)
+		src[i] = (uint32_t) rand();
+	
+	bool ok = true;
+	
+	for (int factor = 1; factor <= SCALE_MAX && w * factor <= display_w && h * factor <= display_h; factor++)
+	{
+		int pitch = display_w * sizeof(uint32_t);
+		
+		double start = now_ms();
+		
+		for (int i = 0; i < repeats; i++)
+			scale_pixels(src, w * sizeof(uint32_t), w, h, dst, pitch, factor);
+		
+		double took = (now_ms() - start) / repeats;
+		
+		/* every pixel, from the source pixel it should have come from */
+		for (int y = 0; y < h * factor && ok; y++)
+			for (int x = 0; x < w * factor && ok; x++)
+				ok = (dst[y * display_w + x] == src[(y / factor) * w + x / factor]);
+		
+		printf("x%d (%4dx%4d): %.2f ms%s\n", factor, w * factor, h * factor, took, (ok ? "" : ", WRONG"));
+	}
+	
+	free(src);
+	free(dst);
+	
+	return (ok ? 0 : 1);
+}
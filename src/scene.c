@@ -0,0 +1,120 @@
+#include "scene.h"
+#include "present.h"
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static struct
+{
+	scene_T *scenes[SCENE_STACK_SIZE];
+	int depth;
+	
+	bool redraw;
+} stack;
+
+static void draw_frame(void);
+
+void scene_push(scene_T *scene)
+{
+	if (stack.depth == SCENE_STACK_SIZE)
+	{
+		printf("Too many scenes on the stack.\n");
+		exit(1);
+	}
+	
+	scene->wake = 0;
+	
+	stack.scenes[stack.depth++] = scene;
+	stack.redraw = true;
+}
+
+void scene_pop(void)
+{
+	if (stack.depth == 0)
+		return;
+	
+	scene_T *scene = stack.scenes[--stack.depth];
+	
+	if (scene->leave != NULL)
+		scene->leave(scene);
+	
+	stack.redraw = true;
+}
+
+void scene_quit(void)
+{
+	while (stack.depth > 0)
+		scene_pop();
+}
+
+void scene_redraw(void)
+{
+	stack.redraw = true;
+}
+
+void scene_run(void)
+{
+	SDL_Event event;
+	
+	while (stack.depth > 0)
+	{
+		/* whatever's on top by then gets each event, scenes can change in between */
+		while (stack.depth > 0 && SDL_PollEvent(&event))
+		{
+			scene_T *top = stack.scenes[stack.depth - 1];
+			
+			if (event.type == SDL_QUIT)
+				scene_quit();
+			else if (top->event != NULL)
+				top->event(top, &event);
+		}
+		
+		if (stack.depth == 0)
+			break;
+		
+		scene_T *top = stack.scenes[stack.depth - 1];
+		
+		if (top->update != NULL)
+			top->update(top, SDL_GetTicks());
+		
+		if (stack.depth == 0)
+			break;
+		
+		if (stack.redraw)
+			draw_frame();
+		
+		/* until the scene on top has something to do, but no longer than the poll interval */
+		top = stack.scenes[stack.depth - 1];
+		
+		clock_t now = SDL_GetTicks();
+		clock_t wait = SCENE_POLL_INTERVAL;
+		
+		if (top->wake != 0)
+			wait = (top->wake <= now ? 0 : top->wake - now);
+		
+		if (wait > 0)
+			SDL_Delay(wait < SCENE_POLL_INTERVAL ? wait : SCENE_POLL_INTERVAL);
+	}
+}
+
+/* every scene from the topmost opaque one up, in one frame */
+static void draw_frame(void)
+{
+	TRACE_SCOPE("draw_frame");
+	
+	int bottom = stack.depth - 1;
+	while (bottom > 0 && stack.scenes[bottom]->opaque == false)
+		bottom--;
+	
+	for (int i = bottom; i < stack.depth; i++)
+		if (stack.scenes[i]->draw != NULL)
+			stack.scenes[i]->draw(stack.scenes[i]);
+	
+	present_frame();
+	stack.redraw = false;
+	
+	for (int i = bottom; i < stack.depth; i++)
+		if (stack.scenes[i]->presented != NULL)
+			stack.scenes[i]->presented(stack.scenes[i]);
+}
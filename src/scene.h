@@ -0,0 +1,56 @@
+#ifndef SCENE_H
+#define SCENE_H
+
+#include <SDL/SDL.h>
+#include <stdbool.h>
+#include <time.h>
+
+/*
+ * The game's screens (the menu, a game, the highscores...) and what's
+ * drawn over them (paused, game over...) are scenes on a stack, all run by
+ * the one loop in `scene_run()`. Each pass it hands the events to the
+ * scene on top and lets that scene update, and if anything asked for a
+ * redraw, draws every scene from the topmost opaque one up and presents
+ * the frame.
+ *
+ * Scenes are long-lived: a screen keeps its scene and everything it's
+ * loaded between visits, so going from one screen to another is only a
+ * push or a pop. Only the scene on top is updated, so a game under the
+ * pause overlay stays frozen, but it's still drawn, from what it retains,
+ * for the overlay to go over.
+*/
+
+#define SCENE_STACK_SIZE 8
+
+/* how long the loop sleeps at most between passes, so events are seen promptly */
+#define SCENE_POLL_INTERVAL 5
+
+typedef struct scene_T scene_T;
+
+struct scene_T
+{
+	bool opaque; /* draws the whole screen, so nothing under it needs drawing */
+	
+	/* any of these can be NULL */
+	void (*event)(scene_T *, const SDL_Event *);
+	void (*update)(scene_T *, clock_t now);
+	void (*draw)(scene_T *);
+	void (*presented)(scene_T *); /* once the frame it drew is on the display */
+	void (*leave)(scene_T *);     /* popped off the stack */
+	
+	/* when `update` next has something to do (SDL_GetTicks() time), 0 if it's only events */
+	clock_t wake;
+};
+
+void scene_push(scene_T *);
+void scene_pop(void);
+
+/* pops everything, so `scene_run()` returns */
+void scene_quit(void);
+
+/* asks for a frame to be drawn at the end of this pass */
+void scene_redraw(void);
+
+/* runs the loop until the stack's empty, ending with scene_quit() on SDL_QUIT */
+void scene_run(void);
+#endif
@@ -1,6 +1,11 @@
 #include "sdlhelperfuncs.h"
+#include "assetcache.h"
+#include "globals.h"
+#include "scale.h"
+#include "trace.h"
 
 #include <SDL/SDL_image.h>
+#include <string.h>
 
 extern SDL_Surface *error_Texture;
 
@@ -16,6 +21,12 @@ void apply_surface(int x, int y, SDL_Surface* src, SDL_Surface* dst)
 
 SDL_Surface *load_image(char *filename)
 {
+	TRACE_SCOPE("load_image");
+	
+	SDL_Surface *cached_image = asset_cache_image(filename);
+	if (cached_image != NULL)
+		return cached_image;
+	
 	SDL_Surface *loaded_image = NULL;
 	
 	loaded_image = IMG_Load(filename);
@@ -27,6 +38,15 @@ SDL_Surface *load_image(char *filename)
 		
 		SDL_FreeSurface(loaded_image);
 		
+		/* scaled the once, so drawing it is only ever a blit */
+		if (optimized_image != NULL && screen_scale > 1)
+		{
+			SDL_Surface *scaled_image = scale_surface(optimized_image, screen_scale);
+			
+			SDL_FreeSurface(optimized_image);
+			optimized_image = scaled_image;
+		}
+		
 		return optimized_image;
 	}
 	
@@ -34,16 +54,58 @@ SDL_Surface *load_image(char *filename)
 	return error_Texture;
 }
 
-void apply_text_blended(int x, int y, char *s, TTF_Font *f, SDL_Color c, SDL_Surface *dst)
+SDL_Surface *scale_surface(SDL_Surface *src, int factor)
+{
+	TRACE_SCOPE("scale_surface");
+	
+	const SDL_PixelFormat *format = src->format;
+	
+	SDL_Surface *dst = SDL_CreateRGBSurface(SDL_SWSURFACE, src->w * factor, src->h * factor,
+		format->BitsPerPixel, format->Rmask, format->Gmask, format->Bmask, format->Amask);
+	
+	if (dst == NULL)
+		return NULL;
+	
+	SDL_LockSurface(src);
+	SDL_LockSurface(dst);
+	
+	int bytes = format->BytesPerPixel;
+	
+	if (bytes == 4)
+		scale_pixels(src->pixels, src->pitch, src->w, src->h, dst->pixels, dst->pitch, factor);
+	else
+	{
+		/* only for displays that aren't 32 bit, a pixel at a time */
+		for (int y = 0; y < dst->h; y++)
+		{
+			const Uint8 *from = (const Uint8 *) src->pixels + (y / factor) * src->pitch;
+			Uint8 *to = (Uint8 *) dst->pixels + y * dst->pitch;
+			
+			for (int x = 0; x < dst->w; x++)
+				memcpy(to + x * bytes, from + (x / factor) * bytes, bytes);
+		}
+	}
+	
+	SDL_UnlockSurface(dst);
+	SDL_UnlockSurface(src);
+	
+	return dst;
+}
+
+void apply_text_blended(int x, int y, char *s, font_T *f, SDL_Color c, SDL_Surface *dst)
 {
-	SDL_Surface *text = TTF_RenderText_Blended(f, s, c);
-	apply_surface(x, y, text, dst);
+	TRACE_SCOPE("apply_text_blended");
+	
+	SDL_Surface *text = render_text_blended(f, s, c);
+	apply_surface(x * screen_scale, y * screen_scale, text, dst);
 	SDL_FreeSurface(text);
 }
 
-void apply_text_shaded(int x, int y, char *s, TTF_Font *f, SDL_Color fg, SDL_Color bg, SDL_Surface *dst)
+void apply_text_shaded(int x, int y, char *s, font_T *f, SDL_Color fg, SDL_Color bg, SDL_Surface *dst)
 {
-	SDL_Surface *text = TTF_RenderText_Shaded(f, s, fg, bg);
-	apply_surface(x, y, text, dst);
+	TRACE_SCOPE("apply_text_shaded");
+	
+	SDL_Surface *text = render_text_shaded(f, s, fg, bg);
+	apply_surface(x * screen_scale, y * screen_scale, text, dst);
 	SDL_FreeSurface(text);
 }
@@ -1,18 +1,26 @@
 #ifndef SDLHELPERFUNCS_H
 #define SDLHELPERFUNCS_H
 
+#include "font.h"
+
 #include <SDL/SDL.h>
-#include <SDL/SDL_ttf.h>
 
+/* scaled up to the screen (see `screen_scale`) */
 SDL_Surface *load_image(char *);
 
+/* a new surface, `factor` times the size of `src` in the same format */
+SDL_Surface *scale_surface(SDL_Surface *src, int factor);
+
+/* at (x, y) in pixels */
 void apply_surface(int x, int y, SDL_Surface *src, SDL_Surface *dst);
 
 /*
+ * At (x, y) in unscaled units (see `screen_scale`).
+ *
  * Not suitable to be called repeatedly -- has to render the string on each
- * call. If drawing text in a loop, pre-render the text with `TTF_RenderFont()`
- * and use `apply_surface()` on it.
+ * call. If drawing text in a loop, pre-render the text with
+ * `render_text_blended()` and use `apply_surface()` on it.
  */
-void apply_text_blended(int x, int y, char *s, TTF_Font *f, SDL_Color c, SDL_Surface *dst);
-void apply_text_shaded (int x, int y, char *s, TTF_Font *f, SDL_Color fg, SDL_Color bg, SDL_Surface *dst);
+void apply_text_blended(int x, int y, char *s, font_T *f, SDL_Color c, SDL_Surface *dst);
+void apply_text_shaded (int x, int y, char *s, font_T *f, SDL_Color fg, SDL_Color bg, SDL_Surface *dst);
 #endif
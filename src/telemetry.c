@@ -0,0 +1,321 @@
+#define _DEFAULT_SOURCE
+
+#include "telemetry.h"
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+static void *run_writer(void *);
+static void write_out(telemetry_T *);
+static void wake_writer(telemetry_T *);
+
+static void put_le(uint8_t *buf, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+		buf[i] = (uint8_t) (value >> (8 * i));
+}
+
+static uint32_t get_le(const uint8_t *buf)
+{
+	return buf[0] | (uint32_t) buf[1] << 8 | (uint32_t) buf[2] << 16 | (uint32_t) buf[3] << 24;
+}
+
+/* all or nothing, going round again if interrupted */
+static bool write_all(int fd, const uint8_t *buf, size_t len)
+{
+	while (len > 0)
+	{
+		ssize_t n = write(fd, buf, len);
+		
+		if (n <= 0)
+			return false;
+		
+		buf += n;
+		len -= n;
+	}
+	
+	return true;
+}
+
+void telemetry_encode(const telemetry_record_T *record, uint8_t *buf)
+{
+	buf[0] = record->kind;
+	buf[1] = record->speed_human;
+	buf[2] = record->detail;
+	buf[3] = record->flags;
+	
+	put_le(buf + 4,  record->game);
+	put_le(buf + 8,  record->tick);
+	put_le(buf + 12, record->cell);
+	
+	for (int i = 0; i < 4; i++)
+		put_le(buf + 16 + 4 * i, (uint32_t) record->value[i]);
+}
+
+void telemetry_decode(const uint8_t *buf, telemetry_record_T *record)
+{
+	record->kind        = buf[0];
+	record->speed_human = buf[1];
+	record->detail      = buf[2];
+	record->flags       = buf[3];
+	
+	record->game = get_le(buf + 4);
+	record->tick = get_le(buf + 8);
+	record->cell = get_le(buf + 12);
+	
+	for (int i = 0; i < 4; i++)
+		record->value[i] = (int32_t) get_le(buf + 16 + 4 * i);
+}
+
+int64_t telemetry_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+/*
+ * A new file starts with the header record. A file left with part of a
+ * record at the end (a crash mid-write) is padded out with a record of an
+ * unknown kind, which readers skip, so everything after it lines up again.
+*/
+static bool start_file(int fd)
+{
+	struct stat st;
+	
+	if (fstat(fd, &st) != 0)
+		return false;
+	
+	uint8_t buf[TELEMETRY_RECORD_SIZE];
+	
+	if (st.st_size == 0)
+	{
+		telemetry_record_T header = { .kind = TELEMETRY_HEADER, .value = { TELEMETRY_VERSION } };
+		
+		telemetry_encode(&header, buf);
+		memcpy(buf + 4, TELEMETRY_MAGIC, 4);
+		
+		return write_all(fd, buf, sizeof(buf));
+	}
+	
+	size_t partial = st.st_size % TELEMETRY_RECORD_SIZE;
+	
+	if (partial == 0)
+		return true;
+	
+	memset(buf, 0xFF, sizeof(buf));
+	return write_all(fd, buf, TELEMETRY_RECORD_SIZE - partial);
+}
+
+bool telemetry_open(telemetry_T *telemetry, const char *path)
+{
+	memset(telemetry, 0, sizeof(telemetry_T));
+	
+	telemetry->fd = open(path, O_WRONLY | O_APPEND | O_CREAT, 0644);
+	
+	if (telemetry->fd < 0)
+		return false;
+	
+	telemetry->ring = malloc((size_t) TELEMETRY_RING * TELEMETRY_RECORD_SIZE);
+	
+	/* the lock keeps two games from writing the header at once */
+	flock(telemetry->fd, LOCK_EX);
+	bool started = start_file(telemetry->fd);
+	flock(telemetry->fd, LOCK_UN);
+	
+	if (telemetry->ring == NULL || started == false)
+	{
+		close(telemetry->fd);
+		free(telemetry->ring);
+		
+		telemetry->fd = -1;
+		telemetry->ring = NULL;
+		
+		return false;
+	}
+	
+	pthread_mutex_init(&telemetry->lock, NULL);
+	pthread_cond_init(&telemetry->wake, NULL);
+	
+	/* without a thread, batches are written by whoever fills them */
+	telemetry->threaded = (pthread_create(&telemetry->thread, NULL, run_writer, telemetry) == 0);
+	
+	return true;
+}
+
+void telemetry_close(telemetry_T *telemetry)
+{
+	if (telemetry->ring == NULL)
+		return;
+	
+	if (telemetry->threaded)
+	{
+		pthread_mutex_lock(&telemetry->lock);
+		telemetry->stopping = true;
+		pthread_cond_signal(&telemetry->wake);
+		pthread_mutex_unlock(&telemetry->lock);
+		
+		pthread_join(telemetry->thread, NULL);
+	}
+	
+	write_out(telemetry);
+	
+	close(telemetry->fd);
+	free(telemetry->ring);
+	
+	pthread_mutex_destroy(&telemetry->lock);
+	pthread_cond_destroy(&telemetry->wake);
+	
+	memset(telemetry, 0, sizeof(telemetry_T));
+	telemetry->fd = -1;
+}
+
+void telemetry_log(telemetry_T *telemetry, const telemetry_record_T *record)
+{
+	if (telemetry->ring == NULL)
+		return;
+	
+	uint64_t head = telemetry->head;
+	
+	if (head - __atomic_load_n(&telemetry->tail, __ATOMIC_ACQUIRE) >= TELEMETRY_RING)
+	{
+		telemetry->dropped++;
+		return;
+	}
+	
+	telemetry_encode(record, telemetry->ring + (head % TELEMETRY_RING) * TELEMETRY_RECORD_SIZE);
+	__atomic_store_n(&telemetry->head, head + 1, __ATOMIC_RELEASE);
+	
+	if (head + 1 - telemetry->woken_at >= TELEMETRY_BATCH)
+		wake_writer(telemetry);
+}
+
+void telemetry_flush(telemetry_T *telemetry)
+{
+	if (telemetry->ring != NULL && telemetry->head != telemetry->woken_at)
+		wake_writer(telemetry);
+}
+
+static void wake_writer(telemetry_T *telemetry)
+{
+	telemetry->woken_at = telemetry->head;
+	
+	if (telemetry->threaded == false)
+	{
+		write_out(telemetry);
+		return;
+	}
+	
+	pthread_mutex_lock(&telemetry->lock);
+	telemetry->woken = true;
+	pthread_cond_signal(&telemetry->wake);
+	pthread_mutex_unlock(&telemetry->lock);
+}
+
+static void *run_writer(void *arg)
+{
+	telemetry_T *telemetry = arg;
+	
+	pthread_mutex_lock(&telemetry->lock);
+	
+	while (1)
+	{
+		while (telemetry->woken == false && telemetry->stopping == false)
+			pthread_cond_wait(&telemetry->wake, &telemetry->lock);
+		
+		bool stopping = telemetry->stopping;
+		telemetry->woken = false;
+		
+		pthread_mutex_unlock(&telemetry->lock);
+		write_out(telemetry);
+		
+		if (stopping)
+			return NULL;
+		
+		pthread_mutex_lock(&telemetry->lock);
+	}
+}
+
+/*
+ * Writes everything logged so far, in at most two writes as the records
+ * may wrap round the end of the ring. Records that can't be written are
+ * lost, the game carries on regardless.
+*/
+static void write_out(telemetry_T *telemetry)
+{
+	uint64_t head = __atomic_load_n(&telemetry->head, __ATOMIC_ACQUIRE);
+	uint64_t tail = telemetry->tail;
+	
+	while (tail < head)
+	{
+		uint64_t start = tail % TELEMETRY_RING;
+		uint64_t n = head - tail;
+		
+		if (n > TELEMETRY_RING - start)
+			n = TELEMETRY_RING - start;
+		
+		write_all(telemetry->fd, telemetry->ring + start * TELEMETRY_RECORD_SIZE, n * TELEMETRY_RECORD_SIZE);
+		
+		tail += n;
+		__atomic_store_n(&telemetry->tail, tail, __ATOMIC_RELEASE);
+	}
+}
+
+void telemetry_tick_time(telemetry_T *telemetry, const telemetry_record_T *record, int64_t ns)
+{
+	int64_t us = ns / 1000;
+	
+	/* bucket b holds [2^(b - 1), 2^b) us, 0 holds 0 */
+	int bucket = (us > 0 ? 64 - __builtin_clzll((uint64_t) us) : 0);
+	
+	telemetry->histogram[bucket < 31 ? bucket : 31]++;
+	telemetry->window_ticks++;
+	telemetry->window_total += us;
+	
+	if (us > telemetry->window_worst)
+		telemetry->window_worst = us;
+	
+	if (telemetry->window_ticks == TELEMETRY_LATENCY_TICKS)
+		telemetry_end_window(telemetry, record);
+}
+
+void telemetry_end_window(telemetry_T *telemetry, const telemetry_record_T *record)
+{
+	if (telemetry->window_ticks == 0)
+		return;
+	
+	/* the 99th percentile, to the top of its bucket */
+	uint32_t wanted = telemetry->window_ticks - telemetry->window_ticks / 100;
+	uint32_t seen = 0;
+	int bucket = 0;
+	
+	while (bucket < 31 && (seen += telemetry->histogram[bucket]) < wanted)
+		bucket++;
+	
+	int64_t p99 = (bucket > 0 ? ((int64_t) 1 << bucket) - 1 : 0);
+	
+	if (p99 > telemetry->window_worst)
+		p99 = telemetry->window_worst;
+	
+	telemetry_record_T summary = *record;
+	
+	summary.kind = TELEMETRY_LATENCY;
+	summary.detail = 0;
+	summary.value[0] = telemetry->window_ticks;
+	summary.value[1] = (int32_t) (telemetry->window_total / telemetry->window_ticks);
+	summary.value[2] = (int32_t) p99;
+	summary.value[3] = (int32_t) telemetry->window_worst;
+	
+	telemetry_log(telemetry, &summary);
+	
+	telemetry->window_ticks = 0;
+	telemetry->window_total = 0;
+	telemetry->window_worst = 0;
+	memset(telemetry->histogram, 0, sizeof(telemetry->histogram));
+}
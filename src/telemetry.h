@@ -0,0 +1,125 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Append-only log of what happens in games: when they start and end, every
+ * apple and powerup a player eats, how and where they die, and how long the
+ * ticks took. telemetry_report reads it back.
+ *
+ * Every record is TELEMETRY_RECORD_SIZE bytes, so a log is an array of them
+ * that can be mapped and walked without parsing, and several games can
+ * append to the same file: every write is of whole records, and O_APPEND
+ * keeps writes from overlapping. The first record of a file says what it
+ * is.
+ *
+ * Logging a record only copies it into a ring. A thread of its own writes
+ * the ring out in batches of TELEMETRY_BATCH records, so the game never
+ * waits on the disk; if the ring fills up anyway, records are dropped
+ * rather than waited for.
+*/
+
+#define TELEMETRY_MAGIC   "SNKT"
+#define TELEMETRY_VERSION 1
+
+#define TELEMETRY_RECORD_SIZE 32
+
+#define TELEMETRY_RING  16384 /* records */
+#define TELEMETRY_BATCH 1024
+
+/* ticks per latency summary */
+#define TELEMETRY_LATENCY_TICKS 256
+
+typedef enum
+{
+	TELEMETRY_HEADER,     /* game = TELEMETRY_MAGIC, value = { version } */
+	TELEMETRY_GAME_START, /* value = { number of snakes, start time (s since the epoch) } */
+	TELEMETRY_APPLE,      /* cell eaten, value = { score, length } */
+	TELEMETRY_POWERUP,    /* cell eaten, detail = powerup_outcome_T, value = { score } */
+	TELEMETRY_DEATH,      /* cell moved into, detail = death_cause_T, value = { score, cols, rows } */
+	TELEMETRY_LATENCY,    /* value = { ticks, mean, 99th percentile, worst } (us) */
+	TELEMETRY_GAME_END,   /* detail = quit before dying, value = { score, duration (ms) } */
+	TELEMETRY_NUM_KINDS
+} telemetry_kind_T;
+
+/* `flags` bits */
+#define TELEMETRY_AUTOPILOT 1 /* the autopilot played some of the game */
+#define TELEMETRY_ARENA     2 /* there were bots on the board */
+#define TELEMETRY_PRACTICE  4 /* the player could rewind */
+
+typedef struct
+{
+	uint8_t kind;
+	uint8_t speed_human;
+	uint8_t detail;
+	uint8_t flags;
+	
+	uint32_t game; /* the game's seed */
+	uint32_t tick;
+	uint32_t cell;
+	
+	int32_t value[4];
+} telemetry_record_T;
+
+typedef struct
+{
+	int fd;
+	
+	/*
+	 * Encoded records. `head` is only written by the game and `tail` only
+	 * by the writer; both count records ever logged, so `head - tail` is
+	 * how many are waiting.
+	*/
+	uint8_t *ring;
+	uint64_t head;
+	uint64_t tail;
+	uint64_t woken_at; /* `head` when the writer was last woken */
+	uint64_t dropped;
+	
+	bool threaded; /* else records are written when a batch is ready */
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t wake;
+	bool woken;
+	bool stopping;
+	
+	/* the latency summary being put together, log2 buckets of us */
+	uint32_t window_ticks;
+	int64_t window_total;
+	int64_t window_worst;
+	uint32_t histogram[32];
+} telemetry_T;
+
+/*
+ * Opens (or creates) the log for appending and starts the writer. Returns
+ * false if the file can't be opened, in which case nothing is logged.
+*/
+bool telemetry_open(telemetry_T *, const char *path);
+
+/* writes out everything logged so far */
+void telemetry_close(telemetry_T *);
+
+void telemetry_log(telemetry_T *, const telemetry_record_T *);
+
+/* asks for everything logged so far to be written, without waiting for it */
+void telemetry_flush(telemetry_T *);
+
+/*
+ * Adds how long a tick took (ns) to the latency summary, and logs the
+ * summary every TELEMETRY_LATENCY_TICKS ticks. `record` gives the game's
+ * details to log it with.
+*/
+void telemetry_tick_time(telemetry_T *, const telemetry_record_T *record, int64_t ns);
+
+/* logs the summary of the ticks since the last one, if there were any */
+void telemetry_end_window(telemetry_T *, const telemetry_record_T *record);
+
+/* CLOCK_MONOTONIC, ns */
+int64_t telemetry_now(void);
+
+void telemetry_encode(const telemetry_record_T *, uint8_t *buf);
+void telemetry_decode(const uint8_t *buf, telemetry_record_T *);
+#endif
@@ -0,0 +1,479 @@
+/*
+ * Reads telemetry logs (see telemetry.h) and reports where players die,
+ * how long games last and what they score at each speed, which powerups
+ * get eaten, and how long ticks take.
+ *
+ * The logs are mapped, not read, and split into chunks of records that a
+ * pool of threads goes through, each adding up its own totals, which are
+ * only put together at the end. Games the autopilot played any of, and
+ * practice games, are counted, but left out of everything else.
+ *
+ * usage: telemetry_report <log> [more logs...]
+*/
+#define _DEFAULT_SOURCE
+
+#include "board.h"
+#include "telemetry.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define NUM_SPEEDS 5
+#define NUM_CAUSES (DEATH_ROCK + 1)
+#define NUM_OUTCOMES (OUTCOME_MYSTERY_REVERSAL + 1)
+
+/* board sizes with a heatmap of their own, deaths on any others are only counted */
+#define MAX_HEATMAPS 4
+#define MAX_HEATMAP_CELLS (1 << 20)
+
+/* records per unit of work */
+#define CHUNK_RECORDS (1 << 18)
+
+typedef struct
+{
+	const uint8_t *data;
+	size_t num_records;
+} chunk_T;
+
+typedef struct
+{
+	uint64_t games;
+	uint64_t quit;
+	uint64_t ticks;
+	int64_t score_total;
+	int best;
+	uint64_t duration_ms;
+	
+	uint64_t latency_ticks;
+	uint64_t latency_total; /* us, over every tick */
+	int32_t worst_p99;
+	int32_t worst;
+} speed_stats_T;
+
+typedef struct
+{
+	int cols;
+	int rows;
+	uint64_t *deaths; /* per cell */
+} heatmap_T;
+
+typedef struct
+{
+	uint64_t records;
+	uint64_t skipped;
+	
+	/* [arena][speed_human] */
+	speed_stats_T speed[2][NUM_SPEEDS];
+	
+	uint64_t excluded_games; /* autopilot and practice */
+	uint64_t apples;
+	uint64_t deaths[NUM_CAUSES];
+	uint64_t powerups[NUM_OUTCOMES];
+	
+	int num_heatmaps;
+	heatmap_T heatmap[MAX_HEATMAPS];
+	uint64_t deaths_elsewhere;
+} stats_T;
+
+typedef struct
+{
+	chunk_T *chunks;
+	int num_chunks;
+	int next; /* shared work counter */
+} job_T;
+
+typedef struct
+{
+	job_T *job;
+	pthread_t thread;
+	stats_T stats;
+} worker_T;
+
+static const char *cause_names[NUM_CAUSES] = { "unknown", "itself", "another snake", "head on", "a rock" };
+static const char *outcome_names[NUM_OUTCOMES] = { "banana", "grape", "mystery (bonus)", "mystery (reversal)" };
+
+static void add_record(stats_T *, const telemetry_record_T *);
+
+static void *worker(void *arg)
+{
+	worker_T *self = arg;
+	job_T *job = self->job;
+	
+	while (1)
+	{
+		int i = __sync_fetch_and_add(&job->next, 1);
+		if (i >= job->num_chunks)
+			break;
+		
+		const chunk_T *chunk = &job->chunks[i];
+		
+		for (size_t j = 0; j < chunk->num_records; j++)
+		{
+			telemetry_record_T record;
+			telemetry_decode(chunk->data + j * TELEMETRY_RECORD_SIZE, &record);
+			
+			add_record(&self->stats, &record);
+		}
+	}
+	
+	return NULL;
+}
+
+static heatmap_T *find_heatmap(stats_T *stats, int cols, int rows)
+{
+	for (int i = 0; i < stats->num_heatmaps; i++)
+		if (stats->heatmap[i].cols == cols && stats->heatmap[i].rows == rows)
+			return &stats->heatmap[i];
+	
+	if (stats->num_heatmaps == MAX_HEATMAPS || cols <= 0 || rows <= 0 ||
+	    (int64_t) cols * rows > MAX_HEATMAP_CELLS)
+		return NULL;
+	
+	uint64_t *deaths = calloc((size_t) cols * rows, sizeof(uint64_t));
+	if (deaths == NULL)
+		return NULL;
+	
+	heatmap_T *heatmap = &stats->heatmap[stats->num_heatmaps++];
+	heatmap->cols = cols;
+	heatmap->rows = rows;
+	heatmap->deaths = deaths;
+	
+	return heatmap;
+}
+
+static void add_record(stats_T *stats, const telemetry_record_T *record)
+{
+	stats->records++;
+	
+	if (record->kind == TELEMETRY_HEADER || record->kind >= TELEMETRY_NUM_KINDS ||
+	    record->speed_human >= NUM_SPEEDS)
+	{
+		stats->skipped++;
+		return;
+	}
+	
+	if (record->flags & (TELEMETRY_AUTOPILOT | TELEMETRY_PRACTICE))
+	{
+		stats->excluded_games += (record->kind == TELEMETRY_GAME_END);
+		return;
+	}
+	
+	speed_stats_T *speed = &stats->speed[(record->flags & TELEMETRY_ARENA) != 0][record->speed_human];
+	
+	switch (record->kind)
+	{
+		case TELEMETRY_APPLE: stats->apples++; break;
+		
+		case TELEMETRY_POWERUP:
+			if (record->detail < NUM_OUTCOMES)
+				stats->powerups[record->detail]++;
+			break;
+		
+		case TELEMETRY_DEATH:
+		{
+			stats->deaths[record->detail < NUM_CAUSES ? record->detail : DEATH_NONE]++;
+			
+			heatmap_T *heatmap = find_heatmap(stats, record->value[1], record->value[2]);
+			
+			if (heatmap != NULL && record->cell < (uint32_t) heatmap->cols * heatmap->rows)
+				heatmap->deaths[record->cell]++;
+			else
+				stats->deaths_elsewhere++;
+			
+			break;
+		}
+		
+		case TELEMETRY_LATENCY:
+		{
+			speed->latency_ticks += record->value[0];
+			speed->latency_total += (uint64_t) record->value[0] * record->value[1];
+			
+			if (record->value[2] > speed->worst_p99)
+				speed->worst_p99 = record->value[2];
+			if (record->value[3] > speed->worst)
+				speed->worst = record->value[3];
+			
+			break;
+		}
+		
+		case TELEMETRY_GAME_END:
+		{
+			speed->games++;
+			speed->quit += record->detail;
+			speed->ticks += record->tick;
+			speed->score_total += record->value[0];
+			speed->duration_ms += (uint32_t) record->value[1];
+			
+			if (record->value[0] > speed->best)
+				speed->best = record->value[0];
+			
+			break;
+		}
+		
+		default: break;
+	}
+}
+
+static void merge(stats_T *into, const stats_T *from)
+{
+	into->records += from->records;
+	into->skipped += from->skipped;
+	into->excluded_games += from->excluded_games;
+	into->apples += from->apples;
+	into->deaths_elsewhere += from->deaths_elsewhere;
+	
+	for (int i = 0; i < NUM_CAUSES; i++)
+		into->deaths[i] += from->deaths[i];
+	
+	for (int i = 0; i < NUM_OUTCOMES; i++)
+		into->powerups[i] += from->powerups[i];
+	
+	for (int arena = 0; arena < 2; arena++)
+	{
+		for (int i = 0; i < NUM_SPEEDS; i++)
+		{
+			speed_stats_T *a = &into->speed[arena][i];
+			const speed_stats_T *b = &from->speed[arena][i];
+			
+			a->games         += b->games;
+			a->quit          += b->quit;
+			a->ticks         += b->ticks;
+			a->score_total   += b->score_total;
+			a->duration_ms   += b->duration_ms;
+			a->latency_ticks += b->latency_ticks;
+			a->latency_total += b->latency_total;
+			
+			if (b->best > a->best)
+				a->best = b->best;
+			if (b->worst_p99 > a->worst_p99)
+				a->worst_p99 = b->worst_p99;
+			if (b->worst > a->worst)
+				a->worst = b->worst;
+		}
+	}
+	
+	for (int i = 0; i < from->num_heatmaps; i++)
+	{
+		const heatmap_T *b = &from->heatmap[i];
+		heatmap_T *a = find_heatmap(into, b->cols, b->rows);
+		
+		size_t num_cells = (size_t) b->cols * b->rows;
+		
+		for (size_t cell = 0; cell < num_cells; cell++)
+		{
+			if (a != NULL)
+				a->deaths[cell] += b->deaths[cell];
+			else
+				into->deaths_elsewhere += b->deaths[cell];
+		}
+	}
+}
+
+static void print_speeds(const stats_T *stats, int arena)
+{
+	printf("\n%s games by speed:\n", (arena ? "arena" : "single-player"));
+	printf("  speed     games   quit   mean ticks  mean score   best  mean length  mean tick  worst 99%%  worst tick\n");
+	
+	for (int i = 0; i < NUM_SPEEDS; i++)
+	{
+		const speed_stats_T *speed = &stats->speed[arena][i];
+		
+		if (speed->games == 0 && speed->latency_ticks == 0)
+			continue;
+		
+		double games = (speed->games > 0 ? speed->games : 1);
+		double ticks = (speed->latency_ticks > 0 ? speed->latency_ticks : 1);
+		
+		printf("  %5d %9llu %5.1f%% %12.1f %11.1f %6d %10.1fs %8.0fus %8dus %9dus\n",
+			i + 1, (unsigned long long) speed->games, 100.0 * speed->quit / games,
+			speed->ticks / games, speed->score_total / games, speed->best,
+			speed->duration_ms / games / 1e3,
+			speed->latency_total / ticks, speed->worst_p99, speed->worst);
+	}
+}
+
+/* one character per cell, darker for more deaths */
+static void print_heatmap(const heatmap_T *heatmap)
+{
+	static const char shades[] = " .:-=+*#%@";
+	
+	uint64_t total = 0;
+	uint64_t most = 0;
+	uint32_t worst_cell = 0;
+	
+	for (uint32_t cell = 0; cell < (uint32_t) heatmap->cols * heatmap->rows; cell++)
+	{
+		total += heatmap->deaths[cell];
+		
+		if (heatmap->deaths[cell] > most)
+		{
+			most = heatmap->deaths[cell];
+			worst_cell = cell;
+		}
+	}
+	
+	printf("\ndeaths on the %dx%d board (%llu, at most %llu in a cell, at %d, %d):\n",
+		heatmap->cols, heatmap->rows, (unsigned long long) total, (unsigned long long) most,
+		worst_cell % heatmap->cols, worst_cell / heatmap->cols);
+	
+	for (int y = 0; y < heatmap->rows; y++)
+	{
+		putchar('|');
+		
+		for (int x = 0; x < heatmap->cols; x++)
+		{
+			uint64_t deaths = heatmap->deaths[y * heatmap->cols + x];
+			putchar(deaths == 0 ? shades[0] : shades[1 + (deaths - 1) * 9 / most]);
+		}
+		
+		printf("|\n");
+	}
+}
+
+/* maps the log and checks it's one; returns the number of records, or -1 */
+static ssize_t map_log(const char *path, const uint8_t **data)
+{
+	int fd = open(path, O_RDONLY);
+	if (fd < 0)
+		return -1;
+	
+	struct stat st;
+	if (fstat(fd, &st) != 0 || st.st_size < TELEMETRY_RECORD_SIZE)
+	{
+		close(fd);
+		return -1;
+	}
+	
+	void *map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+	
+	if (map == MAP_FAILED)
+		return -1;
+	
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	
+	telemetry_record_T header;
+	telemetry_decode(map, &header);
+	
+	if (header.kind != TELEMETRY_HEADER || memcmp((const uint8_t *) map + 4, TELEMETRY_MAGIC, 4) != 0 ||
+	    header.value[0] != TELEMETRY_VERSION)
+	{
+		munmap(map, st.st_size);
+		return -1;
+	}
+	
+	*data = map;
+	return st.st_size / TELEMETRY_RECORD_SIZE;
+}
+
+int main(int argc, const char *argv[])
+{
+	if (argc < 2)
+	{
+		printf("usage: %s <log> [more logs...]\n", argv[0]);
+		return 2;
+	}
+	
+	job_T job = { NULL, 0, 0 };
+	int capacity = 0;
+	
+	for (int i = 1; i < argc; i++)
+	{
+		const uint8_t *data;
+		ssize_t num_records = map_log(argv[i], &data);
+		
+		if (num_records < 0)
+		{
+			printf("%s isn't a readable telemetry log\n", argv[i]);
+			continue;
+		}
+		
+		/* the header is the first record, skipped here */
+		for (ssize_t start = 1; start < num_records; start += CHUNK_RECORDS)
+		{
+			if (job.num_chunks == capacity)
+			{
+				capacity = (capacity == 0 ? 256 : capacity * 2);
+				job.chunks = realloc(job.chunks, capacity * sizeof(chunk_T));
+			}
+			
+			chunk_T *chunk = &job.chunks[job.num_chunks++];
+			chunk->data = data + start * TELEMETRY_RECORD_SIZE;
+			chunk->num_records = (num_records - start < CHUNK_RECORDS ? num_records - start : CHUNK_RECORDS);
+		}
+	}
+	
+	struct timespec start, end;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	
+	int num_workers = (int) sysconf(_SC_NPROCESSORS_ONLN);
+	if (num_workers < 1)
+		num_workers = 1;
+	
+	worker_T *workers = calloc(num_workers, sizeof(worker_T));
+	
+	for (int i = 0; i < num_workers; i++)
+	{
+		workers[i].job = &job;
+		pthread_create(&workers[i].thread, NULL, worker, &workers[i]);
+	}
+	
+	stats_T stats;
+	memset(&stats, 0, sizeof(stats_T));
+	
+	for (int i = 0; i < num_workers; i++)
+	{
+		pthread_join(workers[i].thread, NULL);
+		merge(&stats, &workers[i].stats);
+	}
+	
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	
+	uint64_t games = 0;
+	for (int arena = 0; arena < 2; arena++)
+		for (int i = 0; i < NUM_SPEEDS; i++)
+			games += stats.speed[arena][i].games;
+	
+	double elapsed = (end.tv_sec - start.tv_sec) + (end.tv_nsec - start.tv_nsec) / 1e9;
+	
+	printf("%llu records, %llu games (and %llu with the autopilot or in practice), %llu records skipped\n",
+		(unsigned long long) stats.records, (unsigned long long) games,
+		(unsigned long long) stats.excluded_games, (unsigned long long) stats.skipped);
+	
+	print_speeds(&stats, 0);
+	print_speeds(&stats, 1);
+	
+	uint64_t deaths = 0;
+	for (int i = 0; i < NUM_CAUSES; i++)
+		deaths += stats.deaths[i];
+	
+	printf("\n%llu apples eaten, %.1f a game\n", (unsigned long long) stats.apples,
+		(double) stats.apples / (games > 0 ? games : 1));
+	
+	printf("\npowerups eaten:\n");
+	for (int i = 0; i < NUM_OUTCOMES; i++)
+		printf("  %-20s %llu\n", outcome_names[i], (unsigned long long) stats.powerups[i]);
+	
+	printf("\n%llu deaths, running into:\n", (unsigned long long) deaths);
+	for (int i = 0; i < NUM_CAUSES; i++)
+		if (stats.deaths[i] > 0)
+			printf("  %-20s %5.1f%%\n", cause_names[i], 100.0 * stats.deaths[i] / deaths);
+	
+	for (int i = 0; i < stats.num_heatmaps; i++)
+		print_heatmap(&stats.heatmap[i]);
+	
+	if (stats.deaths_elsewhere > 0)
+		printf("\n%llu deaths on other boards\n", (unsigned long long) stats.deaths_elsewhere);
+	
+	fprintf(stderr, "%.3fs with %d workers (%.0f records/s)\n",
+		elapsed, num_workers, stats.records / (elapsed > 0 ? elapsed : 1));
+	
+	return 0;
+}
@@ -0,0 +1,181 @@
+#ifdef TRACE
+#define _POSIX_C_SOURCE 200809L
+
+#include "trace.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define TRACE_FILE "trace.json"
+
+/* events per thread between flushes; must be a power of two */
+#define TRACE_RING_SIZE 65536
+
+typedef struct
+{
+	const char *name;
+	int64_t start;
+	int64_t duration;
+} trace_event_T;
+
+/*
+ * Single producer (the owning thread), single consumer (whoever flushes).
+ * `head` is only written by the producer and `tail` only by the consumer.
+ * A full ring drops new events rather than overwrite unflushed ones.
+*/
+typedef struct trace_ring
+{
+	trace_event_T events[TRACE_RING_SIZE];
+	
+	uint32_t head;
+	uint32_t tail;
+	uint32_t dropped;
+	
+	int tid;
+	struct trace_ring *next;
+} trace_ring_T;
+
+bool trace_enabled = false;
+
+static __thread trace_ring_T *thread_ring = NULL;
+
+/* every thread's ring, pushed on with a compare-and-swap */
+static trace_ring_T *rings = NULL;
+static int next_tid = 1;
+
+static FILE *trace_file = NULL;
+static int64_t epoch = 0;
+
+int64_t trace_now(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	
+	/* never 0, as that marks a span started while tracing was off */
+	return (int64_t) ts.tv_sec * 1000000000 + ts.tv_nsec + 1;
+}
+
+static trace_ring_T *register_thread(void)
+{
+	trace_ring_T *ring = calloc(1, sizeof(trace_ring_T));
+	if (ring == NULL)
+		return NULL;
+	
+	ring->tid = __atomic_fetch_add(&next_tid, 1, __ATOMIC_RELAXED);
+	
+	ring->next = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+	while (__atomic_compare_exchange_n(&rings, &ring->next, ring, false,
+	                                   __ATOMIC_RELEASE, __ATOMIC_ACQUIRE) == false)
+		;
+	
+	return thread_ring = ring;
+}
+
+void trace_record(const char *name, int64_t start)
+{
+	int64_t end = trace_now();
+	
+	trace_ring_T *ring = thread_ring;
+	if (ring == NULL && (ring = register_thread()) == NULL)
+		return;
+	
+	uint32_t head = ring->head;
+	uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	
+	if (head - tail == TRACE_RING_SIZE)
+	{
+		ring->dropped++;
+		return;
+	}
+	
+	trace_event_T *event = &ring->events[head & (TRACE_RING_SIZE - 1)];
+	
+	event->name = name;
+	event->start = start;
+	event->duration = end - start;
+	
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+}
+
+void trace_init(void)
+{
+	if (getenv("SNAKE_TRACE") != NULL)
+		trace_start();
+}
+
+void trace_start(void)
+{
+	if (trace_enabled)
+		return;
+	
+	if (trace_file == NULL)
+	{
+		trace_file = fopen(TRACE_FILE, "w");
+		if (trace_file == NULL)
+		{
+			printf("Couldn't create %s\n", TRACE_FILE);
+			return;
+		}
+		
+		/*
+		 * The JSON array form of the trace format; viewers accept it
+		 * without the closing bracket, so it can be appended to.
+		*/
+		fprintf(trace_file, "[\n");
+		epoch = trace_now();
+	}
+	
+	/* set up this thread's ring now rather than inside the first span */
+	if (thread_ring == NULL)
+		register_thread();
+	
+	trace_enabled = true;
+}
+
+void trace_flush(void)
+{
+	if (trace_file == NULL)
+		return;
+	
+	TRACE_SCOPE("trace_flush");
+	
+	for (trace_ring_T *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next)
+	{
+		uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+		
+		for (uint32_t i = ring->tail; i != head; i++)
+		{
+			trace_event_T *event = &ring->events[i & (TRACE_RING_SIZE - 1)];
+			
+			fprintf(trace_file,
+				"{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":1,\"tid\":%d},\n",
+				event->name, (event->start - epoch) / 1e3, event->duration / 1e3, ring->tid);
+		}
+		
+		__atomic_store_n(&ring->tail, head, __ATOMIC_RELEASE);
+		
+		if (ring->dropped != 0)
+		{
+			printf("trace: thread %d dropped %u events, flush more often\n", ring->tid, ring->dropped);
+			ring->dropped = 0;
+		}
+	}
+	
+	fflush(trace_file);
+}
+
+void trace_hotkey(void)
+{
+	if (trace_enabled)
+	{
+		trace_flush();
+		printf("trace: flushed to %s\n", TRACE_FILE);
+	}
+	else
+	{
+		trace_start();
+		printf("trace: recording, F12 again to flush\n");
+	}
+}
+#endif
@@ -0,0 +1,66 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+/*
+ * Timing spans, written out as a Chrome trace (load trace.json in
+ * chrome://tracing or ui.perfetto.dev).
+ *
+ *     TRACE_SCOPE("draw_game");
+ *
+ * records a span from that line to the end of the enclosing block. Each
+ * thread buffers its spans in its own ring, so recording never takes a
+ * lock; the rings are drained to the file by `trace_flush()`.
+ *
+ * Tracing is only compiled in when building with TRACE defined (`make
+ * TRACE=1`). Even then it is off until switched on with `trace_start()`,
+ * the SNAKE_TRACE environment variable or F12, and while off a span costs
+ * one well-predicted branch on entry and exit.
+*/
+
+#ifdef TRACE
+#include <stdbool.h>
+#include <stdint.h>
+
+typedef struct
+{
+	const char *name;
+	int64_t start; /* 0 if tracing was off when the span began */
+} trace_span_T;
+
+extern bool trace_enabled;
+
+int64_t trace_now(void);
+void trace_record(const char *name, int64_t start);
+
+static inline void trace_span_end(trace_span_T *span)
+{
+	if (__builtin_expect(span->start != 0, 0))
+		trace_record(span->name, span->start);
+}
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b)  TRACE_CONCAT_(a, b)
+
+#define TRACE_SCOPE(name) \
+	trace_span_T TRACE_CONCAT(trace_span_, __LINE__) __attribute__((cleanup(trace_span_end))) = \
+		{ (name), (__builtin_expect(trace_enabled, 0) ? trace_now() : 0) }
+
+/* reads SNAKE_TRACE, and starts tracing if it is set */
+void trace_init(void);
+
+void trace_start(void);
+
+/* appends everything recorded so far to trace.json */
+void trace_flush(void);
+
+/* F12: starts tracing, or if already tracing, flushes */
+void trace_hotkey(void);
+#else
+#define TRACE_SCOPE(name) ((void) 0)
+
+#define trace_init()   ((void) 0)
+#define trace_start()  ((void) 0)
+#define trace_flush()  ((void) 0)
+#define trace_hotkey() ((void) 0)
+#endif
+#endif
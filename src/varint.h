@@ -0,0 +1,46 @@
+#ifndef VARINT_H
+#define VARINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * LEB128 style variable length integers: 7 bits per byte, low bits first,
+ * the top bit set on every byte but the last.
+*/
+
+#define VARINT_MAX_LEN 10
+
+static inline size_t varint_put(uint8_t *buf, uint64_t value)
+{
+	size_t len = 0;
+	
+	while (value >= 0x80)
+	{
+		buf[len++] = (uint8_t) (value | 0x80);
+		value >>= 7;
+	}
+	
+	buf[len++] = (uint8_t) value;
+	return len;
+}
+
+/* returns the number of bytes read, or 0 if the buffer ends mid-varint */
+static inline size_t varint_get(const uint8_t *buf, size_t size, uint64_t *value)
+{
+	uint64_t result = 0;
+	
+	for (size_t i = 0; i < size && i < VARINT_MAX_LEN; i++)
+	{
+		result |= (uint64_t) (buf[i] & 0x7F) << (7 * i);
+		
+		if ((buf[i] & 0x80) == 0)
+		{
+			*value = result;
+			return i + 1;
+		}
+	}
+	
+	return 0;
+}
+#endif
@@ -0,0 +1,72 @@
+#include "wheel.h"
+
+#include <string.h>
+
+size_t wheel_memory_size(uint32_t num_timers)
+{
+	return sizeof(wheel_timer_T) * num_timers + sizeof(uint32_t) * WHEEL_SLOTS;
+}
+
+void wheel_init(wheel_T *wheel, void *memory, uint32_t num_timers)
+{
+	/* the timers first, for alignment */
+	wheel->timer = memory;
+	wheel->slot = (uint32_t *) (wheel->timer + num_timers);
+	wheel->num_timers = num_timers;
+	
+	memset(wheel->timer, 0, sizeof(wheel_timer_T) * num_timers);
+	
+	for (int i = 0; i < WHEEL_SLOTS; i++)
+		wheel->slot[i] = NO_TIMER;
+}
+
+void wheel_cancel(wheel_T *wheel, uint32_t i)
+{
+	wheel_timer_T *timer = &wheel->timer[i];
+	
+	if (timer->scheduled == false)
+		return;
+	
+	if (timer->prev == NO_TIMER)
+		wheel->slot[timer->due % WHEEL_SLOTS] = timer->next;
+	else
+		wheel->timer[timer->prev].next = timer->next;
+	
+	if (timer->next != NO_TIMER)
+		wheel->timer[timer->next].prev = timer->prev;
+	
+	timer->scheduled = false;
+}
+
+void wheel_schedule(wheel_T *wheel, uint32_t i, uint32_t due)
+{
+	wheel_cancel(wheel, i);
+	
+	wheel_timer_T *timer = &wheel->timer[i];
+	uint32_t *slot = &wheel->slot[due % WHEEL_SLOTS];
+	
+	timer->due = due;
+	timer->scheduled = true;
+	
+	timer->prev = NO_TIMER;
+	timer->next = *slot;
+	
+	if (*slot != NO_TIMER)
+		wheel->timer[*slot].prev = i;
+	
+	*slot = i;
+}
+
+uint32_t wheel_expire(wheel_T *wheel, uint32_t tick)
+{
+	for (uint32_t i = wheel->slot[tick % WHEEL_SLOTS]; i != NO_TIMER; i = wheel->timer[i].next)
+	{
+		if (wheel->timer[i].due == tick)
+		{
+			wheel_cancel(wheel, i);
+			return i;
+		}
+	}
+	
+	return NO_TIMER;
+}
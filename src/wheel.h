@@ -0,0 +1,67 @@
+#ifndef WHEEL_H
+#define WHEEL_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Timing wheel for things that happen some number of ticks from now.
+ *
+ * The timers are a fixed set, numbered from 0, each either scheduled for
+ * one tick or not at all. Every slot of the wheel holds a list of the
+ * timers due on the ticks that map to it, so scheduling and cancelling
+ * are O(1), and a tick only looks at the timers in its own slot. Timers
+ * more than WHEEL_SLOTS ticks away share a slot with nearer ones and are
+ * passed over until their tick comes round.
+ *
+ * The wheel lives in memory the caller gives it, so it can sit inside a
+ * bigger block (e.g. a board's).
+*/
+
+#define WHEEL_SLOTS 256
+
+#define NO_TIMER UINT32_MAX
+
+typedef struct
+{
+	uint32_t due;
+	bool scheduled;
+	
+	uint32_t prev;
+	uint32_t next;
+} wheel_timer_T;
+
+typedef struct
+{
+	uint32_t *slot; /* first timer in each slot */
+	wheel_timer_T *timer;
+	uint32_t num_timers;
+} wheel_T;
+
+size_t wheel_memory_size(uint32_t num_timers);
+
+/* sets up the wheel in `memory`, with every timer unscheduled */
+void wheel_init(wheel_T *, void *memory, uint32_t num_timers);
+
+/* (re)schedules the timer for tick `due` */
+void wheel_schedule(wheel_T *, uint32_t timer, uint32_t due);
+void wheel_cancel(wheel_T *, uint32_t timer);
+
+static inline bool wheel_scheduled(const wheel_T *wheel, uint32_t timer)
+{
+	return wheel->timer[timer].scheduled;
+}
+
+static inline uint32_t wheel_due(const wheel_T *wheel, uint32_t timer)
+{
+	return wheel->timer[timer].due;
+}
+
+/*
+ * Takes a timer due at `tick` off the wheel and returns it, or NO_TIMER if
+ * there are no more. Timers due on the same tick come off in no particular
+ * order.
+*/
+uint32_t wheel_expire(wheel_T *, uint32_t tick);
+#endif